@@ -15,6 +15,60 @@
 	.cdecls "beaglelogic-pru0.c"
 	.include "beaglelogic-pru-defs.inc"
 
+;* Generator mode: compute the next 32 bit word (8 samples) into 'out'.
+;* R2 PRBS history, R3 its shifts, R4 counter, R5 its increment, R6 sample
+;* offsets, R7-R9 masks, R11 0x77777777; R1 and R12 are scratch
+GEN_WORD	.macro	out
+	LSR	R1, R2, R3.b2									; s[t - a], s[t - b] for the word
+	LSR	R12, R2, R3.b3
+	XOR	R1, R1, R12										; Bits below a are final
+	LSL	R12, R1, R3.b0									; Second round fills in the rest
+	LSL	R2, R1, R3.b1
+	XOR	R2, R2, R12
+	XOR	R2, R2, R1										; Next 32 PRBS bits
+	AND	out, R2, R7
+	ADD	R4, R4, R5										; Counter value in all nibbles
+	LSR	R1, R4, 28
+	LSL	R12, R1, 4
+	OR	R1, R1, R12
+	LSL	R12, R1, 8
+	OR	R1, R1, R12
+	LSL	R12, R1, 16
+	OR	R1, R1, R12
+	AND	R12, R1, R11									; Add the sample offsets nibble-wise
+	XOR	R1, R1, R12
+	ADD	R12, R12, R6
+	XOR	R1, R1, R12
+	AND	R1, R1, R8
+	OR	out, out, R1
+	XOR	out, out, R9
+	.endm
+
+;* Generator mode with tables: OR the next word of each channel's table into
+;* 'out'. R2, R4, R6, R8 hold offset (w0) and length (w2), R3, R5, R7, R9 the
+;* table addresses; R1 is scratch
+PAT_WORD	.macro	out
+	LBBO	&out, R3, R2.w0, 4
+	ADD	R2.w0, R2.w0, 4
+	SUB	R1.w0, R2.w0, R2.w2								; Wraps above the offset unless at the end
+	MIN	R2.w0, R2.w0, R1.w0
+	LBBO	&R1, R5, R4.w0, 4
+	OR	out, out, R1
+	ADD	R4.w0, R4.w0, 4
+	SUB	R1.w0, R4.w0, R4.w2
+	MIN	R4.w0, R4.w0, R1.w0
+	LBBO	&R1, R7, R6.w0, 4
+	OR	out, out, R1
+	ADD	R6.w0, R6.w0, 4
+	SUB	R1.w0, R6.w0, R6.w2
+	MIN	R6.w0, R6.w0, R1.w0
+	LBBO	&R1, R9, R8.w0, 4
+	OR	out, out, R1
+	ADD	R8.w0, R8.w0, 4
+	SUB	R1.w0, R8.w0, R8.w2
+	MIN	R8.w0, R8.w0, R1.w0
+	.endm
+
 ;* C declaration:
 ;* void run(struct capture_context *ctx)
 	.clink
@@ -22,39 +76,432 @@
 run:
 	XOUT	11, &R0, 120									; Save all registers (R0:29) onto scratchpad's bank 1
 	LDI	R0, SYSEV_PRU1_TO_PRU0								; Necessary to reset PRU1's interrupt
-	ADD	R1, R14, 12											; Load scatter/gather list entries
+	MOV	R10, R14											; Keep the context pointer, R14 is overwritten by the data blocks
+	LDI	R6, 0												; Worst DDR block read time of this run (IEP cycles)
+	LDI	R9, 0												; Written over the start address of a played buffer
+	LDI	R11, 0												; List entry to hand back to ARM, 0 if none
+	ZERO	&R13, 24										; Clock monitor state in scratchpad bank 2, see $run$next
+	NOT	R13, R13
+	XOUT	12, &R13, 24
+	LBBO	&R1, R10, CXT_GEN_OFFSET, 4						; Generator mode if not 0, no list
+	QBNE	$gen, R1, 0
+	LBBO	&R12, R10, CXT_LOOP_OFFSET, 4
+	MIN	R12, R12, 1											; Bit 0: loop mode, buffers are kept
+	LBBO	&R7, R10, CXT_INDEX_OFFSET, 8
+	QBEQ	$run$mode, R7, 0
+	SET	R12, R12, 1											; Bit 1: indexed mode, see $run$index
+$run$mode:
+	LBBO	&R5, R10, CXT_CAP_OFFSET, 4
+	QBEQ	$run$sums, R5, 0
+	OR	R12, R12, 0x0C										; Bit 2: capture, bit 3: none to copy yet, see $run$cap
+$run$sums:
+	LBBO	&R5, R10, CXT_SUM_OFFSET, 4
+	QBEQ	$run$list, R5, 0
+	SET	R12, R12, 4											; Bit 4: block sums, see $run$sum
+$run$list:
+	LBBO	&R1, R10, CXT_PROGRESS_OFFSET, 4				; List entry to start at, set by ARM (0 = the first one)
+	QBNE	$run$first, R1, 0
+	ADD	R1, R10, CXT_LIST_OFFSET							; Load scatter/gather list entries
+$run$first:
 	LBBO	&R2, R1, 0, 8									; Load first DMA addresses, if they are 0 = exit	
 	QBEQ	$run$exit, R2, 0
+	LBBO	&R29, R1, LIST_CLK_OFFSET, 4					; Handed over with each block: sample period, and
+	SET	R29, R29, 0											; bit 0 cleared for the last block
+	QBBS	$run$index$first, R12, 1
 	LBBO	&R13, R2, 0, 64									; Load data and place onto scratchpad
-	XOUT	10, &R13, 64
 	ADD	R2, R2, 64
 	QBLT	$run$start, R3, R2								; Check if more data is available in buffer
-	ADD	R1, R1, 8											; If not, check if there is a second buffer
+	MOV	R11, R1
+	ADD	R1, R1, LIST_ENTRY_SIZE											; If not, check if there is a second buffer
 	LBBO	&R2, R1, 0, 8
-	QBEQ	$run$oneChunk, R2, 0							; If no second buffer, start sending and wait until PRU1 finishes this only chunk
+	QBNE	$run$start, R2, 0
+	CLR	R29, R29, 0											; This only chunk is also the last one
 
 $run$start:
+	XOUT	10, &R13, 68
+	SBBO	&R1, R10, CXT_PROGRESS_OFFSET, 8				; Publish list entry and DDR address (R1, R2)
+	QBBC	$run$start$1, R12, 4
+	JAL	R29.w2, $run$sum									; Before PRU1 asks for the next block
+$run$start$1:
 	LDI	R31, PRU0_PRU1_INTERRUPT + 16						; Start PRU1 and wait until it ends its operation
+	QBBC	$run$drain, R29, 0
 
 $run$0:
+	LBBO	&R29, R1, LIST_CLK_OFFSET, 4					; Period of the buffer the next block comes from
+	SET	R29, R29, 0
+	QBBS	$run$cmd, R31, 31								; Command from ARM (or PRU1 not started yet)
+	QBNE	$run$release, R11, 0							; A buffer was read completely, hand it back
+$run$wait:
+	QBBS	$run$index, R12, 1
+	QBBS	$run$late, R31, 30								; PRU1 asked before PRU0 got here
 	WBS	R31, 30												; Wait until PRU1 has completely processed the last data block
 	SBCO	&R0, C0, 0x24, 4
+	LBCO	&R4, C26, 0x0C, 4								; Time the DDR read with the IEP counter
 	LBBO	&R13, R2, 0, 64
-	XOUT	10, &R13, 64
+	LBCO	&R5, C26, 0x0C, 4
+	SUB	R5, R5, R4
+	MAX	R6, R6, R5
+$run$read:
 	ADD	R2, R2, 64
-	QBLT	$run$0, R3, R2
-	ADD	R1, R1, 8
+	QBLT	$run$1, R3, R2
+	MOV	R11, R1												; End of this buffer, move to the next one
+	ADD	R1, R1, LIST_ENTRY_SIZE
+	LBBO	&R2, R1, 0, 8
+	QBNE	$run$1, R2, 0
+	QBNE	$run$last, R3, LIST_LINK						; Null entry, or a link back to the first one
+	QBBS	$run$loop, R12, 0
+	ADD	R1, R10, CXT_LIST_OFFSET
 	LBBO	&R2, R1, 0, 8
-	QBNE	$run$0, R2, 0
-	JMP	$run$exit
+	QBEQ	$run$last, R2, 0								; Stream mode: not refilled in time
+$run$1:
+	XOUT	10, &R13, 68
+	SBBO	&R1, R10, CXT_PROGRESS_OFFSET, 8
+	QBBC	$run$next, R12, 4
+	JAL	R29.w2, $run$sum
+	JMP	$run$next
 
-$run$oneChunk:
-	LDI	R31, PRU0_PRU1_INTERRUPT + 16						
-	WBS	R31,30												
+$run$last:
+	CLR	R29, R29, 0											; PRU1 stops after this block
+	XOUT	10, &R13, 68
+	SBBO	&R1, R10, CXT_PROGRESS_OFFSET, 8
+	QBBC	$run$last$1, R12, 4
+	JAL	R29.w2, $run$sum
+$run$last$1:
+	QBBC	$run$drain, R12, 2
+	JAL	R7.w0, $run$cap$next
+
+;* Return only once PRU1 has taken the last block and played it out, with
+;* the blocks it captured meanwhile: the one before the last, unless the
+;* last is the first, and the last
+$run$drain:
+	WBS	R31, 30
+	SBCO	&R0, C0, 0x24, 4
+	WBS	R31, 30
 	SBCO	&R0, C0, 0x24, 4
+	QBBC	$run$exit, R12, 2
+	QBBS	$run$drain$1, R12, 3
+	JAL	R7.w0, $run$cap
+$run$drain$1:
+	JAL	R7.w0, $run$cap
 	
 $run$exit:
+	SBBO	&R6, R10, CXT_DDR_LAT_OFFSET, 4					; Publish the worst DDR read time
 	LDI	R31, 32 | (SYSEV_PRU0_TO_ARM_A - 16)				; Notify ARM that process is done
 	XIN	11, &R0, 120										; Restore the original register values via scratchpad's bank 1
 	LDI	R14, 0												; Return succesful operation
 	JMP	R3.w2
+
+;* The same read when PRU1's request was already pending: R4 then holds when
+;* PRU0 saw it, not when PRU1 made it, and R5 = 0 tells the clock monitor
+$run$late:
+	SBCO	&R0, C0, 0x24, 4
+	LBCO	&R4, C26, 0x0C, 4
+	LBBO	&R13, R2, 0, 64
+	LBCO	&R5, C26, 0x0C, 4
+	SUB	R5, R5, R4
+	MAX	R6, R6, R5
+	LDI	R5, 0
+	JMP	$run$read
+
+;* Indexed mode: the list holds 16 bit indices into a dictionary of 64 byte
+;* blocks at CXT_INDEX_OFFSET. PRU0 copies 32 indices at a time to the
+;* context and reads one dictionary block per request; only the last index
+;* of a batch moves on in the list. CXT_INDEX_POS_OFFSET holds the address
+;* of the next index, 0 when the batch is used up. The read is not timed
+$run$index:
+	LBBO	&R7, R10, CXT_INDEX_OFFSET, 8					; Dictionary (R7) and next index (R8)
+	LDI	R5, 0												; Late, see $run$late
+	QBBS	$run$index$0, R31, 30
+	WBS	R31, 30
+	LDI	R5, 1
+$run$index$0:
+	SBCO	&R0, C0, 0x24, 4
+	LBCO	&R4, C26, 0x0C, 4
+	QBNE	$run$index$1, R8, 0
+	LBBO	&R13, R2, 0, 64
+	SBBO	&R13, R10, CXT_INDEX_BATCH_OFFSET, 64
+	ADD	R8, R10, CXT_INDEX_BATCH_OFFSET
+$run$index$1:
+	LBBO	&R13, R8, 0, 2
+	LSL	R13, R13.w0, 6
+	ADD	R7, R7, R13
+	LBBO	&R13, R7, 0, 64
+	ADD	R8, R8, 2
+	SUB	R7, R8, R10
+	QBEQ	$run$index$2, R7, CXT_INDEX_BATCH_OFFSET + 64
+	SBBO	&R8, R10, CXT_INDEX_POS_OFFSET, 4
+	JMP	$run$1
+$run$index$2:
+	LDI	R8, 0
+	SBBO	&R8, R10, CXT_INDEX_POS_OFFSET, 4
+	JMP	$run$read											; Batch played, move on in the list
+
+;* The first block of an indexed run, before PRU1 is started
+$run$index$first:
+	LBBO	&R13, R2, 0, 64
+	SBBO	&R13, R10, CXT_INDEX_BATCH_OFFSET, 64
+	LSL	R13, R13.w0, 6
+	ADD	R7, R7, R13
+	LBBO	&R13, R7, 0, 64
+	ADD	R8, R10, CXT_INDEX_BATCH_OFFSET + 2
+	SBBO	&R8, R10, CXT_INDEX_POS_OFFSET, 4
+	JMP	$run$start
+
+;* Serve a command in between two blocks; PRU1 has a full block in hand
+$run$cmd:
+	LDI	R7, SYSEV_ARM_TO_PRU0_A
+	SBCO	&R7, C0, 0x24, 4								; Clear the doorbell
+	LBBO	&R7, R10, CXT_CMD_OFFSET, 4
+	QBEQ	$run$0, R7, 0									; Nothing pending, e.g. PRU0_PRU1 not yet taken
+	LDI32	R8, RESP_BUSY
+	QBNE	$run$cmd$reply, R7, CMD_GET_STATUS
+	LDI	R8, 1												; Running
+$run$cmd$reply:
+	SBBO	&R8, R10, CXT_RESP_OFFSET, 4
+	LDI	R7, 0
+	SBBO	&R7, R10, CXT_CMD_OFFSET, 4
+	LDI	R31, 32 | (SYSEV_PRU0_TO_ARM_B - 16)				; Reply to ARM
+	JMP	$run$0
+
+;* Hand a completely read buffer back to ARM while PRU1 plays: zero the start
+;* address of its list entry and raise PRU0_TO_ARM_C. Loop mode keeps it
+$run$release:
+	QBBS	$run$keep, R12, 0
+	SBBO	&R9, R11, 0, 4
+	LDI	R11, 0
+	LDI	R31, 32 | (SYSEV_PRU0_TO_ARM_C - 16)
+	JMP	$run$wait
+$run$keep:
+	LDI	R11, 0
+	JMP	$run$wait
+
+;* Loop mode, at the link entry with the last block of an iteration loaded:
+;* count the iteration and end the run once all are read. Otherwise hand the
+;* block to PRU1 first, then apply a pending segment swap and go on at the
+;* first entry while PRU1 plays it
+$run$loop:
+	LBBO	&R7, R10, CXT_LOOP_OFFSET, 8					; Iterations to play (R7) and read so far (R8)
+	ADD	R8, R8, 1
+	SBBO	&R8, R10, CXT_LOOP_ITER_OFFSET, 4
+	QBGE	$run$last, R7, R8								; All read, or ARM asked to stop here
+	XOUT	10, &R13, 68
+	QBBC	$run$loop$0, R12, 4
+	JAL	R29.w2, $run$sum
+	LBBO	&R8, R10, CXT_LOOP_ITER_OFFSET, 4				; Again, $run$sum used R8
+$run$loop$0:
+	LBBO	&R19, R10, CXT_SWAP_OFFSET, 4					; List entry to swap, 0 if none
+	QBEQ	$run$loop$1, R19, 0
+	SBBO	&R8, R10, CXT_SWAP_ITER_OFFSET, 4				; The next iteration is the first with the new data
+	LBBO	&R7, R10, CXT_SWAP_ADDR_OFFSET, 8
+	SBBO	&R7, R19, 0, 8
+	SBBO	&R9, R10, CXT_SWAP_OFFSET, 4
+	LDI	R31, 32 | (SYSEV_PRU0_TO_ARM_C - 16)
+$run$loop$1:
+	ADD	R1, R10, CXT_LIST_OFFSET
+	LBBO	&R2, R1, 0, 8
+	SBBO	&R1, R10, CXT_PROGRESS_OFFSET, 8
+	JMP	$run$next
+
+;* Clock monitor, once the next block is handed over: R4 holds the IEP count
+;* when PRU1 asked for it, which it does at the same sample of every block.
+;* Bank 12 keeps the shortest (R13) and longest (R14) time between two such
+;* requests, the last request (R15), the number of requests (R16) and of late
+;* ones (R17), and R5 of the last one (R18). Only requests PRU0 waited for
+;* time a block; the first one is published on its own. R13-R28 are free
+;* until the next read
+$run$next:
+	XIN	12, &R13, 24
+	SUB	R19, R4, R15
+	MOV	R15, R4
+	QBEQ	$run$next$first, R16, 0
+	QBEQ	$run$next$late, R5, 0
+	QBEQ	$run$next$1, R18, 0								; The block started with a late request
+	MIN	R13, R13, R19
+	MAX	R14, R14, R19
+$run$next$1:
+	MOV	R18, R5
+	ADD	R16, R16, 1
+	XOUT	12, &R13, 24
+	SBBO	&R13, R10, CXT_CLK_OFFSET, 20
+	QBBC	$run$0, R12, 2
+	JAL	R7.w0, $run$cap$next
+	JMP	$run$0
+$run$next$late:
+	ADD	R17, R17, 1
+	JMP	$run$next$1
+$run$next$first:
+	SBBO	&R4, R10, CXT_CLK_FIRST_OFFSET, 4
+	JMP	$run$next$1
+
+;* Capture: PRU1 stores the inputs of block N in half N % 2 of cap_ring, the
+;* last word once it has started on block N + 1. So each time a block is
+;* handed over, once PRU1 has asked for it in its block N + 1, block N - 1
+;* is complete in the other half and is copied to the DDR ring; the first
+;* hand-over has none yet (bit 3 of R12). Returns to R7.w0, uses R4, R5, R8
+;* and R13-R28
+$run$cap$next:
+	QBBC	$run$cap, R12, 3
+	CLR	R12, R12, 3
+	JMP	R7.w0
+$run$cap:
+	LBBO	&R4, R10, CXT_CAP_ADDR_OFFSET, 8				; DDR address (R4) and blocks copied (R5)
+	LDI	R8, CXT_CAP_RING_OFFSET
+	QBBC	$run$cap$0, R5, 0
+	ADD	R8, R8, 64
+$run$cap$0:
+	LBBO	&R13, R10, R8, 64
+	SBBO	&R13, R4, 0, 64
+	LBBO	&R13, R10, CXT_CAP_OFFSET, 8					; Ring start (R13) and end (R14)
+	ADD	R4, R4, 64
+	QBLT	$run$cap$1, R14, R4
+	MOV	R4, R13
+$run$cap$1:
+	ADD	R5, R5, 1
+	SBBO	&R4, R10, CXT_CAP_ADDR_OFFSET, 8
+	JMP	R7.w0
+
+;* Block sums: fold the block just handed over (R13-R28) into the sums of the
+;* run and of the list entry it came from. That is R11 if the block ended the
+;* entry, R1 otherwise; its sums sit CXT_LIST_OFFSET - CXT_SUM_LIST_OFFSET
+;* bytes before it. R7 and R8 collect the a and b of the block alone, b being
+;* 16 * a + b of the block when added to a sum. Returns to R29.w2, only bit 0
+;* of R29 is kept; uses R7, R8 and R13-R17
+$run$sum:
+	MOV	R7, R13
+	MOV	R8, R13
+	ADD	R7, R7, R14
+	ADD	R8, R8, R7
+	ADD	R7, R7, R15
+	ADD	R8, R8, R7
+	ADD	R7, R7, R16
+	ADD	R8, R8, R7
+	ADD	R7, R7, R17
+	ADD	R8, R8, R7
+	ADD	R7, R7, R18
+	ADD	R8, R8, R7
+	ADD	R7, R7, R19
+	ADD	R8, R8, R7
+	ADD	R7, R7, R20
+	ADD	R8, R8, R7
+	ADD	R7, R7, R21
+	ADD	R8, R8, R7
+	ADD	R7, R7, R22
+	ADD	R8, R8, R7
+	ADD	R7, R7, R23
+	ADD	R8, R8, R7
+	ADD	R7, R7, R24
+	ADD	R8, R8, R7
+	ADD	R7, R7, R25
+	ADD	R8, R8, R7
+	ADD	R7, R7, R26
+	ADD	R8, R8, R7
+	ADD	R7, R7, R27
+	ADD	R8, R8, R7
+	ADD	R7, R7, R28
+	ADD	R8, R8, R7
+	LBBO	&R13, R10, CXT_SUM_A_OFFSET, 8					; Run: a (R13) and b (R14)
+	LSL	R15, R13, 4
+	ADD	R14, R14, R15
+	ADD	R14, R14, R8
+	ADD	R13, R13, R7
+	SBBO	&R13, R10, CXT_SUM_A_OFFSET, 8
+	MOV	R16, R1
+	QBEQ	$run$sum$0, R11, 0
+	MOV	R16, R11
+$run$sum$0:
+	LDI	R17, CXT_LIST_OFFSET - CXT_SUM_LIST_OFFSET
+	SUB	R16, R16, R17
+	LBBO	&R13, R16, 0, 12								; Entry: a, b and blocks (R15)
+	LSL	R17, R13, 4
+	ADD	R14, R14, R17
+	ADD	R14, R14, R8
+	ADD	R13, R13, R7
+	ADD	R15, R15, 1
+	SBBO	&R13, R16, 0, 12
+	JMP	R29.w2
+
+;* Generator mode: compute each block while PRU1 plays the previous one. R0
+;* counts the blocks, R1 and R12 serve the commands, R11 is 0 with tables
+$gen:
+	LBBO	&R1, R10, CXT_GEN_TABLES_OFFSET, 36				; R1 gen_tables, R2-R9 the state words
+	LBBO	&R29, R10, CXT_CLK_INT_OFFSET, 4				; All blocks at the same period
+	SET	R29, R29, 0
+	LDI	R0, 0
+	LDI	R11, 0
+	QBNE	$pat$0, R1, 0
+	LDI32	R11, 0x77777777
+$gen$0:
+	GEN_WORD	R13
+	GEN_WORD	R14
+	GEN_WORD	R15
+	GEN_WORD	R16
+	GEN_WORD	R17
+	GEN_WORD	R18
+	GEN_WORD	R19
+	GEN_WORD	R20
+	GEN_WORD	R21
+	GEN_WORD	R22
+	GEN_WORD	R23
+	GEN_WORD	R24
+	GEN_WORD	R25
+	GEN_WORD	R26
+	GEN_WORD	R27
+	GEN_WORD	R28
+$gen$next:
+	ADD	R0, R0, 1
+	SBBO	&R0, R10, CXT_GEN_BLOCK_OFFSET, 4
+	LBBO	&R1, R10, CXT_GEN_OFFSET, 4						; ARM lowers it to stop
+	QBGE	$gen$last, R1, R0
+	XOUT	10, &R13, 68
+	QBNE	$gen$1, R0, 1
+	LDI	R31, PRU0_PRU1_INTERRUPT + 16						; Start PRU1 with the first block
+$gen$1:
+	QBBS	$gen$cmd, R31, 31
+	WBS	R31, 30
+	LDI	R1, SYSEV_PRU1_TO_PRU0
+	SBCO	&R1, C0, 0x24, 4
+	QBNE	$gen$0, R11, 0
+$pat$0:
+	PAT_WORD	R13
+	PAT_WORD	R14
+	PAT_WORD	R15
+	PAT_WORD	R16
+	PAT_WORD	R17
+	PAT_WORD	R18
+	PAT_WORD	R19
+	PAT_WORD	R20
+	PAT_WORD	R21
+	PAT_WORD	R22
+	PAT_WORD	R23
+	PAT_WORD	R24
+	PAT_WORD	R25
+	PAT_WORD	R26
+	PAT_WORD	R27
+	PAT_WORD	R28
+	JMP	$gen$next
+
+$gen$last:
+	CLR	R29, R29, 0
+	XOUT	10, &R13, 68
+	QBNE	$gen$last$1, R0, 1
+	LDI	R31, PRU0_PRU1_INTERRUPT + 16
+$gen$last$1:
+	LDI	R0, SYSEV_PRU1_TO_PRU0
+	LDI	R6, 0												; No DDR reads
+	LDI	R12, 0												; Nor a capture
+	JMP	$run$drain
+
+$gen$cmd:
+	LDI	R1, SYSEV_ARM_TO_PRU0_A
+	SBCO	&R1, C0, 0x24, 4
+	LBBO	&R1, R10, CXT_CMD_OFFSET, 4
+	QBEQ	$gen$1, R1, 0
+	LDI32	R12, RESP_BUSY
+	QBNE	$gen$cmd$reply, R1, CMD_GET_STATUS
+	LDI	R12, 1
+$gen$cmd$reply:
+	SBBO	&R12, R10, CXT_RESP_OFFSET, 4
+	LDI	R1, 0
+	SBBO	&R1, R10, CXT_CMD_OFFSET, 4
+	LDI	R31, 32 | (SYSEV_PRU0_TO_ARM_B - 16)
+	JMP	$gen$1
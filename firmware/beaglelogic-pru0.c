@@ -23,6 +23,7 @@
 #include <stdio.h>
 #include <pru_cfg.h>
 #include <pru_intc.h>
+#include <pru_iep.h>
 #include <rsc_types.h>
 
 #include "pru_defs.h"
@@ -30,27 +31,200 @@
 
 /*
  * Define firmware version
- * This is version 0.1
+ * This is version 0.16. The driver only runs the version it was built for
+ * (BL_FW_VERSION in kernel/beaglelogic.c), so bump both whenever the
+ * layout of struct capture_context or of its list entries, or the command
+ * protocol changes
  */
 #define MAJORVER	0
-#define MINORVER	1
+#define MINORVER	16
 
-/* Maximum number of SG entries; each entry is 8 bytes */
+/* Maximum number of SG entries; each entry is 12 bytes */
 #define MAX_BUFLIST_ENTRIES	128
+#define LIST_ENTRY_SIZE		12
+#define LIST_CLK_OFFSET		8
 
 /* Commands */
 #define CMD_GET_VERSION	1   /* Firmware version */
 #define CMD_GET_MAX_SG	2   /* Get the max number of bufferlist entries */
 #define CMD_SET_CONFIG 	3   /* Get the context pointer */
 #define CMD_START	4   /* Arm the LA (start sampling) */
+#define CMD_GET_STATUS	5   /* 1 while a waveform plays, 0 when idle */
+
+/* Command reply while run() is busy with anything but a status query */
+#define RESP_BUSY	0xFFFFFFFF
 
 /* Define magic bytes for the structure. This "looks like" BEAGLELO */
 #define FW_MAGIC	0xBEA61E10
 
-/* Structure describing the start and end buffer addresses */
+/* Offsets into the capture context used by the assembler code */
+#define CXT_CMD_OFFSET		4
+#define CXT_RESP_OFFSET		8
+#define CXT_DDR_LAT_OFFSET	12
+#define CXT_PROGRESS_OFFSET	16
+#define CXT_LOOP_OFFSET		24
+#define CXT_LOOP_ITER_OFFSET	28
+#define CXT_SWAP_OFFSET		32
+#define CXT_SWAP_ADDR_OFFSET	36
+#define CXT_SWAP_ITER_OFFSET	44
+#define CXT_GEN_OFFSET		48
+#define CXT_GEN_BLOCK_OFFSET	52
+#define CXT_GEN_TABLES_OFFSET	56
+#define CXT_GEN_STATE_OFFSET	60
+#define CXT_EDGE_OFFSET		92
+#define CXT_EDGE_LATE_OFFSET	96
+#define CXT_CLK_OFFSET		100
+#define CXT_CLK_FIRST_OFFSET	120
+#define CXT_INDEX_OFFSET	124
+#define CXT_INDEX_POS_OFFSET	128
+#define CXT_INDEX_BATCH_OFFSET	132
+#define CXT_START_OFFSET	196
+#define CXT_START_IEP_OFFSET	204
+#define CXT_CLK_INT_OFFSET	212
+#define CXT_CAP_OFFSET		216
+#define CXT_CAP_ADDR_OFFSET	224
+#define CXT_CAP_RING_OFFSET	256
+#define CXT_SUM_OFFSET		384
+#define CXT_SUM_A_OFFSET	388
+#define CXT_SUM_LIST_OFFSET	400
+#define CXT_LIST_OFFSET		1936
+
+/* PRU0's data RAM as seen from PRU1 */
+#define OTHERPRU_MEM	0x2000
+
+/*
+ * End address of a link entry (start address 0): the list continues at its
+ * first entry. Any other entry with start address 0 ends the run. run()
+ * zeroes the start address of every buffer it has completely read and
+ * raises PRU0_TO_ARM_C, so in stream mode the driver can refill the buffer
+ * and queue it again before PRU0 comes around.
+ */
+#define LIST_LINK	1
+
+/*
+ * run() starts at the list entry whose address ARM leaves in the progress
+ * word (CXT_PROGRESS_OFFSET), or at the first entry if that is 0. A stream
+ * that ran dry resumes where the driver queued the next buffer.
+ */
+
+/*
+ * Loop mode (loop_count != 0): the list ends with a link entry and run()
+ * keeps the buffers instead of handing them back. Each time it reaches the
+ * link entry it counts an iteration, and it stops once loop_count have been
+ * read; ARM lowers loop_count to stop at the next boundary. A segment swap
+ * posted by ARM (swap_entry, the address of a list entry, and the new start
+ * and end addresses) is applied at that point too, so the next iteration is
+ * the first to play the new data: run() records that iteration, clears
+ * swap_entry and raises PRU0_TO_ARM_C.
+ */
+
+/*
+ * Generator mode (gen_blocks != 0): run() computes the 64 byte blocks in
+ * registers instead of reading the list, gen_blocks of them (0xFFFFFFFF
+ * until ARM lowers it to stop). Every 32 bit word (8 samples) is
+ *
+ *   ((prbs & gen_prbs_mask) | (counter & gen_count_mask)) ^ gen_invert
+ *
+ * The PRBS words continue the sequence s[t] = s[t - a] ^ s[t - b] from the
+ * previous word (gen_prbs, bit 31 the latest), two shift/XOR rounds per
+ * word, so the driver hands over the recurrence with its lags doubled until
+ * a >= 16. gen_taps holds a, b, 32 - a and 32 - b, one per byte. The counter
+ * value is the top nibble of gen_count, which advances by gen_inc per word;
+ * gen_pattern adds the offsets of the 8 samples within a word (a divider
+ * below 8 samples). The masks select channels with 0x11111111 << channel.
+ *
+ * With gen_tables set, each channel instead loops over its own table of
+ * words in shared RAM, with its samples already in place (bit 4i + channel
+ * for sample i) and ORed together. The state words are then a pair per
+ * channel: the byte offset of the next word (bits 15:0) and the table
+ * length in bytes (bits 31:16), then the table address. A table holds
+ * L / gcd(L, 8) words for a loop of L samples, so channels with different
+ * loop lengths never need to be expanded to a common period.
+ */
+
+/*
+ * Edge list mode (edge != 0): the list is played as it is, but PRU1 reads
+ * each 64 byte block as 8 records of a time in PRU cycles and an output
+ * value, and changes the outputs at those times instead of on the sample
+ * clock. configure_capture() hands PRU1 the address of edge_late in its R12
+ * (0 for samples); PRU1 stores the number of records it played late there
+ * before it signals the end of the run.
+ */
+
+/*
+ * Indexed mode (index_dict != 0): the list holds one 16 bit index per 64
+ * byte block into a dictionary of unique blocks, so a waveform that repeats
+ * blocks is stored once. run() copies the indices to index_batch 32 at a
+ * time and reads the dictionary block of each; a block that starts a batch
+ * costs two DDR reads. Loop and stream mode work on the list as usual.
+ */
+
+/*
+ * Clock monitor: PRU1 asks for the next block at the same sample of every
+ * block, so the time between two requests is the time the external clock
+ * takes for one block. run() keeps the shortest and longest of these in IEP
+ * cycles (clk_min, clk_max) and counts the requests (clk_blocks), with the
+ * IEP count of the first (clk_first) and the last one (clk_last) for the
+ * mean. A request PRU0 only finds once it is done with the previous block
+ * is counted in clk_late and times neither of its blocks; a clock faster
+ * than PRU0 can serve makes most of them late.
+ */
+
+/*
+ * Scheduled start (start_delay != 0): PRU1 holds the first sample until the
+ * IEP counter has run start_delay cycles past its count at CMD_START
+ * (start_ref). main() hands PRU1 that count in R9 and the address of
+ * start_iep in R10 (0 starts right away); PRU1 stores the IEP count it
+ * started at there and sets start_done. The first sample goes out at the
+ * next clock edge, an edge list counts its times from that point.
+ */
+
+/*
+ * Internal clock (clk_int != 0): PRU1 times the samples itself instead of
+ * waiting for the external clock. Each list entry carries the sample period
+ * of its buffer in its clk word, (P - 7) << 8 for P PRU cycles per sample
+ * (P >= 9); run() hands it to PRU1 in R29 with each block, bit 0 set while
+ * more blocks follow. PRU1 takes the R29 of the next block only once the
+ * last sample of the current one has been held for its period, so a new
+ * period starts exactly at the buffer boundary. Generator mode plays all
+ * blocks at clk_int. configure_capture() hands PRU1 1 in R12.
+ */
+
+/*
+ * Capture (cap_start != 0): with every sample it puts on the outputs, PRU1
+ * also reads the inputs one cycle later, R31 bits 7:4 (the pins next to the
+ * outputs) as far as cap_mask selects them, and packs them like the samples
+ * it plays, 2 per byte with the first in the low nibble. It stores each 64
+ * byte block of them in one half of cap_ring, alternating, and run() copies
+ * the block before the one PRU1 works on to the DDR ring from cap_start to
+ * cap_end once it has handed over the next block to play, the last two once
+ * PRU1 is done. cap_addr is where the next block goes and cap_blocks counts
+ * them. configure_capture() hands PRU1 2 in R12, the address of cap_ring in
+ * R4 and cap_mask in every nibble of R11. External clock and list modes only.
+ */
+
+/*
+ * Block sums (sum_enable != 0): once it has handed a block over, run() folds
+ * its 16 words w into a Fletcher style sum, a += w then b += a for each word
+ * (modulo 2^32), both for the run (sum_a, sum_b) and for the list entry the
+ * block came from (sum_list, one per entry). A table CRC32 would take PRU0
+ * several hundred cycles per block, this takes 61 (60 in $run$sum and the
+ * JAL, as counted by prusim; BL_PRU0_SUM_CYCLES). List modes only.
+ */
+
+/* Block sums of one list entry */
+typedef struct bufsum {
+	uint32_t a;
+	uint32_t b;
+	uint32_t blocks;        // Blocks folded in
+} bufsum;
+
+/* Structure describing the start and end buffer addresses, and the sample
+ * period of the buffer on the internal clock */
 typedef struct buflist {
 	uint32_t dma_start_addr;
 	uint32_t dma_end_addr;
+	uint32_t clk;
 } bufferlist;
 
 /* Structure describing the core context.
@@ -61,6 +235,76 @@ struct capture_context {
 	uint32_t cmd;           // Command from Linux host to us
 	uint32_t resp;          // Response code
 
+	uint32_t ddr_lat_max;   // Worst 64 byte DDR read time of the last run (cycles)
+
+	/* Playback progress, written by run() after every block */
+	uint32_t prog_entry;    // Address of the list entry being played
+	uint32_t prog_addr;     // DDR address of the next block to load
+
+	/* Loop mode */
+	uint32_t loop_count;    // Iterations to play, 0 if not looping
+	uint32_t loop_iter;     // Iterations read so far
+	uint32_t swap_entry;    // List entry to replace at the next boundary
+	uint32_t swap_start;    // Its new start address
+	uint32_t swap_end;      // and end address
+	uint32_t swap_iter;     // First iteration that played the new data
+
+	/* Generator mode, the order of the words from gen_tables on is fixed by
+	 * run(). With gen_tables set, the 8 state words hold the table pairs */
+	uint32_t gen_blocks;    // Blocks to generate, 0 plays the list
+	uint32_t gen_block;     // Blocks generated so far
+	uint32_t gen_tables;    // Channels play tables in shared RAM
+	uint32_t gen_prbs;      // The last 32 PRBS bits
+	uint32_t gen_taps;      // Lags and shift counts of the PRBS recurrence
+	uint32_t gen_count;     // Counter, the value in bits 31:28
+	uint32_t gen_inc;       // Counter increment per word
+	uint32_t gen_pattern;   // Counter offsets of the samples in a word
+	uint32_t gen_prbs_mask; // Channels playing the PRBS
+	uint32_t gen_count_mask; // Channels playing a counter bit
+	uint32_t gen_invert;    // Channels inverted (or high if not selected)
+
+	/* Edge list mode */
+	uint32_t edge;          // Blocks hold edge records instead of samples
+	uint32_t edge_late;     // Records PRU1 played late in the last run
+
+	/* Clock monitor, the order of the first five words is fixed by run() */
+	uint32_t clk_min;       // Shortest block, 0xFFFFFFFF before the second
+	uint32_t clk_max;       // Longest block
+	uint32_t clk_last;      // IEP count at the last request of PRU1
+	uint32_t clk_blocks;    // Requests seen
+	uint32_t clk_late;      // Requests that were pending already
+	uint32_t clk_first;     // IEP count at the first request
+
+	/* Indexed mode */
+	uint32_t index_dict;    // DDR address of the dictionary, 0 plays samples
+	uint32_t index_pos;     // Address of the next index in index_batch
+	uint16_t index_batch[32];
+
+	/* Scheduled start */
+	uint32_t start_delay;   // IEP cycles from CMD_START to the start, 0 now
+	uint32_t start_ref;     // IEP count at CMD_START
+	uint32_t start_iep;     // IEP count PRU1 started at
+	uint32_t start_done;    // Set by PRU1 along with start_iep
+
+	/* Internal clock */
+	uint32_t clk_int;       // R29 of generated blocks, 0 for the external clock
+
+	/* Capture, the order of the first four words is fixed by run() */
+	uint32_t cap_start;     // DDR ring, 0 when not capturing
+	uint32_t cap_end;
+	uint32_t cap_addr;      // Where the next block goes
+	uint32_t cap_blocks;    // Blocks copied in this run
+	uint32_t cap_mask;      // Inputs captured, bit N for R31 bit N + 4
+	uint32_t cap_pad[5];    // cap_ring is 128 byte aligned
+	uint32_t cap_ring[32];  // Written by PRU1, one block per half
+
+	/* Block sums, sum_list must come right before list */
+	uint32_t sum_enable;    // Fold every block handed to PRU1 into the sums
+	uint32_t sum_a;         // Of the run
+	uint32_t sum_b;
+	uint32_t sum_pad;
+	bufsum sum_list[MAX_BUFLIST_ENTRIES];
+
 	bufferlist list[MAX_BUFLIST_ENTRIES];
 } cxt __attribute__((location(0))) = {0};
 
@@ -92,6 +336,13 @@ int configure_capture() {
 	/* Verify magic bytes */
 	if (pru_other_read_reg(0) != FW_MAGIC)
 		return -1;
+
+	/* Sample, edge list, internal clock or capture mode, see above */
+	cxt.edge_late = 0;
+	pru_other_write_reg(12, cxt.edge ? OTHERPRU_MEM + CXT_EDGE_LATE_OFFSET :
+			cxt.clk_int ? 1 : cxt.cap_start ? 2 : 0);
+	pru_other_write_reg(4, OTHERPRU_MEM + CXT_CAP_RING_OFFSET);
+	pru_other_write_reg(11, (cxt.cap_mask & 0xF) * 0x11111111);
 	
 	/* Resume over the HALT instruction, give it some time to configure */
 	resume_other_pru();
@@ -115,8 +366,13 @@ static int handle_command(uint32_t cmd) {
 			return configure_capture();
 
 		case CMD_START:
+			cxt.start_ref = CT_IEP.TMR_CNT;
+			cxt.start_done = 0;
 			state_run = 1;
 			return 0;
+
+		case CMD_GET_STATUS:
+			return 0;
 	}
 	return -1;
 }
@@ -128,20 +384,35 @@ int main(void) {
 	CT_CFG.SYSCFG_bit.STANDBY_INIT = 0;
 	cxt.magic = FW_MAGIC;
 
+	/* Free running IEP counter (1 count per PRU cycle) times DDR reads */
+	CT_IEP.TMR_GLB_CFG = 0x11;
+
 	/* Clear all interrupts */
 	CT_INTC.SECR0 = 0xFFFFFFFF;
 
 	while (1) {
-		/* Process received command */
-		if (cxt.cmd != 0)
-		{
-			cxt.resp = handle_command(cxt.cmd);
-			cxt.cmd = 0;
+		/* Commands are announced by ARM_TO_PRU0_A on host 1 */
+		if ((__R31 & (1U << 31)) &&
+				(CT_INTC.SRSR0 & (1 << SYSEV_ARM_TO_PRU0_A))) {
+			CT_INTC.SICR = SYSEV_ARM_TO_PRU0_A;
+
+			if (cxt.cmd != 0) {
+				cxt.resp = handle_command(cxt.cmd);
+				cxt.cmd = 0;
+				SIGNAL_EVENT(SYSEV_PRU0_TO_ARM_B);
+			}
 		}
 
 		/* Run triggered */
 		if (state_run == 1) {
-			CT_INTC.SECR0 = 0xFFFFFFFF;
+			/* Keep a pending command, run() answers it */
+			CT_INTC.SECR0 = (1 << SYSEV_PRU1_TO_PRU0) |
+				(1 << SYSEV_PRU0_TO_PRU1);
+
+			/* Scheduled start, see above */
+			pru_other_write_reg(9, cxt.start_ref + cxt.start_delay);
+			pru_other_write_reg(10, cxt.start_delay ?
+					OTHERPRU_MEM + CXT_START_IEP_OFFSET : 0);
 
 			resume_other_pru();
 			run(&cxt);
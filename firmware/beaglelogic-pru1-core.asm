@@ -24,10 +24,44 @@ WAIT_EXT_CLOCK .macro Rx, op
 	op
 	.endm
 
+; Capture: put Rx on the pins, read the inputs with cap one cycle later,
+; then run op and op2
+CAP_CLOCK .macro Rx, cap, op, op2
+	WBC	R31, 16
+	WBS	R31, 16
+	MOV	R30.b0, Rx
+	cap
+	op
+	op2
+	.endm
+
 NOP	.macro
 	 ADD R0.b0, R0.b0, R0.b0
 	.endm
 
+; Internal clock: put Rx on the pins, run op, then wait out the rest of the
+; sample period in $int$wait
+INT_CLOCK .macro Rx, op
+	MOV	R30.b0, Rx
+	op
+	JAL	R3.w0, $int$wait
+	.endm
+
+; Edge list mode: play the record (time Rt, value Rv) 'cycles' cycles after
+; the previous one would have been played on time
+EDGE	.macro	Rt, Rv, cycles
+	MOV	R6, Rt
+	MOV	R7, Rv
+	LDI	R8, cycles
+	JAL	R3.w0, $edge$play
+	.endm
+
+; Cycles from one record to the next one played without waiting: 4 for the
+; EDGE call, 10 in $edge$play, and the return. The first record of a block
+; also waits for the jump back, R29 and the XIN
+	.asg	14, EDGE_CYCLES
+	.asg	18, EDGE_BLOCK_CYCLES
+
 	.sect ".text:main"
 	.global asm_main
 asm_main:
@@ -40,9 +74,22 @@ asm_main:
 	HALT
 
 	; Actual waveform generation
+$wait_start$:
 	WBS		R31, 31													; Wait for start signal
+	LBCO	&R2, C0, 0x200, 4										; Host 1 is shared with ARM commands to PRU0,
+	QBBC	$wait_start$, R2, PRU0_PRU1_INTERRUPT					; only start on PRU0's event
 	SBCO	&R1, C0, 0x24, 4										; Clear PRU0 interrupt
-	XIN		10, &R13, 64											; Copy data from scratchpad
+	XIN		10, &R13, 68											; Copy data and R29 (bit 0 clear = last block) from scratchpad
+	QBEQ	$started$, R10, 0										; Scheduled start: R10 = &start_iep in PRU0's RAM
+$wait_time$:
+	LBCO	&R5, C26, 0x0C, 4										; Wait for the IEP count in R9
+	SUB		R5, R5, R9
+	QBBS	$wait_time$, R5, 31
+	ADD		R5, R5, R9
+	LDI		R6, 1
+	SBBO	&R5, R10, 0, 8											; start_iep, start_done
+$started$:
+	QBNE	$mode$, R12, 0											; Edge list, internal clock or capture, set by PRU0 with the configuration
 	WAIT_EXT_CLOCK	R13.b0, "LSR	R13.b0, R13.b0, 4"
 	WAIT_EXT_CLOCK	R13.b0, "LDI	R31, PRU1_PRU0_INTERRUPT + 16"
 	WAIT_EXT_CLOCK	R13.b1, "LSR	R13.b1, R13.b1, 4"
@@ -169,13 +216,412 @@ $samplem8$:
 	WAIT_EXT_CLOCK	R28.b1, "LSR	R28.b1, R28.b1, 4"
 	WAIT_EXT_CLOCK	R28.b1, "NOP"
 	WAIT_EXT_CLOCK	R28.b2, "LSR	R28.b2, R28.b2, 4"
-	WAIT_EXT_CLOCK	R28.b2, "NOP"
+	WAIT_EXT_CLOCK	R28.b2, "QBBC	$lastblock$, R29, 0"
 	WAIT_EXT_CLOCK	R28.b3, "LSR	R28.b3, R28.b3, 4"
-	WAIT_EXT_CLOCK	R28.b3, "XIN	10, &R13, 64"
+	WAIT_EXT_CLOCK	R28.b3, "XIN	10, &R13, 68"
 	WAIT_EXT_CLOCK	R13.b0, "LSR	R13.b0, R13.b0, 4"
 	WAIT_EXT_CLOCK	R13.b0, "LDI	R31, PRU1_PRU0_INTERRUPT + 16"
 	WAIT_EXT_CLOCK	R13.b1, "LSR	R13.b1, R13.b1, 4"
 	WAIT_EXT_CLOCK	R13.b1, "JMP	$samplem8$"
 
+	; Last block: play its final samples, then tell PRU0 we are done
+$lastblock$:
+	WAIT_EXT_CLOCK	R28.b3, "LSR	R28.b3, R28.b3, 4"
+	WAIT_EXT_CLOCK	R28.b3, "LDI	R31, PRU1_PRU0_INTERRUPT + 16"
+	HALT
+
+	; Capture: the external clock path, but each sample also reads the inputs
+	; in R31 bits 7:4 into R6 (even words of the block) or R7 (odd words), 2
+	; samples per byte. A word is masked with R11 in the next word's first
+	; sample and stored in its third one, to the half of PRU0's cap_ring in
+	; R4; R4 flips to the other half at sample 6 of every block (and once at
+	; the very first sample, so block 0 goes to the first half). The last
+	; word of a block so goes out at sample 3 of the next one. PRU1 takes 6
+	; cycles per sample instead of 4
+$cap$:
+	CAP_CLOCK	R13.b0, "LSR	R6.b0, R31.b0, 4", "LSR	R13.b0, R13.b0, 4", "XOR	R4, R4, 64"
+	CAP_CLOCK	R13.b0, "AND	R8.b0, R31.b0, 0xF0", "OR	R6.b0, R6.b0, R8.b0", "LDI	R31, PRU1_PRU0_INTERRUPT + 16"
+	CAP_CLOCK	R13.b1, "LSR	R6.b1, R31.b0, 4", "LSR	R13.b1, R13.b1, 4"
+	CAP_CLOCK	R13.b1, "AND	R8.b0, R31.b0, 0xF0", "OR	R6.b1, R6.b1, R8.b0"
+$cap$m8$:
+	CAP_CLOCK	R13.b2, "LSR	R6.b2, R31.b0, 4", "LSR	R13.b2, R13.b2, 4"
+	CAP_CLOCK	R13.b2, "AND	R8.b0, R31.b0, 0xF0", "OR	R6.b2, R6.b2, R8.b0", "XOR	R4, R4, 64"
+	CAP_CLOCK	R13.b3, "LSR	R6.b3, R31.b0, 4", "LSR	R13.b3, R13.b3, 4"
+	CAP_CLOCK	R13.b3, "AND	R8.b0, R31.b0, 0xF0", "OR	R6.b3, R6.b3, R8.b0"
+	CAP_CLOCK	R14.b0, "LSR	R7.b0, R31.b0, 4", "LSR	R14.b0, R14.b0, 4", "AND	R6, R6, R11"
+	CAP_CLOCK	R14.b0, "AND	R8.b0, R31.b0, 0xF0", "OR	R7.b0, R7.b0, R8.b0"
+	CAP_CLOCK	R14.b1, "LSR	R7.b1, R31.b0, 4", "LSR	R14.b1, R14.b1, 4", "SBBO	&R6, R4, 0, 4"
+	CAP_CLOCK	R14.b1, "AND	R8.b0, R31.b0, 0xF0", "OR	R7.b1, R7.b1, R8.b0"
+	CAP_CLOCK	R14.b2, "LSR	R7.b2, R31.b0, 4", "LSR	R14.b2, R14.b2, 4"
+	CAP_CLOCK	R14.b2, "AND	R8.b0, R31.b0, 0xF0", "OR	R7.b2, R7.b2, R8.b0"
+	CAP_CLOCK	R14.b3, "LSR	R7.b3, R31.b0, 4", "LSR	R14.b3, R14.b3, 4"
+	CAP_CLOCK	R14.b3, "AND	R8.b0, R31.b0, 0xF0", "OR	R7.b3, R7.b3, R8.b0"
+	CAP_CLOCK	R15.b0, "LSR	R6.b0, R31.b0, 4", "LSR	R15.b0, R15.b0, 4", "AND	R7, R7, R11"
+	CAP_CLOCK	R15.b0, "AND	R8.b0, R31.b0, 0xF0", "OR	R6.b0, R6.b0, R8.b0"
+	CAP_CLOCK	R15.b1, "LSR	R6.b1, R31.b0, 4", "LSR	R15.b1, R15.b1, 4", "SBBO	&R7, R4, 4, 4"
+	CAP_CLOCK	R15.b1, "AND	R8.b0, R31.b0, 0xF0", "OR	R6.b1, R6.b1, R8.b0"
+	CAP_CLOCK	R15.b2, "LSR	R6.b2, R31.b0, 4", "LSR	R15.b2, R15.b2, 4"
+	CAP_CLOCK	R15.b2, "AND	R8.b0, R31.b0, 0xF0", "OR	R6.b2, R6.b2, R8.b0"
+	CAP_CLOCK	R15.b3, "LSR	R6.b3, R31.b0, 4", "LSR	R15.b3, R15.b3, 4"
+	CAP_CLOCK	R15.b3, "AND	R8.b0, R31.b0, 0xF0", "OR	R6.b3, R6.b3, R8.b0"
+	CAP_CLOCK	R16.b0, "LSR	R7.b0, R31.b0, 4", "LSR	R16.b0, R16.b0, 4", "AND	R6, R6, R11"
+	CAP_CLOCK	R16.b0, "AND	R8.b0, R31.b0, 0xF0", "OR	R7.b0, R7.b0, R8.b0"
+	CAP_CLOCK	R16.b1, "LSR	R7.b1, R31.b0, 4", "LSR	R16.b1, R16.b1, 4", "SBBO	&R6, R4, 8, 4"
+	CAP_CLOCK	R16.b1, "AND	R8.b0, R31.b0, 0xF0", "OR	R7.b1, R7.b1, R8.b0"
+	CAP_CLOCK	R16.b2, "LSR	R7.b2, R31.b0, 4", "LSR	R16.b2, R16.b2, 4"
+	CAP_CLOCK	R16.b2, "AND	R8.b0, R31.b0, 0xF0", "OR	R7.b2, R7.b2, R8.b0"
+	CAP_CLOCK	R16.b3, "LSR	R7.b3, R31.b0, 4", "LSR	R16.b3, R16.b3, 4"
+	CAP_CLOCK	R16.b3, "AND	R8.b0, R31.b0, 0xF0", "OR	R7.b3, R7.b3, R8.b0"
+	CAP_CLOCK	R17.b0, "LSR	R6.b0, R31.b0, 4", "LSR	R17.b0, R17.b0, 4", "AND	R7, R7, R11"
+	CAP_CLOCK	R17.b0, "AND	R8.b0, R31.b0, 0xF0", "OR	R6.b0, R6.b0, R8.b0"
+	CAP_CLOCK	R17.b1, "LSR	R6.b1, R31.b0, 4", "LSR	R17.b1, R17.b1, 4", "SBBO	&R7, R4, 12, 4"
+	CAP_CLOCK	R17.b1, "AND	R8.b0, R31.b0, 0xF0", "OR	R6.b1, R6.b1, R8.b0"
+	CAP_CLOCK	R17.b2, "LSR	R6.b2, R31.b0, 4", "LSR	R17.b2, R17.b2, 4"
+	CAP_CLOCK	R17.b2, "AND	R8.b0, R31.b0, 0xF0", "OR	R6.b2, R6.b2, R8.b0"
+	CAP_CLOCK	R17.b3, "LSR	R6.b3, R31.b0, 4", "LSR	R17.b3, R17.b3, 4"
+	CAP_CLOCK	R17.b3, "AND	R8.b0, R31.b0, 0xF0", "OR	R6.b3, R6.b3, R8.b0"
+	CAP_CLOCK	R18.b0, "LSR	R7.b0, R31.b0, 4", "LSR	R18.b0, R18.b0, 4", "AND	R6, R6, R11"
+	CAP_CLOCK	R18.b0, "AND	R8.b0, R31.b0, 0xF0", "OR	R7.b0, R7.b0, R8.b0"
+	CAP_CLOCK	R18.b1, "LSR	R7.b1, R31.b0, 4", "LSR	R18.b1, R18.b1, 4", "SBBO	&R6, R4, 16, 4"
+	CAP_CLOCK	R18.b1, "AND	R8.b0, R31.b0, 0xF0", "OR	R7.b1, R7.b1, R8.b0"
+	CAP_CLOCK	R18.b2, "LSR	R7.b2, R31.b0, 4", "LSR	R18.b2, R18.b2, 4"
+	CAP_CLOCK	R18.b2, "AND	R8.b0, R31.b0, 0xF0", "OR	R7.b2, R7.b2, R8.b0"
+	CAP_CLOCK	R18.b3, "LSR	R7.b3, R31.b0, 4", "LSR	R18.b3, R18.b3, 4"
+	CAP_CLOCK	R18.b3, "AND	R8.b0, R31.b0, 0xF0", "OR	R7.b3, R7.b3, R8.b0"
+	CAP_CLOCK	R19.b0, "LSR	R6.b0, R31.b0, 4", "LSR	R19.b0, R19.b0, 4", "AND	R7, R7, R11"
+	CAP_CLOCK	R19.b0, "AND	R8.b0, R31.b0, 0xF0", "OR	R6.b0, R6.b0, R8.b0"
+	CAP_CLOCK	R19.b1, "LSR	R6.b1, R31.b0, 4", "LSR	R19.b1, R19.b1, 4", "SBBO	&R7, R4, 20, 4"
+	CAP_CLOCK	R19.b1, "AND	R8.b0, R31.b0, 0xF0", "OR	R6.b1, R6.b1, R8.b0"
+	CAP_CLOCK	R19.b2, "LSR	R6.b2, R31.b0, 4", "LSR	R19.b2, R19.b2, 4"
+	CAP_CLOCK	R19.b2, "AND	R8.b0, R31.b0, 0xF0", "OR	R6.b2, R6.b2, R8.b0"
+	CAP_CLOCK	R19.b3, "LSR	R6.b3, R31.b0, 4", "LSR	R19.b3, R19.b3, 4"
+	CAP_CLOCK	R19.b3, "AND	R8.b0, R31.b0, 0xF0", "OR	R6.b3, R6.b3, R8.b0"
+	CAP_CLOCK	R20.b0, "LSR	R7.b0, R31.b0, 4", "LSR	R20.b0, R20.b0, 4", "AND	R6, R6, R11"
+	CAP_CLOCK	R20.b0, "AND	R8.b0, R31.b0, 0xF0", "OR	R7.b0, R7.b0, R8.b0"
+	CAP_CLOCK	R20.b1, "LSR	R7.b1, R31.b0, 4", "LSR	R20.b1, R20.b1, 4", "SBBO	&R6, R4, 24, 4"
+	CAP_CLOCK	R20.b1, "AND	R8.b0, R31.b0, 0xF0", "OR	R7.b1, R7.b1, R8.b0"
+	CAP_CLOCK	R20.b2, "LSR	R7.b2, R31.b0, 4", "LSR	R20.b2, R20.b2, 4"
+	CAP_CLOCK	R20.b2, "AND	R8.b0, R31.b0, 0xF0", "OR	R7.b2, R7.b2, R8.b0"
+	CAP_CLOCK	R20.b3, "LSR	R7.b3, R31.b0, 4", "LSR	R20.b3, R20.b3, 4"
+	CAP_CLOCK	R20.b3, "AND	R8.b0, R31.b0, 0xF0", "OR	R7.b3, R7.b3, R8.b0"
+	CAP_CLOCK	R21.b0, "LSR	R6.b0, R31.b0, 4", "LSR	R21.b0, R21.b0, 4", "AND	R7, R7, R11"
+	CAP_CLOCK	R21.b0, "AND	R8.b0, R31.b0, 0xF0", "OR	R6.b0, R6.b0, R8.b0"
+	CAP_CLOCK	R21.b1, "LSR	R6.b1, R31.b0, 4", "LSR	R21.b1, R21.b1, 4", "SBBO	&R7, R4, 28, 4"
+	CAP_CLOCK	R21.b1, "AND	R8.b0, R31.b0, 0xF0", "OR	R6.b1, R6.b1, R8.b0"
+	CAP_CLOCK	R21.b2, "LSR	R6.b2, R31.b0, 4", "LSR	R21.b2, R21.b2, 4"
+	CAP_CLOCK	R21.b2, "AND	R8.b0, R31.b0, 0xF0", "OR	R6.b2, R6.b2, R8.b0"
+	CAP_CLOCK	R21.b3, "LSR	R6.b3, R31.b0, 4", "LSR	R21.b3, R21.b3, 4"
+	CAP_CLOCK	R21.b3, "AND	R8.b0, R31.b0, 0xF0", "OR	R6.b3, R6.b3, R8.b0"
+	CAP_CLOCK	R22.b0, "LSR	R7.b0, R31.b0, 4", "LSR	R22.b0, R22.b0, 4", "AND	R6, R6, R11"
+	CAP_CLOCK	R22.b0, "AND	R8.b0, R31.b0, 0xF0", "OR	R7.b0, R7.b0, R8.b0"
+	CAP_CLOCK	R22.b1, "LSR	R7.b1, R31.b0, 4", "LSR	R22.b1, R22.b1, 4", "SBBO	&R6, R4, 32, 4"
+	CAP_CLOCK	R22.b1, "AND	R8.b0, R31.b0, 0xF0", "OR	R7.b1, R7.b1, R8.b0"
+	CAP_CLOCK	R22.b2, "LSR	R7.b2, R31.b0, 4", "LSR	R22.b2, R22.b2, 4"
+	CAP_CLOCK	R22.b2, "AND	R8.b0, R31.b0, 0xF0", "OR	R7.b2, R7.b2, R8.b0"
+	CAP_CLOCK	R22.b3, "LSR	R7.b3, R31.b0, 4", "LSR	R22.b3, R22.b3, 4"
+	CAP_CLOCK	R22.b3, "AND	R8.b0, R31.b0, 0xF0", "OR	R7.b3, R7.b3, R8.b0"
+	CAP_CLOCK	R23.b0, "LSR	R6.b0, R31.b0, 4", "LSR	R23.b0, R23.b0, 4", "AND	R7, R7, R11"
+	CAP_CLOCK	R23.b0, "AND	R8.b0, R31.b0, 0xF0", "OR	R6.b0, R6.b0, R8.b0"
+	CAP_CLOCK	R23.b1, "LSR	R6.b1, R31.b0, 4", "LSR	R23.b1, R23.b1, 4", "SBBO	&R7, R4, 36, 4"
+	CAP_CLOCK	R23.b1, "AND	R8.b0, R31.b0, 0xF0", "OR	R6.b1, R6.b1, R8.b0"
+	CAP_CLOCK	R23.b2, "LSR	R6.b2, R31.b0, 4", "LSR	R23.b2, R23.b2, 4"
+	CAP_CLOCK	R23.b2, "AND	R8.b0, R31.b0, 0xF0", "OR	R6.b2, R6.b2, R8.b0"
+	CAP_CLOCK	R23.b3, "LSR	R6.b3, R31.b0, 4", "LSR	R23.b3, R23.b3, 4"
+	CAP_CLOCK	R23.b3, "AND	R8.b0, R31.b0, 0xF0", "OR	R6.b3, R6.b3, R8.b0"
+	CAP_CLOCK	R24.b0, "LSR	R7.b0, R31.b0, 4", "LSR	R24.b0, R24.b0, 4", "AND	R6, R6, R11"
+	CAP_CLOCK	R24.b0, "AND	R8.b0, R31.b0, 0xF0", "OR	R7.b0, R7.b0, R8.b0"
+	CAP_CLOCK	R24.b1, "LSR	R7.b1, R31.b0, 4", "LSR	R24.b1, R24.b1, 4", "SBBO	&R6, R4, 40, 4"
+	CAP_CLOCK	R24.b1, "AND	R8.b0, R31.b0, 0xF0", "OR	R7.b1, R7.b1, R8.b0"
+	CAP_CLOCK	R24.b2, "LSR	R7.b2, R31.b0, 4", "LSR	R24.b2, R24.b2, 4"
+	CAP_CLOCK	R24.b2, "AND	R8.b0, R31.b0, 0xF0", "OR	R7.b2, R7.b2, R8.b0"
+	CAP_CLOCK	R24.b3, "LSR	R7.b3, R31.b0, 4", "LSR	R24.b3, R24.b3, 4"
+	CAP_CLOCK	R24.b3, "AND	R8.b0, R31.b0, 0xF0", "OR	R7.b3, R7.b3, R8.b0"
+	CAP_CLOCK	R25.b0, "LSR	R6.b0, R31.b0, 4", "LSR	R25.b0, R25.b0, 4", "AND	R7, R7, R11"
+	CAP_CLOCK	R25.b0, "AND	R8.b0, R31.b0, 0xF0", "OR	R6.b0, R6.b0, R8.b0"
+	CAP_CLOCK	R25.b1, "LSR	R6.b1, R31.b0, 4", "LSR	R25.b1, R25.b1, 4", "SBBO	&R7, R4, 44, 4"
+	CAP_CLOCK	R25.b1, "AND	R8.b0, R31.b0, 0xF0", "OR	R6.b1, R6.b1, R8.b0"
+	CAP_CLOCK	R25.b2, "LSR	R6.b2, R31.b0, 4", "LSR	R25.b2, R25.b2, 4"
+	CAP_CLOCK	R25.b2, "AND	R8.b0, R31.b0, 0xF0", "OR	R6.b2, R6.b2, R8.b0"
+	CAP_CLOCK	R25.b3, "LSR	R6.b3, R31.b0, 4", "LSR	R25.b3, R25.b3, 4"
+	CAP_CLOCK	R25.b3, "AND	R8.b0, R31.b0, 0xF0", "OR	R6.b3, R6.b3, R8.b0"
+	CAP_CLOCK	R26.b0, "LSR	R7.b0, R31.b0, 4", "LSR	R26.b0, R26.b0, 4", "AND	R6, R6, R11"
+	CAP_CLOCK	R26.b0, "AND	R8.b0, R31.b0, 0xF0", "OR	R7.b0, R7.b0, R8.b0"
+	CAP_CLOCK	R26.b1, "LSR	R7.b1, R31.b0, 4", "LSR	R26.b1, R26.b1, 4", "SBBO	&R6, R4, 48, 4"
+	CAP_CLOCK	R26.b1, "AND	R8.b0, R31.b0, 0xF0", "OR	R7.b1, R7.b1, R8.b0"
+	CAP_CLOCK	R26.b2, "LSR	R7.b2, R31.b0, 4", "LSR	R26.b2, R26.b2, 4"
+	CAP_CLOCK	R26.b2, "AND	R8.b0, R31.b0, 0xF0", "OR	R7.b2, R7.b2, R8.b0"
+	CAP_CLOCK	R26.b3, "LSR	R7.b3, R31.b0, 4", "LSR	R26.b3, R26.b3, 4"
+	CAP_CLOCK	R26.b3, "AND	R8.b0, R31.b0, 0xF0", "OR	R7.b3, R7.b3, R8.b0"
+	CAP_CLOCK	R27.b0, "LSR	R6.b0, R31.b0, 4", "LSR	R27.b0, R27.b0, 4", "AND	R7, R7, R11"
+	CAP_CLOCK	R27.b0, "AND	R8.b0, R31.b0, 0xF0", "OR	R6.b0, R6.b0, R8.b0"
+	CAP_CLOCK	R27.b1, "LSR	R6.b1, R31.b0, 4", "LSR	R27.b1, R27.b1, 4", "SBBO	&R7, R4, 52, 4"
+	CAP_CLOCK	R27.b1, "AND	R8.b0, R31.b0, 0xF0", "OR	R6.b1, R6.b1, R8.b0"
+	CAP_CLOCK	R27.b2, "LSR	R6.b2, R31.b0, 4", "LSR	R27.b2, R27.b2, 4"
+	CAP_CLOCK	R27.b2, "AND	R8.b0, R31.b0, 0xF0", "OR	R6.b2, R6.b2, R8.b0"
+	CAP_CLOCK	R27.b3, "LSR	R6.b3, R31.b0, 4", "LSR	R27.b3, R27.b3, 4"
+	CAP_CLOCK	R27.b3, "AND	R8.b0, R31.b0, 0xF0", "OR	R6.b3, R6.b3, R8.b0"
+	CAP_CLOCK	R28.b0, "LSR	R7.b0, R31.b0, 4", "LSR	R28.b0, R28.b0, 4", "AND	R6, R6, R11"
+	CAP_CLOCK	R28.b0, "AND	R8.b0, R31.b0, 0xF0", "OR	R7.b0, R7.b0, R8.b0"
+	CAP_CLOCK	R28.b1, "LSR	R7.b1, R31.b0, 4", "LSR	R28.b1, R28.b1, 4", "SBBO	&R6, R4, 56, 4"
+	CAP_CLOCK	R28.b1, "AND	R8.b0, R31.b0, 0xF0", "OR	R7.b1, R7.b1, R8.b0"
+	CAP_CLOCK	R28.b2, "LSR	R7.b2, R31.b0, 4", "LSR	R28.b2, R28.b2, 4"
+	CAP_CLOCK	R28.b2, "AND	R8.b0, R31.b0, 0xF0", "OR	R7.b2, R7.b2, R8.b0", "QBBC	$cap$lastblock$, R29, 0"
+	CAP_CLOCK	R28.b3, "LSR	R7.b3, R31.b0, 4", "LSR	R28.b3, R28.b3, 4"
+	CAP_CLOCK	R28.b3, "AND	R8.b0, R31.b0, 0xF0", "OR	R7.b3, R7.b3, R8.b0", "XIN	10, &R13, 68"
+	CAP_CLOCK	R13.b0, "LSR	R6.b0, R31.b0, 4", "LSR	R13.b0, R13.b0, 4", "AND	R7, R7, R11"
+	CAP_CLOCK	R13.b0, "AND	R8.b0, R31.b0, 0xF0", "OR	R6.b0, R6.b0, R8.b0", "LDI	R31, PRU1_PRU0_INTERRUPT + 16"
+	CAP_CLOCK	R13.b1, "LSR	R6.b1, R31.b0, 4", "LSR	R13.b1, R13.b1, 4", "SBBO	&R7, R4, 60, 4"
+	CAP_CLOCK	R13.b1, "AND	R8.b0, R31.b0, 0xF0", "OR	R6.b1, R6.b1, R8.b0", "JMP	$cap$m8$"
+
+	; Last block: play and capture its final samples, store the last word,
+	; then tell PRU0 we are done
+$cap$lastblock$:
+	CAP_CLOCK	R28.b3, "LSR	R7.b3, R31.b0, 4", "LSR	R28.b3, R28.b3, 4"
+	CAP_CLOCK	R28.b3, "AND	R8.b0, R31.b0, 0xF0", "OR	R7.b3, R7.b3, R8.b0"
+	AND		R7, R7, R11
+	SBBO	&R7, R4, 60, 4
+	LDI		R31, PRU1_PRU0_INTERRUPT + 16
+	HALT
+
+	; Internal clock: every sample takes the period in R29 (bits 31:8 hold
+	; the cycles beyond 7, see $int$wait), the same for a whole block. The
+	; last sample of a block waits in $int$wait$last, which only then takes
+	; the R29 of the next block, so a new period starts at the block boundary
+$mode$:
+	QBEQ	$cap$, R12, 2
+	QBNE	$edge$, R12, 1
+$int$:
+	INT_CLOCK	R13.b0, "LSR	R13.b0, R13.b0, 4"
+	INT_CLOCK	R13.b0, "LDI	R31, PRU1_PRU0_INTERRUPT + 16"
+	INT_CLOCK	R13.b1, "LSR	R13.b1, R13.b1, 4"
+	INT_CLOCK	R13.b1, "NOP"
+	INT_CLOCK	R13.b2, "LSR	R13.b2, R13.b2, 4"
+	INT_CLOCK	R13.b2, "NOP"
+	INT_CLOCK	R13.b3, "LSR	R13.b3, R13.b3, 4"
+	INT_CLOCK	R13.b3, "NOP"
+	INT_CLOCK	R14.b0, "LSR	R14.b0, R14.b0, 4"
+	INT_CLOCK	R14.b0, "NOP"
+	INT_CLOCK	R14.b1, "LSR	R14.b1, R14.b1, 4"
+	INT_CLOCK	R14.b1, "NOP"
+	INT_CLOCK	R14.b2, "LSR	R14.b2, R14.b2, 4"
+	INT_CLOCK	R14.b2, "NOP"
+	INT_CLOCK	R14.b3, "LSR	R14.b3, R14.b3, 4"
+	INT_CLOCK	R14.b3, "NOP"
+	INT_CLOCK	R15.b0, "LSR	R15.b0, R15.b0, 4"
+	INT_CLOCK	R15.b0, "NOP"
+	INT_CLOCK	R15.b1, "LSR	R15.b1, R15.b1, 4"
+	INT_CLOCK	R15.b1, "NOP"
+	INT_CLOCK	R15.b2, "LSR	R15.b2, R15.b2, 4"
+	INT_CLOCK	R15.b2, "NOP"
+	INT_CLOCK	R15.b3, "LSR	R15.b3, R15.b3, 4"
+	INT_CLOCK	R15.b3, "NOP"
+	INT_CLOCK	R16.b0, "LSR	R16.b0, R16.b0, 4"
+	INT_CLOCK	R16.b0, "NOP"
+	INT_CLOCK	R16.b1, "LSR	R16.b1, R16.b1, 4"
+	INT_CLOCK	R16.b1, "NOP"
+	INT_CLOCK	R16.b2, "LSR	R16.b2, R16.b2, 4"
+	INT_CLOCK	R16.b2, "NOP"
+	INT_CLOCK	R16.b3, "LSR	R16.b3, R16.b3, 4"
+	INT_CLOCK	R16.b3, "NOP"
+	INT_CLOCK	R17.b0, "LSR	R17.b0, R17.b0, 4"
+	INT_CLOCK	R17.b0, "NOP"
+	INT_CLOCK	R17.b1, "LSR	R17.b1, R17.b1, 4"
+	INT_CLOCK	R17.b1, "NOP"
+	INT_CLOCK	R17.b2, "LSR	R17.b2, R17.b2, 4"
+	INT_CLOCK	R17.b2, "NOP"
+	INT_CLOCK	R17.b3, "LSR	R17.b3, R17.b3, 4"
+	INT_CLOCK	R17.b3, "NOP"
+	INT_CLOCK	R18.b0, "LSR	R18.b0, R18.b0, 4"
+	INT_CLOCK	R18.b0, "NOP"
+	INT_CLOCK	R18.b1, "LSR	R18.b1, R18.b1, 4"
+	INT_CLOCK	R18.b1, "NOP"
+	INT_CLOCK	R18.b2, "LSR	R18.b2, R18.b2, 4"
+	INT_CLOCK	R18.b2, "NOP"
+	INT_CLOCK	R18.b3, "LSR	R18.b3, R18.b3, 4"
+	INT_CLOCK	R18.b3, "NOP"
+	INT_CLOCK	R19.b0, "LSR	R19.b0, R19.b0, 4"
+	INT_CLOCK	R19.b0, "NOP"
+	INT_CLOCK	R19.b1, "LSR	R19.b1, R19.b1, 4"
+	INT_CLOCK	R19.b1, "NOP"
+	INT_CLOCK	R19.b2, "LSR	R19.b2, R19.b2, 4"
+	INT_CLOCK	R19.b2, "NOP"
+	INT_CLOCK	R19.b3, "LSR	R19.b3, R19.b3, 4"
+	INT_CLOCK	R19.b3, "NOP"
+	INT_CLOCK	R20.b0, "LSR	R20.b0, R20.b0, 4"
+	INT_CLOCK	R20.b0, "NOP"
+	INT_CLOCK	R20.b1, "LSR	R20.b1, R20.b1, 4"
+	INT_CLOCK	R20.b1, "NOP"
+	INT_CLOCK	R20.b2, "LSR	R20.b2, R20.b2, 4"
+	INT_CLOCK	R20.b2, "NOP"
+	INT_CLOCK	R20.b3, "LSR	R20.b3, R20.b3, 4"
+	INT_CLOCK	R20.b3, "NOP"
+	INT_CLOCK	R21.b0, "LSR	R21.b0, R21.b0, 4"
+	INT_CLOCK	R21.b0, "NOP"
+	INT_CLOCK	R21.b1, "LSR	R21.b1, R21.b1, 4"
+	INT_CLOCK	R21.b1, "NOP"
+	INT_CLOCK	R21.b2, "LSR	R21.b2, R21.b2, 4"
+	INT_CLOCK	R21.b2, "NOP"
+	INT_CLOCK	R21.b3, "LSR	R21.b3, R21.b3, 4"
+	INT_CLOCK	R21.b3, "NOP"
+	INT_CLOCK	R22.b0, "LSR	R22.b0, R22.b0, 4"
+	INT_CLOCK	R22.b0, "NOP"
+	INT_CLOCK	R22.b1, "LSR	R22.b1, R22.b1, 4"
+	INT_CLOCK	R22.b1, "NOP"
+	INT_CLOCK	R22.b2, "LSR	R22.b2, R22.b2, 4"
+	INT_CLOCK	R22.b2, "NOP"
+	INT_CLOCK	R22.b3, "LSR	R22.b3, R22.b3, 4"
+	INT_CLOCK	R22.b3, "NOP"
+	INT_CLOCK	R23.b0, "LSR	R23.b0, R23.b0, 4"
+	INT_CLOCK	R23.b0, "NOP"
+	INT_CLOCK	R23.b1, "LSR	R23.b1, R23.b1, 4"
+	INT_CLOCK	R23.b1, "NOP"
+	INT_CLOCK	R23.b2, "LSR	R23.b2, R23.b2, 4"
+	INT_CLOCK	R23.b2, "NOP"
+	INT_CLOCK	R23.b3, "LSR	R23.b3, R23.b3, 4"
+	INT_CLOCK	R23.b3, "NOP"
+	INT_CLOCK	R24.b0, "LSR	R24.b0, R24.b0, 4"
+	INT_CLOCK	R24.b0, "NOP"
+	INT_CLOCK	R24.b1, "LSR	R24.b1, R24.b1, 4"
+	INT_CLOCK	R24.b1, "NOP"
+	INT_CLOCK	R24.b2, "LSR	R24.b2, R24.b2, 4"
+	INT_CLOCK	R24.b2, "NOP"
+	INT_CLOCK	R24.b3, "LSR	R24.b3, R24.b3, 4"
+	INT_CLOCK	R24.b3, "NOP"
+	INT_CLOCK	R25.b0, "LSR	R25.b0, R25.b0, 4"
+	INT_CLOCK	R25.b0, "NOP"
+	INT_CLOCK	R25.b1, "LSR	R25.b1, R25.b1, 4"
+	INT_CLOCK	R25.b1, "NOP"
+	INT_CLOCK	R25.b2, "LSR	R25.b2, R25.b2, 4"
+	INT_CLOCK	R25.b2, "NOP"
+	INT_CLOCK	R25.b3, "LSR	R25.b3, R25.b3, 4"
+	INT_CLOCK	R25.b3, "NOP"
+	INT_CLOCK	R26.b0, "LSR	R26.b0, R26.b0, 4"
+	INT_CLOCK	R26.b0, "NOP"
+	INT_CLOCK	R26.b1, "LSR	R26.b1, R26.b1, 4"
+	INT_CLOCK	R26.b1, "NOP"
+	INT_CLOCK	R26.b2, "LSR	R26.b2, R26.b2, 4"
+	INT_CLOCK	R26.b2, "NOP"
+	INT_CLOCK	R26.b3, "LSR	R26.b3, R26.b3, 4"
+	INT_CLOCK	R26.b3, "NOP"
+	INT_CLOCK	R27.b0, "LSR	R27.b0, R27.b0, 4"
+	INT_CLOCK	R27.b0, "NOP"
+	INT_CLOCK	R27.b1, "LSR	R27.b1, R27.b1, 4"
+	INT_CLOCK	R27.b1, "NOP"
+	INT_CLOCK	R27.b2, "LSR	R27.b2, R27.b2, 4"
+	INT_CLOCK	R27.b2, "NOP"
+	INT_CLOCK	R27.b3, "LSR	R27.b3, R27.b3, 4"
+	INT_CLOCK	R27.b3, "NOP"
+	INT_CLOCK	R28.b0, "LSR	R28.b0, R28.b0, 4"
+	INT_CLOCK	R28.b0, "NOP"
+	INT_CLOCK	R28.b1, "LSR	R28.b1, R28.b1, 4"
+	INT_CLOCK	R28.b1, "NOP"
+	INT_CLOCK	R28.b2, "LSR	R28.b2, R28.b2, 4"
+	INT_CLOCK	R28.b2, "QBBC	$int$lastblock$, R29, 0"
+	INT_CLOCK	R28.b3, "LSR	R28.b3, R28.b3, 4"
+	MOV		R30.b0, R28.b3
+	XIN		10, &R13, 64											; Next block, its R29 once this sample is over
+	JAL		R3.w0, $int$wait$last
+
+	; Last block: play its final samples, then tell PRU0 we are done
+$int$lastblock$:
+	JAL		R3.w0, $int$wait
+	INT_CLOCK	R28.b3, "LSR	R28.b3, R28.b3, 4"
+	MOV		R30.b0, R28.b3
+	LDI		R31, PRU1_PRU0_INTERRUPT + 16
+	HALT
+
+	; Rest of a sample period: with the MOV, the op and the JAL a sample
+	; takes 7 cycles, one more for bit 8 of R29 and two per count of bits
+	; 31:9 (at least 1). Returns to R3.w0
+$int$wait:
+	QBBC	$int$even, R29, 8
+	NOP
+$int$even:
+	LSR		R5, R29, 9
+$int$loop:
+	SUB		R5, R5, 1
+	QBNE	$int$loop, R5, 0
+	NOP
+	JMP		R3.w0
+
+	; The same for the last sample of a block, then on with the next block
+$int$wait$last:
+	QBBC	$int$even$last, R29, 8
+	NOP
+$int$even$last:
+	LSR		R5, R29, 9
+$int$loop$last:
+	SUB		R5, R5, 1
+	QBNE	$int$loop$last, R5, 0
+	XIN		10, &R29, 4
+	JMP		$int$
+
+	; Edge list mode: each block holds 8 records of a time in PRU cycles and
+	; the value to put on R30.b0 at that time, independent of the sample
+	; clock. Times count from the earliest moment the first record can be
+	; played. R4 is the time of the last record played, R11 counts the late
+	; ones and goes to the address in R12 at the end
+$edge$:
+	LDI		R11, 0
+	LDI		R4, 0
+	SUB		R4, R4, EDGE_BLOCK_CYCLES								; A first record at time 0 plays right away
+	JMP		$edge$first
+$edge$block:
+	QBBC	$edge$end, R29, 0
+	XIN		10, &R13, 68
+$edge$first:
+	LDI		R31, PRU1_PRU0_INTERRUPT + 16							; PRU0 can fetch the next block now
+	EDGE	R13, R14, EDGE_BLOCK_CYCLES
+	EDGE	R15, R16, EDGE_CYCLES
+	EDGE	R17, R18, EDGE_CYCLES
+	EDGE	R19, R20, EDGE_CYCLES
+	EDGE	R21, R22, EDGE_CYCLES
+	EDGE	R23, R24, EDGE_CYCLES
+	EDGE	R25, R26, EDGE_CYCLES
+	EDGE	R27, R28, EDGE_CYCLES
+	JMP		$edge$block
+
+$edge$end:
+	SBBO	&R11, R12, 0, 4											; Late edges, into PRU0's context
+	LDI		R31, PRU1_PRU0_INTERRUPT + 16
+	HALT
+
+	; Wait until R6 (R8 cycles after the last record if that time has
+	; passed), then put R7.b0 on the pins. Skipped records (bit 31 of R7)
+	; take the time of a record played right away, late ones are counted
+	; and move the schedule along. Returns to R3.w0
+$edge$play:
+	SUB		R5, R6, R4
+	SUB		R5, R5, R8												; Cycles left to wait
+	QBBS	$edge$skip, R7, 31
+	QBBS	$edge$late, R5, 31
+	MOV		R4, R6
+	QBBC	$edge$even, R5, 0										; Odd: one cycle more, then pairs
+	NOP
+$edge$even:
+	LSR		R5, R5, 1
+	QBEQ	$edge$out, R5, 0
+$edge$wait:
+	SUB		R5, R5, 1
+	QBNE	$edge$wait, R5, 0
+$edge$out:
+	MOV		R30.b0, R7.b0
+	JMP		R3.w0
+$edge$late:
+	ADD		R11, R11, 1
+	ADD		R4, R4, R8												; Played as soon as possible
+	NOP
+	NOP
+	MOV		R30.b0, R7.b0
+	JMP		R3.w0
+$edge$skip:
+	ADD		R4, R4, R8
+	NOP
+	NOP
+	NOP
+	NOP
+	NOP
+	JMP		R3.w0
+
 	; End-of-firmware
 	HALT
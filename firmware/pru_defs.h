@@ -104,6 +104,7 @@ volatile register uint32_t __R30;
 #define SYSEV_PRU0_TO_ARM_A	22
 #define SYSEV_ARM_TO_PRU0_A	23
 #define SYSEV_PRU0_TO_ARM_B	24
+#define SYSEV_PRU0_TO_ARM_C	25
 
 #define pru0_signal() (__R31 & (1U << 30))
 #define pru1_signal() (__R31 & (1U << 31))
@@ -1,6 +0,0 @@
-release/beaglelogic-pru1.object: beaglelogic-pru1.c
-release/beaglelogic-pru1.object: /usr/share/ti/cgt-pru/include/stdint.h
-release/beaglelogic-pru1.object: resource_table_1.h
-release/beaglelogic-pru1.object: /usr/share/ti/cgt-pru/include/stddef.h
-release/beaglelogic-pru1.object: /usr/lib/ti/pru-software-support-package/include/rsc_types.h
-release/beaglelogic-pru1.object: /usr/lib/ti/pru-software-support-package/include/pru_types.h
@@ -53,7 +53,8 @@ struct ch_map pru_intc_map[] = { {SYSEV_PRU0_TO_ARM, 2},
 				 {SYSEV_PRU0_TO_PRU1, 1},	// The interrupt communication between two PRUss is separated for easier understanding
 				 {SYSEV_PRU0_TO_ARM_A, 4},	// They can be placed onto the same channel and corresponding host controller, I've 
 				 {SYSEV_PRU0_TO_ARM_B, 5},	// a version where the program still works correctly.
-				 {SYSEV_ARM_TO_PRU0_A, 1}
+				 {SYSEV_ARM_TO_PRU0_A, 1},
+				 {SYSEV_PRU0_TO_ARM_C, 6}	// Buffer handed back in stream mode
 };
 
 struct my_resource_table {
@@ -84,7 +85,7 @@ struct my_resource_table resourceTable = {
 			0x0000,
 			/* Channel-to-host mapping, 255 for unused */			// The numbers are the channels, the position is the host controller.
 			0, 1, 2, HOST_UNUSED, 4, 5,
-			HOST_UNUSED, HOST_UNUSED, HOST_UNUSED, HOST_UNUSED,
+			6, HOST_UNUSED, HOST_UNUSED, HOST_UNUSED,
 			/* Number of evts being mapped to channels */
 			(sizeof(pru_intc_map) / sizeof(struct ch_map)),
 			/* Pointer to the structure containing mapped events */
@@ -64,6 +64,8 @@ update_uboot_uenv_txt() {
 		echo "${log} Updating uEnv.txt"
 		sed -i -e "s:#disable_uboot_overlay_video:disable_uboot_overlay_video:" "/boot/uEnv.txt"
 		sed -i -e "s:uboot_overlay_pru:#uboot_overlay_pru:" "/boot/uEnv.txt"
+		# The overlay muxes the pins itself, the universal cape would claim them
+		sed -i -e "s:^enable_uboot_cape_universal=1:#enable_uboot_cape_universal=1:" "/boot/uEnv.txt"
 		echo '#Load BeagleLogic Cape' >> "/boot/uEnv.txt"
 		echo 'uboot_overlay_pru=/lib/firmware/beaglelogic-00A0.dtbo' >> "/boot/uEnv.txt"
 	fi
@@ -79,9 +81,19 @@ display_success_message() {
 
 # Added by Kevin to set correct kernel module at boot
 set_kernel_module_at_boot() {
-	# Required for compiling the firmware, see firmware/Makefile
+	# Built here, so the module matches the firmware built above and the
+	# running kernel (needs linux-headers-$(uname -r))
+	echo "${log} Building kernel module"
+	cd "${DIR}/kernel"
+	make
+
+	# The overlay uEnv.txt loads, which also muxes the pins
+	echo "${log} Building and installing device tree overlay"
+	make overlay deploy_overlay
+
 	echo "${log} Setting correct kernel module to load at boot"
 	cp -v "${DIR}/kernel/beaglelogic.ko" "/lib/modules/$(uname -r)/kernel/drivers/misc/"
+	depmod -a
 }
 
 
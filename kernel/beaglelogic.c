@@ -42,6 +42,11 @@
 #include <linux/init.h>
 #include <linux/wait.h>
 #include <linux/poll.h>
+#include <linux/spinlock.h>
+#include <linux/completion.h>
+#include <linux/jiffies.h>
+#include <linux/ktime.h>
+#include <linux/workqueue.h>
 
 #include <linux/platform_device.h>
 #include <linux/pruss.h>
@@ -55,6 +60,8 @@
 #include <linux/genalloc.h>
 #include <linux/mm.h>
 #include <linux/dma-mapping.h>
+#include <linux/math64.h>
+#include <linux/log2.h>
 
 #include <linux/kobject.h>
 #include <linux/string.h>
@@ -69,6 +76,9 @@
 
 #include "beaglelogic.h"
 
+#define CREATE_TRACE_POINTS
+#include "beaglelogic_trace.h"
+
 /* Buffer states */
 enum bufstates {
 	STATE_BL_BUF_ALLOC,
@@ -82,13 +92,60 @@ enum bufstates {
 #define CMD_GET_MAX_SG  2   /* Get the max number of bufferlist entries */
 #define CMD_SET_CONFIG  3   /* Get the context pointer */
 #define CMD_START       4   /* Arm the waveform generator (start sampling) */
-
-/* PRU-side sample buffer descriptor */
+#define CMD_GET_STATUS  5   /* 1 while a waveform plays, 0 when idle */
+
+/* PRU0 answers within microseconds, even while a waveform plays */
+#define BL_CMD_TIMEOUT_MS	100
+
+/* A run that plays no block for this long has hung, e.g. PRU1 waiting for
+ * a clock that died; the watchdog then restarts both PRUs. The timeout is
+ * raised to twice the longest block time of the internal clock or of an
+ * edge list, see beaglelogic_watchdog_timeout. The driver does not know the
+ * rate of the external clock: at 2000 ms it must play 128 samples (a block)
+ * in less than 2 s, i.e. above 64 SPS; set watchdog_ms higher for slower
+ * external clocks */
+#define BL_WATCHDOG_MS_DEFAULT	2000
+
+/* End address of the entry that closes the list into a ring (stream mode) */
+#define BL_LIST_LINK	1
+
+/* PRU-side sample buffer descriptor. PRU0 zeroes the start address once
+ * it has read the buffer completely and raises PRU0_TO_ARM_C. clk is the
+ * sample period of the buffer on the internal clock, 0 on the external one */
 struct buflist {
 	uint32_t dma_start_addr;
 	uint32_t dma_end_addr;
+	uint32_t clk;
+};
+
+/* Generator state words, loaded by PRU0 in this order. Each 32 bit word
+ * (8 samples) is ((prbs & prbs_mask) | (counter & count_mask)) ^ invert,
+ * or in table mode the OR of the next word of each channel table */
+union bl_gen_state {
+	struct {
+		uint32_t prbs;	/* The last 32 bits of the sequence */
+		uint32_t taps;	/* a, b, 32 - a, 32 - b of s[t] = s[t-a] ^ s[t-b] */
+		uint32_t count;	/* Counter value in bits 31:28 */
+		uint32_t inc;	/* Counter increment per word */
+		uint32_t pattern;	/* Counter offsets of the 8 samples */
+		uint32_t prbs_mask;
+		uint32_t count_mask;
+		uint32_t invert;
+	};
+	struct {
+		uint32_t pos;	/* Offset in bits 15:0, table bytes in 31:16 */
+		uint32_t addr;	/* PRU address of the table */
+	} table[4];
 };
 
+/* Firmware version (major << 8 | minor) with the context layout below and
+ * the command protocol; bump it together with MAJORVER/MINORVER of
+ * beaglelogic-pru0.c */
+#define BL_FW_VERSION	0x0010
+
+/* List entries of the firmware, the block sums of each come before them */
+#define BL_MAX_BUFLIST		128
+
 /* Shared structure containing PRU attributes */
 struct capture_context {
 	/* Magic bytes */
@@ -99,7 +156,69 @@ struct capture_context {
 	uint32_t resp;          // Response code
 
 	// Samplediv, sampleunit, and triggerflags are not needed
-	
+
+	uint32_t ddr_lat_max;   // Worst 64 byte DDR read time of the last run (cycles)
+
+	// Playback progress, written by PRU0 after every block
+	uint32_t prog_entry;    // PRU0 address of the list entry being played
+	uint32_t prog_addr;     // DDR address of the next block to load
+
+	// Loop mode, see struct capture_context in beaglelogic-pru0.c
+	uint32_t loop_count;    // Iterations to play, 0 if not looping
+	uint32_t loop_iter;     // Iterations PRU0 has read
+	uint32_t swap_entry;    // PRU0 address of the list entry to replace
+	uint32_t swap_start;    // Its new addresses, taken at a loop boundary
+	uint32_t swap_end;
+	uint32_t swap_iter;     // First iteration that played them
+
+	// Generator mode, see struct capture_context in beaglelogic-pru0.c
+	uint32_t gen_blocks;    // Blocks to generate, 0 plays the list
+	uint32_t gen_block;     // Blocks PRU0 has generated
+	uint32_t gen_tables;    // The state words point into shared RAM tables
+	union bl_gen_state gen;
+
+	// Edge list mode, see struct capture_context in beaglelogic-pru0.c
+	uint32_t edge;          // Buffers hold struct beaglelogic_edge records
+	uint32_t edge_late;     // Records PRU1 played late in the last run
+
+	// Clock monitor, see struct capture_context in beaglelogic-pru0.c
+	uint32_t clk_min;       // Shortest block (IEP cycles), ~0 before two
+	uint32_t clk_max;       // Longest block
+	uint32_t clk_last;      // IEP count at the last block request of PRU1
+	uint32_t clk_blocks;    // Block requests seen
+	uint32_t clk_late;      // Of these, requests PRU0 came late for
+	uint32_t clk_first;     // IEP count at the first one
+
+	// Indexed mode, see struct capture_context in beaglelogic-pru0.c
+	uint32_t index_dict;    // DDR address of the dictionary, 0 if not indexed
+	uint32_t index_pos;     // Next index in index_batch, 0 if used up
+	uint16_t index_batch[BL_INDEX_BATCH];
+
+	// Scheduled start, see struct capture_context in beaglelogic-pru0.c
+	uint32_t start_delay;   // IEP cycles from CMD_START to the start, 0 now
+	uint32_t start_ref;     // IEP count at CMD_START
+	uint32_t start_iep;     // IEP count PRU1 started at
+	uint32_t start_done;    // Set by PRU1 along with start_iep
+
+	// Internal clock, see struct capture_context in beaglelogic-pru0.c
+	uint32_t clk_int;       // clk word of generated blocks, 0 if external
+
+	// Capture, see struct capture_context in beaglelogic-pru0.c
+	uint32_t cap_start;     // DDR ring, 0 when not capturing
+	uint32_t cap_end;
+	uint32_t cap_addr;      // Where the next block goes
+	uint32_t cap_blocks;    // Blocks copied in this run
+	uint32_t cap_mask;      // Inputs captured, bit N for R31 bit N + 4
+	uint32_t cap_pad[5];
+	uint32_t cap_ring[32];  // Written by PRU1
+
+	// Block sums, see struct capture_context in beaglelogic-pru0.c
+	uint32_t sum_enable;    // Fold every block handed to PRU1 into the sums
+	uint32_t sum_a;         // Of the run
+	uint32_t sum_b;
+	uint32_t sum_pad;
+	struct beaglelogic_sum sum_list[BL_MAX_BUFLIST];
+
 	struct buflist list_head;
 };
 
@@ -112,10 +231,14 @@ struct logic_buffer {
 	void *buf;
 	dma_addr_t phys_addr;
 	size_t size;
+	size_t capacity;	/* Bytes kmalloc'd, size may grow up to it */
 
 	unsigned short state;
 	unsigned short index;
 
+	uint32_t queued;	/* Stream mode: bytes handed to PRU0, 0 if free */
+	uint32_t job;		/* Stream mode: id of the job it ends, 0 if none */
+
 	struct logic_buffer *next;
 };
 
@@ -131,18 +254,25 @@ struct beaglelogicdev {
 	struct pruss *pruss;
 	struct rproc *pru0, *pru1;
 	struct pruss_mem_region pru0sram;
+	struct pruss_mem_region sharedram;	/* Generator tables */
 	const struct beaglelogic_private_data *fw_data;
 
 	/* IRQ numbers */
 	int to_bl_irq;
 	int from_bl_irq_1;
 	int from_bl_irq_2;
+	int from_bl_irq_3;
 
 	/* Private data */
 	struct device *p_dev; /* Parent platform device */
 
 	/* Locks */
 	struct mutex mutex;
+	uint32_t run_locked;	/* mutex is held by a started run until stop */
+	struct mutex cmd_mutex;	/* One command in flight */
+
+	/* Command mailbox, completed by the PRU0_TO_ARM_B reply */
+	struct completion cmd_done;
 
 	/* Buffer management */
 	struct logic_buffer *buffers;
@@ -151,6 +281,77 @@ struct beaglelogicdev {
 	uint32_t bufcount;
 	wait_queue_head_t wait;
 
+	/* Stream mode: the writer queues buffers as they fill, PRU0 hands
+	 * them back; stream_lock orders the two sides */
+	uint32_t stream;
+	spinlock_t stream_lock;
+	struct logic_buffer *stream_tail;	/* Oldest queued buffer */
+	u64 stream_done;	/* Bytes handed back since the reset */
+	uint32_t stream_eof;	/* Writer flushed, running dry is expected */
+	uint32_t stream_dry;	/* The last run ran dry, the writer was late */
+
+	/* Job queue (stream mode): each IOCTL_BL_JOB_END ends a job, which
+	 * plays right after the previous one. Ids count up from 1 */
+	uint32_t jobs_queued;	/* Id of the last job ended by the writer */
+	uint32_t jobs_done;	/* Id of the last job PRU0 has read completely */
+
+	/* Loop mode: the list repeats. A segment swap fills the spare buffer
+	 * and posts it to PRU0; once applied, the spare takes the place of
+	 * the buffer it replaces and the old one becomes the spare */
+	uint32_t loop;		/* Iterations to play, 0 if not looping */
+	struct mutex swap_mutex;	/* One swap being prepared */
+	struct logic_buffer swap_buf;	/* Spare buffer */
+	uint32_t swap_index;	/* Buffer the posted spare replaces */
+	uint32_t swap_pending;	/* Posted, not applied yet */
+	int swap_iter;		/* First iteration that played the last swap,
+				 * -ECANCELED if the run ended before */
+
+	/* Generator mode: PRU0 computes the samples from gen_state, in table
+	 * mode from the gen_table words copied to shared RAM */
+	struct beaglelogic_generator gen;
+	union bl_gen_state gen_state;
+	u32 *gen_table;
+	uint32_t gen_table_words;
+
+	/* Edge list mode: PRU1 plays timed records instead of samples */
+	uint32_t edge;
+
+	/* Indexed mode: the buffers hold indices into this dictionary, which
+	 * is mapped along with them (buf is NULL when not indexed) */
+	struct logic_buffer index_dict;
+
+	/* Internal clock: PRU cycles per sample, 0 for the external clock.
+	 * Buffer i < clk_segments plays at clk_periods[i] unless that is 0 */
+	uint32_t clk_period;
+	uint32_t clk_segments;
+	u32 *clk_periods;
+
+	/* Capture: PRU0 copies the inputs PRU1 reads along with the samples
+	 * to the coherent cap_buf ring (NULL when not capturing); read()
+	 * returns them from cap_read on */
+	struct mutex cap_mutex;	/* Held by read() and mmap() */
+	uint32_t cap_mask;
+	uint32_t cap_size;
+	void *cap_buf;
+	dma_addr_t cap_dma;
+	u64 cap_read;		/* Bytes of the run returned or skipped */
+	u64 cap_lost;		/* Of these, overwritten before they were read */
+	atomic_t cap_maps;	/* mmap()s of the ring still mapped */
+
+	/* Block sums: PRU0 folds every block it hands over into sums */
+	uint32_t sums;
+
+	/* Watchdog: checks every watchdog_ms that the run still plays blocks
+	 * (0 turns it off), restarts the PRUs if it does not */
+	struct delayed_work watchdog;
+	uint32_t watchdog_ms;
+	uint32_t watchdog_timeout;	/* Of the current run, in ms */
+	uint32_t watchdog_seen;	/* Blocks played at the last check */
+	uint32_t watchdog_resets;	/* Hung runs ended since the module load */
+
+	/* Firmware images the PRUs run */
+	struct beaglelogic_firmware fw;
+
 	/* Firmware capabilities */
 	struct capture_context *cxt_pru;
 
@@ -158,9 +359,20 @@ struct beaglelogicdev {
 	uint32_t maxbufcount;	/* Max buffer count supported by the PRU FW */
 	uint32_t bufunitsize;  	/* Size of 1 Allocation unit */
 
+	/* Reliability model inputs */
+	uint32_t ddrlatency;	/* Assumed worst DDR block read time (ns) */
+	uint32_t ddrlatency_max;	/* Worst DDR block read time measured (ns) */
+
+	/* Scheduled start: the deadline of the last start (0 for an immediate
+	 * one) and the time the start command reached PRU0 */
+	u64 start_deadline;
+	u64 start_cmd_ns;
+
 	/* State */
 	uint32_t state;
 	uint32_t lasterror;
+	u64 start_ns;
+	u64 stop_ns;		/* Zero while a waveform plays */
 };
 
 struct logic_buffer_reader {
@@ -169,152 +381,507 @@ struct logic_buffer_reader {
 
 	uint32_t pos;
 	uint32_t remaining;
+	uint32_t job_pending;	/* Data written since the last job end */
 };
 
 #define to_beaglelogicdev(dev)	container_of((dev), \
 		struct beaglelogicdev, miscdev)
 
+/* All state changes go through here, see the beaglelogic_state event */
+static void beaglelogic_set_state(struct beaglelogicdev *bldev,
+		uint32_t state)
+{
+	trace_beaglelogic_state(bldev->state, state, bldev->lasterror);
+	bldev->state = state;
+}
+
 #define DRV_NAME	"beaglelogic"
 #define DRV_VERSION	"0.1"
 
+/* Begin rate model section */
+
+/*
+ * Cycle budget of the firmware loops. PRU1 spends 4 cycles per sample
+ * (WBC, WBS, MOV R30, one extra instruction) and asks PRU0 for the next
+ * 64 byte block 2 samples after loading the current one. PRU0 must then
+ * fetch the block from DDR and place it in the scratchpad before PRU1
+ * reaches the end of its block, i.e. within 'margin' samples. The PRU0
+ * loop costs BL_PRU0_BLOCK_OVERHEAD cycles on top of the DDR read itself
+ * (at a buffer boundary, the worst case), and BL_PRU0_LOOP_OVERHEAD more
+ * at a loop boundary that applies a segment swap. In generator mode PRU0
+ * computes the block in BL_PRU0_GEN_CYCLES instead of reading it.
+ *
+ * After handing a block over, PRU0 also times PRU1's request for the clock
+ * monitor, so one pass of its loop, BL_PRU0_CLOCK_CYCLES longer, must fit
+ * in the samples of a block as well; at 50 MSPS this is the tighter limit.
+ *
+ * In indexed mode the block that starts a batch of indices reads the batch
+ * and the dictionary block, two DDR reads and BL_PRU0_INDEX_OVERHEAD cycles.
+ *
+ * On the internal clock PRU1 takes BL_PRU1_INT_CYCLES per sample plus the
+ * wait the clk word of the list entry asks for, see beaglelogic_clock_word.
+ *
+ * Capture takes PRU1 BL_PRU1_CAPTURE_CYCLES per sample, and PRU0 another
+ * BL_PRU0_CAPTURE_CYCLES per block to copy the inputs to DDR. Block sums
+ * cost PRU0 BL_PRU0_SUM_CYCLES per block.
+ *
+ * The 8 and 13 output variants use bytes and halfwords per sample; the
+ * reliability figures in the README follow the same margin scaling.
+ */
+#define BL_PRU_CLK_HZ		200000000
+#define BL_PRU_CYCLE_NS		5
+#define BL_PRU1_CYCLES_PER_SAMPLE	4
+#define BL_PRU0_BLOCK_OVERHEAD	25
+#define BL_PRU0_LOOP_OVERHEAD	12	/* More at a loop boundary with a swap */
+#define BL_PRU0_CLOCK_CYCLES	30	/* Clock monitor and sample period */
+#define BL_PRU1_INT_CYCLES	7	/* Internal clock, without the wait */
+#define BL_PRU0_INDEX_OVERHEAD	28	/* Indexed mode, with the second read */
+#define BL_PRU0_GEN_CYCLES	368	/* Generator mode, instead of the read */
+#define BL_PRU1_CAPTURE_CYCLES	6	/* Capture, per sample */
+#define BL_PRU0_CAPTURE_CYCLES	55	/* Capture, per block copied */
+#define BL_PRU0_SUM_CYCLES	61	/* Block sums, per block */
+#define BL_CHANNELS		4	/* Output configuration of this firmware */
+#define BL_PRU_SHARED_ADDR	0x10000	/* Shared RAM seen from the PRUs */
+#define BL_GEN_TABLE_WORDS	3072	/* 12 KB of it for generator tables */
+#define BL_CLOCK_LATE_MIN	16	/* Blocks before late requests count */
+#define BL_DDRLATENCY_DEFAULT	3500	/* ns, matches the measured 33.33 MSPS */
+
+static const struct bl_rate_model {
+	uint32_t channels;
+	uint32_t samples_per_block;
+	uint32_t margin;
+} bl_rate_models[] = {
+	{ 4, 128, 126 },	/* 2 samples per byte */
+	{ 8, 64, 62 },		/* 1 sample per byte */
+	{ 13, 32, 30 },		/* 1 sample per halfword */
+};
+
+/* Highest sample rate (Hz) the firmware sustains for a DDR read time */
+static uint32_t beaglelogic_max_samplerate(uint32_t channels,
+		uint32_t ddr_ns)
+{
+	uint32_t i, block_cycles;
+	uint64_t rate;
+
+	for (i = 0; i < ARRAY_SIZE(bl_rate_models); i++)
+		if (bl_rate_models[i].channels == channels)
+			break;
+	if (i == ARRAY_SIZE(bl_rate_models))
+		return 0;
+
+	block_cycles = DIV_ROUND_UP(ddr_ns, BL_PRU_CYCLE_NS) +
+		BL_PRU0_BLOCK_OVERHEAD;
+	rate = div_u64((uint64_t)bl_rate_models[i].margin * BL_PRU_CLK_HZ,
+			block_cycles);
+	rate = min_t(uint64_t, rate, div_u64((uint64_t)
+			bl_rate_models[i].samples_per_block * BL_PRU_CLK_HZ,
+			block_cycles + BL_PRU0_CLOCK_CYCLES));
+
+	return min_t(uint64_t, rate,
+			BL_PRU_CLK_HZ / BL_PRU1_CYCLES_PER_SAMPLE);
+}
+
+/* DDR read time (ns) the rate model assumes for the configured mode:
+ * the worse of the assumed and the measured one */
+static uint32_t beaglelogic_ddr_ns(struct beaglelogicdev *bldev)
+{
+	uint32_t ddr_ns = max(bldev->ddrlatency, bldev->ddrlatency_max);
+
+	/* A loop boundary that swaps a segment is the slowest block */
+	if (bldev->loop)
+		ddr_ns += BL_PRU0_LOOP_OVERHEAD * BL_PRU_CYCLE_NS;
+
+	/* Indexed mode reads the next batch of indices first */
+	if (bldev->index_dict.buf)
+		ddr_ns = 2 * ddr_ns + BL_PRU0_INDEX_OVERHEAD * BL_PRU_CYCLE_NS;
+
+	/* Generator mode reads nothing from DDR */
+	if (bldev->gen.enable)
+		ddr_ns = BL_PRU0_GEN_CYCLES * BL_PRU_CYCLE_NS;
+
+	/* Capture copies a block of inputs to DDR as well */
+	if (bldev->cap_buf)
+		ddr_ns += BL_PRU0_CAPTURE_CYCLES * BL_PRU_CYCLE_NS;
+
+	/* and block sums fold the block in */
+	if (bldev->sums)
+		ddr_ns += BL_PRU0_SUM_CYCLES * BL_PRU_CYCLE_NS;
+
+	return ddr_ns;
+}
+
+/* Highest sample rate (Hz) of the configured mode */
+static uint32_t beaglelogic_mode_samplerate(struct beaglelogicdev *bldev)
+{
+	uint32_t rate = beaglelogic_max_samplerate(BL_CHANNELS,
+			beaglelogic_ddr_ns(bldev));
+
+	if (bldev->cap_buf)
+		rate = min_t(uint32_t, rate,
+				BL_PRU_CLK_HZ / BL_PRU1_CAPTURE_CYCLES);
+
+	return rate;
+}
+
+/* clk word of a list entry for 'period' PRU cycles per sample, 0 for the
+ * external clock: PRU1 waits (period - 7) cycles, bit 8 first */
+static uint32_t beaglelogic_clock_word(uint32_t period)
+{
+	return period ? (period - BL_PRU1_INT_CYCLES) << 8 : 0;
+}
+
+/* Sample period of buffer i, 0 on the external clock */
+static uint32_t beaglelogic_buffer_period(struct beaglelogicdev *bldev,
+		uint32_t i)
+{
+	if (i < bldev->clk_segments && bldev->clk_periods[i])
+		return bldev->clk_periods[i];
+	return bldev->clk_period;
+}
+
+/* Longest time (ms) PRU1 may take to play one block in the configured
+ * mode, 0 when only the external clock paces it: a block of the slowest
+ * internal clock period, or for edge lists 8 records each less than 2^31
+ * cycles after the one before */
+static uint32_t beaglelogic_block_ms(struct beaglelogicdev *bldev)
+{
+	u64 cycles = bldev->clk_period;
+	uint32_t i;
+
+	if (bldev->edge) {
+		cycles = (u64)8 << 31;
+	} else {
+		for (i = 0; i < bldev->clk_segments; i++)
+			cycles = max_t(u64, cycles, bldev->clk_periods[i]);
+		cycles *= bl_rate_models[0].samples_per_block;
+	}
+	return DIV_ROUND_UP_ULL(cycles * BL_PRU_CYCLE_NS, NSEC_PER_MSEC);
+}
+
+/* Watchdog timeout (ms) of a run in the configured mode, 0 when off:
+ * watchdog_ms, but no less than two blocks */
+static uint32_t beaglelogic_watchdog_timeout(struct beaglelogicdev *bldev)
+{
+	if (!bldev->watchdog_ms)
+		return 0;
+	return max_t(uint32_t, bldev->watchdog_ms,
+			2 * beaglelogic_block_ms(bldev));
+}
+
+/* Sample rate (Hz) of a block PRU1 played in 'cycles', 0 if none */
+static uint32_t beaglelogic_block_rate(uint64_t cycles)
+{
+	if (!cycles || cycles == 0xFFFFFFFF)
+		return 0;
+	return div64_u64((uint64_t)bl_rate_models[0].samples_per_block *
+			BL_PRU_CLK_HZ + cycles / 2, cycles);
+}
+
+/* Flag an external clock faster than the rate model sustains, once per
+ * run. The clock monitor times the blocks PRU1 plays while PRU0 keeps up;
+ * a clock PRU0 cannot keep up with shows as mostly late requests instead.
+ * Edge list mode has no sample clock */
+static void beaglelogic_clock_check(struct beaglelogicdev *bldev)
+{
+	struct device *dev = bldev->miscdev.this_device;
+	struct capture_context *cxt = bldev->cxt_pru;
+	uint32_t rate, max_rate, blocks, late;
+
+	if (bldev->edge || (bldev->lasterror & 0x20000))
+		return;
+
+	rate = beaglelogic_block_rate(READ_ONCE(cxt->clk_min));
+	max_rate = beaglelogic_mode_samplerate(bldev);
+	blocks = READ_ONCE(cxt->clk_blocks);
+	late = READ_ONCE(cxt->clk_late);
+
+	if (rate > max_rate) {
+		dev_err(dev, "Sample clock at %u Hz, faster than the %u Hz supported\n",
+				rate, max_rate);
+	} else if (blocks >= BL_CLOCK_LATE_MIN && late > blocks / 2) {
+		dev_err(dev, "Sample clock too fast, PRU0 was late for %u of %u blocks\n",
+				late, blocks);
+	} else
+		return;
+
+	bldev->lasterror = 0x20000;
+}
+
+/* End rate model section */
+
 /* Begin Buffer Management section */
 
-/* Allocate DMA buffers for the PRU core
- * This method acquires & releases the device mutex */
-static int beaglelogic_memalloc(struct device *dev, uint32_t bufsize)
+/* No argument checking for the map/unmap functions */
+static int beaglelogic_map_buffer(struct device *dev, struct logic_buffer *buf)
+{
+	dma_addr_t dma_addr;
+	u64 t0;
+
+	/* If already mapped, do nothing */
+	if (buf->state == STATE_BL_BUF_MAPPED)
+		return 0;
+
+	t0 = ktime_get_ns();
+	dma_addr = dma_map_single(dev, buf->buf, buf->size, DMA_TO_DEVICE);							// Changed DMA direction 
+	if (dma_mapping_error(dev, dma_addr))
+		goto fail;
+	else {
+		buf->phys_addr = dma_addr;
+		buf->state = STATE_BL_BUF_MAPPED;
+	}
+	trace_beaglelogic_map(buf->index, buf->size, dma_addr,
+			ktime_get_ns() - t0);
+
+	return 0;
+fail:
+	dev_err(dev, "DMA Mapping error. \n");
+	return -1;
+}
+
+static void beaglelogic_unmap_buffer(struct device *dev,
+                                     struct logic_buffer *buf)
+{
+	u64 t0 = ktime_get_ns();
+
+	dma_unmap_single(dev, buf->phys_addr, buf->size, DMA_TO_DEVICE);							// Changed DMA direction
+	buf->state = STATE_BL_BUF_UNMAPPED;
+	trace_beaglelogic_unmap(buf->index, buf->size, buf->phys_addr,
+			ktime_get_ns() - t0);
+}
+
+/* Release one chunk of the pool, with its DMA mapping */
+static void beaglelogic_buffer_free(struct device *dev,
+		struct logic_buffer *buf)
+{
+	if (buf->state == STATE_BL_BUF_MAPPED)
+		beaglelogic_unmap_buffer(dev, buf);
+	kfree(buf->buf);
+	buf->buf = NULL;
+}
+
+/* Bytes in the allocated buffers, 0 if there are none */
+static uint32_t beaglelogic_memsize(struct beaglelogicdev *bldev)
+{
+	if (!bldev->bufcount)
+		return 0;
+
+	return (bldev->bufcount - 1) * bldev->bufunitsize +
+		bldev->buffers[bldev->bufcount - 1].size;
+}
+
+/* Resize the DMA buffers for the PRU core to 'bufsize' bytes in units of
+ * 'unitsize', which becomes bufunitsize. The buffers form a pool that is
+ * kept between runs: a buffer that keeps its index and size keeps its
+ * contents and DMA mapping, one that changes size is resized in place when
+ * its allocation is large enough, and only new memory and the padding of
+ * the last buffer are cleared, so the cost follows the size difference.
+ * (assume mutex is held) */
+static int beaglelogic_memalloc_locked(struct device *dev, uint32_t unitsize,
+		uint32_t bufsize)
 {
 	struct beaglelogicdev *bldev = dev_get_drvdata(dev);
-	int i, cnt;
-	unsigned int AllocSize, modulo;
-	void *buf;
+	struct logic_buffer *buffers, *buf;
+	int i, cnt, reused = 0;
+	unsigned int AllocSize, used;
+	u64 t0 = ktime_get_ns(), total = 0;
 
-	// Check if device is available
-	if (!mutex_trylock(&bldev->mutex))
-		return -EBUSY;
+	if (!bufsize || unitsize < 64)
+		return -EINVAL;
 
 	// Buffer amount to allocate (no ping pong action anymore)
-	cnt = DIV_ROUND_UP(bufsize, bldev->bufunitsize);
+	cnt = DIV_ROUND_UP(bufsize, unitsize);
 
 	if (cnt > bldev->maxbufcount) {
 		dev_err(dev, "Not enough memory\n");
 		return -ENOMEM;
 	}
 
-	bldev->bufcount = cnt;
-
-	bldev->buffers = devm_kzalloc(dev, sizeof(struct logic_buffer) * (cnt),
-			GFP_KERNEL);
-	if (!bldev->buffers)
-		goto failnomem;
+	// Grow or shrink the buffer table, the buffers in both stay in place
+	buffers = bldev->buffers;
+	if (cnt != bldev->bufcount) {
+		buffers = devm_kzalloc(dev, sizeof(struct logic_buffer) * (cnt),
+				GFP_KERNEL);
+		if (!buffers)
+			goto failnomem;
+
+		for (i = cnt; i < bldev->bufcount; i++)
+			beaglelogic_buffer_free(dev, &bldev->buffers[i]);
+
+		if (bldev->buffers) {
+			memcpy(buffers, bldev->buffers,
+				sizeof(struct logic_buffer) *
+				min_t(int, cnt, bldev->bufcount));
+			devm_kfree(dev, bldev->buffers);
+		}
+		bldev->buffers = buffers;
+		bldev->bufcount = cnt;
+	}
+	bldev->bufunitsize = unitsize;
 
 	// DMA buffers allocation. Last (or only) buffer's size can deviate from bufunitsize
 	for (i = 0; i < cnt; i++) {
+		buf = &buffers[i];
+
 		// Last buffer?
 		if (i == (cnt - 1)){
 			// Determine last (or only) buffer's size
-			AllocSize = bufsize - i * bldev->bufunitsize;
-			
+			used = bufsize - i * unitsize;
+
 			// Check buffer's size is an integer value of 64.
 			// If not, append extra memory until it fits an integer of 64.
 			// If this step is omitted, PRU0 shall copy at the end of the last
 			// buffer some data that does not belong to the code, therefore
 			// producing an undesired result.
-			modulo = AllocSize % 64;
-			if (modulo != 0) {
-				AllocSize += (64 - modulo);
-			}
+			AllocSize = round_up(used, 64);
 		} else {
 			// Use bufunitsize
-			AllocSize = bldev->bufunitsize;
+			used = AllocSize = unitsize;
+		}
+
+		// Resized buffer: its mapping covers the old size
+		if (buf->buf && buf->size != AllocSize) {
+			if (buf->state == STATE_BL_BUF_MAPPED)
+				beaglelogic_unmap_buffer(dev, buf);
+
+			if (buf->capacity < AllocSize)
+				beaglelogic_buffer_free(dev, buf);
+			else if (buf->size < AllocSize)
+				memset(buf->buf + buf->size, 0x00,
+						AllocSize - buf->size);
 		}
-				
-		buf = kmalloc(AllocSize, GFP_KERNEL);
-		if (!buf)
-			goto failrelease;
 
-		// Buffer's values set to zero
-		memset(buf, 0x00, AllocSize);
+		if (buf->buf) {
+			reused++;
+		} else {
+			buf->buf = kmalloc(AllocSize, GFP_KERNEL);
+			if (!buf->buf)
+				goto failrelease;
+			buf->capacity = AllocSize;
+
+			// Buffer's values set to zero
+			memset(buf->buf, 0x00, AllocSize);
+			buf->state = STATE_BL_BUF_ALLOC;
+		}
+
+		// The padding is played too, so it must not hold old data
+		if (used < AllocSize) {
+			memset(buf->buf + used, 0x00, AllocSize - used);
+			if (buf->state == STATE_BL_BUF_MAPPED)
+				dma_sync_single_range_for_device(dev,
+						buf->phys_addr, used,
+						AllocSize - used,
+						DMA_TO_DEVICE);
+		}
 
 		// Set specific data buffers
-		bldev->buffers[i].buf = buf;
-		bldev->buffers[i].phys_addr = virt_to_phys(buf);
-		bldev->buffers[i].size = AllocSize;
-		bldev->buffers[i].index = i;
+		if (buf->state != STATE_BL_BUF_MAPPED)
+			buf->phys_addr = virt_to_phys(buf->buf);
+		buf->size = AllocSize;
+		buf->index = i;
+		buf->queued = 0;
+		buf->job = 0;
+		total += AllocSize;
 
 		// Circularly link the buffers  --> Modulo necessary to link last buffer with first buffer
-		bldev->buffers[i].next = &bldev->buffers[(i + 1) % cnt];
+		buf->next = &buffers[(i + 1) % cnt];
 	}
 
-	dev_info(dev, "Allocated %d buffers to allocate %d bytes. %d buffers contain each %d bytes (equals %d bytes in total), the last buffer has %d bytes",
-		cnt, bufsize, cnt-1, bldev->bufunitsize, (cnt-1) * bldev->bufunitsize, bldev->buffers[cnt-1].size);
-	
-	/* Write log and unlock */
-	mutex_unlock(&bldev->mutex);
+	bldev->stream_tail = bldev->buffers;
+	bldev->stream_done = 0;
+
+	trace_beaglelogic_memalloc(cnt, total, ktime_get_ns() - t0);
+
+	dev_info(dev, "Allocated %d buffers to allocate %d bytes. %d buffers contain each %d bytes (equals %d bytes in total), the last buffer has %d bytes, %d buffers reused",
+		cnt, bufsize, cnt-1, unitsize, (cnt-1) * unitsize, buffers[cnt-1].size, reused);
 
 	/* Done */
 	return 0;
 failrelease:
-	for (i = 0; i < cnt; i++) {
-		if (bldev->buffers[i].buf)
-			kfree(bldev->buffers[i].buf);
-	}
-	devm_kfree(dev, bldev->buffers);
+	for (i = 0; i < cnt; i++)
+		beaglelogic_buffer_free(dev, &buffers[i]);
+	devm_kfree(dev, buffers);
 	bldev->bufcount = 0;
 	bldev->buffers = NULL;
+	bldev->stream_tail = NULL;
 	dev_err(dev, "Sample buffer allocation:");
 failnomem:
 	dev_err(dev, "Not enough memory\n");
-	mutex_unlock(&bldev->mutex);
 	return -ENOMEM;
 }
 
+/* Resize the DMA buffers, see beaglelogic_memalloc_locked. This method
+ * acquires & releases the device mutex */
+static int beaglelogic_memalloc(struct device *dev, uint32_t unitsize,
+		uint32_t bufsize)
+{
+	struct beaglelogicdev *bldev = dev_get_drvdata(dev);
+	int ret;
+
+	// Check if device is available
+	if (!mutex_trylock(&bldev->mutex))
+		return -EBUSY;
+
+	ret = beaglelogic_memalloc_locked(dev, unitsize, bufsize);
+	mutex_unlock(&bldev->mutex);
+	return ret;
+}
+
 /* Frees the DMA buffers and the bufferlist */
 static void beaglelogic_memfree(struct device *dev)
 {
 	struct beaglelogicdev *bldev = dev_get_drvdata(dev);
+	u64 t0 = ktime_get_ns();
+	uint32_t total;
 	int i;
 
 	mutex_lock(&bldev->mutex);
 	if (bldev->buffers) {
+		total = beaglelogic_memsize(bldev);
 		for (i = 0; i < bldev->bufcount; i++)
-			if (bldev->buffers[i].buf)
-				kfree(bldev->buffers[i].buf);
+			beaglelogic_buffer_free(dev, &bldev->buffers[i]);
 
+		trace_beaglelogic_memfree(bldev->bufcount, total,
+				ktime_get_ns() - t0);
 		devm_kfree(dev, bldev->buffers);
 		bldev->buffers = NULL;
 		bldev->bufcount = 0;
+		bldev->stream_tail = NULL;
 	}
+	kfree(bldev->swap_buf.buf);
+	bldev->swap_buf.buf = NULL;
+	bldev->swap_buf.size = 0;
 	mutex_unlock(&bldev->mutex);
 }
 
-/* No argument checking for the map/unmap functions */
-static int beaglelogic_map_buffer(struct device *dev, struct logic_buffer *buf)
+/* Write buffer table to the PRU memory, and null terminate. In stream mode
+ * only the queued buffers are valid; in stream and loop mode the terminator
+ * links back to the first entry. Each entry carries the sample period of
+ * its buffer. NOTE: PRUs are halted at this time */
+static void beaglelogic_submit_list(struct beaglelogicdev *bldev)
 {
-	dma_addr_t dma_addr;
-
-	/* If already mapped, do nothing */
-	if (buf->state == STATE_BL_BUF_MAPPED)
-		return 0;
+	struct buflist *pru_buflist = &bldev->cxt_pru->list_head;
+	struct logic_buffer *buf;
+	int i;
 
-	dma_addr = dma_map_single(dev, buf->buf, buf->size, DMA_TO_DEVICE);							// Changed DMA direction 
-	if (dma_mapping_error(dev, dma_addr))
-		goto fail;
-	else {
-		buf->phys_addr = dma_addr;
-		buf->state = STATE_BL_BUF_MAPPED;
+	for (i = 0; i < bldev->bufcount; i++) {
+		buf = &bldev->buffers[i];
+		if (bldev->stream) {
+			pru_buflist[i].dma_start_addr = buf->queued ?
+				buf->phys_addr : 0;
+			pru_buflist[i].dma_end_addr = buf->phys_addr +
+				buf->queued;
+		} else {
+			pru_buflist[i].dma_start_addr = buf->phys_addr;
+			pru_buflist[i].dma_end_addr = buf->phys_addr +
+				buf->size;
+		}
+		pru_buflist[i].clk = beaglelogic_clock_word(
+				beaglelogic_buffer_period(bldev, i));
 	}
-
-	return 0;
-fail:
-	dev_err(dev, "DMA Mapping error. \n");
-	return -1;
-}
-
-static void beaglelogic_unmap_buffer(struct device *dev,
-                                     struct logic_buffer *buf)
-{
-	dma_unmap_single(dev, buf->phys_addr, buf->size, DMA_TO_DEVICE);							// Changed DMA direction
-	buf->state = STATE_BL_BUF_UNMAPPED;
+	pru_buflist[i].dma_start_addr = 0;
+	pru_buflist[i].dma_end_addr = bldev->stream || bldev->loop ?
+		BL_LIST_LINK : 0;
+	pru_buflist[i].clk = 0;
 }
 
 /* Map all the buffers. This is done just before beginning a waveform generation
@@ -322,30 +889,24 @@ static void beaglelogic_unmap_buffer(struct device *dev,
 static int beaglelogic_map_and_submit_all_buffers(struct device *dev)
 {
 	struct beaglelogicdev *bldev = dev_get_drvdata(dev);
-	struct buflist *pru_buflist = &bldev->cxt_pru->list_head;
+	u64 t0 = ktime_get_ns(), total = 0;
 	int i, j;
-	dma_addr_t addr;
 
-	if (!pru_buflist)
+	if (!bldev->cxt_pru)
 		return -1;
 
 	for (i = 0; i < bldev->bufcount;i++) {
 		if (beaglelogic_map_buffer(dev, &bldev->buffers[i]))
 			goto fail;
+		total += bldev->buffers[i].size;
 	}
 
-	/* Write buffer table to the PRU memory, and null terminate */
-	for (i = 0; i < bldev->bufcount; i++) {
-		addr = bldev->buffers[i].phys_addr;
-		pru_buflist[i].dma_start_addr = addr;
-		pru_buflist[i].dma_end_addr = addr + bldev->buffers[i].size;
-	}
-	pru_buflist[i].dma_start_addr = 0;
-	pru_buflist[i].dma_end_addr = 0;
+	beaglelogic_submit_list(bldev);
+	trace_beaglelogic_submit(i, total, ktime_get_ns() - t0);
 
 	/* Update state to ready */
 	if (i)
-		bldev->state = STATE_BL_ARMED;
+		beaglelogic_set_state(bldev, STATE_BL_ARMED);
 
 	return 0;
 fail:
@@ -355,122 +916,903 @@ fail:
 
 	dev_err(dev, "DMA Mapping failed at i=%d\n", i);
 
-	bldev->state = STATE_BL_ERROR;
+	beaglelogic_set_state(bldev, STATE_BL_ERROR);
 	return 1;
 }
 
-/* End Buffer Management section */
-
-/* Send command to the PRU firmware */
-static int beaglelogic_send_cmd(struct beaglelogicdev *bldev, uint32_t cmd)
+/* Change the allocation unit. Allocated buffers are cut into the new unit
+ * right away, reusing their memory; if that needs more than maxbufcount
+ * buffers they are freed and have to be allocated again */
+static int beaglelogic_set_bufunitsize(struct device *dev, uint32_t val)
 {
-#define TIMEOUT     200
-	uint32_t timeout = TIMEOUT;
+	struct beaglelogicdev *bldev = dev_get_drvdata(dev);
+	uint32_t size;
+	int ret;
 
-	bldev->cxt_pru->cmd = cmd;
+	val = round_up(val, 64);
 
-	/* Wait for firmware to process the command */
-	while (--timeout && bldev->cxt_pru->cmd != 0)
-		cpu_relax();
+	/* The list PRU0 reads changes along with the buffers, so both happen
+	 * under one hold of the mutex that a start takes */
+	if (!mutex_trylock(&bldev->mutex))
+		return -EBUSY;
+	size = beaglelogic_memsize(bldev);
+	if (size && DIV_ROUND_UP(size, val) <= bldev->maxbufcount) {
+		ret = beaglelogic_memalloc_locked(dev, val, size);
+		if (!ret)
+			beaglelogic_map_and_submit_all_buffers(dev);
+		mutex_unlock(&bldev->mutex);
+		return ret;
+	}
+	mutex_unlock(&bldev->mutex);
 
-	if (timeout == 0)
-		return -1;
+	beaglelogic_memfree(dev);
+	bldev->bufunitsize = val;
+	return 0;
+}
+
+/* Stream mode: forget everything queued, the writer starts over at the
+ * first buffer. NOTE: PRUs are halted at this time */
+static void beaglelogic_stream_reset(struct beaglelogicdev *bldev)
+{
+	unsigned long flags;
+	int i;
 
-	return bldev->cxt_pru->resp;
+	spin_lock_irqsave(&bldev->stream_lock, flags);
+	for (i = 0; i < bldev->bufcount; i++) {
+		bldev->buffers[i].queued = 0;
+		bldev->buffers[i].job = 0;
+	}
+	bldev->stream_tail = bldev->buffers;
+	bldev->stream_done = 0;
+	bldev->stream_eof = 0;
+	bldev->stream_dry = 0;
+	bldev->jobs_queued = 0;
+	bldev->jobs_done = 0;
+	bldev->start_ns = 0;
+	if (bldev->buffers)
+		beaglelogic_submit_list(bldev);
+	spin_unlock_irqrestore(&bldev->stream_lock, flags);
 }
 
-/* Request the PRU firmware to stop capturing */
-static void beaglelogic_request_stop(struct beaglelogicdev *bldev)
+/* Stream mode: hand 'len' bytes of a filled buffer to PRU0. The end address
+ * goes first, PRU0 takes the entry as soon as the start address is set */
+static void beaglelogic_stream_queue(struct beaglelogicdev *bldev,
+		struct logic_buffer *buf, uint32_t len)
 {
-	/* Trigger interrupt */
-	pruss_intc_trigger(bldev->to_bl_irq);
+	struct buflist *entry = &bldev->cxt_pru->list_head + buf->index;
+	unsigned long flags;
+
+	spin_lock_irqsave(&bldev->stream_lock, flags);
+	entry->dma_end_addr = buf->phys_addr + len;
+	wmb();
+	entry->dma_start_addr = buf->phys_addr;
+	buf->queued = len;
+	spin_unlock_irqrestore(&bldev->stream_lock, flags);
 }
 
-/* This is [to be] called from a threaded IRQ handler */
-irqreturn_t beaglelogic_serve_irq(int irqno, void *data)
+/* Stream mode: account for the oldest queued buffer having been played,
+ * and for the job it ends. Call with stream_lock held */
+static void beaglelogic_stream_retire(struct beaglelogicdev *bldev)
 {
-	struct beaglelogicdev *bldev = data;
-	struct device *dev = bldev->miscdev.this_device;
-	uint32_t state = bldev->state;
-	unsigned int i;
-	
-	dev_dbg(dev, "Beaglelogic IRQ #%d\n", irqno);
-	if (irqno == bldev->from_bl_irq_1) {
-		
-		// Unmap all buffers and change state
-		for(i = 0; i < bldev->bufcount; i++){
-				beaglelogic_unmap_buffer(dev, &bldev->buffers[i]);
-		}	
-		
-		bldev->state = STATE_BL_INITIALIZED;
-		wake_up_interruptible(&bldev->wait);
-	} else if (irqno == bldev->from_bl_irq_2) {	// Now only used when PRU1 'configuration' is done
-		state = bldev->state;
-		if (state <= STATE_BL_ARMED) {
-			dev_dbg(dev, "config written, BeagleLogic ready\n");
-			return IRQ_HANDLED;
-		}
-		else if (state != STATE_BL_REQUEST_STOP &&
-				state != STATE_BL_RUNNING) {
-			dev_err(dev, "Unexpected stop request \n");
-			bldev->state = STATE_BL_ERROR;
-			return IRQ_HANDLED;
-		}
-		bldev->state = STATE_BL_INITIALIZED;
-		wake_up_interruptible(&bldev->wait);
+	struct logic_buffer *buf = bldev->stream_tail;
+
+	bldev->stream_done += buf->queued;
+	buf->queued = 0;
+	if (buf->job) {
+		bldev->jobs_done = buf->job;
+		buf->job = 0;
 	}
-	return IRQ_HANDLED;
+	bldev->stream_tail = buf->next;
 }
 
-/* Write configuration into the PRU [via downcall] (assume mutex is held) */
-// Not necessary anymore in transmitter setup as most sysfs attributes are omitted.
-int beaglelogic_write_configuration(struct device *dev)
+/* Stream mode: collect the buffers PRU0 has handed back, oldest first.
+ * Called from the PRU0_TO_ARM_C IRQ and from the writer */
+static void beaglelogic_stream_reap(struct beaglelogicdev *bldev)
 {
-	struct beaglelogicdev *bldev = dev_get_drvdata(dev);
-	int ret;
-
-	ret = beaglelogic_send_cmd(bldev, CMD_SET_CONFIG);
+	struct buflist *list = &bldev->cxt_pru->list_head;
+	struct logic_buffer *buf;
+	unsigned long flags;
 
-	dev_dbg(dev, "PRU Config written, err code = %d\n", ret);
-	return 0;
+	spin_lock_irqsave(&bldev->stream_lock, flags);
+	while ((buf = bldev->stream_tail) && buf->queued &&
+			!READ_ONCE(list[buf->index].dma_start_addr))
+		beaglelogic_stream_retire(bldev);
+	spin_unlock_irqrestore(&bldev->stream_lock, flags);
 }
 
-/* Begin the waveform generation [This takes the mutex] */
-int beaglelogic_start(struct device *dev)
+static int beaglelogic_stream_free(struct beaglelogicdev *bldev,
+		struct logic_buffer *buf)
 {
-	struct beaglelogicdev *bldev = dev_get_drvdata(dev);
+	beaglelogic_stream_reap(bldev);
+	return !buf->queued || bldev->state != STATE_BL_RUNNING;
+}
 
-	/* This mutex will be locked for the entire duration BeagleLogic runs */
-	mutex_lock(&bldev->mutex);
-	if (beaglelogic_write_configuration(dev)) {
-		mutex_unlock(&bldev->mutex);
-		return -1;
-	}
-	bldev->bufbeingread = &bldev->buffers[0];
-	beaglelogic_send_cmd(bldev, CMD_START);
+/* Stream mode: wait until PRU0 has handed 'buf' back. Returns 1 when the
+ * ring is full and playback needs a start, -EPIPE once a run ran dry */
+static int beaglelogic_stream_wait(struct beaglelogicdev *bldev,
+		struct logic_buffer *buf, int nonblock)
+{
+	int ret;
 
-	/* All set now. Start the PRUs and wait for IRQs */
-	bldev->state = STATE_BL_RUNNING;
-	bldev->lasterror = 0;
+	if (beaglelogic_stream_free(bldev, buf) && !buf->queued)
+		return 0;
+	if (bldev->state != STATE_BL_RUNNING)
+		return bldev->stream_dry ? -EPIPE : 1;
+	if (nonblock)
+		return -EAGAIN;
 
-	dev_info(dev, "Waveform generation started");
-	return 0;
+	ret = wait_event_interruptible(bldev->wait,
+			beaglelogic_stream_free(bldev, buf));
+	if (ret)
+		return ret;
+	return buf->queued ? -EPIPE : 0;
 }
 
-/* Request stop. Stop will effect only after the last buffer is written out */
-void beaglelogic_stop(struct device *dev)
+/* Loop mode: account for a posted swap. Once PRU0 has cleared swap_entry
+ * the spare is in the list and the buffer it replaced is free; a swap
+ * still posted when the run ends is withdrawn. Called from the IRQs */
+static void beaglelogic_swap_update(struct beaglelogicdev *bldev, int ended)
 {
-	struct beaglelogicdev *bldev = dev_get_drvdata(dev);
-
-	if (mutex_is_locked(&bldev->mutex)) {
+	struct device *dev = bldev->miscdev.this_device;
+	struct capture_context *cxt = bldev->cxt_pru;
+	struct logic_buffer *buf, *spare = &bldev->swap_buf, tmp;
+	unsigned long flags;
+
+	spin_lock_irqsave(&bldev->stream_lock, flags);
+	if (!bldev->swap_pending) {
+		spin_unlock_irqrestore(&bldev->stream_lock, flags);
+		return;
+	}
+
+	if (READ_ONCE(cxt->swap_entry)) {
+		if (ended) {
+			cxt->swap_entry = 0;
+			bldev->swap_iter = -ECANCELED;
+			bldev->swap_pending = 0;
+			beaglelogic_unmap_buffer(dev, spare);
+		}
+	} else {
+		/* Trade places, the index and ring links stay */
+		buf = &bldev->buffers[bldev->swap_index];
+		tmp = *buf;
+		buf->buf = spare->buf;
+		buf->phys_addr = spare->phys_addr;
+		buf->size = spare->size;
+		buf->state = spare->state;
+		spare->buf = tmp.buf;
+		spare->phys_addr = tmp.phys_addr;
+		spare->size = tmp.size;
+		spare->state = tmp.state;
+
+		bldev->swap_iter = cxt->swap_iter;
+		bldev->swap_pending = 0;
+		beaglelogic_unmap_buffer(dev, spare);
+	}
+	spin_unlock_irqrestore(&bldev->stream_lock, flags);
+}
+
+/* Loop mode: replace the contents of buffer 'index'. While idle the data
+ * goes straight into the buffer. While playing, it goes into the spare,
+ * which is posted to PRU0 for the next loop boundary */
+static int beaglelogic_swap_segment(struct beaglelogicdev *bldev,
+		const struct beaglelogic_swap *req)
+{
+	struct device *dev = bldev->miscdev.this_device;
+	struct capture_context *cxt = bldev->cxt_pru;
+	struct logic_buffer *buf, *spare = &bldev->swap_buf;
+	const void __user *data = u64_to_user_ptr(req->data);
+	int ret = 0;
+
+	if (!bldev->loop || req->index >= bldev->bufcount)
+		return -EINVAL;
+
+	mutex_lock(&bldev->swap_mutex);
+	buf = &bldev->buffers[req->index];
+	if (req->length != buf->size) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	if (bldev->state == STATE_BL_REQUEST_STOP) {
+		ret = -EBUSY;
+		goto out;
+	}
+	if (bldev->state != STATE_BL_RUNNING) {
+		if (copy_from_user(buf->buf, data, req->length))
+			ret = -EFAULT;
+		bldev->swap_iter = 0;
+		goto out;
+	}
+
+	/* The previous swap has to be applied first */
+	if (bldev->swap_pending) {
+		ret = -EBUSY;
+		goto out;
+	}
+
+	if (spare->size < req->length) {
+		kfree(spare->buf);
+		spare->buf = kmalloc(bldev->bufunitsize, GFP_KERNEL);
+		spare->size = spare->buf ? bldev->bufunitsize : 0;
+		spare->state = STATE_BL_BUF_UNMAPPED;
+		if (!spare->buf) {
+			ret = -ENOMEM;
+			goto out;
+		}
+	}
+	spare->size = req->length;
+	if (copy_from_user(spare->buf, data, req->length)) {
+		ret = -EFAULT;
+		goto out;
+	}
+
+	/* Mapping cleans the new data out of the CPU cache */
+	if (beaglelogic_map_buffer(dev, spare)) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	/* The addresses go first, PRU0 takes the swap once the entry is set */
+	bldev->swap_index = req->index;
+	bldev->swap_pending = 1;
+	cxt->swap_start = spare->phys_addr;
+	cxt->swap_end = spare->phys_addr + spare->size;
+	wmb();
+	cxt->swap_entry = offsetof(struct capture_context, list_head) +
+		req->index * sizeof(struct buflist);
+out:
+	mutex_unlock(&bldev->swap_mutex);
+	return ret;
+}
+
+/* Loop mode: wait for the last swap, returns the first iteration that
+ * played it (0 if it was made while idle) */
+static int beaglelogic_wait_swap(struct beaglelogicdev *bldev,
+		uint32_t *iter, int nonblock)
+{
+	int ret;
+
+	if (!bldev->loop)
+		return -EINVAL;
+	if (bldev->swap_pending && nonblock)
+		return -EAGAIN;
+
+	ret = wait_event_interruptible(bldev->wait, !bldev->swap_pending);
+	if (ret)
+		return ret;
+	if (bldev->swap_iter < 0)
+		return bldev->swap_iter;
+	*iter = bldev->swap_iter;
+	return 0;
+}
+
+/* End Buffer Management section */
+
+/* Begin generator section */
+
+/* Lags of s[t] = s[t - a] ^ s[t - b] for the trinomial x^b + x^a + 1 */
+static int beaglelogic_gen_lags(const struct beaglelogic_generator *g,
+		int *a, int *b)
+{
+	uint32_t rest;
+
+	if (!(g->prbs_poly & 1) || !(g->prbs_poly >> 1))
+		return -EINVAL;
+	*b = fls(g->prbs_poly) - 1;
+	rest = g->prbs_poly & ~(BIT(*b) | 1);
+	if (!is_power_of_2(rest))
+		return -EINVAL;
+	*a = __ffs(rest);
+	if (!(g->prbs_seed & (BIT(*b) - 1)))
+		return -EINVAL;
+	return 0;
+}
+
+/*
+ * PRU0 makes 32 bits of the sequence from the previous 32 in two shift/XOR
+ * rounds, the first of which gets the bits below a right. Since
+ * s[t] = s[t - 2a] ^ s[t - 2b] as well, the lags are doubled while b stays
+ * below 32; x^7 + x^6 + 1 becomes 24 and 28. The polynomial must have
+ * a >= 16 after that.
+ */
+static int beaglelogic_gen_prbs(const struct beaglelogic_generator *g,
+		union bl_gen_state *st)
+{
+	uint32_t prev = 0, seq;
+	int a, b, k = 1, i, ret;
+
+	ret = beaglelogic_gen_lags(g, &a, &b);
+	if (ret)
+		return ret;
+
+	while (2 * k * b <= 31)
+		k *= 2;
+	if (k * a < 16)
+		return -EINVAL;
+	st->taps = k * a | (k * b) << 8 | (32 - k * a) << 16 |
+		(32 - k * b) << 24;
+
+	/* The 32 bits before the seed, running the recurrence backwards:
+	 * s[t - 1] = s[t + b - 1] ^ s[t + b - 1 - a]. Bit j of seq is s[t + j] */
+	seq = g->prbs_seed & (BIT(b) - 1);
+	for (i = 0; i < 32; i++) {
+		uint32_t bit = ((seq >> (b - 1)) ^ (seq >> (b - 1 - a))) & 1;
+
+		seq = ((seq << 1) | bit) & (BIT(b) - 1);
+		prev |= bit << (31 - i);
+	}
+	st->prbs = prev;
+	return 0;
+}
+
+/* Loop length of channel 'ch' in samples */
+static u64 beaglelogic_gen_period(const struct beaglelogic_generator *g,
+		int ch, int prbs_bits)
+{
+	switch ((g->channels >> (4 * ch)) & ~BL_GEN_INVERT & 0xF) {
+	case BL_GEN_PRBS:
+		return BIT_ULL(prbs_bits) - 1;
+	case BL_GEN_COUNT:
+		return (u64)g->count_div << (ch + 1);
+	case BL_GEN_PATTERN:
+		return g->pattern_len[ch];
+	}
+	return 1;
+}
+
+/* A table of L / gcd(L, 8) words loops over L samples */
+static u64 beaglelogic_gen_table_words(u64 period)
+{
+	return div64_u64(period, min_t(u64, period & -period, 8));
+}
+
+/* Level of channel 'ch' at sample t. prbs holds the sequence from its
+ * start, the channels take consecutive bits */
+static int beaglelogic_gen_level(const struct beaglelogic_generator *g,
+		const unsigned long *prbs, const u8 *pattern, int ch, u32 t)
+{
+	uint32_t src = (g->channels >> (4 * ch)) & 0xF;
+	int bit = 0;
+
+	switch (src & ~BL_GEN_INVERT) {
+	case BL_GEN_HIGH:
+		bit = 1;
+		break;
+	case BL_GEN_PRBS:
+		bit = test_bit(4 * t + ch, prbs);
+		break;
+	case BL_GEN_COUNT:
+		bit = (((g->count_start + t / g->count_div) & 0xF) >> ch) & 1;
+		break;
+	case BL_GEN_PATTERN:
+		bit = (pattern[t / 8] >> (t % 8)) & 1;
+		break;
+	}
+	return bit ^ !!(src & BL_GEN_INVERT);
+}
+
+/*
+ * Table mode: every channel loops over its own table in shared RAM, so
+ * loop lengths of 7, 11, 13 and 17 samples take 48 words instead of an
+ * expansion to 17017 samples. The other sources are turned into tables as
+ * well; a PRBS loops over 2^b - 1 samples.
+ */
+static int beaglelogic_gen_tables(const struct beaglelogic_generator *g,
+		u8 *const pattern[BL_CHANNELS], union bl_gen_state *st,
+		u32 **table, uint32_t *table_words)
+{
+	unsigned long *prbs = NULL;
+	u64 period[BL_CHANNELS], words = 0, len;
+	int a = 0, b = 0, ch, i, ret;
+	u32 *tab, w, t;
+
+	ret = beaglelogic_gen_lags(g, &a, &b);
+	if (ret)
+		return ret;
+
+	for (ch = 0; ch < BL_CHANNELS; ch++) {
+		period[ch] = beaglelogic_gen_period(g, ch, b);
+		words += beaglelogic_gen_table_words(period[ch]);
+	}
+	if (words > BL_GEN_TABLE_WORDS)
+		return -ENOSPC;
+
+	tab = kmalloc_array(words, sizeof(u32), GFP_KERNEL);
+	if (!tab)
+		return -ENOMEM;
+
+	/* The PRBS bits the channels use, from the seed on */
+	for (ch = 0; ch < BL_CHANNELS; ch++) {
+		if (((g->channels >> (4 * ch)) & ~BL_GEN_INVERT & 0xF) !=
+				BL_GEN_PRBS)
+			continue;
+		len = 4 * period[ch] + BL_CHANNELS;
+		prbs = kcalloc(BITS_TO_LONGS(len), sizeof(long), GFP_KERNEL);
+		if (!prbs) {
+			kfree(tab);
+			return -ENOMEM;
+		}
+		for (t = 0; t < len; t++)
+			if (t < b ? (g->prbs_seed >> t) & 1 :
+					test_bit(t - a, prbs) ^
+					test_bit(t - b, prbs))
+				__set_bit(t, prbs);
+		break;
+	}
+
+	for (ch = 0, words = 0; ch < BL_CHANNELS; ch++) {
+		len = beaglelogic_gen_table_words(period[ch]);
+		for (w = 0; w < len; w++) {
+			u32 lane = 0;
+
+			for (i = 0; i < 8; i++) {
+				t = (8 * w + i) % (u32)period[ch];
+				lane |= beaglelogic_gen_level(g, prbs,
+						pattern[ch], ch, t) <<
+					(4 * i + ch);
+			}
+			tab[words + w] = lane;
+		}
+		st->table[ch].pos = len * sizeof(u32) << 16;
+		st->table[ch].addr = BL_PRU_SHARED_ADDR + words * sizeof(u32);
+		words += len;
+	}
+
+	kfree(prbs);
+	*table = tab;
+	*table_words = words;
+	return 0;
+}
+
+/* Set up generator mode while the PRUs are idle. The state words reach
+ * PRU0 with the next CMD_SET_CONFIG, the tables with them. 'pattern' holds
+ * the bits of BL_GEN_PATTERN channels, sample 0 in bit 0 of the first byte.
+ * This method acquires & releases the device mutex */
+static int beaglelogic_set_generator(struct beaglelogicdev *bldev,
+		const struct beaglelogic_generator *g,
+		u8 *const pattern[BL_CHANNELS])
+{
+	union bl_gen_state st = { 0 };
+	uint32_t src, lane, tables = 0, table_words = 0;
+	u32 *table = NULL;
+	int i, ch, ret;
+
+	if (g->enable > 1 || (g->enable && (bldev->stream || bldev->loop ||
+			bldev->edge || bldev->index_dict.buf || bldev->cap_buf ||
+			bldev->sums)))
+		return -EINVAL;
+
+	for (ch = 0; g->enable && ch < BL_CHANNELS; ch++) {
+		src = (g->channels >> (4 * ch)) & 0xF;
+		lane = 0x11111111 << ch;
+		switch (src & ~BL_GEN_INVERT) {
+		case BL_GEN_LOW:
+			break;
+		case BL_GEN_HIGH:
+			st.invert ^= lane;
+			break;
+		case BL_GEN_PRBS:
+			st.prbs_mask |= lane;
+			break;
+		case BL_GEN_COUNT:
+			st.count_mask |= lane;
+			break;
+		case BL_GEN_PATTERN:
+			if (!g->pattern_len[ch] || !pattern[ch])
+				return -EINVAL;
+			tables = 1;
+			break;
+		default:
+			return -EINVAL;
+		}
+		if (src & BL_GEN_INVERT)
+			st.invert ^= lane;
+	}
+
+	if (g->enable) {
+		if (!is_power_of_2(g->count_div))
+			return -EINVAL;
+
+		if (tables) {
+			memset(&st, 0, sizeof(st));
+			ret = beaglelogic_gen_tables(g, pattern, &st, &table,
+					&table_words);
+			if (ret)
+				return ret;
+		} else {
+			ret = beaglelogic_gen_prbs(g, &st);
+			if (ret)
+				return ret;
+
+			st.inc = 0x80000000 / g->count_div;
+			st.count = ((g->count_start & 0xF) << 28) - st.inc;
+			for (i = 0; g->count_div < 8 && i < 8; i++)
+				st.pattern |= (i / g->count_div) << (4 * i);
+		}
+	}
+
+	if (!mutex_trylock(&bldev->mutex)) {
+		kfree(table);
+		return -EBUSY;
+	}
+
+	bldev->gen = *g;
+	bldev->gen_state = st;
+	kfree(bldev->gen_table);
+	bldev->gen_table = table;
+	bldev->gen_table_words = table_words;
+
+	mutex_unlock(&bldev->mutex);
+	return 0;
+}
+
+/* Blocks of 128 samples PRU0 generates, 0xFFFFFFFF until stopped */
+static uint32_t beaglelogic_gen_blocks(const struct beaglelogic_generator *g)
+{
+	u64 blocks = DIV_ROUND_UP_ULL(g->samples, 128);
+
+	if (!g->samples || blocks >= 0xFFFFFFFF)
+		return 0xFFFFFFFF;
+	return blocks;
+}
+
+/* End generator section */
+
+/* Send command to the PRU firmware and sleep until PRU0 replies.
+ * PRU0 writes the response, clears cmd and raises PRU0_TO_ARM_B; it also
+ * services commands in between data blocks while a waveform plays. */
+static int beaglelogic_send_cmd(struct beaglelogicdev *bldev, uint32_t cmd)
+{
+	unsigned long flags;
+	u64 now;
+	int ret;
+
+	mutex_lock(&bldev->cmd_mutex);
+	reinit_completion(&bldev->cmd_done);
+
+	bldev->cxt_pru->cmd = cmd;
+
+	/* A scheduled start counts from the doorbell, which PRU0 answers
+	 * within a microsecond; nothing may come in between */
+	local_irq_save(flags);
+	now = ktime_get_ns();
+	if (cmd == CMD_START) {
+		bldev->start_cmd_ns = now;
+		bldev->cxt_pru->start_delay = !bldev->start_deadline ? 0 :
+			bldev->start_deadline <= now ? 1 :
+			div_u64(bldev->start_deadline - now, BL_PRU_CYCLE_NS);
+	}
+
+	/* Ring the doorbell only once the command is visible to PRU0 */
+	wmb();
+	pruss_intc_trigger(bldev->to_bl_irq);
+	local_irq_restore(flags);
+
+	if (!wait_for_completion_timeout(&bldev->cmd_done,
+				msecs_to_jiffies(BL_CMD_TIMEOUT_MS))) {
+		/* Withdraw the command so a late reply cannot be mistaken */
+		bldev->cxt_pru->cmd = 0;
+		ret = -ETIMEDOUT;
+	} else
+		ret = bldev->cxt_pru->resp;
+
+	mutex_unlock(&bldev->cmd_mutex);
+	trace_beaglelogic_cmd(cmd, ret, ktime_get_ns() - now);
+	return ret;
+}
+
+/* Request the PRU firmware to stop capturing */
+static void beaglelogic_request_stop(struct beaglelogicdev *bldev)
+{
+	struct capture_context *cxt = bldev->cxt_pru;
+
+	/* Loop mode: end with the iteration being read, PRU0 checks the
+	 * count at every loop boundary */
+	if (bldev->loop)
+		cxt->loop_count = READ_ONCE(cxt->loop_iter) + 1;
+
+	/* Generator mode: end with the block being computed */
+	if (bldev->gen.enable)
+		cxt->gen_blocks = READ_ONCE(cxt->gen_block) + 1;
+
+	/* Trigger interrupt */
+	pruss_intc_trigger(bldev->to_bl_irq);
+}
+
+/* Stream mode: account for the run having ended. PRU0 stops at the first
+ * entry that was not queued; unless the writer flushed the end of the
+ * stream, the writer was too late */
+static void beaglelogic_stream_end(struct beaglelogicdev *bldev)
+{
+	struct device *dev = bldev->miscdev.this_device;
+	struct logic_buffer *buf;
+	unsigned long flags;
+	uint32_t entry;
+
+	beaglelogic_stream_reap(bldev);
+
+	/* The last buffer played is not handed back. It is the oldest one
+	 * still queued, unless it was queued just after PRU0 found it empty */
+	spin_lock_irqsave(&bldev->stream_lock, flags);
+	buf = bldev->stream_tail;
+	entry = offsetof(struct capture_context, list_head) +
+		(buf ? buf->index : 0) * sizeof(struct buflist);
+	if (buf && buf->queued && bldev->cxt_pru->prog_entry != entry)
+		beaglelogic_stream_retire(bldev);
+	spin_unlock_irqrestore(&bldev->stream_lock, flags);
+
+	if (!bldev->stream_eof) {
+		buf = bldev->stream_tail;
+		bldev->stream_dry = 1;
+		bldev->lasterror = 0x10000 | (buf ? buf->index : 0);
+		dev_warn(dev, "Stream ran dry after %llu bytes\n",
+				bldev->stream_done);
+	}
+}
+
+/* Account for the end of a run, from the PRU0_TO_ARM_A handler or once
+ * the watchdog has stopped the PRUs. The caller sets the state */
+static void beaglelogic_run_end(struct beaglelogicdev *bldev)
+{
+	struct device *dev = bldev->miscdev.this_device;
+	unsigned int i;
+	uint32_t lat;
+
+	// A swap applied at the last boundaries trades buffers first
+	if (bldev->loop)
+		beaglelogic_swap_update(bldev, 1);
+
+	// Unmap all buffers
+	for(i = 0; i < bldev->bufcount; i++){
+			beaglelogic_unmap_buffer(dev, &bldev->buffers[i]);
+	}	
+	if (bldev->index_dict.buf)
+		beaglelogic_unmap_buffer(dev, &bldev->index_dict);
+
+	// Keep the worst DDR read time seen for the rate model
+	lat = bldev->cxt_pru->ddr_lat_max * BL_PRU_CYCLE_NS;
+	if (lat > bldev->ddrlatency_max)
+		bldev->ddrlatency_max = lat;
+
+	if (bldev->stream)
+		beaglelogic_stream_end(bldev);
+
+	beaglelogic_clock_check(bldev);
+
+	if (bldev->edge && bldev->cxt_pru->edge_late)
+		dev_warn(dev, "%u edges played late\n",
+				bldev->cxt_pru->edge_late);
+
+	bldev->stop_ns = ktime_get_ns();
+	trace_beaglelogic_run_end(bldev->cxt_pru->clk_blocks +
+			bldev->cxt_pru->gen_block,
+			bldev->stop_ns > bldev->start_ns ?
+			bldev->stop_ns - bldev->start_ns : 0,
+			bldev->lasterror);
+}
+
+/* This is [to be] called from a threaded IRQ handler */
+irqreturn_t beaglelogic_serve_irq(int irqno, void *data)
+{
+	struct beaglelogicdev *bldev = data;
+	struct device *dev = bldev->miscdev.this_device;
+	uint32_t state = bldev->state;
+	
+	dev_dbg(dev, "Beaglelogic IRQ #%d\n", irqno);
+	trace_beaglelogic_irq(irqno == bldev->from_bl_irq_1 ? 1 :
+			irqno == bldev->from_bl_irq_2 ? 2 : 3, state);
+	if (irqno == bldev->from_bl_irq_1) {
+		beaglelogic_run_end(bldev);
+		beaglelogic_set_state(bldev, STATE_BL_INITIALIZED);
+		wake_up_interruptible(&bldev->wait);
+	} else if (irqno == bldev->from_bl_irq_2) {
+		/* Command reply from PRU0. PRU1 raises the same event once its
+		 * configuration is loaded, while the command is still pending */
+		if (bldev->cxt_pru->cmd == 0)
+			complete(&bldev->cmd_done);
+		else
+			dev_dbg(dev, "config written, state %d\n", state);
+	} else if (irqno == bldev->from_bl_irq_3) {
+		/* PRU0 has read a buffer completely, or in loop mode,
+		 * applied a segment swap */
+		beaglelogic_clock_check(bldev);
+		if (bldev->stream) {
+			beaglelogic_stream_reap(bldev);
+			wake_up_interruptible(&bldev->wait);
+		} else if (bldev->loop) {
+			beaglelogic_swap_update(bldev, 0);
+			wake_up_interruptible(&bldev->wait);
+		}
+	}
+	return IRQ_HANDLED;
+}
+
+/* Write configuration into the PRU [via downcall] (assume mutex is held).
+ * Returns 0, or the error of a command that timed out or was refused */
+int beaglelogic_write_configuration(struct device *dev)
+{
+	struct beaglelogicdev *bldev = dev_get_drvdata(dev);
+	struct capture_context *cxt = bldev->cxt_pru;
+	int ret;
+
+	/* Generator mode is selected along with the configuration */
+	cxt->gen_blocks = bldev->gen.enable ?
+		beaglelogic_gen_blocks(&bldev->gen) : 0;
+	cxt->gen_block = 0;
+	cxt->gen_tables = bldev->gen_table_words;
+	cxt->edge = bldev->edge;
+	cxt->edge_late = 0;
+	cxt->clk_int = beaglelogic_clock_word(bldev->clk_period);
+	cxt->cap_start = bldev->cap_buf ? bldev->cap_dma : 0;
+	cxt->cap_end = cxt->cap_start + bldev->cap_size;
+	cxt->cap_mask = bldev->cap_mask;
+	cxt->sum_enable = bldev->sums;
+	cxt->gen = bldev->gen_state;
+	if (bldev->gen_table)
+		memcpy(bldev->sharedram.va, bldev->gen_table,
+				bldev->gen_table_words * sizeof(u32));
+
+	ret = beaglelogic_send_cmd(bldev, CMD_SET_CONFIG);
+
+	dev_dbg(dev, "PRU Config written, err code = %d\n", ret);
+	if (ret) {
+		dev_err(dev, "PRU rejected the configuration: %d\n", ret);
+		return ret < 0 ? ret : -EIO;
+	}
+	return 0;
+}
+
+/* Begin the waveform generation, PRU1 holding the first sample until
+ * 'deadline' (CLOCK_MONOTONIC) if that is not 0 [This takes the mutex] */
+int beaglelogic_start_at(struct device *dev, u64 deadline)
+{
+	struct beaglelogicdev *bldev = dev_get_drvdata(dev);
+	int ret;
+
+	/* This mutex will be locked for the entire duration BeagleLogic runs */
+	mutex_lock(&bldev->mutex);
+
+	/* A failed PRU restart leaves no firmware to talk to */
+	if (bldev->state == STATE_BL_ERROR) {
+		dev_err(dev, "PRU firmware not running, reload it first\n");
+		mutex_unlock(&bldev->mutex);
+		return -ENODEV;
+	}
+
+	/* Firmware loaded since the allocation may take a shorter list */
+	if (bldev->bufcount > bldev->maxbufcount) {
+		dev_err(dev, "Firmware supports %u buffers, %u allocated\n",
+				bldev->maxbufcount, bldev->bufcount);
+		mutex_unlock(&bldev->mutex);
+		return -EINVAL;
+	}
+
+	/* The writer needs a second buffer to fill while one plays */
+	if (bldev->stream && bldev->bufcount < 2) {
+		dev_err(dev, "Stream mode needs at least 2 buffers\n");
+		mutex_unlock(&bldev->mutex);
+		return -EINVAL;
+	}
+
+	/* A stale context must not be run */
+	ret = beaglelogic_write_configuration(dev);
+	if (ret) {
+		mutex_unlock(&bldev->mutex);
+		return ret;
+	}
+
+	/* The previous run unmapped the buffers; mapping them again cleans
+	 * whatever was written since out of the CPU cache. In stream mode,
+	 * the list holds the buffers queued so far */
+	if (beaglelogic_map_and_submit_all_buffers(dev)) {
+		mutex_unlock(&bldev->mutex);
+		return -ENOMEM;
+	}
+	bldev->bufbeingread = &bldev->buffers[0];
+
+	/* Indexed mode: PRU0 reads the dictionary like a buffer */
+	bldev->cxt_pru->index_dict = 0;
+	bldev->cxt_pru->index_pos = 0;
+	if (bldev->index_dict.buf) {
+		if (beaglelogic_map_buffer(dev, &bldev->index_dict)) {
+			mutex_unlock(&bldev->mutex);
+			return -ENOMEM;
+		}
+		bldev->cxt_pru->index_dict = bldev->index_dict.phys_addr;
+	}
+
+	/* All set now. Start the PRUs and wait for IRQs. The state is set
+	 * first as a short waveform can complete before the reply is seen */
+	beaglelogic_set_state(bldev, STATE_BL_RUNNING);
+	bldev->lasterror = 0;
+	bldev->cxt_pru->prog_entry = 0;
+	bldev->cxt_pru->prog_addr = 0;
+	bldev->cxt_pru->loop_count = bldev->loop;
+	bldev->cxt_pru->loop_iter = 0;
+	bldev->cxt_pru->swap_entry = 0;
+	bldev->cxt_pru->swap_iter = 0;
+	bldev->cxt_pru->clk_min = 0xFFFFFFFF;
+	bldev->cxt_pru->clk_max = 0;
+	bldev->cxt_pru->clk_blocks = 0;
+	bldev->cxt_pru->clk_late = 0;
+	bldev->cxt_pru->cap_addr = bldev->cxt_pru->cap_start;
+	bldev->cxt_pru->cap_blocks = 0;
+	bldev->cap_read = 0;
+	bldev->cap_lost = 0;
+	bldev->cxt_pru->sum_a = 0;
+	bldev->cxt_pru->sum_b = 0;
+	memset(bldev->cxt_pru->sum_list, 0, sizeof(bldev->cxt_pru->sum_list));
+
+	/* A stream resumes at its oldest queued buffer, e.g. the next job
+	 * after the previous run ran out of jobs */
+	if (bldev->stream && bldev->stream_tail) {
+		bldev->stream_dry = 0;
+		bldev->cxt_pru->prog_entry =
+			offsetof(struct capture_context, list_head) +
+			bldev->stream_tail->index * sizeof(struct buflist);
+		bldev->cxt_pru->prog_addr = bldev->stream_tail->phys_addr;
+	}
+	bldev->cxt_pru->start_done = 0;
+	bldev->start_deadline = deadline;
+	bldev->start_ns = max_t(u64, ktime_get_ns(), deadline);
+	bldev->stop_ns = 0;
+	ret = beaglelogic_send_cmd(bldev, CMD_START);
+	if (ret) {
+		beaglelogic_set_state(bldev, STATE_BL_ARMED);
+		mutex_unlock(&bldev->mutex);
+		return ret < 0 ? ret : -EIO;
+	}
+
+	/* Nothing plays before a scheduled start */
+	bldev->watchdog_timeout = beaglelogic_watchdog_timeout(bldev);
+	bldev->watchdog_seen = 0;
+	if (bldev->watchdog_timeout)
+		mod_delayed_work(system_wq, &bldev->watchdog,
+				msecs_to_jiffies(bldev->watchdog_timeout) +
+				nsecs_to_jiffies(deadline > bldev->start_cmd_ns ?
+					deadline - bldev->start_cmd_ns : 0));
+
+	bldev->run_locked = 1;
+	dev_info(dev, "Waveform generation started");
+	return 0;
+}
+
+int beaglelogic_start(struct device *dev)
+{
+	return beaglelogic_start_at(dev, 0);
+}
+
+/* The time PRU1 started the last run at, 0 while it waits for a scheduled
+ * start. Both IEP counts come from the same counter as the delay */
+static u64 beaglelogic_started(struct beaglelogicdev *bldev)
+{
+	struct capture_context *cxt = bldev->cxt_pru;
+
+	if (!bldev->start_deadline)
+		return bldev->start_ns;
+	if (!READ_ONCE(cxt->start_done))
+		return 0;
+	return bldev->start_cmd_ns + (u64)(READ_ONCE(cxt->start_iep) -
+			cxt->start_ref) * BL_PRU_CYCLE_NS;
+}
+
+/* Request stop. Stop will effect only after the last buffer is written out */
+void beaglelogic_stop(struct device *dev)
+{
+	struct beaglelogicdev *bldev = dev_get_drvdata(dev);
+
+	/* Release only the mutex of a started run; a setter may hold it for
+	 * a moment, and a second stop finds it released already */
+	if (xchg(&bldev->run_locked, 0)) {
 		if (bldev->state == STATE_BL_RUNNING)
 		{
 			beaglelogic_request_stop(bldev);
-			bldev->state = STATE_BL_REQUEST_STOP;
+			beaglelogic_set_state(bldev, STATE_BL_REQUEST_STOP);
 
-			/* Wait for the PRU to signal completion */
+			/* Wait for the PRU to signal completion, or for the
+			 * watchdog to end a hung run */
 			wait_event_interruptible(bldev->wait,
-					bldev->state == STATE_BL_INITIALIZED);
+					bldev->state != STATE_BL_REQUEST_STOP);
 		}
 		/* Release */
 		mutex_unlock(&bldev->mutex);
@@ -479,296 +1821,1707 @@ void beaglelogic_stop(struct device *dev)
 	}
 }
 
-/* fops */
-static int beaglelogic_f_open(struct inode *inode, struct file *filp)
+/* Check that PRU0 runs a firmware this driver speaks to and take over its
+ * capabilities */
+static int beaglelogic_fw_check(struct beaglelogicdev *bldev)
 {
-	struct logic_buffer_reader *reader;
-	struct beaglelogicdev *bldev = to_beaglelogicdev(filp->private_data);
 	struct device *dev = bldev->miscdev.this_device;
+	int ret;
 
-	if (bldev->bufcount == 0)
-		return -ENOMEM;
-
-	reader = devm_kzalloc(dev, sizeof(*reader), GFP_KERNEL);
-	reader->bldev = bldev;
-	reader->buf = NULL;
-	reader->pos = 0;
+	if (bldev->cxt_pru->magic == BL_FW_MAGIC)
+		dev_info(dev, "Valid PRU capture context structure "\
+				"found at offset %04X\n", 0);
+	else {
+		dev_err(dev, "Firmware error!\n");
+		return -EIO;
+	}
+
+	/* Get firmware properties */
+	ret = beaglelogic_send_cmd(bldev, CMD_GET_VERSION);
+	if (ret == BL_FW_VERSION) {
+		dev_info(dev, "BeagleLogic PRU Firmware version: %d.%d\n",
+				ret >> 8, ret & 0xFF);
+	} else if (ret > 0) {
+		/* Another context layout, its list would be read elsewhere */
+		dev_err(dev, "Firmware version %d.%d, this driver needs %d.%d\n",
+				ret >> 8, ret & 0xFF, BL_FW_VERSION >> 8,
+				BL_FW_VERSION & 0xFF);
+		return -EIO;
+	} else {
+		dev_err(dev, "Firmware error!\n");
+		return -EIO;
+	}
+
+	ret = beaglelogic_send_cmd(bldev, CMD_GET_MAX_SG);
+	if (ret > 0 && ret <= BL_MAX_BUFLIST) { /* The context holds as many */
+		dev_info(dev, "Device supports max %d vector transfers\n", ret);
+		bldev->maxbufcount = ret;
+	} else {
+		dev_err(dev, "Firmware error!\n");
+		return -EIO;
+	}
+	return 0;
+}
+
+/* Shut both PRUs down and boot them again, with new images if 'fw' names
+ * any. A run that was playing ends as if PRU0 had signalled it, with
+ * lasterror 0x40000. The buffers live in DDR and stay allocated; the next
+ * start maps them and hands them to PRU0 again, along with the settings */
+static int beaglelogic_reset_prus(struct beaglelogicdev *bldev,
+		const struct beaglelogic_firmware *fw)
+{
+	struct device *dev = bldev->miscdev.this_device;
+	u64 t0 = ktime_get_ns();
+	uint32_t state;
+	int ret = 0;
+
+	rproc_shutdown(bldev->pru1);
+	rproc_shutdown(bldev->pru0);
+
+	/* No handler runs any more; the context stays in PRU0 RAM until the
+	 * next boot loads it again */
+	synchronize_irq(bldev->from_bl_irq_3);
+	state = bldev->state;
+	if (state == STATE_BL_RUNNING || state == STATE_BL_REQUEST_STOP) {
+		beaglelogic_run_end(bldev);
+		bldev->lasterror = 0x40000;
+	}
+
+	if (fw && fw->pru0[0]) {
+		ret = rproc_set_firmware(bldev->pru0, fw->pru0);
+		if (!ret)
+			strscpy(bldev->fw.pru0, fw->pru0, BL_FW_NAME_LEN);
+	}
+	if (fw && fw->pru1[0] && !ret) {
+		ret = rproc_set_firmware(bldev->pru1, fw->pru1);
+		if (!ret)
+			strscpy(bldev->fw.pru1, fw->pru1, BL_FW_NAME_LEN);
+	}
+	if (ret)
+		dev_err(dev, "Failed to set PRU firmware: %d\n", ret);
+
+	if (rproc_boot(bldev->pru0)) {
+		dev_err(dev, "Failed to boot PRU0 with %s\n", bldev->fw.pru0);
+		ret = -EIO;
+	} else if (rproc_boot(bldev->pru1)) {
+		dev_err(dev, "Failed to boot PRU1 with %s\n", bldev->fw.pru1);
+		rproc_shutdown(bldev->pru0);
+		ret = -EIO;
+	} else if (beaglelogic_fw_check(bldev)) {
+		ret = -EIO;
+	}
+
+	/* Only now release a stop waiting for the run to end, a start that
+	 * follows needs the firmware up */
+	beaglelogic_set_state(bldev, ret == -EIO ?
+			STATE_BL_ERROR : STATE_BL_INITIALIZED);
+	wake_up_interruptible(&bldev->wait);
+	trace_beaglelogic_reset(ret, ktime_get_ns() - t0);
+	return ret;
+}
+
+/* Restart the PRUs when the blocks played stop counting up for the
+ * timeout of the run. PRU0 counts the block requests of PRU1, or in
+ * generator mode the blocks it computes */
+static void beaglelogic_watchdog(struct work_struct *work)
+{
+	struct beaglelogicdev *bldev = container_of(to_delayed_work(work),
+			struct beaglelogicdev, watchdog);
+	struct device *dev = bldev->miscdev.this_device;
+	uint32_t seen;
+
+	if (bldev->state != STATE_BL_RUNNING &&
+			bldev->state != STATE_BL_REQUEST_STOP)
+		return;
+
+	seen = READ_ONCE(bldev->cxt_pru->clk_blocks) +
+		READ_ONCE(bldev->cxt_pru->gen_block);
+	if (seen != bldev->watchdog_seen || !bldev->watchdog_ms) {
+		bldev->watchdog_seen = seen;
+		if (bldev->watchdog_ms)
+			schedule_delayed_work(&bldev->watchdog,
+					msecs_to_jiffies(bldev->watchdog_timeout));
+		return;
+	}
+
+	/* The run is ours once PRU0_TO_ARM_A cannot end it any more; the
+	 * stop that releases the device mutex waits for the new state */
+	disable_irq(bldev->from_bl_irq_1);
+	if (bldev->state == STATE_BL_RUNNING ||
+			bldev->state == STATE_BL_REQUEST_STOP) {
+		dev_err(dev, "No block played for %u ms, restarting the PRUs\n",
+				bldev->watchdog_timeout);
+		bldev->watchdog_resets++;
+		beaglelogic_reset_prus(bldev, NULL);
+	}
+	enable_irq(bldev->from_bl_irq_1);
+}
+
+/* Load other firmware images while the PRUs are idle, see
+ * IOCTL_BL_SET_FIRMWARE. This method acquires & releases the device mutex */
+static int beaglelogic_set_firmware(struct beaglelogicdev *bldev,
+		struct beaglelogic_firmware *fw)
+{
+	struct device *dev = bldev->miscdev.this_device;
+	int ret;
+
+	fw->pru0[BL_FW_NAME_LEN - 1] = 0;
+	fw->pru1[BL_FW_NAME_LEN - 1] = 0;
+	if (!mutex_trylock(&bldev->mutex))
+		return -EBUSY;
+
+	ret = beaglelogic_reset_prus(bldev, fw);
+	if (!ret && bldev->bufcount > bldev->maxbufcount)
+		dev_warn(dev, "Firmware supports %u buffers, %u allocated\n",
+				bldev->maxbufcount, bldev->bufcount);
+
+	mutex_unlock(&bldev->mutex);
+	return ret;
+}
+
+/* Translate the list entry and DDR address PRU0 publishes after every block
+ * into a buffer index and byte counts. Does not block, any state is fine. */
+static void beaglelogic_get_progress(struct beaglelogicdev *bldev,
+		struct beaglelogic_progress *p)
+{
+	struct capture_context *cxt = bldev->cxt_pru;
+	uint32_t entry, addr, i;
+	u64 elapsed, done = 0, total = 0;
+
+	memset(p, 0, sizeof(*p));
+	p->state = bldev->state;
+
+	/* Both words come from one SBBO; re-read if PRU0 moved on in between */
+	do {
+		entry = READ_ONCE(cxt->prog_entry);
+		addr = READ_ONCE(cxt->prog_addr);
+	} while (entry != READ_ONCE(cxt->prog_entry));
+
+	if (bldev->stream)
+		beaglelogic_stream_reap(bldev);
+
+	for (i = 0; i < bldev->bufcount; i++)
+		total += bldev->stream ? bldev->buffers[i].queued :
+			bldev->buffers[i].size;
+
+	if (!bldev->start_ns)
+		goto out;
+
+	/* Generator mode: no buffers, count the blocks PRU0 computed */
+	if (bldev->gen.enable) {
+		done = (u64)READ_ONCE(cxt->gen_block) * 64;
+		total = bldev->gen.samples ? (u64)beaglelogic_gen_blocks(
+				&bldev->gen) * 64 : done;
+		p->index = 0;
+		goto rate;
+	}
+
+	i = (entry - offsetof(struct capture_context, list_head)) /
+		sizeof(struct buflist);
+	if (!entry || i > bldev->bufcount) {
+		/* PRU0 has not published the first block yet */
+		p->index = 0;
+	} else if (i == bldev->bufcount) {
+		/* Past the null terminator: everything handed over */
+		p->index = i;
+		done = total;
+	} else {
+		p->index = i;
+		if (!bldev->stream || bldev->buffers[i].queued)
+			p->offset = min_t(uint32_t,
+					addr - bldev->buffers[i].phys_addr,
+					bldev->buffers[i].size);
+		done = p->offset;
+		while (!bldev->stream && i--)
+			done += bldev->buffers[i].size;
+	}
+
+	/* Stream mode: the ring wraps, count what PRU0 handed back on top */
+	if (bldev->stream) {
+		done += bldev->stream_done;
+		total += bldev->stream_done;
+	}
+
+	/* Indexed mode: each 2 byte index plays a 64 byte block */
+	if (bldev->index_dict.buf) {
+		done *= 64 / 2;
+		total *= 64 / 2;
+	}
+
+rate:
+	/* Nothing has elapsed before a scheduled start */
+	elapsed = bldev->stop_ns ? bldev->stop_ns : ktime_get_ns();
+	elapsed = elapsed > bldev->start_ns ? elapsed - bldev->start_ns : 0;
+	p->elapsed_ms = div_u64(elapsed, NSEC_PER_MSEC);
+
+	/* The sample clock is external, extrapolate from the rate so far.
+	 * For a stream, this is the time until the queued data runs out */
+	if (!bldev->stop_ns && done)
+		p->eta_ms = div64_u64((u64)p->elapsed_ms * (total - done),
+				done);
+out:
+	p->bytes_done = done;
+	p->bytes_total = total;
+}
+
+/* Switch between one-shot and stream mode while the PRUs are idle
+ * This method acquires & releases the device mutex */
+static int beaglelogic_set_stream(struct beaglelogicdev *bldev, uint32_t val)
+{
+	if (val > 1 || (val && (bldev->loop || bldev->gen.enable)))
+		return -EINVAL;
+	if (!mutex_trylock(&bldev->mutex))
+		return -EBUSY;
+
+	bldev->stream = val;
+	beaglelogic_stream_reset(bldev);
+
+	mutex_unlock(&bldev->mutex);
+	return 0;
+}
+
+/* Switch between samples and edge records while the PRUs are idle. Edge
+ * times only count forward, so no loop or generator mode, and they are
+ * timed without a sample clock or capture. This method acquires & releases the device
+ * mutex */
+static int beaglelogic_set_edge(struct beaglelogicdev *bldev, uint32_t val)
+{
+	if (val > 1 || (val && (bldev->loop || bldev->gen.enable ||
+			bldev->index_dict.buf || bldev->clk_period ||
+			bldev->cap_buf)))
+		return -EINVAL;
+	if (!mutex_trylock(&bldev->mutex))
+		return -EBUSY;
+
+	bldev->edge = val;
+
+	mutex_unlock(&bldev->mutex);
+	return 0;
+}
+
+/* Switch the block sums while the PRUs are idle. Only the list modes
+ * hand blocks over one by one, so no generator mode. This method acquires
+ * & releases the device mutex */
+static int beaglelogic_set_sums(struct beaglelogicdev *bldev, uint32_t val)
+{
+	if (val > 1 || (val && bldev->gen.enable))
+		return -EINVAL;
+	if (!mutex_trylock(&bldev->mutex))
+		return -EBUSY;
+
+	bldev->sums = val;
+
+	mutex_unlock(&bldev->mutex);
+	return 0;
+}
+
+/* Sums of the run, from the sums of the buffers */
+static void beaglelogic_get_sums(struct beaglelogicdev *bldev,
+		struct beaglelogic_sum *run)
+{
+	int i;
+
+	run->a = READ_ONCE(bldev->cxt_pru->sum_a);
+	run->b = READ_ONCE(bldev->cxt_pru->sum_b);
+	run->blocks = 0;
+	for (i = 0; i < bldev->bufcount && i < BL_MAX_BUFLIST; i++)
+		run->blocks += READ_ONCE(bldev->cxt_pru->sum_list[i].blocks);
+}
+
+/* Switch indexed mode while the PRUs are idle, with a copy of the
+ * dictionary at 'dict' (user space). Only samples are indexed, so no edge
+ * list or generator mode. This method acquires & releases the device mutex */
+static int beaglelogic_set_index(struct beaglelogicdev *bldev,
+		const struct beaglelogic_index *ix)
+{
+	void *dict = NULL;
+
+	if (ix->enable > 1)
+		return -EINVAL;
+	if (ix->enable) {
+		if (!ix->blocks || ix->blocks > BL_INDEX_MAX_BLOCKS ||
+				bldev->edge || bldev->gen.enable)
+			return -EINVAL;
+		dict = memdup_user(u64_to_user_ptr(ix->dict), ix->blocks * 64);
+		if (IS_ERR(dict))
+			return PTR_ERR(dict);
+	}
+
+	if (!mutex_trylock(&bldev->mutex)) {
+		kfree(dict);
+		return -EBUSY;
+	}
+
+	kfree(bldev->index_dict.buf);
+	bldev->index_dict.buf = dict;
+	bldev->index_dict.size = dict ? ix->blocks * 64 : 0;
+	bldev->index_dict.state = STATE_BL_BUF_UNMAPPED;
+
+	mutex_unlock(&bldev->mutex);
+	return 0;
+}
+
+static bool beaglelogic_period_valid(uint32_t period)
+{
+	return period >= BL_CLOCK_MIN_PERIOD && period <= BL_CLOCK_MAX_PERIOD;
+}
+
+/* Select the sample clock while the PRUs are idle: the external one, or
+ * the internal one at clk->period, with the periods of the first
+ * clk->segments buffers at 'periods' (user space). Edge records are not
+ * sampled, and capture follows the external clock only. This method
+ * acquires & releases the device mutex */
+static int beaglelogic_set_clock(struct beaglelogicdev *bldev,
+		const struct beaglelogic_clock *clk)
+{
+	u32 *periods = NULL;
+	uint32_t i;
+
+	if (clk->period ? !beaglelogic_period_valid(clk->period) ||
+			bldev->edge || bldev->cap_buf : clk->segments)
+		return -EINVAL;
+	if (clk->segments > bldev->maxbufcount)
+		return -EINVAL;
+	if (clk->segments) {
+		periods = memdup_user(u64_to_user_ptr(clk->periods),
+				clk->segments * sizeof(u32));
+		if (IS_ERR(periods))
+			return PTR_ERR(periods);
+		for (i = 0; i < clk->segments; i++) {
+			if (periods[i] && !beaglelogic_period_valid(periods[i])) {
+				kfree(periods);
+				return -EINVAL;
+			}
+		}
+	}
+
+	if (!mutex_trylock(&bldev->mutex)) {
+		kfree(periods);
+		return -EBUSY;
+	}
+
+	kfree(bldev->clk_periods);
+	bldev->clk_periods = periods;
+	bldev->clk_segments = clk->segments;
+	bldev->clk_period = clk->period;
+
+	mutex_unlock(&bldev->mutex);
+	return 0;
+}
+
+/* Turn capture on with a ring of cap->size bytes for the inputs in
+ * cap->mask, or off with a mask of 0, while the PRUs are idle and the ring
+ * is not mapped. PRU1 only captures in list modes on the external clock.
+ * This method acquires & releases the device mutex */
+static int beaglelogic_set_capture(struct beaglelogicdev *bldev,
+		const struct beaglelogic_capture *cap)
+{
+	struct device *dev = bldev->miscdev.this_device;
+	void *buf = NULL;
+	dma_addr_t dma = 0;
+	uint32_t size = cap->mask ? cap->size : 0;
+	int ret = 0;
+
+	if (cap->mask > 0xF)
+		return -EINVAL;
+	if (cap->mask && (size < BL_CAPTURE_MIN_SIZE ||
+			size > BL_CAPTURE_MAX_SIZE ||
+			size % BL_CAPTURE_MIN_SIZE || bldev->edge ||
+			bldev->gen.enable || bldev->clk_period))
+		return -EINVAL;
+
+	if (!mutex_trylock(&bldev->mutex))
+		return -EBUSY;
+	if (!mutex_trylock(&bldev->cap_mutex)) {
+		mutex_unlock(&bldev->mutex);
+		return -EBUSY;
+	}
+	if (atomic_read(&bldev->cap_maps)) {
+		ret = -EBUSY;
+		goto out;
+	}
+
+	/* Keep the ring if its size does not change */
+	if (size && size == bldev->cap_size) {
+		bldev->cap_mask = cap->mask;
+		goto out;
+	}
+
+	if (size) {
+		buf = dma_alloc_coherent(dev, size, &dma, GFP_KERNEL);
+		if (!buf) {
+			dev_err(dev, "Cannot allocate a %u byte capture ring\n",
+					size);
+			ret = -ENOMEM;
+			goto out;
+		}
+	}
+
+	if (bldev->cap_buf)
+		dma_free_coherent(dev, bldev->cap_size, bldev->cap_buf,
+				bldev->cap_dma);
+	bldev->cap_buf = buf;
+	bldev->cap_dma = dma;
+	bldev->cap_size = size;
+	bldev->cap_mask = cap->mask;
+	bldev->cap_read = 0;
+	bldev->cap_lost = 0;
+out:
+	mutex_unlock(&bldev->cap_mutex);
+	mutex_unlock(&bldev->mutex);
+	return ret;
+}
+
+/* Set the loop count while the PRUs are idle; not with stream mode, whose
+ * ring is refilled as it plays. This method acquires & releases the device
+ * mutex */
+static int beaglelogic_set_loop(struct beaglelogicdev *bldev, uint32_t val)
+{
+	if (val && (bldev->stream || bldev->gen.enable || bldev->edge))
+		return -EINVAL;
+	if (!mutex_trylock(&bldev->mutex))
+		return -EBUSY;
+
+	bldev->loop = val;
+
+	mutex_unlock(&bldev->mutex);
+	return 0;
+}
+
+/* fops */
+static int beaglelogic_f_open(struct inode *inode, struct file *filp)
+{
+	struct logic_buffer_reader *reader;
+	struct beaglelogicdev *bldev = to_beaglelogicdev(filp->private_data);
+	struct device *dev = bldev->miscdev.this_device;
+
+	if (bldev->bufcount == 0)
+		return -ENOMEM;
+
+	reader = devm_kzalloc(dev, sizeof(*reader), GFP_KERNEL);
+	reader->bldev = bldev;
+	reader->buf = NULL;
+	reader->pos = 0;
 	reader->remaining = 0;
 
 	filp->private_data = reader;
 
-	if(!bldev->buffers)
-		return -ENOMEM;
+	if(!bldev->buffers)
+		return -ENOMEM;
+
+	/* Every open starts a new stream */
+	if (bldev->stream && bldev->state != STATE_BL_RUNNING)
+		beaglelogic_stream_reset(bldev);
+
+	beaglelogic_map_buffer(dev, &bldev->buffers[0]);
+
+	return 0;
+}
+
+/* Write operation of a user space buffer. Behind write() as well as
+ * splice() and sendfile(), which hand over page cache pages without a
+ * bounce through user space. Fills as many buffers as the data covers.
+ *
+ * In stream mode the ring is reused while the waveform plays: every full
+ * buffer is queued to PRU0 at once, and the writer blocks until PRU0 has
+ * handed back the buffer it is about to fill. */
+static ssize_t beaglelogic_f_write_iter(struct kiocb *iocb,
+		struct iov_iter *from)
+{
+	struct logic_buffer_reader *reader = iocb->ki_filp->private_data;
+	struct beaglelogicdev *bldev = reader->bldev;
+	struct device *dev = bldev->miscdev.this_device;
+	struct logic_buffer *buf;
+	size_t count, copied, total = 0;
+	int ret;
+
+	if (bldev->state == STATE_BL_ERROR)
+		return -EIO;
+
+	if (reader->buf == NULL) {
+		/* First time init */
+		reader->buf = &reader->bldev->buffers[0];
+		reader->pos = 0;
+		reader->remaining = reader->buf->size;
+	} else {
+		if (!bldev->stream && reader->buf == bldev->buffers &&
+				reader->pos == 0 &&
+				bldev->state == STATE_BL_INITIALIZED)
+			return 0;
+	}
+	bldev->stream_eof = 0;
+
+	while (iov_iter_count(from)) {
+		buf = reader->buf;
+		if (bldev->stream && reader->pos == 0) {
+			ret = beaglelogic_stream_wait(bldev, buf,
+					iocb->ki_filp->f_flags & O_NONBLOCK);
+			if (ret > 0 || (ret && total))
+				return total;
+			if (ret)
+				return ret;
+		}
+
+		count = min_t(size_t, reader->remaining, iov_iter_count(from));
+		copied = copy_from_iter(buf->buf + reader->pos, count, from);
+
+		/* Push the new data out of the CPU cache for the PRU */
+		if (copied && buf->state == STATE_BL_BUF_MAPPED)
+			dma_sync_single_range_for_device(dev, buf->phys_addr,
+					reader->pos, copied, DMA_TO_DEVICE);
+
+		reader->pos += copied;
+		reader->remaining -= copied;
+		reader->job_pending |= copied != 0;
+		total += copied;
+
+		if (reader->remaining == 0) {
+			if (bldev->stream)
+				beaglelogic_stream_queue(bldev, buf, buf->size);
+
+			/* Change the buffer */
+			reader->buf = buf->next;
+			reader->pos = 0;
+			reader->remaining = reader->buf->size;
+
+			/* Wrapped around, every buffer has been written */
+			if (!bldev->stream && reader->buf == bldev->buffers)
+				break;
+		}
+
+		if (copied < count) {
+			if (!total)
+				return -EFAULT;
+			break;
+		}
+	}
+	return total;
+}
+
+/* Stream mode: queue the partly filled buffer, padded with zeros to whole
+ * 64 byte blocks, and mark the end of the stream */
+static void beaglelogic_stream_flush(struct logic_buffer_reader *reader)
+{
+	struct beaglelogicdev *bldev = reader->bldev;
+	struct device *dev = bldev->miscdev.this_device;
+	struct logic_buffer *buf = reader->buf;
+	uint32_t len;
+
+	bldev->stream_eof = 1;
+	if (!buf || !reader->pos)
+		return;
+
+	len = round_up(reader->pos, 64);
+	memset(buf->buf + reader->pos, 0, len - reader->pos);
+	if (buf->state == STATE_BL_BUF_MAPPED)
+		dma_sync_single_range_for_device(dev, buf->phys_addr,
+				reader->pos, len - reader->pos, DMA_TO_DEVICE);
+	beaglelogic_stream_queue(bldev, buf, len);
+
+	reader->buf = buf->next;
+	reader->pos = 0;
+	reader->remaining = reader->buf->size;
+}
+
+/* fsync() ends a stream: the rest of the data is queued to PRU0 */
+static int beaglelogic_f_fsync(struct file *filp, loff_t start, loff_t end,
+		int datasync)
+{
+	struct logic_buffer_reader *reader = filp->private_data;
+
+	if (reader->bldev->stream)
+		beaglelogic_stream_flush(reader);
+	return 0;
+}
+
+/* Stream mode: end the current job at the write position, the next job
+ * plays right after it. A partly filled buffer is queued at once, padded to
+ * whole 64 byte blocks with its last sample so the outputs hold their
+ * level. Returns the job id */
+static int beaglelogic_job_end(struct logic_buffer_reader *reader)
+{
+	struct beaglelogicdev *bldev = reader->bldev;
+	struct device *dev = bldev->miscdev.this_device;
+	struct logic_buffer *buf = reader->buf, *last;
+	unsigned long flags;
+	uint32_t len, id;
+	uint8_t hold;
+
+	if (!bldev->stream)
+		return -EINVAL;
+	if (!buf || !reader->job_pending)
+		return -ENODATA;
+
+	if (reader->pos) {
+		hold = ((uint8_t *)buf->buf)[reader->pos - 1] >> 4;
+		len = round_up(reader->pos, 64);
+		memset(buf->buf + reader->pos, hold | hold << 4,
+				len - reader->pos);
+		if (buf->state == STATE_BL_BUF_MAPPED)
+			dma_sync_single_range_for_device(dev, buf->phys_addr,
+					reader->pos, len - reader->pos,
+					DMA_TO_DEVICE);
+		beaglelogic_stream_queue(bldev, buf, len);
+
+		reader->buf = buf->next;
+		reader->pos = 0;
+		reader->remaining = reader->buf->size;
+		last = buf;
+	} else {
+		/* The job filled its last buffer, which is queued already */
+		last = &bldev->buffers[(buf->index + bldev->bufcount - 1) %
+			bldev->bufcount];
+	}
+	reader->job_pending = 0;
+
+	spin_lock_irqsave(&bldev->stream_lock, flags);
+	id = ++bldev->jobs_queued;
+	if (last->queued)
+		last->job = id;
+	else
+		bldev->jobs_done = id;	/* PRU0 is past it already */
+	bldev->stream_eof = 1;
+	spin_unlock_irqrestore(&bldev->stream_lock, flags);
+
+	wake_up_interruptible(&bldev->wait);
+	return id;
+}
+
+static int beaglelogic_job_done(struct beaglelogicdev *bldev, uint32_t id)
+{
+	return (int32_t)(READ_ONCE(bldev->jobs_done) - id) >= 0;
+}
+
+/* Stream mode: wait until PRU0 has read job 'id' completely; its last
+ * samples reach the outputs within two blocks. -EPIPE if it never will */
+static int beaglelogic_wait_job(struct beaglelogicdev *bldev, uint32_t id,
+		int nonblock)
+{
+	int ret;
+
+	if (!bldev->stream || !id ||
+			(int32_t)(bldev->jobs_queued - id) < 0)
+		return -EINVAL;
+
+	beaglelogic_stream_reap(bldev);
+	if (beaglelogic_job_done(bldev, id))
+		return 0;
+	if (bldev->state != STATE_BL_RUNNING)
+		return -EPIPE;
+	if (nonblock)
+		return -EAGAIN;
+
+	ret = wait_event_interruptible(bldev->wait,
+			beaglelogic_job_done(bldev, id) ||
+			bldev->state != STATE_BL_RUNNING);
+	if (ret)
+		return ret;
+	return beaglelogic_job_done(bldev, id) ? 0 : -EPIPE;
+}
+
+/* Capture: bytes of inputs in the ring since the start of the run */
+static u64 beaglelogic_capture_bytes(struct beaglelogicdev *bldev)
+{
+	if (!bldev->cap_buf)
+		return 0;
+	return (u64)READ_ONCE(bldev->cxt_pru->cap_blocks) * 64;
+}
+
+/* PRU0 may still copy blocks, up to the end of a stopping run */
+static bool beaglelogic_capturing(struct beaglelogicdev *bldev)
+{
+	uint32_t state = READ_ONCE(bldev->state);
+
+	return state == STATE_BL_RUNNING || state == STATE_BL_REQUEST_STOP;
+}
+
+/* Read the captured inputs of the current (or last) run. PRU0 does not
+ * interrupt for the blocks it copies, so a reader waiting for data checks
+ * every jiffy; the ring should hold a few jiffies of samples. Data PRU0
+ * has overwritten is skipped and counted in cap_lost, including a block it
+ * may be writing. Returns 0 once the run has ended and all is read */
+static ssize_t beaglelogic_f_read(struct file *filp, char __user *ubuf,
+		size_t len, loff_t *ppos)
+{
+	struct logic_buffer_reader *reader = filp->private_data;
+	struct beaglelogicdev *bldev = reader->bldev;
+	uint64_t bytes, first, pos;
+	uint32_t off, count;
+	size_t total = 0;
+	ssize_t ret;
+
+	if (mutex_lock_interruptible(&bldev->cap_mutex))
+		return -ERESTARTSYS;
+	if (!bldev->cap_buf) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	while (total < len) {
+		bytes = beaglelogic_capture_bytes(bldev);
+		if (bytes == bldev->cap_read) {
+			if (total || !beaglelogic_capturing(bldev))
+				break;
+			if (filp->f_flags & O_NONBLOCK) {
+				ret = -EAGAIN;
+				goto out;
+			}
+			ret = wait_event_interruptible_timeout(bldev->wait,
+					!beaglelogic_capturing(bldev), 1);
+			if (ret < 0)
+				goto out;
+			continue;
+		}
+		/* Order the ring reads after cap_blocks */
+		rmb();
+
+		/* Keep a block clear of the one PRU0 may be writing */
+		first = bytes + 64 > bldev->cap_size ?
+			bytes + 64 - bldev->cap_size : 0;
+		if (bldev->cap_read < first) {
+			bldev->cap_lost += first - bldev->cap_read;
+			bldev->cap_read = first;
+		}
+
+		pos = bldev->cap_read;
+		div_u64_rem(pos, bldev->cap_size, &off);
+		count = min_t(uint64_t, bytes - pos, len - total);
+		count = min(count, bldev->cap_size - off);
+		if (copy_to_user(ubuf + total, bldev->cap_buf + off, count)) {
+			ret = total ? total : -EFAULT;
+			goto out;
+		}
+
+		/* Overwritten while copied: copy the newer data over it */
+		rmb();
+		bytes = beaglelogic_capture_bytes(bldev);
+		if (bytes + 64 > pos + bldev->cap_size)
+			continue;
+
+		bldev->cap_read += count;
+		total += count;
+	}
+	ret = total;
+out:
+	mutex_unlock(&bldev->cap_mutex);
+	return ret;
+}
+
+static void beaglelogic_vm_open(struct vm_area_struct *vma)
+{
+	struct beaglelogicdev *bldev = vma->vm_private_data;
+
+	atomic_inc(&bldev->cap_maps);
+}
+
+static void beaglelogic_vm_close(struct vm_area_struct *vma)
+{
+	struct beaglelogicdev *bldev = vma->vm_private_data;
+
+	atomic_dec(&bldev->cap_maps);
+}
+
+static const struct vm_operations_struct beaglelogic_vm_ops = {
+	.open = beaglelogic_vm_open,
+	.close = beaglelogic_vm_close,
+};
+
+/* Map the capture ring, which stays allocated while it is mapped */
+static int beaglelogic_f_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+	struct logic_buffer_reader *reader = filp->private_data;
+	struct beaglelogicdev *bldev = reader->bldev;
+	struct device *dev = bldev->miscdev.this_device;
+	unsigned long len = vma->vm_end - vma->vm_start;
+	int ret;
+
+	if (vma->vm_pgoff || (vma->vm_flags & VM_WRITE))
+		return -EINVAL;
+
+	mutex_lock(&bldev->cap_mutex);
+	if (!bldev->cap_buf || len > bldev->cap_size) {
+		ret = -EINVAL;
+		goto out;
+	}
+	ret = dma_mmap_coherent(dev, vma, bldev->cap_buf, bldev->cap_dma, len);
+	if (ret)
+		goto out;
+
+	vma->vm_ops = &beaglelogic_vm_ops;
+	vma->vm_private_data = bldev;
+	beaglelogic_vm_open(vma);
+out:
+	mutex_unlock(&bldev->cap_mutex);
+	return ret;
+}
+
+/* Configuration through ioctl */
+// Number of ioctl calls cropped since most BeagleLogic's sysfs attributes are omitted 
+static long beaglelogic_f_ioctl(struct file *filp, unsigned int cmd,
+		  unsigned long arg)
+{
+	struct logic_buffer_reader *reader = filp->private_data;
+	struct beaglelogicdev *bldev = reader->bldev;
+	struct device *dev = bldev->miscdev.this_device;
+
+	uint32_t val;
+
+	dev_dbg(dev, "BeagleLogic: IOCTL called cmd = %08X, "\
+			"arg = %08lX\n", cmd, arg);
+
+	switch (cmd) {
+		case IOCTL_BL_GET_VERSION:
+			return 0;
+
+		case IOCTL_BL_GET_BUFFER_SIZE:
+			// Adapted to display correct allocated n° bytes
+			val = beaglelogic_memsize(bldev);
+			if (copy_to_user((void * __user)arg,
+					&val,
+					sizeof(val)))
+				return -EFAULT;
+			return 0;
+
+		case IOCTL_BL_SET_BUFFER_SIZE:
+			val = beaglelogic_memalloc(dev, bldev->bufunitsize, arg);
+			if (!val)
+				return beaglelogic_map_and_submit_all_buffers(dev);
+			return val;
+
+		case IOCTL_BL_GET_BUFUNIT_SIZE:
+			if(copy_to_user((void * __user)arg,
+					&bldev->bufunitsize,
+					sizeof(bldev->bufunitsize)))
+				return -EFAULT;
+			return 0;
+
+		case IOCTL_BL_SET_BUFUNIT_SIZE:
+			// Data block transfer 64 bytes instead of 32 bytes in original BeagleLogic code
+			if ((uint32_t)arg < 64)
+				return -EINVAL;
+			return beaglelogic_set_bufunitsize(dev, arg);
+
+		case IOCTL_BL_START:
+		case IOCTL_BL_START_AT: {
+			struct beaglelogic_start start = { 0 };
+			u64 now = ktime_get_ns();
+
+			if (cmd == IOCTL_BL_START_AT) {
+				if (copy_from_user(&start, (void * __user)arg,
+						sizeof(start)))
+					return -EFAULT;
+				if (start.deadline <= now ||
+						start.deadline - now > BL_START_MAX_NS)
+					return -EINVAL;
+			}
+			if (bldev->state == STATE_BL_RUNNING ||
+					bldev->state == STATE_BL_REQUEST_STOP)
+				return -EBUSY;
+			/* Release the previous run, e.g. a job queue that ran
+			 * out of jobs, before starting again */
+			beaglelogic_stop(dev);
+
+			/* Reset and reconfigure the reader object and then start.
+			 * A stream carries on where the writer is */
+			if (!bldev->stream) {
+				reader->buf = &bldev->buffers[0];
+				reader->pos = 0;
+				reader->remaining = reader->buf->size;
+			}
+
+			return beaglelogic_start_at(dev, start.deadline);
+		}
+
+		case IOCTL_BL_GET_START: {
+			struct beaglelogic_start start = {
+				.deadline = bldev->start_deadline,
+				.started = beaglelogic_started(bldev),
+			};
+
+			if (copy_to_user((void * __user)arg, &start,
+					sizeof(start)))
+				return -EFAULT;
+			return 0;
+		}
+
+		case IOCTL_BL_GET_PROGRESS: {
+			struct beaglelogic_progress progress;
+
+			beaglelogic_get_progress(bldev, &progress);
+			if (copy_to_user((void * __user)arg,
+					&progress,
+					sizeof(progress)))
+				return -EFAULT;
+			return 0;
+		}
+
+		case IOCTL_BL_GET_STREAM:
+			if (copy_to_user((void * __user)arg,
+					&bldev->stream,
+					sizeof(bldev->stream)))
+				return -EFAULT;
+			return 0;
+
+		case IOCTL_BL_SET_STREAM:
+			return beaglelogic_set_stream(bldev, arg);
+
+		case IOCTL_BL_JOB_END:
+			return beaglelogic_job_end(reader);
+
+		case IOCTL_BL_WAIT_JOB:
+			return beaglelogic_wait_job(bldev, arg,
+					filp->f_flags & O_NONBLOCK);
+
+		case IOCTL_BL_GET_JOBS: {
+			struct beaglelogic_jobs jobs;
+
+			beaglelogic_stream_reap(bldev);
+			jobs.queued = bldev->jobs_queued;
+			jobs.done = bldev->jobs_done;
+			if (copy_to_user((void * __user)arg, &jobs,
+					sizeof(jobs)))
+				return -EFAULT;
+			return 0;
+		}
+
+		case IOCTL_BL_GET_LOOP:
+			if (copy_to_user((void * __user)arg,
+					&bldev->loop,
+					sizeof(bldev->loop)))
+				return -EFAULT;
+			return 0;
+
+		case IOCTL_BL_SET_LOOP:
+			return beaglelogic_set_loop(bldev, arg);
+
+		case IOCTL_BL_GET_SUMS: {
+			struct beaglelogic_sums sums;
+			uint32_t n;
+
+			if (copy_from_user(&sums, (void * __user)arg,
+					sizeof(sums)))
+				return -EFAULT;
+
+			n = min_t(uint32_t, bldev->bufcount, BL_MAX_BUFLIST);
+			if (copy_to_user(u64_to_user_ptr(sums.sums),
+					bldev->cxt_pru->sum_list,
+					min(sums.entries, n) *
+					sizeof(struct beaglelogic_sum)))
+				return -EFAULT;
+
+			sums.enable = bldev->sums;
+			sums.entries = n;
+			beaglelogic_get_sums(bldev, &sums.run);
+			sums.pad = 0;
+			if (copy_to_user((void * __user)arg, &sums,
+					sizeof(sums)))
+				return -EFAULT;
+			return 0;
+		}
+
+		case IOCTL_BL_SET_SUMS:
+			return beaglelogic_set_sums(bldev, arg);
+
+		case IOCTL_BL_GET_EDGE:
+			if (copy_to_user((void * __user)arg,
+					&bldev->edge,
+					sizeof(bldev->edge)))
+				return -EFAULT;
+			return 0;
+
+		case IOCTL_BL_SET_EDGE:
+			return beaglelogic_set_edge(bldev, arg);
+
+		case IOCTL_BL_GET_CLOCK: {
+			struct beaglelogic_clock clk = {
+				.period = bldev->clk_period,
+				.segments = bldev->clk_segments,
+			};
+
+			if (copy_to_user((void * __user)arg, &clk, sizeof(clk)))
+				return -EFAULT;
+			return 0;
+		}
+
+		case IOCTL_BL_SET_CLOCK: {
+			struct beaglelogic_clock clk;
+
+			if (copy_from_user(&clk, (void * __user)arg, sizeof(clk)))
+				return -EFAULT;
+			return beaglelogic_set_clock(bldev, &clk);
+		}
+
+		case IOCTL_BL_GET_CAPTURE: {
+			struct beaglelogic_capture cap = {
+				.mask = bldev->cap_mask,
+				.size = bldev->cap_size,
+				.bytes = beaglelogic_capture_bytes(bldev),
+				.lost = bldev->cap_lost,
+			};
+
+			if (copy_to_user((void * __user)arg, &cap, sizeof(cap)))
+				return -EFAULT;
+			return 0;
+		}
+
+		case IOCTL_BL_SET_CAPTURE: {
+			struct beaglelogic_capture cap;
+
+			if (copy_from_user(&cap, (void * __user)arg, sizeof(cap)))
+				return -EFAULT;
+			return beaglelogic_set_capture(bldev, &cap);
+		}
+
+		case IOCTL_BL_GET_INDEX: {
+			struct beaglelogic_index ix = {
+				.enable = !!bldev->index_dict.buf,
+				.blocks = bldev->index_dict.size / 64,
+			};
+
+			if (copy_to_user((void * __user)arg, &ix, sizeof(ix)))
+				return -EFAULT;
+			return 0;
+		}
+
+		case IOCTL_BL_SET_INDEX: {
+			struct beaglelogic_index ix;
+
+			if (copy_from_user(&ix, (void * __user)arg, sizeof(ix)))
+				return -EFAULT;
+			return beaglelogic_set_index(bldev, &ix);
+		}
+
+		case IOCTL_BL_GET_FIRMWARE:
+			if (copy_to_user((void * __user)arg, &bldev->fw,
+					sizeof(bldev->fw)))
+				return -EFAULT;
+			return 0;
+
+		case IOCTL_BL_SET_FIRMWARE: {
+			struct beaglelogic_firmware fw;
+
+			if (copy_from_user(&fw, (void * __user)arg, sizeof(fw)))
+				return -EFAULT;
+			return beaglelogic_set_firmware(bldev, &fw);
+		}
+
+		case IOCTL_BL_SWAP_SEGMENT: {
+			struct beaglelogic_swap swap;
+
+			if (copy_from_user(&swap, (void * __user)arg,
+					sizeof(swap)))
+				return -EFAULT;
+			return beaglelogic_swap_segment(bldev, &swap);
+		}
+
+		case IOCTL_BL_WAIT_SWAP: {
+			int ret = beaglelogic_wait_swap(bldev, &val,
+					filp->f_flags & O_NONBLOCK);
+
+			if (ret)
+				return ret;
+			if (copy_to_user((void * __user)arg, &val,
+					sizeof(val)))
+				return -EFAULT;
+			return 0;
+		}
+
+		case IOCTL_BL_GET_GENERATOR:
+			if (copy_to_user((void * __user)arg, &bldev->gen,
+					sizeof(bldev->gen)))
+				return -EFAULT;
+			return 0;
+
+		case IOCTL_BL_SET_GENERATOR: {
+			struct beaglelogic_generator gen;
+			u8 *pattern[BL_CHANNELS] = { NULL };
+			int ch, ret = 0;
+
+			if (copy_from_user(&gen, (void * __user)arg,
+					sizeof(gen)))
+				return -EFAULT;
+
+			/* A table holds at most BL_GEN_TABLE_WORDS * 8
+			 * samples, longer patterns do not fit anyway */
+			for (ch = 0; ch < BL_CHANNELS; ch++) {
+				if (!gen.pattern_len[ch])
+					continue;
+				if (gen.pattern_len[ch] > BL_GEN_TABLE_WORDS * 8) {
+					ret = -ENOSPC;
+					goto gen_out;
+				}
+				pattern[ch] = memdup_user(
+					u64_to_user_ptr(gen.pattern[ch]),
+					DIV_ROUND_UP(gen.pattern_len[ch], 8));
+				if (IS_ERR(pattern[ch])) {
+					ret = PTR_ERR(pattern[ch]);
+					pattern[ch] = NULL;
+					goto gen_out;
+				}
+			}
+			ret = beaglelogic_set_generator(bldev, &gen, pattern);
+gen_out:
+			for (ch = 0; ch < BL_CHANNELS; ch++)
+				kfree(pattern[ch]);
+			return ret;
+		}
+
+	}
+	return -ENOTTY;
+}
+
+/* Device file close handler */
+static int beaglelogic_f_release(struct inode *inode, struct file *filp)
+{
+	struct logic_buffer_reader *reader = filp->private_data;
+	struct beaglelogicdev *bldev = reader->bldev;
+	struct device *dev = bldev->miscdev.this_device;
+
+	/* Stop & Release; a stream plays out what was written */
+	if (bldev->stream)
+		beaglelogic_stream_flush(reader);
+	beaglelogic_stop(dev);
+	devm_kfree(dev, reader);
+
+	return 0;
+}
+
+/* File operations struct */
+static const struct file_operations pru_beaglelogic_fops = {
+	.owner = THIS_MODULE,
+	.open = beaglelogic_f_open,
+	.unlocked_ioctl = beaglelogic_f_ioctl,
+	.read = beaglelogic_f_read,
+	.write_iter = beaglelogic_f_write_iter,
+	.splice_write = iter_file_splice_write,
+	.mmap = beaglelogic_f_mmap,
+	.fsync = beaglelogic_f_fsync,
+//	.poll = beaglelogic_f_poll,
+	.release = beaglelogic_f_release,
+};
+/* fops */
+
+/* begin sysfs attrs */
+static ssize_t bl_bufunitsize_show(struct device *dev,
+        struct device_attribute *attr, char *buf)
+{
+	struct beaglelogicdev *bldev = dev_get_drvdata(dev);
+
+	return scnprintf(buf, PAGE_SIZE, "%d\n", bldev->bufunitsize);
+}
+
+static ssize_t bl_bufunitsize_store(struct device *dev,
+        struct device_attribute *attr, const char *buf, size_t count)
+{
+	uint32_t val;
+	int ret;
+
+	if (kstrtouint(buf, 10, &val))
+		return -EINVAL;
+
+	if (val < 64)
+		return -EINVAL;
+
+	/* Cut previously allocated buffers into the new unit */
+	ret = beaglelogic_set_bufunitsize(dev, val);
+
+	return ret ? ret : count;
+}
+
+static ssize_t bl_maxbufcount_show(struct device *dev,
+        struct device_attribute *attr, char *buf)
+{
+	struct beaglelogicdev *bldev = dev_get_drvdata(dev);
+
+	return scnprintf(buf, PAGE_SIZE, "%d\n", bldev->maxbufcount);
+}
+
+static ssize_t bl_memalloc_show(struct device *dev,
+        struct device_attribute *attr, char *buf)
+{
+	struct beaglelogicdev *bldev = dev_get_drvdata(dev);
+
+	// Adapted to show correct amount of bytes allocated
+	return scnprintf(buf, PAGE_SIZE, "%d\n", beaglelogic_memsize(bldev));
+}
+
+static ssize_t bl_memalloc_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct beaglelogicdev *bldev = dev_get_drvdata(dev);
+	uint32_t val;
+	int ret;
+
+	if(kstrtouint(buf, 10, &val))
+		return -EINVAL;
+
+	if (val > bldev->maxbufcount * bldev->bufunitsize)
+		return -EINVAL;
+
+	ret = beaglelogic_memalloc(dev, bldev->bufunitsize, val);
+
+	if (!ret)
+		beaglelogic_map_and_submit_all_buffers(dev);
+	else
+		return ret;
+	return count;
+}
+
+static ssize_t bl_state_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct beaglelogicdev *bldev = dev_get_drvdata(dev);
+	struct beaglelogic_progress progress;
+
+	if (bldev->state == STATE_BL_RUNNING) {
+		/* Returns the buffer being played, without blocking */
+		beaglelogic_get_progress(bldev, &progress);
+		return scnprintf(buf, PAGE_SIZE, "%d\n", progress.index);
+	}
+
+	/* Identify non-buffer debug states with a -ve value */
+	return scnprintf(buf, PAGE_SIZE, "-%d\n", -bldev->state);
+}
+
+// Not handled at the moment
+static ssize_t bl_state_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count)
+{
+	uint32_t val;
+	int ret;
+
+	if (kstrtouint(buf, 10, &val))
+		return -EINVAL;
+
+	/* State going to 1 starts the sampling operation, 0 aborts*/
+	if (val > 1)
+		return -EINVAL;
+
+	if (val == 1) {
+		ret = beaglelogic_start(dev);
+		if (ret)
+			return ret;
+	} else
+		beaglelogic_stop(dev);
+
+	return count;
+}
+
+static ssize_t bl_buffers_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct beaglelogicdev *bldev = dev_get_drvdata(dev);
+	int i, c, cnt;
+
+	for (i = 0, c = 0, cnt = 0; i < bldev->bufcount; i++) {
+		c = scnprintf(buf, PAGE_SIZE, "%08x,%u\n",
+				(uint32_t)bldev->buffers[i].phys_addr,
+				bldev->buffers[i].size);
+		cnt += c;
+		buf += c;
+	}
+
+	return cnt;
+}
+
+// Not handled at the moment
+static ssize_t bl_lasterror_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct beaglelogicdev *bldev = dev_get_drvdata(dev);
+
+	wait_event_interruptible(bldev->wait,
+			bldev->state != STATE_BL_RUNNING);
+
+
+	return scnprintf(buf, PAGE_SIZE, "%d\n", bldev->lasterror);
+}
+
+static ssize_t bl_ddrlatency_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct beaglelogicdev *bldev = dev_get_drvdata(dev);
+
+	return scnprintf(buf, PAGE_SIZE, "%d\n", bldev->ddrlatency);
+}
+
+static ssize_t bl_ddrlatency_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct beaglelogicdev *bldev = dev_get_drvdata(dev);
+	uint32_t val;
+
+	if (kstrtouint(buf, 10, &val))
+		return -EINVAL;
+
+	bldev->ddrlatency = val;
+	return count;
+}
+
+static ssize_t bl_ddrlatencymax_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct beaglelogicdev *bldev = dev_get_drvdata(dev);
+
+	return scnprintf(buf, PAGE_SIZE, "%d\n", bldev->ddrlatency_max);
+}
+
+// Uses the worse of the assumed and the measured DDR read time
+static ssize_t bl_maxsamplerate_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct beaglelogicdev *bldev = dev_get_drvdata(dev);
+
+	return scnprintf(buf, PAGE_SIZE, "%d\n",
+			beaglelogic_mode_samplerate(bldev));
+}
+
+// Clock monitor: slowest, fastest and mean sample rate (Hz) over the blocks
+// of this (or the last) run, 0 until PRU1 has asked for two blocks, then
+// the blocks PRU0 was late for (these are not timed)
+static ssize_t bl_clock_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct beaglelogicdev *bldev = dev_get_drvdata(dev);
+	struct capture_context *cxt = bldev->cxt_pru;
+	uint32_t blocks = READ_ONCE(cxt->clk_blocks);
+	uint64_t span, est;
+
+	if (bldev->edge || blocks < 2 || !bldev->start_ns)
+		return scnprintf(buf, PAGE_SIZE, "0 0 0 0\n");
+
+	/* The IEP counter wraps every 21 s; the time since the start tells
+	 * how often it did between the first and the last request */
+	span = (uint32_t)(READ_ONCE(cxt->clk_last) - READ_ONCE(cxt->clk_first));
+	est = div_u64((bldev->stop_ns ? bldev->stop_ns : ktime_get_ns()) -
+			bldev->start_ns, BL_PRU_CYCLE_NS);
+	if (est > span)
+		span += (est - span + BIT_ULL(31)) & ~(BIT_ULL(32) - 1);
+
+	return scnprintf(buf, PAGE_SIZE, "%u %u %u %u\n",
+			beaglelogic_block_rate(READ_ONCE(cxt->clk_max)),
+			beaglelogic_block_rate(READ_ONCE(cxt->clk_min)),
+			beaglelogic_block_rate(div_u64(span, blocks - 1)),
+			READ_ONCE(cxt->clk_late));
+}
+
+// index offset samples elapsed_ms eta_ms, see struct beaglelogic_progress
+static ssize_t bl_progress_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct beaglelogicdev *bldev = dev_get_drvdata(dev);
+	struct beaglelogic_progress p;
+
+	beaglelogic_get_progress(bldev, &p);
+
+	/* Each byte holds two 4 bit samples */
+	return scnprintf(buf, PAGE_SIZE, "%u %u %llu %u %u\n",
+			p.index, p.offset, (u64)p.bytes_done * 2,
+			p.elapsed_ms, p.eta_ms);
+}
+
+// Answered by PRU0 through the command mailbox, also while running
+static ssize_t bl_fwstatus_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct beaglelogicdev *bldev = dev_get_drvdata(dev);
+	int ret = beaglelogic_send_cmd(bldev, CMD_GET_STATUS);
+
+	if (ret < 0)
+		return ret == -ETIMEDOUT ? ret : -EIO;
+
+	return scnprintf(buf, PAGE_SIZE, "%d\n", ret);
+}
+
+static ssize_t bl_stream_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct beaglelogicdev *bldev = dev_get_drvdata(dev);
+
+	return scnprintf(buf, PAGE_SIZE, "%d\n", bldev->stream);
+}
+
+// 1: the buffer ring is refilled while the waveform plays
+static ssize_t bl_stream_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct beaglelogicdev *bldev = dev_get_drvdata(dev);
+	uint32_t val;
+	int ret;
+
+	if (kstrtouint(buf, 10, &val))
+		return -EINVAL;
+
+	ret = beaglelogic_set_stream(bldev, val);
+	return ret ? ret : count;
+}
+
+// Job queue: id of the last job ended, id of the last job played
+static ssize_t bl_jobs_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct beaglelogicdev *bldev = dev_get_drvdata(dev);
+
+	if (bldev->stream && bldev->buffers)
+		beaglelogic_stream_reap(bldev);
+	return scnprintf(buf, PAGE_SIZE, "%u %u\n", bldev->jobs_queued,
+			bldev->jobs_done);
+}
 
-	beaglelogic_map_buffer(dev, &bldev->buffers[0]);
+static ssize_t bl_loop_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct beaglelogicdev *bldev = dev_get_drvdata(dev);
 
-	return 0;
+	return scnprintf(buf, PAGE_SIZE, "%u\n", bldev->loop);
 }
 
-// Write operation of a user space buffer
-ssize_t beaglelogic_f_write (struct file *filp, const char __user *buf,
-                           size_t sz, loff_t *offset)
+// Loop mode: iterations to play, 4294967295 until stopped, 0 to play once
+static ssize_t bl_loop_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count)
 {
- 	int count;
- 	struct logic_buffer_reader *reader = filp->private_data;
- 	struct beaglelogicdev *bldev = reader->bldev;
-
- 	if (bldev->state == STATE_BL_ERROR)
- 		return -EIO;
+	struct beaglelogicdev *bldev = dev_get_drvdata(dev);
+	uint32_t val;
+	int ret;
 
- 	if (reader->pos > 0)
- 		goto perform_copy;
+	if (kstrtouint(buf, 10, &val))
+		return -EINVAL;
 
- 	if (reader->buf == NULL) {
- 		/* First time init */
- 		reader->buf = &reader->bldev->buffers[0];
-		reader->pos = 0;							
- 		reader->remaining = reader->buf->size;
- 	} else {
- 		if (reader->buf == bldev->buffers &&
- 				bldev->state == STATE_BL_INITIALIZED)
- 			return 0;
- 	}
+	ret = beaglelogic_set_loop(bldev, val);
+	return ret ? ret : count;
+}
 
- perform_copy:
- 	count = min(reader->remaining, sz);
+// Loop mode: iterations PRU0 has read in this (or the last) run
+static ssize_t bl_iteration_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct beaglelogicdev *bldev = dev_get_drvdata(dev);
 
- 	if (copy_from_user(reader->buf->buf + reader->pos, buf, count))
- 		return -EFAULT;
+	return scnprintf(buf, PAGE_SIZE, "%u\n",
+			READ_ONCE(bldev->cxt_pru->loop_iter));
+}
 
- 	reader->pos += count;
- 	reader->remaining -= count;
+static ssize_t bl_edge_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct beaglelogicdev *bldev = dev_get_drvdata(dev);
 
- 	if (reader->remaining == 0) {
- 		/* Change the buffer */
- 		reader->buf = reader->buf->next;
- 		reader->pos = 0;
- 		reader->remaining = reader->buf->size;
- 	}
- 	return count;
+	return scnprintf(buf, PAGE_SIZE, "%u\n", bldev->edge);
 }
 
-/* Configuration through ioctl */
-// Number of ioctl calls cropped since most BeagleLogic's sysfs attributes are omitted 
-static long beaglelogic_f_ioctl(struct file *filp, unsigned int cmd,
-		  unsigned long arg)
+// Edge list mode: 1 plays the buffers as struct beaglelogic_edge records
+static ssize_t bl_edge_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count)
 {
-	struct logic_buffer_reader *reader = filp->private_data;
-	struct beaglelogicdev *bldev = reader->bldev;
-	struct device *dev = bldev->miscdev.this_device;
-
+	struct beaglelogicdev *bldev = dev_get_drvdata(dev);
 	uint32_t val;
+	int ret;
 
-	dev_dbg(dev, "BeagleLogic: IOCTL called cmd = %08X, "\
-			"arg = %08lX\n", cmd, arg);
-
-	switch (cmd) {
-		case IOCTL_BL_GET_VERSION:
-			return 0;
-
-		case IOCTL_BL_GET_BUFFER_SIZE:
-			// Adapted to display correct allocated n° bytes
-			val = bldev->bufunitsize * (bldev->bufcount-1) + bldev->buffers[bldev->bufcount-1].size;
-			if (copy_to_user((void * __user)arg,
-					&val,
-					sizeof(val)))
-				return -EFAULT;
-			return 0;
+	if (kstrtouint(buf, 10, &val))
+		return -EINVAL;
 
-		case IOCTL_BL_SET_BUFFER_SIZE:
-			beaglelogic_memfree(dev);
-			val = beaglelogic_memalloc(dev,arg);
-			if (!val)
-				return beaglelogic_map_and_submit_all_buffers(dev);
-			return val;
+	ret = beaglelogic_set_edge(bldev, val);
+	return ret ? ret : count;
+}
 
-		case IOCTL_BL_GET_BUFUNIT_SIZE:
-			if(copy_to_user((void * __user)arg,
-					&bldev->bufunitsize,
-					sizeof(bldev->bufunitsize)))
-				return -EFAULT;
-			return 0;
+static ssize_t bl_sums_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct beaglelogicdev *bldev = dev_get_drvdata(dev);
+	struct beaglelogic_sum run;
 
-		case IOCTL_BL_SET_BUFUNIT_SIZE:
-			// Data block transfer 64 bytes instead of 32 bytes in original BeagleLogic code
-			if ((uint32_t)arg < 64)
-				return -EINVAL;
-			bldev->bufunitsize = round_up(arg, 64);
-			beaglelogic_memfree(dev);
-			return 0;
+	beaglelogic_get_sums(bldev, &run);
+	return scnprintf(buf, PAGE_SIZE, "%u %08x %08x %u\n", bldev->sums,
+			run.a, run.b, run.blocks);
+}
 
-		case IOCTL_BL_START:
-			/* Reset and reconfigure the reader object and then start */
-			reader->buf = &bldev->buffers[0];
-			reader->pos = 0;
-			reader->remaining = reader->buf->size;
+// Block sums: 1 folds every block PRU0 hands over, shows "enable a b blocks"
+static ssize_t bl_sums_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct beaglelogicdev *bldev = dev_get_drvdata(dev);
+	uint32_t val;
+	int ret;
 
-			beaglelogic_start(dev);
-			return 0;
+	if (kstrtouint(buf, 10, &val))
+		return -EINVAL;
 
-	}
-	return -ENOTTY;
+	ret = beaglelogic_set_sums(bldev, val);
+	return ret ? ret : count;
 }
 
-/* Device file close handler */
-static int beaglelogic_f_release(struct inode *inode, struct file *filp)
+// Edge list mode: records PRU1 played late in this (or the last) run
+static ssize_t bl_edgelate_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
 {
-	struct logic_buffer_reader *reader = filp->private_data;
-	struct beaglelogicdev *bldev = reader->bldev;
-	struct device *dev = bldev->miscdev.this_device;
-
-	/* Stop & Release */
-	beaglelogic_stop(dev);
-	devm_kfree(dev, reader);
+	struct beaglelogicdev *bldev = dev_get_drvdata(dev);
 
-	return 0;
+	return scnprintf(buf, PAGE_SIZE, "%u\n",
+			READ_ONCE(bldev->cxt_pru->edge_late));
 }
 
-/* File operations struct */
-static const struct file_operations pru_beaglelogic_fops = {
-	.owner = THIS_MODULE,
-	.open = beaglelogic_f_open,
-	.unlocked_ioctl = beaglelogic_f_ioctl,
-	.write = beaglelogic_f_write,
-//	.poll = beaglelogic_f_poll,
-	.release = beaglelogic_f_release,
-};
-/* fops */
-
-/* begin sysfs attrs */
-static ssize_t bl_bufunitsize_show(struct device *dev,
-        struct device_attribute *attr, char *buf)
+// Indexed mode: enable and dictionary blocks. The dictionary comes with
+// IOCTL_BL_SET_INDEX; writing 0 plays the buffers as samples again
+static ssize_t bl_index_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
 {
 	struct beaglelogicdev *bldev = dev_get_drvdata(dev);
 
-	return scnprintf(buf, PAGE_SIZE, "%d\n", bldev->bufunitsize);
+	return scnprintf(buf, PAGE_SIZE, "%d %u\n",
+			!!bldev->index_dict.buf, bldev->index_dict.size / 64);
 }
 
-static ssize_t bl_bufunitsize_store(struct device *dev,
-        struct device_attribute *attr, const char *buf, size_t count)
+static ssize_t bl_index_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count)
 {
 	struct beaglelogicdev *bldev = dev_get_drvdata(dev);
-	uint32_t val;
+	struct beaglelogic_index ix = { 0 };
+	int ret;
 
-	if (kstrtouint(buf, 10, &val))
+	if (kstrtouint(buf, 10, &ix.enable) || ix.enable)
 		return -EINVAL;
 
-	if (val < 64)
-		return -EINVAL;
+	ret = beaglelogic_set_index(bldev, &ix);
+	return ret ? ret : count;
+}
 
-	bldev->bufunitsize = round_up(val, 64);
+// Internal clock: PRU cycles per sample (0 on the external clock) and the
+// buffers with their own period. Writing sets the period of all buffers
+static ssize_t bl_sampleperiod_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct beaglelogicdev *bldev = dev_get_drvdata(dev);
 
-	/* Free up previously allocated buffers */
-	beaglelogic_memfree(dev);
+	return scnprintf(buf, PAGE_SIZE, "%u %u\n", bldev->clk_period,
+			bldev->clk_segments);
+}
 
-	return count;
+static ssize_t bl_sampleperiod_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct beaglelogicdev *bldev = dev_get_drvdata(dev);
+	struct beaglelogic_clock clk = { 0 };
+	int ret;
+
+	if (kstrtouint(buf, 10, &clk.period))
+		return -EINVAL;
+
+	ret = beaglelogic_set_clock(bldev, &clk);
+	return ret ? ret : count;
 }
 
-static ssize_t bl_memalloc_show(struct device *dev,
-        struct device_attribute *attr, char *buf)
+// Capture: inputs captured (0 off), ring size, then the bytes captured in
+// the last or current run and those read() skipped. Writing takes the mask
+// and, to turn capture on, the ring size
+static ssize_t bl_capture_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
 {
 	struct beaglelogicdev *bldev = dev_get_drvdata(dev);
 
-	// Adapted to show correct amount of bytes allocated
-	return scnprintf(buf, PAGE_SIZE, "%d\n",
-			(bldev->bufcount-1) * bldev->bufunitsize + bldev->buffers[bldev->bufcount-1].size);
+	return scnprintf(buf, PAGE_SIZE, "%u %u %llu %llu\n", bldev->cap_mask,
+			bldev->cap_size, beaglelogic_capture_bytes(bldev),
+			bldev->cap_lost);
 }
 
-static ssize_t bl_memalloc_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t count)
+static ssize_t bl_capture_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count)
 {
 	struct beaglelogicdev *bldev = dev_get_drvdata(dev);
-	uint32_t val;
+	struct beaglelogic_capture cap = { 0 };
 	int ret;
 
-	if(kstrtouint(buf, 10, &val))
-		return -EINVAL;
-
-	if (val > bldev->maxbufcount * bldev->bufunitsize)
+	if (sscanf(buf, "%i %i", &cap.mask, &cap.size) < 1)
 		return -EINVAL;
 
-	beaglelogic_memfree(dev);
-	ret = beaglelogic_memalloc(dev, val);
-
-	if (!ret)
-		beaglelogic_map_and_submit_all_buffers(dev);
-	else
-		return ret;
-	return count;
+	ret = beaglelogic_set_capture(bldev, &cap);
+	return ret ? ret : count;
 }
 
-// Not handled at the moment
-static ssize_t bl_state_show(struct device *dev,
+// Watchdog: timeout (ms, 0 off), the hung runs it ended and the timeout
+// a run in the configured mode gets (at least two blocks)
+static ssize_t bl_watchdog_show(struct device *dev,
 		struct device_attribute *attr, char *buf)
 {
 	struct beaglelogicdev *bldev = dev_get_drvdata(dev);
-	uint32_t state = bldev->state;
-	struct logic_buffer *buffer = bldev->bufbeingread;
-
-	if (state == STATE_BL_RUNNING) {
-		/* State blocks and returns last buffer read */
-		wait_event_interruptible(bldev->wait,
-				buffer->state == STATE_BL_BUF_UNMAPPED);
-		return scnprintf(buf, PAGE_SIZE, "%d\n", buffer->index);
-	}
 
-	/* Identify non-buffer debug states with a -ve value */
-	return scnprintf(buf, PAGE_SIZE, "-%d\n", -bldev->state);
+	return scnprintf(buf, PAGE_SIZE, "%u %u %u\n", bldev->watchdog_ms,
+			bldev->watchdog_resets,
+			beaglelogic_watchdog_timeout(bldev));
 }
 
-// Not handled at the moment
-static ssize_t bl_state_store(struct device *dev,
+static ssize_t bl_watchdog_store(struct device *dev,
 		struct device_attribute *attr, const char *buf, size_t count)
 {
+	struct beaglelogicdev *bldev = dev_get_drvdata(dev);
 	uint32_t val;
 
 	if (kstrtouint(buf, 10, &val))
 		return -EINVAL;
 
-	/* State going to 1 starts the sampling operation, 0 aborts*/
-	if (val > 1)
-		return -EINVAL;
-
-	if (val == 1)
-		beaglelogic_start(dev);
-	else
-		beaglelogic_stop(dev);
-
+	/* A new timeout, or turning it on, takes effect with the next run */
+	bldev->watchdog_ms = val;
 	return count;
 }
 
-static ssize_t bl_buffers_show(struct device *dev,
+// Generator mode: enable channels poly seed start div samples, numbers in
+// any base; "0" plays the buffers again
+static ssize_t bl_generator_show(struct device *dev,
 		struct device_attribute *attr, char *buf)
 {
 	struct beaglelogicdev *bldev = dev_get_drvdata(dev);
-	int i, c, cnt;
-
-	for (i = 0, c = 0, cnt = 0; i < bldev->bufcount; i++) {
-		c = scnprintf(buf, PAGE_SIZE, "%08x,%u\n",
-				(uint32_t)bldev->buffers[i].phys_addr,
-				bldev->buffers[i].size);
-		cnt += c;
-		buf += c;
-	}
+	struct beaglelogic_generator *g = &bldev->gen;
 
-	return cnt;
+	return scnprintf(buf, PAGE_SIZE, "%u 0x%04x 0x%x 0x%x %u %u %llu\n",
+			g->enable, g->channels, g->prbs_poly, g->prbs_seed,
+			g->count_start, g->count_div, g->samples);
 }
 
-// Not handled at the moment
-static ssize_t bl_lasterror_show(struct device *dev,
-		struct device_attribute *attr, char *buf)
+/* "enable channels poly seed start div samples", followed by the samples of
+ * each BL_GEN_PATTERN channel as a string of 0s and 1s, in channel order */
+static ssize_t bl_generator_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count)
 {
 	struct beaglelogicdev *bldev = dev_get_drvdata(dev);
+	struct beaglelogic_generator g = { 0 };
+	u8 *pattern[BL_CHANNELS] = { NULL };
+	int ret = 0, n, pos = 0, ch;
+	size_t len, i;
+
+	n = sscanf(buf, "%i %i %i %i %i %i %lli%n", &g.enable, &g.channels,
+			&g.prbs_poly, &g.prbs_seed, &g.count_start,
+			&g.count_div, &g.samples, &pos);
+	if (n != 7 && !(n == 1 && !g.enable))
+		return -EINVAL;
 
-	wait_event_interruptible(bldev->wait,
-			bldev->state != STATE_BL_RUNNING);
-
+	for (ch = 0; n == 7 && ch < BL_CHANNELS; ch++) {
+		if (((g.channels >> (4 * ch)) & ~BL_GEN_INVERT & 0xF) !=
+				BL_GEN_PATTERN)
+			continue;
+		buf = skip_spaces(buf + pos);
+		len = strspn(buf, "01");
+		pattern[ch] = kzalloc(DIV_ROUND_UP(len, 8) + 1, GFP_KERNEL);
+		if (!pattern[ch]) {
+			ret = -ENOMEM;
+			goto out;
+		}
+		for (i = 0; i < len; i++)
+			pattern[ch][i / 8] |= (buf[i] - '0') << (i % 8);
+		g.pattern_len[ch] = len;
+		pos = len;
+	}
 
-	return scnprintf(buf, PAGE_SIZE, "%d\n", bldev->lasterror);
+	ret = beaglelogic_set_generator(bldev, &g, pattern);
+out:
+	for (ch = 0; ch < BL_CHANNELS; ch++)
+		kfree(pattern[ch]);
+	return ret ? ret : count;
 }
 
 static DEVICE_ATTR(bufunitsize, S_IWUSR | S_IRUGO,
 		bl_bufunitsize_show, bl_bufunitsize_store);
 
+static DEVICE_ATTR(maxbufcount, S_IRUGO,
+		bl_maxbufcount_show, NULL);
+
 static DEVICE_ATTR(memalloc, S_IWUSR | S_IRUGO,
 		bl_memalloc_show, bl_memalloc_store);
 
@@ -781,12 +3534,85 @@ static DEVICE_ATTR(buffers, S_IRUGO,
 static DEVICE_ATTR(lasterror, S_IRUGO,
 		bl_lasterror_show, NULL);
 
+static DEVICE_ATTR(ddrlatency, S_IWUSR | S_IRUGO,
+		bl_ddrlatency_show, bl_ddrlatency_store);
+
+static DEVICE_ATTR(ddrlatencymax, S_IRUGO,
+		bl_ddrlatencymax_show, NULL);
+
+static DEVICE_ATTR(maxsamplerate, S_IRUGO,
+		bl_maxsamplerate_show, NULL);
+
+static DEVICE_ATTR(clock, S_IRUGO,
+		bl_clock_show, NULL);
+
+static DEVICE_ATTR(fwstatus, S_IRUGO,
+		bl_fwstatus_show, NULL);
+
+static DEVICE_ATTR(progress, S_IRUGO,
+		bl_progress_show, NULL);
+
+static DEVICE_ATTR(stream, S_IWUSR | S_IRUGO,
+		bl_stream_show, bl_stream_store);
+
+static DEVICE_ATTR(jobs, S_IRUGO,
+		bl_jobs_show, NULL);
+
+static DEVICE_ATTR(loop, S_IWUSR | S_IRUGO,
+		bl_loop_show, bl_loop_store);
+
+static DEVICE_ATTR(iteration, S_IRUGO,
+		bl_iteration_show, NULL);
+
+static DEVICE_ATTR(generator, S_IWUSR | S_IRUGO,
+		bl_generator_show, bl_generator_store);
+
+static DEVICE_ATTR(edge, S_IWUSR | S_IRUGO,
+		bl_edge_show, bl_edge_store);
+
+static DEVICE_ATTR(edgelate, S_IRUGO,
+		bl_edgelate_show, NULL);
+
+static DEVICE_ATTR(sums, S_IWUSR | S_IRUGO,
+		bl_sums_show, bl_sums_store);
+
+static DEVICE_ATTR(index, S_IWUSR | S_IRUGO,
+		bl_index_show, bl_index_store);
+
+static DEVICE_ATTR(sampleperiod, S_IWUSR | S_IRUGO,
+		bl_sampleperiod_show, bl_sampleperiod_store);
+
+static DEVICE_ATTR(capture, S_IWUSR | S_IRUGO,
+		bl_capture_show, bl_capture_store);
+
+static DEVICE_ATTR(watchdog, S_IWUSR | S_IRUGO,
+		bl_watchdog_show, bl_watchdog_store);
+
 static struct attribute *beaglelogic_attributes[] = {
 	&dev_attr_bufunitsize.attr,
+	&dev_attr_maxbufcount.attr,
 	&dev_attr_memalloc.attr,
 	&dev_attr_state.attr,
 	&dev_attr_buffers.attr,
 	&dev_attr_lasterror.attr,
+	&dev_attr_ddrlatency.attr,
+	&dev_attr_ddrlatencymax.attr,
+	&dev_attr_maxsamplerate.attr,
+	&dev_attr_clock.attr,
+	&dev_attr_fwstatus.attr,
+	&dev_attr_progress.attr,
+	&dev_attr_stream.attr,
+	&dev_attr_jobs.attr,
+	&dev_attr_loop.attr,
+	&dev_attr_iteration.attr,
+	&dev_attr_generator.attr,
+	&dev_attr_edge.attr,
+	&dev_attr_edgelate.attr,
+	&dev_attr_sums.attr,
+	&dev_attr_index.attr,
+	&dev_attr_sampleperiod.attr,
+	&dev_attr_capture.attr,
+	&dev_attr_watchdog.attr,
 	NULL
 };
 
@@ -799,6 +3625,7 @@ static const struct of_device_id beaglelogic_dt_ids[];
 
 static int beaglelogic_probe(struct platform_device *pdev)
 {
+	static char *ready_envp[] = { "BEAGLELOGIC=ready", NULL };
 	struct beaglelogicdev *bldev;
 	struct device *dev;
 	struct device_node *node = pdev->dev.of_node;
@@ -862,6 +3689,13 @@ static int beaglelogic_probe(struct platform_device *pdev)
 		goto fail_putmem;
 	}
 
+	ret = pruss_request_mem_region(bldev->pruss, PRUSS_MEM_SHRD_RAM2,
+		&bldev->sharedram);
+	if (ret) {
+		dev_err(dev, "Unable to get PRUSS shared RAM.\n");
+		goto fail_putmem;
+	}
+
 	/* Get interrupts and install interrupt handlers */
 	bldev->from_bl_irq_1 = platform_get_irq_byname(pdev, "from_bl_1");		// PRU0_TO_ARM_A
 	if (bldev->from_bl_irq_1 <= 0) {
@@ -875,6 +3709,12 @@ static int beaglelogic_probe(struct platform_device *pdev)
 		if (ret == -EPROBE_DEFER)
 			goto fail_putmem;
 	}
+	bldev->from_bl_irq_3 = platform_get_irq_byname(pdev, "from_bl_3");		// PRU0_TO_ARM_C
+	if (bldev->from_bl_irq_3 <= 0) {
+		ret = bldev->from_bl_irq_3;
+		if (ret == -EPROBE_DEFER)
+			goto fail_putmem;
+	}
 	bldev->to_bl_irq = platform_get_irq_byname(pdev, "to_bl");				// ARM_TO_PRU0
 	if (bldev->to_bl_irq<= 0) {
 		ret = bldev->to_bl_irq;
@@ -882,6 +3722,19 @@ static int beaglelogic_probe(struct platform_device *pdev)
 			goto fail_putmem;
 	}
 
+	/* Set up locks and the command mailbox before any IRQ can arrive */
+	mutex_init(&bldev->mutex);
+	mutex_init(&bldev->cmd_mutex);
+	mutex_init(&bldev->swap_mutex);
+	mutex_init(&bldev->cap_mutex);
+	init_completion(&bldev->cmd_done);
+	init_waitqueue_head(&bldev->wait);
+	spin_lock_init(&bldev->stream_lock);
+	INIT_DELAYED_WORK(&bldev->watchdog, beaglelogic_watchdog);
+
+	/* Capture context structure is at location 0000h in PRU0 SRAM */
+	bldev->cxt_pru = bldev->pru0sram.va + 0;
+
 	ret = request_irq(bldev->from_bl_irq_1, beaglelogic_serve_irq,
 		IRQF_ONESHOT, dev_name(dev), bldev);								// PRU0_TO_ARM_A
 	if (ret) goto fail_putmem;
@@ -890,7 +3743,13 @@ static int beaglelogic_probe(struct platform_device *pdev)
 		IRQF_ONESHOT, dev_name(dev), bldev);								// PRU0_TO_ARM_B
 	if (ret) goto fail_free_irq1;
 
+	ret = request_irq(bldev->from_bl_irq_3, beaglelogic_serve_irq,
+		IRQF_ONESHOT, dev_name(dev), bldev);								// PRU0_TO_ARM_C
+	if (ret) goto fail_free_irq2;
+
 	/* Set firmware and boot the PRUs */
+	strscpy(bldev->fw.pru0, bldev->fw_data->fw_names[0], BL_FW_NAME_LEN);
+	strscpy(bldev->fw.pru1, bldev->fw_data->fw_names[1], BL_FW_NAME_LEN);
 	ret = rproc_set_firmware(bldev->pru0, bldev->fw_data->fw_names[0]);
 	if (ret) {
 		dev_err(dev, "Failed to set PRU0 firmware %s: %d\n",
@@ -926,48 +3785,23 @@ static int beaglelogic_probe(struct platform_device *pdev)
 	dev = bldev->miscdev.this_device;
 	dev_set_drvdata(dev, bldev);
 
-	/* Set up locks */
-	mutex_init(&bldev->mutex);
-	init_waitqueue_head(&bldev->wait);
-
 	/* Power on in disabled state */
-	bldev->state = STATE_BL_DISABLED;
-
-	/* Capture context structure is at location 0000h in PRU0 SRAM */
-	bldev->cxt_pru = bldev->pru0sram.va + 0;
-
-	if (bldev->cxt_pru->magic == BL_FW_MAGIC)
-		dev_info(dev, "Valid PRU capture context structure "\
-				"found at offset %04X\n", 0);
-	else {
-		dev_err(dev, "Firmware error!\n");
-		goto faildereg;
-	}
-
-	/* Get firmware properties */
-	ret = beaglelogic_send_cmd(bldev, CMD_GET_VERSION);
-	if (ret != 0) {
-		dev_info(dev, "BeagleLogic PRU Firmware version: %d.%d\n",
-				ret >> 8, ret & 0xFF);
-	} else {
-		dev_err(dev, "Firmware error!\n");
-		goto faildereg;
-	}
+	beaglelogic_set_state(bldev, STATE_BL_DISABLED);
 
-	ret = beaglelogic_send_cmd(bldev, CMD_GET_MAX_SG);
-	if (ret > 0 && ret < 256) { /* Let's be reasonable here */
-		dev_info(dev, "Device supports max %d vector transfers\n", ret);
-		bldev->maxbufcount = ret;
-	} else {
-		dev_err(dev, "Firmware error!\n");
+	/* Check the firmware and get its properties */
+	ret = beaglelogic_fw_check(bldev);
+	if (ret)
 		goto faildereg;
-	}
 
 	// Apply buffer unit size, currently up to 163 MiB, if higher value desired, increase this.
 	bldev->bufunitsize = 640000;
 
+	bldev->ddrlatency = BL_DDRLATENCY_DEFAULT;
+
+	bldev->watchdog_ms = BL_WATCHDOG_MS_DEFAULT;
+
 	/* We got configuration from PRUs, now mark device init'd */
-	bldev->state = STATE_BL_INITIALIZED;
+	beaglelogic_set_state(bldev, STATE_BL_INITIALIZED);
 
 	/* Display our init'ed state */
 	dev_info(dev, "Device driver initialized with unit buffer size: %d\n", bldev->bufunitsize);
@@ -979,6 +3813,10 @@ static int beaglelogic_probe(struct platform_device *pdev)
 		goto faildereg;
 	}
 
+	/* The add event of the misc device came before the attributes, so
+	 * tell udev (scripts/90-beaglelogic.rules) the device is ready now */
+	kobject_uevent_env(&dev->kobj, KOBJ_CHANGE, ready_envp);
+
 	return 0;
 faildereg:
 	misc_deregister(&bldev->miscdev);
@@ -987,10 +3825,14 @@ fail_shutdown_prus:
 fail_shutdown_pru0:
 	rproc_shutdown(bldev->pru0);
 fail_free_irqs:
+	free_irq(bldev->from_bl_irq_3, bldev);
+fail_free_irq2:
 	free_irq(bldev->from_bl_irq_2, bldev);
 fail_free_irq1:
 	free_irq(bldev->from_bl_irq_1, bldev);
 fail_putmem:
+	if (bldev->sharedram.va)
+		pruss_release_mem_region(bldev->pruss, &bldev->sharedram);
 	if (bldev->pru0sram.va)
 		pruss_release_mem_region(bldev->pruss, &bldev->pru0sram);
 	pruss_rproc_put(bldev->pruss, bldev->pru1);
@@ -1009,8 +3851,14 @@ static int beaglelogic_remove(struct platform_device *pdev)
 	struct beaglelogicdev *bldev = platform_get_drvdata(pdev);
 	struct device *dev = bldev->miscdev.this_device;
 
+	/* No restart once the PRUs go down */
+	cancel_delayed_work_sync(&bldev->watchdog);
+
 	/* Free all buffers */
 	beaglelogic_memfree(dev);
+	if (bldev->cap_buf)
+		dma_free_coherent(dev, bldev->cap_size, bldev->cap_buf,
+				bldev->cap_dma);
 
 	/* Remove the sysfs attributes */
 	sysfs_remove_group(&dev->kobj, &beaglelogic_attr_group);
@@ -1023,16 +3871,21 @@ static int beaglelogic_remove(struct platform_device *pdev)
 	rproc_shutdown(bldev->pru0);
 
 	/* Free IRQs */
+	free_irq(bldev->from_bl_irq_3, bldev);
 	free_irq(bldev->from_bl_irq_2, bldev);
 	free_irq(bldev->from_bl_irq_1, bldev);
 
 	/* Release handles to PRUSS memory regions */
+	pruss_release_mem_region(bldev->pruss, &bldev->sharedram);
 	pruss_release_mem_region(bldev->pruss, &bldev->pru0sram);
 	pruss_rproc_put(bldev->pruss, bldev->pru1);
 	pruss_rproc_put(bldev->pruss, bldev->pru0);
 	pruss_put(bldev->pruss);
 
 	/* Free up memory */
+	kfree(bldev->gen_table);
+	kfree(bldev->index_dict.buf);
+	kfree(bldev->clk_periods);
 	kfree(bldev);
 
 	/* Print a log message to announce unloading */
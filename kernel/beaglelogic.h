@@ -47,4 +47,228 @@ enum beaglelogic_states {
 
 #define IOCTL_BL_START               _IO('k', 0x29)
 
+/* Playback progress, readable at any time without blocking */
+struct beaglelogic_progress {
+	u32 state;		/* enum beaglelogic_states */
+	u32 index;		/* Buffer being played (bufcount when done) */
+	u32 offset;		/* Bytes of that buffer handed to PRU1 */
+	u32 bytes_done;		/* Bytes handed to PRU1 since the start */
+	u32 bytes_total;	/* Bytes in all buffers (stream mode: queued
+				 * so far; both modulo 4 GiB) */
+	u32 elapsed_ms;		/* Since the start, frozen at the end */
+	u32 eta_ms;		/* Estimated time left, 0 when unknown */
+};
+
+#define IOCTL_BL_GET_PROGRESS       _IOR('k', 0x2A, struct beaglelogic_progress)
+
+/* Stream mode (1): the buffer ring is refilled while the waveform plays */
+#define IOCTL_BL_GET_STREAM         _IOR('k', 0x2B, u32)
+#define IOCTL_BL_SET_STREAM         _IOW('k', 0x2B, u32)
+
+/* Job queue (stream mode): JOB_END ends the job written so far, which plays
+ * gaplessly after the previous one, and returns its id (1, 2, ...).
+ * WAIT_JOB blocks until PRU0 has read the given job completely */
+struct beaglelogic_jobs {
+	u32 queued;		/* Id of the last job ended */
+	u32 done;		/* Id of the last job PRU0 has read */
+};
+
+#define IOCTL_BL_JOB_END             _IO('k', 0x2C)
+#define IOCTL_BL_WAIT_JOB           _IOW('k', 0x2D, u32)
+#define IOCTL_BL_GET_JOBS           _IOR('k', 0x2E, struct beaglelogic_jobs)
+
+/* Loop mode: the waveform plays this many times, BL_LOOP_FOREVER until it
+ * is stopped; 0 plays it once. A stop ends it at a loop boundary */
+#define BL_LOOP_FOREVER	0xFFFFFFFF
+
+#define IOCTL_BL_GET_LOOP           _IOR('k', 0x2F, u32)
+#define IOCTL_BL_SET_LOOP           _IOW('k', 0x2F, u32)
+
+/* Loop mode: replace the contents of one buffer (segment) for the following
+ * iterations. While the waveform plays, the data goes into a shadow copy
+ * that PRU0 swaps in at the next loop boundary; WAIT_SWAP then returns the
+ * first iteration (counted from 0) that played it */
+struct beaglelogic_swap {
+	u32 index;		/* Buffer to replace */
+	u32 length;		/* Bytes at 'data', the size of the buffer */
+	u64 data;		/* User space address of the new contents */
+};
+
+#define IOCTL_BL_SWAP_SEGMENT       _IOW('k', 0x30, struct beaglelogic_swap)
+#define IOCTL_BL_WAIT_SWAP          _IOR('k', 0x31, u32)
+
+/* Generator mode: PRU0 computes the samples instead of reading buffers.
+ * Each channel takes one source, optionally inverted */
+#define BL_GEN_LOW	0
+#define BL_GEN_HIGH	1
+#define BL_GEN_PRBS	2	/* The PRBS, one bit per channel and sample */
+#define BL_GEN_COUNT	3	/* Channel N: bit N of the counter */
+#define BL_GEN_PATTERN	4	/* Its own pattern, looping over pattern_len */
+#define BL_GEN_INVERT	8
+
+#define BL_GEN_CHANNEL(ch, src)	((src) << (4 * (ch)))
+
+/* PRBS polynomials x^b + x^a + 1, bit N stands for x^N */
+#define BL_PRBS7	0x000000C1
+#define BL_PRBS15	0x0000C001
+#define BL_PRBS23	0x00840001
+#define BL_PRBS31	0x90000001
+
+struct beaglelogic_generator {
+	u32 enable;		/* 0 plays the buffers */
+	u32 channels;		/* Source of channel N in bits 4N+3:4N */
+	u32 prbs_poly;		/* Trinomial, see BL_PRBS7 */
+	u32 prbs_seed;		/* First b bits of the sequence, not all 0 */
+	u32 count_start;	/* Counter value of the first sample */
+	u32 count_div;		/* Samples per count, a power of 2 */
+	u64 samples;		/* Samples to play (in blocks of 128), 0 until
+				 * stopped */
+	u32 pattern_len[4];	/* BL_GEN_PATTERN: samples in the loop */
+	u64 pattern[4];		/* User space address of the samples, sample 0
+				 * in bit 0 of the first byte */
+};
+
+/* With a BL_GEN_PATTERN channel every channel plays from a table of
+ * L / gcd(L, 8) words for a loop of L samples (a PRBS loops over 2^b - 1,
+ * counter bit N over count_div << (N + 1)). The tables of all channels
+ * share 12 KB, 3072 words */
+
+#define IOCTL_BL_GET_GENERATOR      _IOR('k', 0x32, struct beaglelogic_generator)
+#define IOCTL_BL_SET_GENERATOR      _IOW('k', 0x32, struct beaglelogic_generator)
+
+/* Edge list mode (1): the buffers hold records instead of samples. PRU1
+ * puts 'value' on the outputs at 'time', in PRU cycles (5 ns) from the
+ * start of the run and modulo 2^32; records follow each other by less than
+ * 2^31 cycles. A record comes at least BL_EDGE_MIN_CYCLES after the one
+ * before, BL_EDGE_BLOCK_CYCLES for the first of each block of 8, or PRU1
+ * plays it late, as soon as it can. PRU0 reads the next block while PRU1
+ * plays one, so the last records of consecutive blocks (and the first
+ * block's from time 0) must also be a DDR read apart. The last block is
+ * padded with BL_EDGE_SKIP records */
+struct beaglelogic_edge {
+	u32 time;
+	u32 value;		/* Outputs in the low bits */
+};
+
+#define BL_EDGE_SKIP		0x80000000	/* In value: not played */
+#define BL_EDGE_MIN_CYCLES	14
+#define BL_EDGE_BLOCK_CYCLES	18
+
+#define IOCTL_BL_GET_EDGE           _IOR('k', 0x33, u32)
+#define IOCTL_BL_SET_EDGE           _IOW('k', 0x33, u32)
+
+/* Indexed mode: the buffers hold one 16 bit index (little endian) per 64
+ * byte block into a dictionary of unique blocks, so repeated blocks are
+ * stored once. The index stream is played in batches of 32; pad the last
+ * one with the index of an idle block. A block that starts a batch costs
+ * PRU0 two DDR reads, see maxsamplerate */
+struct beaglelogic_index {
+	u32 enable;		/* 0 plays the buffers as samples */
+	u32 blocks;		/* Dictionary blocks, up to BL_INDEX_MAX_BLOCKS */
+	u64 dict;		/* User space address of blocks * 64 bytes */
+};
+
+#define BL_INDEX_MAX_BLOCKS	65536
+#define BL_INDEX_BATCH		32
+
+#define IOCTL_BL_GET_INDEX          _IOR('k', 0x34, struct beaglelogic_index)
+#define IOCTL_BL_SET_INDEX          _IOW('k', 0x34, struct beaglelogic_index)
+
+/* Firmware images of the two PRUs, as names under /lib/firmware. While
+ * idle, SET_FIRMWARE restarts both PRUs with these images (an empty name
+ * keeps the current one, so all empty just resets them); the allocated
+ * buffers and settings are kept */
+#define BL_FW_NAME_LEN		64
+
+struct beaglelogic_firmware {
+	char pru0[BL_FW_NAME_LEN];
+	char pru1[BL_FW_NAME_LEN];
+};
+
+#define IOCTL_BL_GET_FIRMWARE       _IOR('k', 0x35, struct beaglelogic_firmware)
+#define IOCTL_BL_SET_FIRMWARE       _IOW('k', 0x35, struct beaglelogic_firmware)
+
+/* Scheduled start: START_AT starts like IOCTL_BL_START, but PRU1 holds the
+ * first sample until 'deadline' (CLOCK_MONOTONIC, ns), at most
+ * BL_START_MAX_NS ahead. The first sample goes out at the next clock edge.
+ * GET_START returns the deadline of the last start (0 for an immediate one)
+ * and the time PRU1 started at, 0 until then */
+struct beaglelogic_start {
+	u64 deadline;
+	u64 started;
+};
+
+#define BL_START_MAX_NS		10000000000ULL
+
+#define IOCTL_BL_START_AT           _IOW('k', 0x36, struct beaglelogic_start)
+#define IOCTL_BL_GET_START          _IOR('k', 0x36, struct beaglelogic_start)
+
+/* Internal sample clock: PRU1 times the samples itself at 'period' PRU
+ * cycles (5 ns) per sample instead of following the external clock; 0
+ * selects the external clock. Buffer N < 'segments' plays at its own
+ * period, the Nth u32 at 'periods' (user space), or at 'period' if that is
+ * 0. A new period starts exactly at the buffer boundary, so slow parts of
+ * a waveform take memory at their own rate. Not with edge list mode; the
+ * generator plays at 'period'. GET_CLOCK returns 'period' and 'segments' */
+struct beaglelogic_clock {
+	u32 period;
+	u32 segments;
+	u64 periods;
+};
+
+#define BL_CLOCK_MIN_PERIOD	9		/* 22.2 MSPS */
+#define BL_CLOCK_MAX_PERIOD	0x1000006	/* 2^24 + 6, about 12 SPS */
+
+#define IOCTL_BL_GET_CLOCK          _IOR('k', 0x37, struct beaglelogic_clock)
+#define IOCTL_BL_SET_CLOCK          _IOW('k', 0x37, struct beaglelogic_clock)
+
+/* Capture: with every sample it plays on the external clock, PRU1 also
+ * reads the inputs 'mask' selects, bit N for R31 bit N + 4 (P8_41, P8_42,
+ * P8_39, P8_40 muxed as PRU1 inputs), one PRU cycle after the outputs
+ * change. They come in the format of the samples played, 2 per byte with
+ * the first in the low nibble and the others 0, sample N of the capture
+ * taken with sample N of the run. read() returns them from a ring of 'size'
+ * bytes (a multiple of BL_CAPTURE_MIN_SIZE), skipping what was overwritten
+ * before it was read; mmap() maps the ring, where byte B of a run sits at
+ * B % size. A mask of 0 turns capture off. Not with edge list, generator or
+ * internal clock mode. GET_CAPTURE also returns the bytes captured in the
+ * last or current run and those read() skipped */
+struct beaglelogic_capture {
+	u32 mask;
+	u32 size;
+	u64 bytes;
+	u64 lost;
+};
+
+#define BL_CAPTURE_MIN_SIZE	4096
+#define BL_CAPTURE_MAX_SIZE	(16 << 20)
+
+#define IOCTL_BL_GET_CAPTURE        _IOR('k', 0x38, struct beaglelogic_capture)
+#define IOCTL_BL_SET_CAPTURE        _IOW('k', 0x38, struct beaglelogic_capture)
+
+/* Block sums (1): PRU0 folds the 16 little endian words w of every 64 byte
+ * block it hands to PRU1 into a += w, then b += a (modulo 2^32), over the
+ * whole run and per buffer, so the data played can be checked against the
+ * data written; libbeaglelogic bl_sum_update computes the same. A block
+ * costs PRU0 BL_PRU0_SUM_CYCLES more, see maxsamplerate. Cleared at each
+ * start, not with generator mode. GET_SUMS returns the sums of the run and
+ * 'entries' comes back as the number of buffers, whose sums are copied to
+ * 'sums' (user space), at most as many as 'entries' asked for */
+struct beaglelogic_sum {
+	u32 a;
+	u32 b;
+	u32 blocks;		/* Blocks folded in */
+};
+
+struct beaglelogic_sums {
+	u32 enable;
+	u32 entries;
+	u64 sums;		/* struct beaglelogic_sum per buffer */
+	struct beaglelogic_sum run;
+	u32 pad;
+};
+
+#define IOCTL_BL_GET_SUMS           _IOWR('k', 0x39, struct beaglelogic_sums)
+#define IOCTL_BL_SET_SUMS           _IOW('k', 0x39, u32)
+
 #endif /* BEAGLELOGIC_H_ */
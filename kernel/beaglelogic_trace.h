@@ -0,0 +1,199 @@
+/*
+ * Tracepoints of the BeagleLogic waveform generator driver
+ *
+ * State transitions, buffer operations, PRU commands and interrupts, with
+ * sizes and durations, so the arm/run/teardown cycle can be profiled with
+ * perf or trace-cmd (e.g. trace-cmd record -e beaglelogic).
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM beaglelogic
+
+#if !defined(BEAGLELOGIC_TRACE_H_) || defined(TRACE_HEADER_MULTI_READ)
+#define BEAGLELOGIC_TRACE_H_
+
+#include <linux/tracepoint.h>
+
+/* Device state, enum beaglelogic_states, and the error code at the time */
+TRACE_EVENT(beaglelogic_state,
+	TP_PROTO(u32 from, u32 to, u32 lasterror),
+	TP_ARGS(from, to, lasterror),
+
+	TP_STRUCT__entry(
+		__field(u32, from)
+		__field(u32, to)
+		__field(u32, lasterror)
+	),
+
+	TP_fast_assign(
+		__entry->from = from;
+		__entry->to = to;
+		__entry->lasterror = lasterror;
+	),
+
+	TP_printk("state %u -> %u lasterror 0x%x",
+		__entry->from, __entry->to, __entry->lasterror)
+);
+
+/* Allocation (kmalloc and clearing) or release of all buffers */
+DECLARE_EVENT_CLASS(beaglelogic_mem,
+	TP_PROTO(u32 count, u64 bytes, u64 ns),
+	TP_ARGS(count, bytes, ns),
+
+	TP_STRUCT__entry(
+		__field(u32, count)
+		__field(u64, bytes)
+		__field(u64, ns)
+	),
+
+	TP_fast_assign(
+		__entry->count = count;
+		__entry->bytes = bytes;
+		__entry->ns = ns;
+	),
+
+	TP_printk("%u buffers, %llu bytes in %llu ns",
+		__entry->count, __entry->bytes, __entry->ns)
+);
+
+DEFINE_EVENT(beaglelogic_mem, beaglelogic_memalloc,
+	TP_PROTO(u32 count, u64 bytes, u64 ns),
+	TP_ARGS(count, bytes, ns)
+);
+
+DEFINE_EVENT(beaglelogic_mem, beaglelogic_memfree,
+	TP_PROTO(u32 count, u64 bytes, u64 ns),
+	TP_ARGS(count, bytes, ns)
+);
+
+/* Mapping all buffers and writing the list for PRU0 */
+DEFINE_EVENT(beaglelogic_mem, beaglelogic_submit,
+	TP_PROTO(u32 count, u64 bytes, u64 ns),
+	TP_ARGS(count, bytes, ns)
+);
+
+/* DMA mapping (cache clean) or unmapping of one buffer */
+DECLARE_EVENT_CLASS(beaglelogic_buffer,
+	TP_PROTO(u32 index, u32 size, u32 addr, u64 ns),
+	TP_ARGS(index, size, addr, ns),
+
+	TP_STRUCT__entry(
+		__field(u32, index)
+		__field(u32, size)
+		__field(u32, addr)
+		__field(u64, ns)
+	),
+
+	TP_fast_assign(
+		__entry->index = index;
+		__entry->size = size;
+		__entry->addr = addr;
+		__entry->ns = ns;
+	),
+
+	TP_printk("buffer %u, %u bytes at 0x%08x in %llu ns",
+		__entry->index, __entry->size, __entry->addr, __entry->ns)
+);
+
+DEFINE_EVENT(beaglelogic_buffer, beaglelogic_map,
+	TP_PROTO(u32 index, u32 size, u32 addr, u64 ns),
+	TP_ARGS(index, size, addr, ns)
+);
+
+DEFINE_EVENT(beaglelogic_buffer, beaglelogic_unmap,
+	TP_PROTO(u32 index, u32 size, u32 addr, u64 ns),
+	TP_ARGS(index, size, addr, ns)
+);
+
+/* Command through the mailbox, from the doorbell to PRU0's reply */
+TRACE_EVENT(beaglelogic_cmd,
+	TP_PROTO(u32 cmd, int resp, u64 ns),
+	TP_ARGS(cmd, resp, ns),
+
+	TP_STRUCT__entry(
+		__field(u32, cmd)
+		__field(int, resp)
+		__field(u64, ns)
+	),
+
+	TP_fast_assign(
+		__entry->cmd = cmd;
+		__entry->resp = resp;
+		__entry->ns = ns;
+	),
+
+	TP_printk("cmd %u resp %d in %llu ns",
+		__entry->cmd, __entry->resp, __entry->ns)
+);
+
+/* Interrupt from PRU0: 1 run ended, 2 command reply, 3 buffer released */
+TRACE_EVENT(beaglelogic_irq,
+	TP_PROTO(int event, u32 state),
+	TP_ARGS(event, state),
+
+	TP_STRUCT__entry(
+		__field(int, event)
+		__field(u32, state)
+	),
+
+	TP_fast_assign(
+		__entry->event = event;
+		__entry->state = state;
+	),
+
+	TP_printk("event %d in state %u", __entry->event, __entry->state)
+);
+
+/* End of a run: its length and the 64 byte blocks played (requested by
+ * PRU1, or generated by PRU0) */
+TRACE_EVENT(beaglelogic_run_end,
+	TP_PROTO(u32 blocks, u64 ns, u32 lasterror),
+	TP_ARGS(blocks, ns, lasterror),
+
+	TP_STRUCT__entry(
+		__field(u32, blocks)
+		__field(u64, ns)
+		__field(u32, lasterror)
+	),
+
+	TP_fast_assign(
+		__entry->blocks = blocks;
+		__entry->ns = ns;
+		__entry->lasterror = lasterror;
+	),
+
+	TP_printk("%u blocks in %llu ns lasterror 0x%x",
+		__entry->blocks, __entry->ns, __entry->lasterror)
+);
+
+/* Restart of both PRUs, by the watchdog or for a firmware reload */
+TRACE_EVENT(beaglelogic_reset,
+	TP_PROTO(int ret, u64 ns),
+	TP_ARGS(ret, ns),
+
+	TP_STRUCT__entry(
+		__field(int, ret)
+		__field(u64, ns)
+	),
+
+	TP_fast_assign(
+		__entry->ret = ret;
+		__entry->ns = ns;
+	),
+
+	TP_printk("ret %d in %llu ns", __entry->ret, __entry->ns)
+);
+
+#endif /* BEAGLELOGIC_TRACE_H_ */
+
+/* This part must be outside the include guard */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE beaglelogic_trace
+#include <trace/define_trace.h>
@@ -1,15 +1,15 @@
 #!/bin/bash
 
 # Adapted by Kevin Verniers from Kumar Abhishek's BeagleLogic project.
+#
+# Started by udev (90-beaglelogic.rules) once the driver reports the device
+# ready. The overlay (beaglelogic-00A0.dts) muxes the pins, so there is
+# nothing to wait for or configure pin by pin.
 
 log='beaglelogic-startup:'
-SLOTS="/sys/devices/platform/bone_capemgr/slots"
 board=$(cat /proc/device-tree/model | sed "s/ /_/g" | tr -d '\000')
-is_standalone="N"
 
 if [ "x${board}" = "xTI_AM335x_BeagleLogic_Standalone" ] ; then
-	is_standalone="Y"
-
 	# Enable OE of 74LVCH16T245 buffer by writing a '1' to GPIO58
 	if [ ! -d "/sys/class/gpio/gpio58" ] ; then
 		echo 58 > /sys/class/gpio/export
@@ -29,25 +29,4 @@ if [ "x${board}" = "xTI_AM335x_BeagleLogic_Standalone" ] ; then
 	ethtool -C eth0 rx-usecs 500
 fi
 
-check_uboot_overlay=$(grep bone_capemgr.uboot_capemgr_enabled=1 /proc/cmdline || true)
-if [ ! -d /sys/devices/virtual/misc/beaglelogic ] ; then
-	if [ "x${check_uboot_overlay}" = "x" ] && [ "x${is_standalone}" = "xN" ] ; then
-		echo beaglelogic > "${SLOTS}"
-		echo cape-universalh > "${SLOTS}"
-	fi
-
-	echo "${log} Waiting for BeagleLogic to show up (timeout in 120 seconds)"
-	wait_seconds=120
-	until test $((wait_seconds--)) -eq 0 -o -d "/sys/devices/virtual/misc/beaglelogic" ; do sleep 1; done
-	if [ ! -d /sys/devices/virtual/misc/beaglelogic ] ; then
-		echo "${log} timeout. BeagleLogic couldn't load."
-		exit 1
-	fi
-fi
-
-if [ "x${is_standalone}" = "xN" ] ; then
-	echo "${log} Configuring waveform generator output pins"
-	config-pin -f $(dirname $0)/pinconfig
-fi
-
 echo "${log} Loaded"
@@ -0,0 +1,371 @@
+/*
+ * blbench - write path throughput benchmark
+ *
+ * Measures, for every combination of buffer unit size and total size:
+ *   - the time from writing 'memalloc' until the buffers are armed
+ *     (kmalloc + memset + dma_map_single in the driver)
+ *   - write() throughput into the buffer ring, or with -f, sendfile()
+ *     throughput from a file (the page cache is copied straight into the
+ *     buffers, without a bounce through user space)
+ *   - the time IOCTL_BL_START takes to return (optional, -s)
+ *
+ * Runs against /dev/beaglelogic or, with -m, against the userspace mock of
+ * the driver's buffer ring (blmock.c) on any Linux machine. Results are
+ * printed as CSV, one line per repetition, so runs of different versions
+ * can be compared directly.
+ *
+ * This file is a part of the PRU digital waveform generator project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+
+#include "libbeaglelogic.h"
+#include "blmock.h"
+
+#define MAX_SIZES	16
+#define MOCK_MAXBUFCOUNT	128	/* MAX_BUFLIST_ENTRIES of the firmware */
+
+struct backend {
+	const char *name;
+	int (*memalloc)(uint32_t unitsize, uint32_t total);
+	int (*open)(void);
+	ssize_t (*write)(const void *buf, size_t len);
+	ssize_t (*sendfile)(int fd, off_t off, size_t len);
+	int (*start)(void);
+	void (*close)(void);
+	uint32_t maxbufcount;
+};
+
+/* Begin device backend section */
+
+static int dev_fd = -1;
+
+static int dev_memalloc(uint32_t unitsize, uint32_t total)
+{
+	int ret = bl_sysfs_write("bufunitsize", unitsize);
+
+	return ret ? ret : bl_sysfs_write("memalloc", total);
+}
+
+static int dev_open(void)
+{
+	dev_fd = bl_open();
+	return dev_fd < 0 ? dev_fd : 0;
+}
+
+static ssize_t dev_write(const void *buf, size_t len)
+{
+	ssize_t n = write(dev_fd, buf, len);
+
+	return n < 0 ? -errno : n;
+}
+
+static ssize_t dev_sendfile(int fd, off_t off, size_t len)
+{
+	ssize_t n = sendfile(dev_fd, fd, &off, len);
+
+	return n < 0 ? -errno : n;
+}
+
+static int dev_start(void)
+{
+	return bl_start(dev_fd);
+}
+
+static void dev_close(void)
+{
+	close(dev_fd);
+	dev_fd = -1;
+}
+
+/* End device backend section */
+
+/* Begin mock backend section */
+
+static struct blmock mock;
+
+static int mock_memalloc(uint32_t unitsize, uint32_t total)
+{
+	int ret = blmock_set_bufunitsize(&mock, unitsize);
+
+	return ret ? ret : blmock_memalloc(&mock, total);
+}
+
+static int mock_open(void)
+{
+	return mock.bufcount ? 0 : -ENOMEM;
+}
+
+static ssize_t mock_write(const void *buf, size_t len)
+{
+	return blmock_write(&mock, buf, len);
+}
+
+/* The driver copies from the page cache; so does the mock, via mmap */
+static ssize_t mock_sendfile(int fd, off_t off, size_t len)
+{
+	long page = sysconf(_SC_PAGESIZE);
+	off_t base = off & ~(off_t)(page - 1);
+	size_t maplen = len + (off - base);
+	uint8_t *map;
+	ssize_t n;
+
+	map = mmap(NULL, maplen, PROT_READ, MAP_SHARED, fd, base);
+	if (map == MAP_FAILED)
+		return -errno;
+	n = blmock_write(&mock, map + (off - base), len);
+	munmap(map, maplen);
+	return n;
+}
+
+static int mock_start(void)
+{
+	return blmock_start(&mock);
+}
+
+static void mock_close(void)
+{
+}
+
+/* End mock backend section */
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static unsigned long parse_size(const char *s)
+{
+	char *end;
+	unsigned long v = strtoul(s, &end, 0);
+
+	if (*end == 'k' || *end == 'K')
+		v <<= 10;
+	else if (*end == 'M' || *end == 'm')
+		v <<= 20;
+	return v;
+}
+
+static int parse_sizes(char *s, uint32_t *out)
+{
+	int n = 0;
+	char *tok;
+
+	for (tok = strtok(s, ","); tok && n < MAX_SIZES;
+			tok = strtok(NULL, ","))
+		out[n++] = parse_size(tok);
+	return n;
+}
+
+static void read_version(int mock_backend, char *buf, size_t len)
+{
+	FILE *f;
+
+	snprintf(buf, len, "%s", mock_backend ? "mock" : "unknown");
+	if (mock_backend)
+		return;
+	f = fopen("/sys/module/beaglelogic/version", "r");
+	if (!f)
+		return;
+	if (fgets(buf, len, f))
+		buf[strcspn(buf, "\n")] = 0;
+	fclose(f);
+}
+
+static void usage(FILE *f)
+{
+	fprintf(f,
+		"Usage: blbench [options]\n"
+		"  -m          use the userspace mock instead of /dev/beaglelogic\n"
+		"  -u LIST     buffer unit sizes (default 64k,256k,640000,1M)\n"
+		"  -t LIST     total sizes (default 1M,16M,64M)\n"
+		"  -w BYTES    size of each write() or sendfile() call (default 64k)\n"
+		"  -f FILE     upload FILE with sendfile() instead of write(),\n"
+		"              repeated as needed to reach the total size\n"
+		"  -r N        repetitions per combination (default 3)\n"
+		"  -s          also time IOCTL_BL_START (needs a sample clock,\n"
+		"              close() blocks until the waveform has played)\n"
+		"Sizes accept k and M suffixes. Output is CSV.\n");
+}
+
+int main(int argc, char **argv)
+{
+	struct backend dev = {
+		"device", dev_memalloc, dev_open, dev_write, dev_sendfile,
+		dev_start, dev_close, 0
+	};
+	struct backend mck = {
+		"mock", mock_memalloc, mock_open, mock_write, mock_sendfile,
+		mock_start, mock_close, MOCK_MAXBUFCOUNT
+	};
+	char default_units[] = "64k,256k,640000,1M";
+	char default_totals[] = "1M,16M,64M";
+	uint32_t units[MAX_SIZES], totals[MAX_SIZES];
+	int nunits, ntotals, i, j, rep, reps = 3, do_start = 0, use_mock = 0;
+	size_t chunk = 64 << 10;
+	char *unit_list = default_units, *total_list = default_totals;
+	const char *src_file = NULL;
+	off_t src_size = 0;
+	int src_fd = -1;
+	char version[64];
+	struct backend *be;
+	uint8_t *data;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "mu:t:w:r:f:sh")) != -1) {
+		switch (opt) {
+		case 'm':
+			use_mock = 1;
+			break;
+		case 'u':
+			unit_list = optarg;
+			break;
+		case 't':
+			total_list = optarg;
+			break;
+		case 'w':
+			chunk = parse_size(optarg);
+			break;
+		case 'r':
+			reps = atoi(optarg);
+			break;
+		case 'f':
+			src_file = optarg;
+			break;
+		case 's':
+			do_start = 1;
+			break;
+		case 'h':
+			usage(stdout);
+			return 0;
+		default:
+			usage(stderr);
+			return 1;
+		}
+	}
+	if (!chunk || reps < 1) {
+		usage(stderr);
+		return 1;
+	}
+
+	nunits = parse_sizes(unit_list, units);
+	ntotals = parse_sizes(total_list, totals);
+
+	be = use_mock ? &mck : &dev;
+	if (use_mock)
+		blmock_init(&mock, MOCK_MAXBUFCOUNT);
+	else if (bl_sysfs_read("maxbufcount", &dev.maxbufcount))
+		dev.maxbufcount = MOCK_MAXBUFCOUNT;
+	read_version(use_mock, version, sizeof(version));
+
+	if (src_file) {
+		struct stat st;
+
+		src_fd = open(src_file, O_RDONLY);
+		if (src_fd < 0 || fstat(src_fd, &st) || !st.st_size) {
+			fprintf(stderr, "blbench: cannot use %s\n", src_file);
+			return 1;
+		}
+		src_size = st.st_size;
+	}
+
+	data = malloc(chunk);
+	if (!data) {
+		fprintf(stderr, "blbench: out of memory\n");
+		return 1;
+	}
+	for (i = 0; i < (int)chunk; i++)
+		data[i] = i * 7;
+
+	printf("backend,version,method,bufunitsize,total,write_size,rep,"
+			"alloc_us,write_mbps,start_us,status\n");
+
+	for (i = 0; i < nunits; i++) {
+		for (j = 0; j < ntotals; j++) {
+			uint32_t unit = (units[i] + 63) & ~63u;
+			uint32_t total = totals[j];
+
+			for (rep = 0; rep < reps; rep++) {
+				double t0, t_alloc, t_write, t_start = 0;
+				size_t done = 0;
+				int ret;
+
+				printf("%s,%s,%s,%u,%u,%zu,%d,", be->name, version,
+						src_file ? "sendfile" : "write",
+						unit, total, chunk, rep);
+				if ((total + unit - 1) / unit > be->maxbufcount) {
+					printf(",,,too_many_buffers\n");
+					break;
+				}
+
+				t0 = now();
+				ret = be->memalloc(unit, total);
+				t_alloc = now() - t0;
+				if (ret || be->open()) {
+					printf(",,,alloc_failed\n");
+					break;
+				}
+
+				t0 = now();
+				while (done < total) {
+					size_t len = total - done < chunk ?
+						total - done : chunk;
+					ssize_t n;
+
+					if (src_file) {
+						off_t off = done % src_size;
+
+						if ((off_t)len > src_size - off)
+							len = src_size - off;
+						n = be->sendfile(src_fd, off, len);
+					} else {
+						n = be->write(data, len);
+					}
+
+					if (n <= 0)
+						break;
+					done += n;
+				}
+				t_write = now() - t0;
+
+				if (do_start) {
+					t0 = now();
+					ret = be->start();
+					t_start = now() - t0;
+				}
+				be->close();
+
+				printf("%.1f,%.2f,", t_alloc * 1e6,
+						done / t_write / 1e6);
+				if (do_start)
+					printf("%.1f", t_start * 1e6);
+				printf(",%s\n", done < total ? "short_write" :
+						ret ? "start_failed" : "ok");
+				fflush(stdout);
+			}
+		}
+	}
+
+	if (use_mock)
+		blmock_memfree(&mock);
+	if (src_fd >= 0)
+		close(src_fd);
+	free(data);
+	return 0;
+}
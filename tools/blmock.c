@@ -0,0 +1,509 @@
+/*
+ * Userspace mock of the BeagleLogic buffer ring
+ *
+ * Every function follows its kernel counterpart step by step; keep them
+ * in sync when the driver changes. kmalloc becomes malloc, ksize becomes
+ * malloc_usable_size, copy_from_iter becomes memcpy, and dma_map_single and dma_sync_single_range_for_device,
+ * which clean the data cache on the BeagleBone, are approximated by reading
+ * every cache line of the range. In stream mode, a thread plays the role of
+ * PRU0 and the PRU0_TO_ARM_C interrupt becomes a condition variable.
+ *
+ * This file is a part of the PRU digital waveform generator project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <errno.h>
+#include <malloc.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "blmock.h"
+#include "blwf.h"
+
+#define CACHE_LINE	64
+
+void blmock_init(struct blmock *m, uint32_t maxbufcount)
+{
+	memset(m, 0, sizeof(*m));
+	m->maxbufcount = maxbufcount;
+	m->bufunitsize = 640000;	/* beaglelogic_probe default */
+	pthread_mutex_init(&m->lock, NULL);
+	pthread_cond_init(&m->cond, NULL);
+}
+
+/* Wait for the player to finish */
+static void blmock_join(struct blmock *m)
+{
+	if (!m->started)
+		return;
+	pthread_join(m->player, NULL);
+	m->started = 0;
+}
+
+void blmock_memfree(struct blmock *m)
+{
+	uint32_t i;
+
+	if (!m->buffers)
+		return;
+	blmock_join(m);
+	for (i = 0; i < m->bufcount; i++)
+		free(m->buffers[i].buf);
+	free(m->buffers);
+	m->buffers = NULL;
+	m->bufcount = 0;
+}
+
+/* Stands in for the cache clean over a range of a buffer */
+static void blmock_clean_range(struct blmock_buffer *b, size_t off,
+		size_t len)
+{
+	volatile const uint8_t *p = (const uint8_t *)b->buf + off;
+	size_t i;
+	uint8_t sink = 0;
+
+	for (i = 0; i < len; i += CACHE_LINE)
+		sink ^= p[i];
+	(void)sink;
+}
+
+/* beaglelogic_map_buffer */
+static void blmock_map_buffer(struct blmock_buffer *b)
+{
+	if (b->mapped)
+		return;
+	blmock_clean_range(b, 0, b->size);
+	b->mapped = 1;
+}
+
+/* beaglelogic_buffer_free */
+static void blmock_buffer_free(struct blmock_buffer *b)
+{
+	b->mapped = 0;
+	free(b->buf);
+	b->buf = NULL;
+}
+
+/* beaglelogic_memsize */
+static uint32_t blmock_memsize(struct blmock *m)
+{
+	if (!m->bufcount)
+		return 0;
+	return (m->bufcount - 1) * m->bufunitsize +
+		m->buffers[m->bufcount - 1].size;
+}
+
+/* beaglelogic_memalloc: the pool keeps every buffer that fits */
+static int blmock_resize(struct blmock *m, uint32_t unitsize,
+		uint32_t bufsize)
+{
+	struct blmock_buffer *buffers, *b;
+	uint32_t i, cnt, size, used;
+
+	cnt = (bufsize + unitsize - 1) / unitsize;
+	if (!cnt || cnt > m->maxbufcount)
+		return -ENOMEM;
+
+	blmock_join(m);
+	buffers = m->buffers;
+	if (cnt != m->bufcount) {
+		buffers = calloc(cnt, sizeof(*buffers));
+		if (!buffers)
+			return -ENOMEM;
+		for (i = cnt; i < m->bufcount; i++)
+			blmock_buffer_free(&m->buffers[i]);
+		if (m->buffers) {
+			memcpy(buffers, m->buffers, sizeof(*buffers) *
+					(cnt < m->bufcount ? cnt : m->bufcount));
+			free(m->buffers);
+		}
+		m->buffers = buffers;
+		m->bufcount = cnt;
+	}
+	m->bufunitsize = unitsize;
+
+	for (i = 0; i < cnt; i++) {
+		b = &buffers[i];
+		if (i == cnt - 1) {
+			used = bufsize - i * unitsize;
+			size = (used + 63) & ~63u;
+		} else {
+			used = size = unitsize;
+		}
+
+		if (b->buf && b->size != size) {
+			b->mapped = 0;
+			if (malloc_usable_size(b->buf) < size)
+				blmock_buffer_free(b);
+			else if (b->size < size)
+				memset((uint8_t *)b->buf + b->size, 0,
+						size - b->size);
+		}
+
+		if (!b->buf) {
+			b->buf = malloc(size);
+			if (!b->buf) {
+				blmock_memfree(m);
+				return -ENOMEM;
+			}
+			memset(b->buf, 0, size);
+		}
+
+		if (used < size) {
+			memset((uint8_t *)b->buf + used, 0, size - used);
+			if (b->mapped)
+				blmock_clean_range(b, used, size - used);
+		}
+
+		b->size = size;
+		b->index = i;
+		b->queued = 0;
+		b->job = 0;
+		b->next = &buffers[(i + 1) % cnt];
+	}
+
+	/* beaglelogic_map_and_submit_all_buffers */
+	for (i = 0; i < cnt; i++)
+		blmock_map_buffer(&buffers[i]);
+
+	m->cur = NULL;
+	m->pos = 0;
+	m->remaining = 0;
+	m->tail = m->buffers;
+	m->done = 0;
+	m->eof = 0;
+	m->dry = 0;
+	m->jobs_queued = 0;
+	m->jobs_done = 0;
+	return 0;
+}
+
+/* IOCTL_BL_SET_BUFFER_SIZE / memalloc store */
+int blmock_memalloc(struct blmock *m, uint32_t bufsize)
+{
+	return blmock_resize(m, m->bufunitsize, bufsize);
+}
+
+/* IOCTL_BL_SET_BUFUNIT_SIZE / bufunitsize store (beaglelogic_set_bufunitsize) */
+int blmock_set_bufunitsize(struct blmock *m, uint32_t size)
+{
+	uint32_t total = blmock_memsize(m);
+
+	if (size < 64)
+		return -EINVAL;
+	size = (size + 63) & ~63u;
+	if (total && (total + size - 1) / size <= m->maxbufcount)
+		return blmock_resize(m, size, total);
+
+	blmock_memfree(m);
+	m->bufunitsize = size;
+	return 0;
+}
+
+/* Begin stream section */
+
+/* beaglelogic_stream_reset, the player is not running */
+static void blmock_stream_reset(struct blmock *m)
+{
+	uint32_t i;
+
+	blmock_join(m);
+	pthread_mutex_lock(&m->lock);
+	for (i = 0; i < m->bufcount; i++) {
+		m->buffers[i].queued = 0;
+		m->buffers[i].job = 0;
+	}
+	m->tail = m->buffers;
+	m->done = 0;
+	m->eof = 0;
+	m->dry = 0;
+	m->jobs_queued = 0;
+	m->jobs_done = 0;
+	m->played_crc = 0;
+	pthread_mutex_unlock(&m->lock);
+}
+
+/* beaglelogic_stream_retire, with 'lock' held */
+static void blmock_stream_retire(struct blmock *m)
+{
+	struct blmock_buffer *b = m->tail;
+
+	m->done += b->queued;
+	b->queued = 0;
+	if (b->job) {
+		m->jobs_done = b->job;
+		b->job = 0;
+	}
+	m->tail = b->next;
+}
+
+/* beaglelogic_stream_queue */
+static void blmock_stream_queue(struct blmock *m, struct blmock_buffer *b,
+		uint32_t len)
+{
+	pthread_mutex_lock(&m->lock);
+	b->queued = len;
+	pthread_mutex_unlock(&m->lock);
+}
+
+/* beaglelogic_stream_wait for a blocking writer */
+static int blmock_stream_wait(struct blmock *m, struct blmock_buffer *b)
+{
+	int ret;
+
+	pthread_mutex_lock(&m->lock);
+	while (b->queued && m->running)
+		pthread_cond_wait(&m->cond, &m->lock);
+	ret = !b->queued ? 0 : m->dry ? -EPIPE : 1;
+	pthread_mutex_unlock(&m->lock);
+	return ret;
+}
+
+static void timespec_add(struct timespec *t, double s)
+{
+	long ns = (long)(s * 1e9);
+
+	t->tv_sec += ns / 1000000000;
+	t->tv_nsec += ns % 1000000000;
+	if (t->tv_nsec >= 1000000000) {
+		t->tv_sec++;
+		t->tv_nsec -= 1000000000;
+	}
+}
+
+/* PRU0 in stream mode: play the queued buffers in ring order, from the
+ * oldest one, and hand each one back; stop at the first buffer that is not
+ * queued in time */
+static void *blmock_player(void *arg)
+{
+	struct blmock *m = arg;
+	struct blmock_buffer *b = m->tail;
+	struct timespec t;
+	uint32_t len;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	pthread_mutex_lock(&m->lock);
+	while (b->queued) {
+		len = b->queued;
+		pthread_mutex_unlock(&m->lock);
+
+		m->played_crc = blwf_crc32(m->played_crc, b->buf, len);
+		if (m->byte_rate > 0) {
+			timespec_add(&t, len / m->byte_rate);
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t,
+					NULL);
+		}
+
+		pthread_mutex_lock(&m->lock);
+		blmock_stream_retire(m);
+		pthread_cond_broadcast(&m->cond);
+		b = b->next;
+	}
+
+	/* beaglelogic_stream_end */
+	if (!m->eof) {
+		m->dry = 1;
+		m->lasterror = 0x10000 | b->index;
+	}
+	m->running = 0;
+	pthread_cond_broadcast(&m->cond);
+	pthread_mutex_unlock(&m->lock);
+	return NULL;
+}
+
+/* beaglelogic_set_stream; 'byte_rate' is the speed of the player */
+int blmock_set_stream(struct blmock *m, int on, double byte_rate)
+{
+	if (m->running)
+		return -EBUSY;
+	m->stream = !!on;
+	m->byte_rate = byte_rate;
+	blmock_stream_reset(m);
+	return 0;
+}
+
+/* beaglelogic_f_open: every open starts a new stream */
+void blmock_open(struct blmock *m)
+{
+	m->cur = NULL;
+	if (m->stream && !m->running)
+		blmock_stream_reset(m);
+}
+
+/* beaglelogic_stream_flush, behind fsync() */
+void blmock_fsync(struct blmock *m)
+{
+	struct blmock_buffer *b = m->cur;
+	uint32_t len;
+
+	if (!m->stream)
+		return;
+	m->eof = 1;
+	if (!b || !m->pos)
+		return;
+
+	len = (m->pos + 63) & ~63u;
+	memset((uint8_t *)b->buf + m->pos, 0, len - m->pos);
+	blmock_clean_range(b, m->pos, len - m->pos);
+	blmock_stream_queue(m, b, len);
+
+	m->cur = b->next;
+	m->pos = 0;
+	m->remaining = m->cur->size;
+}
+
+/* beaglelogic_job_end, the hold level fills the last 64 byte block */
+int blmock_job_end(struct blmock *m)
+{
+	struct blmock_buffer *b = m->cur, *last;
+	uint32_t len, id;
+	uint8_t hold;
+
+	if (!m->stream)
+		return -EINVAL;
+	if (!b || !m->job_pending)
+		return -ENODATA;
+
+	if (m->pos) {
+		hold = ((uint8_t *)b->buf)[m->pos - 1] >> 4;
+		len = (m->pos + 63) & ~63u;
+		memset((uint8_t *)b->buf + m->pos, hold | hold << 4,
+				len - m->pos);
+		blmock_clean_range(b, m->pos, len - m->pos);
+		blmock_stream_queue(m, b, len);
+
+		m->cur = b->next;
+		m->pos = 0;
+		m->remaining = m->cur->size;
+		last = b;
+	} else {
+		last = &m->buffers[(b->index + m->bufcount - 1) % m->bufcount];
+	}
+	m->job_pending = 0;
+
+	pthread_mutex_lock(&m->lock);
+	id = ++m->jobs_queued;
+	if (last->queued)
+		last->job = id;
+	else
+		m->jobs_done = id;
+	m->eof = 1;
+	pthread_cond_broadcast(&m->cond);
+	pthread_mutex_unlock(&m->lock);
+	return id;
+}
+
+/* beaglelogic_wait_job for a blocking caller */
+int blmock_wait_job(struct blmock *m, uint32_t id)
+{
+	int ret;
+
+	if (!m->stream || !id || (int32_t)(m->jobs_queued - id) < 0)
+		return -EINVAL;
+
+	pthread_mutex_lock(&m->lock);
+	while ((int32_t)(m->jobs_done - id) < 0 && m->running)
+		pthread_cond_wait(&m->cond, &m->lock);
+	ret = (int32_t)(m->jobs_done - id) >= 0 ? 0 : -EPIPE;
+	pthread_mutex_unlock(&m->lock);
+	return ret;
+}
+
+/* beaglelogic_f_release: ends the stream and waits until it has played */
+void blmock_close(struct blmock *m)
+{
+	if (m->stream && m->cur)
+		blmock_fsync(m);
+	blmock_join(m);
+	m->cur = NULL;
+}
+
+/* End stream section */
+
+/* beaglelogic_f_write_iter: fills buffers until the data or the ring ends */
+ssize_t blmock_write(struct blmock *m, const void *buf, size_t sz)
+{
+	const uint8_t *src = buf;
+	size_t count, total = 0;
+
+	int ret;
+
+	if (!m->bufcount)
+		return -ENOMEM;
+
+	if (m->cur == NULL) {
+		m->cur = &m->buffers[0];
+		m->pos = 0;
+		m->remaining = m->cur->size;
+	} else if (!m->stream && m->cur == m->buffers && m->pos == 0) {
+		return 0;
+	}
+	m->eof = 0;
+
+	while (total < sz) {
+		struct blmock_buffer *b = m->cur;
+
+		if (m->stream && m->pos == 0) {
+			ret = blmock_stream_wait(m, b);
+			if (ret > 0 || (ret && total))
+				return total;
+			if (ret)
+				return ret;
+		}
+
+		count = sz - total < m->remaining ? sz - total : m->remaining;
+		memcpy((uint8_t *)b->buf + m->pos, src + total, count);
+		if (b->mapped)
+			blmock_clean_range(b, m->pos, count);
+
+		m->pos += count;
+		m->remaining -= count;
+		m->job_pending |= count != 0;
+		total += count;
+
+		if (m->remaining == 0) {
+			if (m->stream)
+				blmock_stream_queue(m, b, b->size);
+
+			m->cur = b->next;
+			m->pos = 0;
+			m->remaining = m->cur->size;
+			if (!m->stream && m->cur == m->buffers)
+				break;
+		}
+	}
+	return total;
+}
+
+/* IOCTL_BL_START: rewinds the writer to the first buffer. A stream keeps
+ * its writer and starts the player at the oldest queued buffer */
+int blmock_start(struct blmock *m)
+{
+	if (!m->bufcount)
+		return -ENOMEM;
+	if (m->stream) {
+		if (m->bufcount < 2)
+			return -EINVAL;
+		if (m->running)
+			return -EBUSY;
+		blmock_join(m);
+		m->lasterror = 0;
+		m->dry = 0;
+		m->running = 1;
+		m->started = 1;
+		if (pthread_create(&m->player, NULL, blmock_player, m)) {
+			m->running = 0;
+			m->started = 0;
+			return -EAGAIN;
+		}
+		return 0;
+	}
+	m->cur = &m->buffers[0];
+	m->pos = 0;
+	m->remaining = m->cur->size;
+	return 0;
+}
@@ -0,0 +1,82 @@
+/*
+ * Userspace mock of the BeagleLogic buffer ring
+ *
+ * Reproduces the buffer management of kernel/beaglelogic.c (memalloc,
+ * map_and_submit_all_buffers, f_write_iter) on ordinary heap memory, so the
+ * write path can be benchmarked and exercised on any Linux machine.
+ *
+ * In stream mode a player thread stands in for PRU0: it takes the queued
+ * buffers in ring order at a fixed byte rate, hands each one back once it
+ * has been played and stops at the first buffer that was not queued.
+ *
+ * This file is a part of the PRU digital waveform generator project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef BLMOCK_H_
+#define BLMOCK_H_
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+struct blmock_buffer {
+	void *buf;
+	size_t size;
+	unsigned short mapped;
+	unsigned short index;
+	uint32_t queued;	/* Bytes queued to the player, stream mode */
+	uint32_t job;		/* Id of the job it ends, 0 if none */
+	struct blmock_buffer *next;
+};
+
+struct blmock {
+	uint32_t maxbufcount;
+	uint32_t bufunitsize;
+
+	struct blmock_buffer *buffers;
+	uint32_t bufcount;
+
+	/* Reader (writer) state of the open file */
+	struct blmock_buffer *cur;
+	uint32_t pos;
+	uint32_t remaining;
+	uint32_t job_pending;
+
+	/* Stream mode, see beaglelogic_stream_*; 'lock' orders the writer
+	 * and the player */
+	int stream;
+	double byte_rate;	/* Player speed, 0 = as fast as possible */
+	pthread_t player;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int running;		/* STATE_BL_RUNNING */
+	int started;		/* start_ns != 0 */
+	int eof;		/* stream_eof */
+	int dry;		/* stream_dry */
+	struct blmock_buffer *tail;	/* stream_tail */
+	uint64_t done;		/* stream_done */
+	uint32_t jobs_queued;
+	uint32_t jobs_done;
+	uint32_t played_crc;	/* CRC-32 of everything played */
+	uint32_t lasterror;
+};
+
+void blmock_init(struct blmock *m, uint32_t maxbufcount);
+int blmock_set_bufunitsize(struct blmock *m, uint32_t size);
+int blmock_memalloc(struct blmock *m, uint32_t bufsize);
+void blmock_memfree(struct blmock *m);
+ssize_t blmock_write(struct blmock *m, const void *buf, size_t sz);
+int blmock_start(struct blmock *m);
+int blmock_set_stream(struct blmock *m, int on, double byte_rate);
+void blmock_open(struct blmock *m);
+void blmock_fsync(struct blmock *m);
+int blmock_job_end(struct blmock *m);
+int blmock_wait_job(struct blmock *m, uint32_t id);
+void blmock_close(struct blmock *m);
+
+#endif /* BLMOCK_H_ */
@@ -0,0 +1,886 @@
+/*
+ * blpack - create, inspect and upload BLWF waveform containers
+ *
+ *   blpack create [options] IN.bin OUT.blwf   wrap a raw device byte stream
+ *   blpack info FILE                          print the header
+ *   blpack verify FILE                        check header and payload CRCs
+ *   blpack extract [-S NAME] FILE OUT.bin     write the decoded stream
+ *   blpack upload [-S NAME] [-s] [-T TIME] [-x] [-L N] [-W I:FILE] FILE
+ *                                             load into /dev/beaglelogic
+ *   blpack queue [-m BYTES] FILE...           play files back to back
+ *
+ * Raw payloads are uploaded with sendfile() from the page aligned payload,
+ * without passing through user space; RLE, zstd and LZ4 payloads are
+ * decoded in pieces of one buffer unit, straight from the mapped file.
+ * Plain zstd or LZ4 files (a compressed raw byte stream, no container) are
+ * accepted by extract and upload as well.
+ *
+ * upload -T starts the waveform at a CLOCK_MONOTONIC time (ns), or with
+ * +MS that many milliseconds after the upload, and reports when PRU1
+ * actually started.
+ *
+ * upload -x stores each distinct 64 byte block once, in the dictionary of
+ * the driver's indexed mode, and uploads one 16 bit index per block.
+ *
+ * upload -L plays the waveform N times (0 until stopped) and -W replaces
+ * buffer I by the contents of FILE while it loops, one swap at a time,
+ * reporting the first iteration that played each.
+ *
+ * queue streams each file as one job of the driver's job queue, so the
+ * files play without a gap between them, and reports each one as PRU0
+ * finishes reading it.
+ *
+ * This file is a part of the PRU digital waveform generator project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "libbeaglelogic.h"
+#include "blwf.h"
+#include "blz.h"
+
+#define MAX_SEGMENTS	64
+#define MAX_SWAPS	16
+#define MAX_PERIODS	128	/* Buffer list entries of the firmware */
+
+/* Playback options of upload */
+struct playback {
+	int start;
+	const char *at;		/* Scheduled start, NULL for right away */
+	int index;		/* Upload as dictionary and indices */
+	int loop;		/* Iterations + 1, 0 for no loop mode */
+	unsigned nswaps;
+	uint32_t swap_index[MAX_SWAPS];
+	const char *swap_file[MAX_SWAPS];
+	unsigned nperiods;	/* Internal clock, 0 for the external one */
+	uint32_t periods[MAX_PERIODS];
+};
+
+/* Output order of the 4 channel firmware, see beaglelogic-pru1-core.asm */
+static const char *default_pins[] = { "P8_45", "P8_46", "P8_43", "P8_44" };
+
+static const char *encodings[] = { "raw", "rle", "zstd", "lz4" };
+
+static void usage(FILE *f)
+{
+	fprintf(f,
+		"Usage: blpack create [options] IN OUT\n"
+		"         -r HZ              sample rate (default 0, not fixed)\n"
+		"         -c N               channels in use (default 4)\n"
+		"         -p PIN,PIN,...     pin of each channel, bit 0 first\n"
+		"         -e ENCODING        payload encoding: raw (default), rle,\n"
+		"                            zstd or lz4\n"
+		"         -l START:END[:N]   loop samples START..END-1, N times\n"
+		"         -S NAME:START:LEN  add a segment (in samples)\n"
+		"         -d TEXT            description\n"
+		"       blpack info FILE\n"
+		"       blpack verify FILE\n"
+		"       blpack extract [-S NAME] FILE OUT\n"
+		"       blpack upload [-S NAME] [-s] [-T TIME] [-x] [-L N] [-W I:FILE]\n"
+		"                     [-P P,...] FILE\n"
+		"         -s                 start playback after the upload\n"
+		"         -T TIME            start at TIME (CLOCK_MONOTONIC ns),\n"
+		"                            +MS: MS ms after the upload\n"
+		"         -x                 indexed: upload each distinct 64 byte\n"
+		"                            block once\n"
+		"         -L N               loop N times, 0 until stopped (Ctrl-C)\n"
+		"         -W I:FILE          while looping, swap buffer I for the\n"
+		"                            contents of FILE (repeatable)\n"
+		"         -P P,...           internal sample clock, PRU cycles per\n"
+		"                            sample of buffer 0, 1, ...; the last\n"
+		"                            one for the rest\n"
+		"       blpack queue [-m BYTES] FILE...\n"
+		"         -m BYTES           size of the buffer ring (default 8M)\n");
+}
+
+static int fail(const char *what, int err)
+{
+	fprintf(stderr, "blpack: %s: %s\n", what, strerror(-err));
+	return 1;
+}
+
+static uint8_t *load_file(const char *path, size_t *len)
+{
+	struct stat st;
+	uint8_t *data;
+	size_t done = 0;
+	ssize_t n;
+	int fd = open(path, O_RDONLY);
+
+	if (fd < 0 || fstat(fd, &st))
+		return NULL;
+	data = malloc(st.st_size ? st.st_size : 1);
+	while (data && done < (size_t)st.st_size) {
+		n = read(fd, data + done, st.st_size - done);
+		if (n <= 0) {
+			free(data);
+			data = NULL;
+			break;
+		}
+		done += n;
+	}
+	close(fd);
+	*len = done;
+	return data;
+}
+
+static int cmd_create(int argc, char **argv)
+{
+	struct blwf_header hdr;
+	struct blwf_segment segs[MAX_SEGMENTS];
+	unsigned nsegs = 0, i;
+	uint8_t *data;
+	size_t len;
+	char *pins = NULL, *tok;
+	int opt, ret;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memset(segs, 0, sizeof(segs));
+	hdr.channels = 4;
+	hdr.sample_bits = 4;
+	hdr.encoding = BLWF_ENC_RAW;
+
+	while ((opt = getopt(argc, argv, "r:c:p:e:l:S:d:")) != -1) {
+		switch (opt) {
+		case 'r':
+			hdr.sample_rate = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			hdr.channels = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			pins = optarg;
+			break;
+		case 'e':
+			for (i = 0; i < 4; i++)
+				if (!strcmp(optarg, encodings[i]))
+					break;
+			if (i == 4)
+				return fail(optarg, -EINVAL);
+			hdr.encoding = i;
+			break;
+		case 'l': {
+			unsigned long long a = 0, b = 0;
+			unsigned n = 0;
+
+			if (sscanf(optarg, "%llu:%llu:%u", &a, &b, &n) < 2)
+				return fail(optarg, -EINVAL);
+			hdr.flags |= BLWF_FLAG_LOOP;
+			hdr.loop_start = a;
+			hdr.loop_end = b;
+			hdr.loop_count = n;
+			break;
+		}
+		case 'S': {
+			unsigned long long a, b;
+			char name[BLWF_NAME_LEN];
+
+			if (nsegs == MAX_SEGMENTS ||
+					sscanf(optarg, "%31[^:]:%llu:%llu",
+						name, &a, &b) != 3)
+				return fail(optarg, -EINVAL);
+			strcpy(segs[nsegs].name, name);
+			segs[nsegs].start = a;
+			segs[nsegs].samples = b;
+			nsegs++;
+			break;
+		}
+		case 'd':
+			strncpy(hdr.description, optarg,
+					sizeof(hdr.description) - 1);
+			break;
+		default:
+			usage(stderr);
+			return 2;
+		}
+	}
+	if (argc - optind != 2) {
+		usage(stderr);
+		return 2;
+	}
+
+	for (i = 0; i < hdr.channels && i < BLWF_MAX_CHANNELS; i++) {
+		tok = pins ? strsep(&pins, ",") : NULL;
+		if (!tok && i < 4)
+			tok = (char *)default_pins[i];
+		if (tok)
+			strncpy(hdr.pins[i], tok, BLWF_PIN_NAME_LEN - 1);
+	}
+
+	data = load_file(argv[optind], &len);
+	if (!data)
+		return fail(argv[optind], -errno);
+
+	for (i = 0; i < nsegs; i++)
+		if (segs[i].start + segs[i].samples > (uint64_t)len * 2)
+			return fail(segs[i].name, -ERANGE);
+
+	ret = blwf_write(argv[optind + 1], &hdr, segs, nsegs, data, len);
+	free(data);
+	if (ret)
+		return fail(argv[optind + 1], ret);
+	return 0;
+}
+
+static int cmd_info(const char *path)
+{
+	struct blwf_file f;
+	const struct blwf_header *h;
+	uint32_t i;
+	int ret = blwf_open(&f, path);
+
+	if (ret)
+		return fail(path, ret);
+	h = f.hdr;
+
+	printf("version=%u\n", h->version);
+	printf("encoding=%s\n", encodings[h->encoding]);
+	printf("channels=%u\n", h->channels);
+	printf("sample_bits=%u\n", h->sample_bits);
+	printf("sample_rate=%u\n", h->sample_rate);
+	printf("pins=");
+	for (i = 0; i < h->channels; i++)
+		printf("%s%.*s", i ? "," : "", BLWF_PIN_NAME_LEN, h->pins[i]);
+	printf("\n");
+	printf("samples=%llu\n", (unsigned long long)h->samples);
+	if (h->sample_rate)
+		printf("duration_s=%.6f\n",
+				(double)h->samples / h->sample_rate);
+	printf("payload_offset=%llu\n",
+			(unsigned long long)h->payload_offset);
+	printf("payload_size=%llu\n", (unsigned long long)h->payload_size);
+	printf("payload_crc=%08x\n", h->payload_crc);
+	if (h->flags & BLWF_FLAG_LOOP)
+		printf("loop=%llu:%llu:%u\n",
+				(unsigned long long)h->loop_start,
+				(unsigned long long)h->loop_end,
+				h->loop_count);
+	for (i = 0; i < h->nsegments; i++)
+		printf("segment=%s:%llu:%llu\n", f.segs[i].name,
+				(unsigned long long)f.segs[i].start,
+				(unsigned long long)f.segs[i].samples);
+	printf("description=%.*s\n", (int)sizeof(h->description),
+			h->description);
+	blwf_close(&f);
+	return 0;
+}
+
+static int cmd_verify(const char *path)
+{
+	struct blwf_file f;
+	int ret = blwf_open(&f, path);
+
+	if (ret)
+		return fail(path, ret);
+	ret = blwf_verify_payload(&f);
+	blwf_close(&f);
+	if (ret)
+		return fail(path, ret);
+	printf("%s: ok\n", path);
+	return 0;
+}
+
+/* Byte range of the decoded stream for the whole file or one segment */
+static int select_range(const struct blwf_file *f, const char *segment,
+		uint64_t *start, uint64_t *len)
+{
+	const struct blwf_segment *seg;
+	uint64_t first = 0, samples = f->hdr->samples;
+
+	if (segment) {
+		seg = blwf_find_segment(f, segment);
+		if (!seg)
+			return -ENOENT;
+		first = seg->start;
+		samples = seg->samples;
+	}
+
+	/* Samples share bytes, a range has to start on a byte boundary */
+	if (blwf_bytes(f->hdr, first) * 8 != first * f->hdr->sample_bits)
+		return -EINVAL;
+	*start = blwf_bytes(f->hdr, first);
+	*len = blwf_bytes(f->hdr, samples + 1);
+	return 0;
+}
+
+static ssize_t fd_sink(void *arg, const void *buf, size_t len)
+{
+	ssize_t n;
+
+	do {
+		n = write(*(int *)arg, buf, len);
+	} while (n < 0 && errno == EINTR);
+	return n < 0 ? -errno : n;
+}
+
+/* Begin indexed upload section */
+
+static ssize_t index_sink(void *arg, const void *buf, size_t len)
+{
+	int ret = bl_index_add(arg, buf, len);
+
+	return ret ? ret : (ssize_t)len;
+}
+
+static int start_playback(int fd, const struct playback *pb,
+		const char **what);
+
+/* Uploads the indices of the waveform fed to 'ix' with its dictionary */
+static int upload_index(struct bl_index *ix, const struct playback *pb,
+		const char **what)
+{
+	ssize_t n;
+	size_t done;
+	int fd, ret;
+
+	*what = "index";
+	ret = bl_index_finish(ix);
+	if (ret)
+		return ret;
+	fprintf(stderr, "blpack: %zu blocks, %u distinct\n", ix->len / 2,
+			ix->blocks);
+
+	*what = "memalloc";
+	ret = bl_sysfs_write("memalloc", ix->len);
+	if (ret)
+		return ret;
+	*what = BL_DEVICE;
+	fd = bl_open();
+	if (fd < 0)
+		return fd;
+
+	ret = bl_set_index(fd, ix);
+	for (done = 0; !ret && done < ix->len; done += n) {
+		n = fd_sink(&fd, ix->stream + done, ix->len - done);
+		if (n <= 0)
+			ret = n < 0 ? (int)n : -ENOSPC;
+	}
+	if (!ret)
+		ret = start_playback(fd, pb, what);
+
+	/* close() returns once the waveform has played */
+	close(fd);
+	return ret;
+}
+
+/* End indexed upload section */
+
+/* Begin plain compressed file section */
+
+struct zfile {
+	const uint8_t *map;
+	size_t len;
+	enum blz_format fmt;
+	uint64_t size;		/* Decoded, or BLZ_SIZE_UNKNOWN */
+};
+
+/* Maps 'path' if it is a plain zstd or LZ4 file; returns 1 if it is not */
+static int zfile_open(struct zfile *z, const char *path)
+{
+	uint8_t magic[4];
+	struct stat st;
+	int fd = open(path, O_RDONLY), ret = 1;
+
+	if (fd < 0)
+		return -errno;
+	if (fstat(fd, &st) || pread(fd, magic, 4, 0) != 4)
+		goto out;
+	z->fmt = blz_detect(magic, 4);
+	if (z->fmt == BLZ_NONE)
+		goto out;
+
+	z->len = st.st_size;
+	z->map = mmap(NULL, z->len, PROT_READ, MAP_SHARED, fd, 0);
+	if (z->map == MAP_FAILED) {
+		ret = -errno;
+		goto out;
+	}
+	z->size = blz_content_size(z->fmt, z->map, z->len);
+	ret = 0;
+out:
+	close(fd);
+	return ret;
+}
+
+static void zfile_close(struct zfile *z)
+{
+	munmap((void *)z->map, z->len);
+}
+
+static int extract_compressed(struct zfile *z, const char *out)
+{
+	int fd, ret;
+
+	fd = open(out, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		return fail(out, -errno);
+	ret = blz_decode(z->fmt, z->map, z->len, 0, z->size, 1 << 20,
+			fd_sink, &fd);
+	close(fd);
+	return ret ? fail(out, ret) : 0;
+}
+
+/* The driver needs the size up front: 'blpack create' and the zstd tool
+ * record it, the lz4 tool only with --content-size */
+static int upload_compressed(struct zfile *z, const char *path,
+		const struct playback *pb)
+{
+	const char *what = path;
+	struct bl_index ix;
+	uint32_t unit;
+	int fd, ret;
+
+	if (!blz_supported(z->fmt))
+		return fail(blz_name(z->fmt), -ENOTSUP);
+	if (pb->index) {
+		ret = bl_index_init(&ix);
+		if (!ret)
+			ret = blz_decode(z->fmt, z->map, z->len, 0,
+					BLZ_SIZE_UNKNOWN, 1 << 20, index_sink,
+					&ix);
+		if (!ret)
+			ret = upload_index(&ix, pb, &what);
+		bl_index_free(&ix);
+		return ret ? fail(what, ret) : 0;
+	}
+	if (z->size == BLZ_SIZE_UNKNOWN) {
+		fprintf(stderr, "blpack: %s does not record its size\n", path);
+		return 1;
+	}
+
+	ret = bl_sysfs_write("memalloc", z->size);
+	if (ret)
+		return fail("memalloc", ret);
+	fd = bl_open();
+	if (fd < 0)
+		return fail(BL_DEVICE, fd);
+	if (bl_sysfs_read("bufunitsize", &unit))
+		unit = 1 << 20;
+
+	ret = blz_decode(z->fmt, z->map, z->len, 0, z->size, unit, fd_sink,
+			&fd);
+	if (!ret)
+		ret = start_playback(fd, pb, &what);
+
+	/* close() returns once the waveform has played */
+	close(fd);
+	return ret ? fail(what, ret) : 0;
+}
+
+/* End plain compressed file section */
+
+static int cmd_extract(const char *path, const char *segment,
+		const char *out)
+{
+	struct blwf_file f;
+	struct zfile z;
+	uint64_t start, len;
+	int fd, ret = zfile_open(&z, path);
+
+	if (ret < 0)
+		return fail(path, ret);
+	if (ret == 0) {
+		ret = segment ? fail(segment, -EINVAL) :
+			extract_compressed(&z, out);
+		zfile_close(&z);
+		return ret;
+	}
+
+	ret = blwf_open(&f, path);
+	if (ret)
+		return fail(path, ret);
+	ret = select_range(&f, segment, &start, &len);
+	if (ret) {
+		blwf_close(&f);
+		return fail(segment, ret);
+	}
+	fd = open(out, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		blwf_close(&f);
+		return fail(out, -errno);
+	}
+	ret = blwf_decode(&f, start, len, 1 << 20, fd_sink, &fd);
+	close(fd);
+	blwf_close(&f);
+	return ret ? fail(out, ret) : 0;
+}
+
+/* Loop mode: hand each swap to the driver once the previous one is in */
+static int run_swaps(int fd, const struct playback *pb, const char **what)
+{
+	uint32_t iter;
+	uint8_t *data;
+	size_t len;
+	unsigned i;
+	int ret;
+
+	for (i = 0; i < pb->nswaps; i++) {
+		*what = pb->swap_file[i];
+		data = load_file(pb->swap_file[i], &len);
+		if (!data)
+			return -errno;
+		ret = bl_swap_segment(fd, pb->swap_index[i], data, len);
+		if (!ret)
+			ret = bl_wait_swap(fd, &iter);
+		free(data);
+		if (ret)
+			return ret;
+		fprintf(stderr, "blpack: buffer %u: %s from iteration %u\n",
+				pb->swap_index[i], pb->swap_file[i], iter);
+	}
+	return 0;
+}
+
+static uint64_t monotonic_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Scheduled start: wait for the deadline, then report the time PRU1
+ * started at, which the driver has shortly after */
+static int start_at(int fd, const char *at)
+{
+	struct beaglelogic_start st;
+	struct timespec ts;
+	uint64_t deadline;
+	int ret, tries;
+
+	if (*at == '+')
+		deadline = monotonic_ns() + strtoull(at + 1, NULL, 0) * 1000000;
+	else
+		deadline = strtoull(at, NULL, 0);
+	ret = bl_start_at(fd, deadline);
+	if (ret)
+		return ret;
+
+	ts.tv_sec = deadline / 1000000000;
+	ts.tv_nsec = deadline % 1000000000;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) ==
+			EINTR)
+		;
+	for (tries = 0; tries < 100; tries++) {
+		ret = bl_get_start(fd, &st);
+		if (ret || st.started)
+			break;
+		usleep(1000);
+	}
+	if (!ret && st.started)
+		fprintf(stderr, "blpack: started at %llu ns, %lld ns after "
+				"the deadline\n",
+				(unsigned long long)st.started,
+				(long long)(st.started - st.deadline));
+	return ret;
+}
+
+/* Endless loops play until the process is interrupted, close() then ends
+ * them at the next loop boundary */
+static int start_playback(int fd, const struct playback *pb,
+		const char **what)
+{
+	int ret = 0;
+
+	if (!pb->start)
+		return 0;
+	*what = "start";
+	ret = bl_set_loop(fd, pb->loop > 1 ? (uint32_t)pb->loop - 1 :
+			pb->loop ? BL_LOOP_FOREVER : 0);
+	if (!ret && pb->nperiods)
+		ret = bl_set_clock(fd, pb->periods[pb->nperiods - 1],
+				pb->periods, pb->nperiods);
+	if (!ret)
+		ret = pb->at ? start_at(fd, pb->at) : bl_start(fd);
+	if (!ret)
+		ret = run_swaps(fd, pb, what);
+	if (!ret && pb->loop == 1)
+		pause();
+	return ret;
+}
+
+static int cmd_upload(const char *path, const char *segment,
+		const struct playback *pb)
+{
+	struct blwf_file f;
+	struct zfile z;
+	struct bl_index ix;
+	const char *what = path;
+	uint64_t start, len;
+	uint32_t unit;
+	ssize_t n;
+	int fd, ret = zfile_open(&z, path);
+
+	if (ret < 0)
+		return fail(path, ret);
+	if (ret == 0) {
+		ret = segment ? fail(segment, -EINVAL) :
+			upload_compressed(&z, path, pb);
+		zfile_close(&z);
+		return ret;
+	}
+
+	ret = blwf_open(&f, path);
+	if (ret)
+		return fail(path, ret);
+	ret = select_range(&f, segment, &start, &len);
+	if (ret)
+		goto out;
+	if (f.hdr->sample_rate)
+		fprintf(stderr, "blpack: %s plays at %u Hz\n", path,
+				f.hdr->sample_rate);
+
+	if (pb->index) {
+		ret = bl_index_init(&ix);
+		if (!ret)
+			ret = blwf_decode(&f, start, len, 1 << 20, index_sink,
+					&ix);
+		if (!ret)
+			ret = upload_index(&ix, pb, &what);
+		bl_index_free(&ix);
+		goto out;
+	}
+
+	what = "memalloc";
+	ret = bl_sysfs_write("memalloc", len);
+	if (ret)
+		goto out;
+	what = BL_DEVICE;
+	fd = bl_open();
+	if (fd < 0) {
+		ret = fd;
+		goto out;
+	}
+
+	if (f.hdr->encoding == BLWF_ENC_RAW) {
+		n = bl_sendfile(fd, f.fd, f.hdr->payload_offset + start, len);
+		ret = n < 0 ? (int)n : (uint64_t)n < len ? -ENOSPC : 0;
+	} else {
+		if (bl_sysfs_read("bufunitsize", &unit))
+			unit = 1 << 20;
+		ret = blwf_decode(&f, start, len, unit, fd_sink, &fd);
+	}
+
+	if (!ret)
+		ret = start_playback(fd, pb, &what);
+
+	/* close() returns once the waveform has played */
+	close(fd);
+out:
+	blwf_close(&f);
+	return ret ? fail(what, ret) : 0;
+}
+
+/* Begin job queue section */
+
+struct queue {
+	int fd;
+	int started;
+};
+
+/* Starts playback the first time the ring is full */
+static ssize_t queue_sink(void *arg, const void *buf, size_t len)
+{
+	struct queue *q = arg;
+	ssize_t n;
+	int ret;
+
+	for (;;) {
+		n = write(q->fd, buf, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0)
+			return -errno;
+		if (n > 0 || q->started)
+			return n ? n : -EPIPE;
+		ret = bl_start(q->fd);
+		if (ret)
+			return ret;
+		q->started = 1;
+	}
+}
+
+/* Writes one file (container or plain compressed) into the ring */
+static int queue_file(struct queue *q, const char *path, uint32_t unit)
+{
+	struct blwf_file f;
+	struct zfile z;
+	uint64_t start, len;
+	int ret = zfile_open(&z, path);
+
+	if (ret < 0)
+		return ret;
+	if (ret == 0) {
+		ret = blz_supported(z.fmt) ? blz_decode(z.fmt, z.map, z.len, 0,
+				BLZ_SIZE_UNKNOWN, unit, queue_sink, q) :
+			-ENOTSUP;
+		zfile_close(&z);
+		return ret;
+	}
+
+	ret = blwf_open(&f, path);
+	if (ret)
+		return ret;
+	ret = select_range(&f, NULL, &start, &len);
+	if (!ret)
+		ret = blwf_decode(&f, start, len, unit, queue_sink, q);
+	blwf_close(&f);
+	return ret;
+}
+
+static int cmd_queue(int argc, char **argv)
+{
+	struct queue q = { -1, 0 };
+	const char *what = "stream";
+	uint32_t ring = 8 << 20, unit, id, last = 0;
+	int opt, i, ret;
+
+	while ((opt = getopt(argc, argv, "m:")) != -1) {
+		switch (opt) {
+		case 'm':
+			ring = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(stderr);
+			return 2;
+		}
+	}
+	if (optind == argc) {
+		usage(stderr);
+		return 2;
+	}
+
+	ret = bl_sysfs_write("stream", 1);
+	if (!ret) {
+		what = "memalloc";
+		ret = bl_sysfs_write("memalloc", ring);
+	}
+	if (ret)
+		return fail(what, ret);
+	q.fd = bl_open();
+	if (q.fd < 0)
+		return fail(BL_DEVICE, q.fd);
+	if (bl_sysfs_read("bufunitsize", &unit))
+		unit = 1 << 20;
+
+	for (i = optind; i < argc; i++) {
+		what = argv[i];
+		ret = queue_file(&q, argv[i], unit);
+		if (ret)
+			goto out;
+		what = "job";
+		ret = bl_job_end(q.fd);
+		if (ret < 0)
+			goto out;
+		last = ret;
+		fprintf(stderr, "blpack: job %u: %s\n", last, argv[i]);
+	}
+
+	/* Everything fit in the ring */
+	if (!q.started) {
+		what = "start";
+		ret = bl_start(q.fd);
+		if (ret)
+			goto out;
+	}
+	for (id = last - (argc - optind) + 1; id != last + 1; id++) {
+		what = "job";
+		ret = bl_wait_job(q.fd, id);
+		if (ret)
+			goto out;
+		fprintf(stderr, "blpack: job %u done\n", id);
+	}
+	ret = 0;
+out:
+	/* close() returns once the rest has played */
+	close(q.fd);
+	return ret ? fail(what, ret) : 0;
+}
+
+/* End job queue section */
+
+int main(int argc, char **argv)
+{
+	struct playback pb;
+	const char *cmd, *segment = NULL;
+	char *sep, *tok;
+	int opt;
+
+	if (argc < 2) {
+		usage(stderr);
+		return 2;
+	}
+	cmd = argv[1];
+	argc--;
+	argv++;
+
+	if (!strcmp(cmd, "create"))
+		return cmd_create(argc, argv);
+	if (!strcmp(cmd, "queue"))
+		return cmd_queue(argc, argv);
+
+	memset(&pb, 0, sizeof(pb));
+	while ((opt = getopt(argc, argv, "S:sT:xL:W:P:")) != -1) {
+		switch (opt) {
+		case 'S':
+			segment = optarg;
+			break;
+		case 's':
+			pb.start = 1;
+			break;
+		case 'T':
+			pb.start = 1;
+			pb.at = optarg;
+			break;
+		case 'x':
+			pb.index = 1;
+			break;
+		case 'L':
+			pb.loop = strtoul(optarg, NULL, 0) + 1;
+			break;
+		case 'W':
+			sep = strchr(optarg, ':');
+			if (!sep || pb.nswaps == MAX_SWAPS)
+				return fail(optarg, -EINVAL);
+			pb.swap_index[pb.nswaps] = strtoul(optarg, NULL, 0);
+			pb.swap_file[pb.nswaps++] = sep + 1;
+			break;
+		case 'P':
+			for (tok = strtok(optarg, ","); tok;
+					tok = strtok(NULL, ",")) {
+				if (pb.nperiods == MAX_PERIODS)
+					return fail(optarg, -E2BIG);
+				pb.periods[pb.nperiods++] =
+					strtoul(tok, NULL, 0);
+			}
+			break;
+		default:
+			usage(stderr);
+			return 2;
+		}
+	}
+
+	if (!strcmp(cmd, "info") && argc - optind == 1)
+		return cmd_info(argv[optind]);
+	if (!strcmp(cmd, "verify") && argc - optind == 1)
+		return cmd_verify(argv[optind]);
+	if (!strcmp(cmd, "extract") && argc - optind == 2)
+		return cmd_extract(argv[optind], segment, argv[optind + 1]);
+	if (!strcmp(cmd, "upload") && argc - optind == 1)
+		return cmd_upload(argv[optind], segment, &pb);
+
+	usage(!strcmp(cmd, "-h") ? stdout : stderr);
+	return !strcmp(cmd, "-h") ? 0 : 2;
+}
@@ -0,0 +1,136 @@
+/*
+ * blpredict - maximum safe sample rate per output configuration
+ *
+ * Feeds DDR read times into the firmware cycle budget model. With a file of
+ * measured read times (ns per 64 byte block, one per line, e.g. collected
+ * from the ddrlatencymax attribute), the rate for each reliability level is
+ * taken from the matching quantile of the distribution; 100 % uses the
+ * worst read time seen.
+ *
+ * This file is a part of the PRU digital waveform generator project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libbeaglelogic.h"
+
+static const uint32_t channel_configs[] = { 4, 8, 13 };
+static const double reliabilities[] = { 100.0, 99.999, 99.99, 99.9 };
+
+static int cmp_u32(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static uint32_t *load_latencies(const char *path, size_t *n)
+{
+	FILE *f = fopen(path, "r");
+	uint32_t *v = NULL, x;
+	size_t cap = 0;
+
+	if (!f) {
+		fprintf(stderr, "blpredict: %s: %s\n", path, strerror(errno));
+		exit(1);
+	}
+	*n = 0;
+	while (fscanf(f, "%u", &x) == 1) {
+		if (*n == cap) {
+			cap = cap ? cap * 2 : 256;
+			v = realloc(v, cap * sizeof(*v));
+			if (!v) {
+				fprintf(stderr, "blpredict: out of memory\n");
+				exit(1);
+			}
+		}
+		v[(*n)++] = x;
+	}
+	fclose(f);
+	if (!*n) {
+		fprintf(stderr, "blpredict: no read times in %s\n", path);
+		exit(1);
+	}
+	qsort(v, *n, sizeof(*v), cmp_u32);
+	return v;
+}
+
+static void print_rate(uint32_t channels, double reliability, uint32_t ns)
+{
+	printf("channels=%u reliability=%g ddr_ns=%u max_samplerate=%u\n",
+			channels, reliability, ns,
+			bl_max_samplerate(channels, ns));
+}
+
+static void usage(FILE *f)
+{
+	fprintf(f,
+		"Usage: blpredict [-l NS | -f FILE | -d]\n"
+		"  -l NS    worst DDR block read time in ns\n"
+		"  -f FILE  measured DDR block read times in ns, one per line\n"
+		"  -d       use the model inputs of the loaded driver\n");
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t *lat = NULL, ns = 0, measured;
+	size_t nlat = 0, i, j;
+	int opt, from_dev = 0;
+
+	while ((opt = getopt(argc, argv, "l:f:dh")) != -1) {
+		switch (opt) {
+		case 'l':
+			ns = strtoul(optarg, NULL, 10);
+			break;
+		case 'f':
+			lat = load_latencies(optarg, &nlat);
+			break;
+		case 'd':
+			from_dev = 1;
+			break;
+		case 'h':
+			usage(stdout);
+			return 0;
+		default:
+			usage(stderr);
+			return 1;
+		}
+	}
+
+	if (from_dev) {
+		if (bl_sysfs_read("ddrlatency", &ns) ||
+		    bl_sysfs_read("ddrlatencymax", &measured)) {
+			fprintf(stderr, "blpredict: driver not loaded\n");
+			return 1;
+		}
+		if (measured > ns)
+			ns = measured;
+	}
+
+	for (i = 0; i < sizeof(channel_configs) / sizeof(channel_configs[0]);
+			i++) {
+		if (!lat) {
+			print_rate(channel_configs[i], 100.0, ns);
+			continue;
+		}
+		for (j = 0; j < sizeof(reliabilities) / sizeof(reliabilities[0]);
+				j++) {
+			/* Every block must arrive within this quantile */
+			size_t k = (size_t)(reliabilities[j] / 100.0 * nlat);
+
+			if (k >= nlat)
+				k = nlat - 1;
+			print_rate(channel_configs[i], reliabilities[j], lat[k]);
+		}
+	}
+	free(lat);
+	return 0;
+}
@@ -0,0 +1,130 @@
+/*
+ * Bounded single-producer, single-consumer queue of pointers
+ *
+ * Lock-free ring between two threads: the producer only writes 'head', the
+ * consumer only writes 'tail', each with release semantics so the slot
+ * contents are visible before the index moves. A full queue blocks the
+ * producer and an empty one the consumer, which is how backpressure
+ * travels up a pipeline. Waiting spins briefly, then yields, then sleeps,
+ * so an idle stage costs next to nothing on a single core.
+ *
+ * This file is a part of the PRU digital waveform generator project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef BLQUEUE_H_
+#define BLQUEUE_H_
+
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define BLQ_CACHE_LINE	64
+
+struct blqueue {
+	_Alignas(BLQ_CACHE_LINE) atomic_size_t head;	/* Next slot to fill */
+	_Alignas(BLQ_CACHE_LINE) atomic_size_t tail;	/* Next slot to take */
+	_Alignas(BLQ_CACHE_LINE) size_t size;		/* Power of two */
+	void **slots;
+	atomic_int closed;	/* Producer is done, drain and stop */
+};
+
+/* Capacity is rounded up to a power of two */
+static inline int blq_init(struct blqueue *q, size_t capacity)
+{
+	size_t size = 2;
+
+	while (size < capacity)
+		size <<= 1;
+	q->slots = calloc(size, sizeof(*q->slots));
+	if (!q->slots)
+		return -1;
+	q->size = size;
+	atomic_init(&q->head, 0);
+	atomic_init(&q->tail, 0);
+	atomic_init(&q->closed, 0);
+	return 0;
+}
+
+static inline void blq_free(struct blqueue *q)
+{
+	free(q->slots);
+	q->slots = NULL;
+}
+
+static inline int blq_try_push(struct blqueue *q, void *p)
+{
+	size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+	size_t tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+
+	if (head - tail == q->size)
+		return 0;
+	q->slots[head & (q->size - 1)] = p;
+	atomic_store_explicit(&q->head, head + 1, memory_order_release);
+	return 1;
+}
+
+static inline void *blq_try_pop(struct blqueue *q)
+{
+	size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+	size_t head = atomic_load_explicit(&q->head, memory_order_acquire);
+	void *p;
+
+	if (head == tail)
+		return NULL;
+	p = q->slots[tail & (q->size - 1)];
+	atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+	return p;
+}
+
+/* Spin, then yield, then sleep up to 1 ms between polls */
+static inline void blq_backoff(unsigned *spins)
+{
+	struct timespec ts = { 0, 0 };
+
+	if (++*spins < 64)
+		return;
+	if (*spins < 128) {
+		sched_yield();
+		return;
+	}
+	ts.tv_nsec = *spins < 1024 ? 50000 : 1000000;
+	nanosleep(&ts, NULL);
+}
+
+static inline void blq_push(struct blqueue *q, void *p)
+{
+	unsigned spins = 0;
+
+	while (!blq_try_push(q, p))
+		blq_backoff(&spins);
+}
+
+/* NULL once the queue is closed and drained */
+static inline void *blq_pop(struct blqueue *q)
+{
+	unsigned spins = 0;
+	void *p;
+
+	while (!(p = blq_try_pop(q))) {
+		if (atomic_load_explicit(&q->closed, memory_order_acquire) &&
+				!(p = blq_try_pop(q)))
+			return NULL;
+		if (p)
+			break;
+		blq_backoff(&spins);
+	}
+	return p;
+}
+
+static inline void blq_close(struct blqueue *q)
+{
+	atomic_store_explicit(&q->closed, 1, memory_order_release);
+}
+
+#endif /* BLQUEUE_H_ */
@@ -0,0 +1,642 @@
+/*
+ * blserve - network waveform server
+ *
+ * Runs on the BeagleBone and takes waveform uploads and playback commands
+ * from a test controller over TCP, one connection at a time. Commands are
+ * text lines, each answered by one line starting with OK or ERR:
+ *
+ *   UPLOAD BYTES [START]  BYTES of the device byte stream follow the line
+ *                         right away; the reply gives the bytes, the time
+ *                         and the throughput from the first to the last
+ *                         byte. START plays the waveform once it is in.
+ *   START                 plays the uploaded waveform (again)
+ *   STOP                  ends playback and releases the device
+ *   STATUS                state, buffer, bytes played and total, elapsed
+ *                         and remaining ms (IOCTL_BL_GET_PROGRESS)
+ *   QUIT                  closes the connection
+ *
+ * Upload data goes from the socket into a pipe and from the pipe into
+ * /dev/beaglelogic with splice(), so the only copy is the driver's, into
+ * its buffers. The client sends the data right behind the UPLOAD line: the
+ * server sizes the buffers (memalloc) and opens the device while the data
+ * queues up in the socket, and with START playback begins as soon as the
+ * last byte is in, without another round trip.
+ *
+ * With -m, the server runs against the userspace mock of the driver's
+ * buffer ring (blmock.c) instead, so it can be tried over loopback on any
+ * Linux machine. The mock has no file to splice into, so the data is read
+ * into a bounce buffer first, and STATUS gives the CRC-32 of what was
+ * uploaded instead of the progress.
+ *
+ * The client side runs anywhere: blserve -c HOST[:PORT] sends one command,
+ * an upload with sendfile() straight from the page cache of the file.
+ *
+ * This file is a part of the PRU digital waveform generator project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#include "libbeaglelogic.h"
+#include "blmock.h"
+#include "blwf.h"
+
+#define DEFAULT_PORT		"4950"
+#define MOCK_MAXBUFCOUNT	128	/* MAX_BUFLIST_ENTRIES of the firmware */
+#define PIPE_SIZE		(1 << 20)
+#define SOCK_RCVBUF		(4 << 20)
+#define LINE_MAX_LEN		128
+
+struct backend {
+	const char *name;
+	int (*arm)(uint32_t len);
+	ssize_t (*upload)(int sock, size_t len);
+	int (*start)(void);
+	void (*stop)(void);
+	int (*status)(char *buf, size_t len);
+};
+
+static uint64_t monotonic_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Reads and drops what is left of an upload, so the next line is a command */
+static int discard(int sock, size_t len)
+{
+	char buf[4096];
+	ssize_t n;
+
+	while (len) {
+		n = read(sock, buf, len < sizeof(buf) ? len : sizeof(buf));
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return n ? -errno : -ECONNRESET;
+		len -= n;
+	}
+	return 0;
+}
+
+/* Begin device backend section */
+
+static int dev_fd = -1;
+static int dev_pipe[2] = { -1, -1 };
+
+static void dev_stop(void)
+{
+	if (dev_fd >= 0)
+		close(dev_fd);
+	dev_fd = -1;
+}
+
+/* The device only takes a new size while it is closed */
+static int dev_arm(uint32_t len)
+{
+	int ret;
+
+	dev_stop();
+	ret = bl_sysfs_write("memalloc", len);
+	if (ret)
+		return ret;
+	dev_fd = bl_open();
+	return dev_fd < 0 ? dev_fd : 0;
+}
+
+/* socket -> pipe -> device; a pipe holds page references, not copies */
+static ssize_t dev_upload(int sock, size_t len)
+{
+	size_t done = 0;
+	ssize_t n, m;
+
+	if (dev_pipe[0] < 0) {
+		if (pipe(dev_pipe))
+			return -errno;
+		fcntl(dev_pipe[1], F_SETPIPE_SZ, PIPE_SIZE);
+	}
+
+	while (done < len) {
+		n = splice(sock, NULL, dev_pipe[1], NULL,
+				len - done < PIPE_SIZE ? len - done : PIPE_SIZE,
+				SPLICE_F_MOVE | SPLICE_F_MORE);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return n ? -errno : -ECONNRESET;
+
+		while (n) {
+			m = splice(dev_pipe[0], NULL, dev_fd, NULL, n,
+					SPLICE_F_MOVE | SPLICE_F_MORE);
+			if (m < 0 && errno == EINTR)
+				continue;
+			if (m <= 0) {
+				/* Empty the pipe, the caller drops the rest */
+				int err = m ? -errno : -ENOSPC;
+
+				discard(dev_pipe[0], n);
+				if (discard(sock, len - done - n))
+					return -ECONNRESET;
+				return err;
+			}
+			n -= m;
+			done += m;
+		}
+	}
+	return done;
+}
+
+static int dev_start(void)
+{
+	return dev_fd < 0 ? -EBADF : bl_start(dev_fd);
+}
+
+static int dev_status(char *buf, size_t len)
+{
+	struct beaglelogic_progress p;
+	int ret;
+
+	if (dev_fd < 0)
+		return -EBADF;
+	ret = bl_get_progress(dev_fd, &p);
+	if (ret)
+		return ret;
+	snprintf(buf, len, "%u %u %u %u %u %u", p.state, p.index,
+			p.bytes_done, p.bytes_total, p.elapsed_ms, p.eta_ms);
+	return 0;
+}
+
+/* End device backend section */
+
+/* Begin mock backend section */
+
+static struct blmock mock;
+static uint32_t mock_crc;
+static uint64_t mock_bytes;
+
+static int mock_arm(uint32_t len)
+{
+	blmock_close(&mock);
+	mock_crc = 0;
+	mock_bytes = 0;
+	return blmock_memalloc(&mock, len);
+}
+
+static ssize_t mock_upload(int sock, size_t len)
+{
+	static uint8_t buf[PIPE_SIZE];
+	size_t done = 0;
+	ssize_t n, m;
+
+	while (done < len) {
+		n = read(sock, buf, len - done < sizeof(buf) ?
+				len - done : sizeof(buf));
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return n ? -errno : -ECONNRESET;
+		m = blmock_write(&mock, buf, n);
+		if (m != n) {
+			if (discard(sock, len - done - n))
+				return -ECONNRESET;
+			return m < 0 ? m : -ENOSPC;
+		}
+		mock_crc = blwf_crc32(mock_crc, buf, n);
+		done += n;
+	}
+	mock_bytes += done;
+	return done;
+}
+
+static int mock_start(void)
+{
+	return blmock_start(&mock);
+}
+
+static void mock_stop(void)
+{
+	blmock_close(&mock);
+}
+
+static int mock_status(char *buf, size_t len)
+{
+	snprintf(buf, len, "%u %llu %08x", mock.bufcount,
+			(unsigned long long)mock_bytes, mock_crc);
+	return 0;
+}
+
+/* End mock backend section */
+
+/* Begin server section */
+
+static int reply(int sock, const char *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+
+static int reply(int sock, const char *fmt, ...)
+{
+	char line[LINE_MAX_LEN];
+	va_list ap;
+	int n;
+
+	va_start(ap, fmt);
+	n = vsnprintf(line, sizeof(line) - 1, fmt, ap);
+	va_end(ap);
+	if (n > (int)sizeof(line) - 2)
+		n = sizeof(line) - 2;
+	line[n++] = '\n';
+	return write(sock, line, n) == n ? 0 : -1;
+}
+
+static int reply_err(int sock, int err)
+{
+	return reply(sock, "ERR %s", strerror(-err));
+}
+
+/* One byte at a time: the upload data right behind the line must stay in
+ * the socket for splice() */
+static int read_line(int sock, char *line, size_t len)
+{
+	size_t n = 0;
+	ssize_t r;
+
+	for (;;) {
+		r = read(sock, line + n, 1);
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r <= 0)
+			return -1;
+		if (line[n] == '\n')
+			break;
+		if (n < len - 1)
+			n++;
+	}
+	if (n && line[n - 1] == '\r')
+		n--;
+	line[n] = '\0';
+	return 0;
+}
+
+static int cmd_upload(const struct backend *be, int sock, char *args)
+{
+	char *end;
+	unsigned long long len = strtoull(args, &end, 0);
+	int start = 0, ret;
+	uint64_t t0, ns;
+	ssize_t n;
+
+	while (*end == ' ')
+		end++;
+	if (!strcasecmp(end, "START"))
+		start = 1;
+	else if (*end)
+		len = 0;
+	if (!len || len > UINT32_MAX) {
+		/* Without a valid length the stream is out of step for good */
+		reply(sock, "ERR %s", strerror(EINVAL));
+		return -1;
+	}
+
+	ret = be->arm(len);
+	if (ret) {
+		if (discard(sock, len))
+			return -1;
+		return reply_err(sock, ret);
+	}
+
+	t0 = monotonic_ns();
+	n = be->upload(sock, len);
+	ns = monotonic_ns() - t0;
+	if (n == -ECONNRESET)
+		return -1;
+	if (n < 0)
+		return reply_err(sock, n);
+
+	if (start) {
+		ret = be->start();
+		if (ret)
+			return reply_err(sock, ret);
+	}
+	fprintf(stderr, "blserve: %zd bytes in %.3f s, %.1f MB/s\n", n,
+			ns / 1e9, ns ? n * 1e3 / ns : 0);
+	return reply(sock, "OK %zd %llu %.1f", n,
+			(unsigned long long)(ns / 1000000),
+			ns ? n * 1e3 / ns : 0);
+}
+
+static void serve(const struct backend *be, int sock)
+{
+	char line[LINE_MAX_LEN], status[LINE_MAX_LEN];
+	char *args;
+	int ret;
+
+	while (!read_line(sock, line, sizeof(line))) {
+		args = strchr(line, ' ');
+		if (args)
+			*args++ = '\0';
+		else
+			args = line + strlen(line);
+
+		if (!strcasecmp(line, "UPLOAD")) {
+			ret = cmd_upload(be, sock, args);
+		} else if (!strcasecmp(line, "START")) {
+			ret = be->start();
+			ret = ret ? reply_err(sock, ret) : reply(sock, "OK");
+		} else if (!strcasecmp(line, "STOP")) {
+			be->stop();
+			ret = reply(sock, "OK");
+		} else if (!strcasecmp(line, "STATUS")) {
+			ret = be->status(status, sizeof(status));
+			ret = ret ? reply_err(sock, ret) :
+				reply(sock, "OK %s", status);
+		} else if (!strcasecmp(line, "QUIT")) {
+			reply(sock, "OK");
+			break;
+		} else {
+			ret = reply_err(sock, -EINVAL);
+		}
+		if (ret)
+			break;
+	}
+}
+
+static int listen_on(const char *host, const char *port)
+{
+	struct addrinfo hints = { 0 }, *res, *ai;
+	int sock = -1, on = 1, ret;
+
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE;
+	ret = getaddrinfo(host, port, &hints, &res);
+	if (ret) {
+		fprintf(stderr, "blserve: %s\n", gai_strerror(ret));
+		return -1;
+	}
+	for (ai = res; ai; ai = ai->ai_next) {
+		sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if (sock < 0)
+			continue;
+		setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+		if (!bind(sock, ai->ai_addr, ai->ai_addrlen) &&
+				!listen(sock, 1))
+			break;
+		close(sock);
+		sock = -1;
+	}
+	freeaddrinfo(res);
+	if (sock < 0)
+		perror("blserve: listen");
+	return sock;
+}
+
+static int run_server(const struct backend *be, const char *host,
+		const char *port)
+{
+	int lsock = listen_on(host, port), sock, rcvbuf = SOCK_RCVBUF;
+
+	if (lsock < 0)
+		return 1;
+	/* Accepted sockets inherit it: room for the data that arrives
+	 * while the buffers are allocated */
+	setsockopt(lsock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+	fprintf(stderr, "blserve: %s backend on port %s\n", be->name, port);
+
+	for (;;) {
+		sock = accept(lsock, NULL, NULL);
+		if (sock < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("blserve: accept");
+			return 1;
+		}
+		serve(be, sock);
+		close(sock);
+	}
+}
+
+/* End server section */
+
+/* Begin client section */
+
+static int connect_to(char *addr)
+{
+	struct addrinfo hints = { 0 }, *res, *ai;
+	char *port = strrchr(addr, ':');
+	int sock = -1, on = 1, ret;
+
+	if (port)
+		*port++ = '\0';
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	ret = getaddrinfo(addr, port ? port : DEFAULT_PORT, &hints, &res);
+	if (ret) {
+		fprintf(stderr, "blserve: %s: %s\n", addr, gai_strerror(ret));
+		return -1;
+	}
+	for (ai = res; ai; ai = ai->ai_next) {
+		sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if (sock < 0)
+			continue;
+		if (!connect(sock, ai->ai_addr, ai->ai_addrlen))
+			break;
+		close(sock);
+		sock = -1;
+	}
+	freeaddrinfo(res);
+	if (sock < 0)
+		perror("blserve: connect");
+	else
+		setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+	return sock;
+}
+
+static int client_upload(int sock, const char *path, int start)
+{
+	char line[LINE_MAX_LEN];
+	struct stat st;
+	off_t off = 0;
+	ssize_t n;
+	int fd = open(path, O_RDONLY);
+
+	if (fd < 0 || fstat(fd, &st)) {
+		perror(path);
+		return -1;
+	}
+	n = snprintf(line, sizeof(line), "UPLOAD %lld%s\n",
+			(long long)st.st_size, start ? " START" : "");
+	if (write(sock, line, n) != n) {
+		close(fd);
+		return -1;
+	}
+	while (off < st.st_size) {
+		n = sendfile(sock, fd, &off, st.st_size - off);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0) {
+			perror("blserve: sendfile");
+			close(fd);
+			return -1;
+		}
+	}
+	close(fd);
+	return 0;
+}
+
+static int run_client(char *addr, int argc, char **argv)
+{
+	char line[LINE_MAX_LEN];
+	uint64_t t0 = monotonic_ns();
+	int sock = connect_to(addr), ret = 0, n;
+
+	if (sock < 0)
+		return 1;
+	if (!strcmp(argv[0], "upload")) {
+		if (argc < 2 || argc > 3 ||
+				(argc == 3 && strcmp(argv[2], "start"))) {
+			close(sock);
+			return 2;
+		}
+		ret = client_upload(sock, argv[1], argc == 3);
+	} else if (argc == 1 && (!strcmp(argv[0], "start") ||
+			!strcmp(argv[0], "stop") || !strcmp(argv[0], "status"))) {
+		n = snprintf(line, sizeof(line), "%s\n", argv[0]);
+		if (write(sock, line, n) != n)
+			ret = -1;
+	} else {
+		close(sock);
+		return 2;
+	}
+
+	if (!ret)
+		ret = read_line(sock, line, sizeof(line));
+	if (!ret) {
+		printf("%s\n", line);
+		fprintf(stderr, "blserve: %.3f s\n",
+				(monotonic_ns() - t0) / 1e9);
+		ret = strncmp(line, "OK", 2) ? -1 : 0;
+	} else {
+		fprintf(stderr, "blserve: connection closed\n");
+	}
+	close(sock);
+	return ret ? 1 : 0;
+}
+
+/* End client section */
+
+static void usage(FILE *f)
+{
+	fprintf(f,
+		"Usage: blserve [options]                serve /dev/beaglelogic\n"
+		"       blserve -c HOST[:PORT] COMMAND   send one command\n"
+		"Server options:\n"
+		"  -p PORT     TCP port (default " DEFAULT_PORT ")\n"
+		"  -b ADDR     address to listen on (default all)\n"
+		"  -u BYTES    buffer unit size to set first\n"
+		"  -m          use the userspace mock instead of /dev/beaglelogic\n"
+		"Commands:\n"
+		"  upload FILE [start]   upload FILE, then play it with start\n"
+		"  start | stop | status\n"
+		"Sizes accept k and M suffixes.\n");
+}
+
+static unsigned long parse_size(const char *s)
+{
+	char *end;
+	unsigned long v = strtoul(s, &end, 0);
+
+	if (*end == 'k' || *end == 'K')
+		v <<= 10;
+	else if (*end == 'M' || *end == 'm')
+		v <<= 20;
+	return v;
+}
+
+int main(int argc, char **argv)
+{
+	struct backend dev = {
+		"device", dev_arm, dev_upload, dev_start, dev_stop, dev_status
+	};
+	struct backend mck = {
+		"mock", mock_arm, mock_upload, mock_start, mock_stop,
+		mock_status
+	};
+	const char *port = DEFAULT_PORT, *host = NULL;
+	char *client = NULL;
+	unsigned long unit = 0;
+	int use_mock = 0, opt, ret;
+
+	while ((opt = getopt(argc, argv, "+p:b:u:mc:h")) != -1) {
+		switch (opt) {
+		case 'p':
+			port = optarg;
+			break;
+		case 'b':
+			host = optarg;
+			break;
+		case 'u':
+			unit = parse_size(optarg);
+			break;
+		case 'm':
+			use_mock = 1;
+			break;
+		case 'c':
+			client = optarg;
+			break;
+		case 'h':
+			usage(stdout);
+			return 0;
+		default:
+			usage(stderr);
+			return 1;
+		}
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+
+	if (client) {
+		if (optind == argc) {
+			usage(stderr);
+			return 1;
+		}
+		ret = run_client(client, argc - optind, argv + optind);
+		if (ret == 2)
+			usage(stderr);
+		return ret ? 1 : 0;
+	}
+	if (optind != argc) {
+		usage(stderr);
+		return 1;
+	}
+
+	if (use_mock) {
+		blmock_init(&mock, MOCK_MAXBUFCOUNT);
+		ret = blmock_set_bufunitsize(&mock, unit ? unit : 640000);
+	} else {
+		ret = unit ? bl_sysfs_write("bufunitsize", unit) : 0;
+	}
+	if (ret) {
+		fprintf(stderr, "blserve: bufunitsize: %s\n", strerror(-ret));
+		return 1;
+	}
+	return run_server(use_mock ? &mck : &dev, host, port);
+}
@@ -0,0 +1,838 @@
+/*
+ * blstream - stream a waveform of any length into the device
+ *
+ * The driver's stream mode (sysfs 'stream') reuses the buffer ring while the
+ * waveform plays, so user space has to keep up with the sample clock for
+ * as long as it runs. The work is split into a pipeline of threads, one per
+ * stage, connected by bounded lock-free queues of chunks:
+ *
+ *   source  reads FILE (or stdin), or generates a test waveform
+ *   pack    turns planar input (one bit plane per channel) into the
+ *           device's byte stream of 4 bit samples; absent for packed input
+ *   writer  write()s into /dev/beaglelogic, starts playback once the ring
+ *           has been filled, and ends the stream with fsync()
+ *
+ * Every link between two stages owns a fixed set of chunks that circulate
+ * between a 'full' and an 'empty' queue, so nothing is allocated while
+ * streaming and a slow stage throttles the ones before it. Each stage can
+ * be pinned to a CPU. At the end, the throughput and the busy and waiting
+ * time of every stage are printed, and with -r compared against the sample
+ * rate the waveform needs.
+ *
+ * Planar input consists of frames of FRAME samples per channel: for each
+ * channel in turn, FRAME / 8 bytes holding one sample per bit, the first
+ * sample in bit 0. Channel 0 drives bit 0 of the device's samples.
+ *
+ * This file is a part of the PRU digital waveform generator project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libbeaglelogic.h"
+#include "blmock.h"
+#include "blqueue.h"
+#include "blwf.h"
+
+#define MOCK_MAXBUFCOUNT	128	/* MAX_BUFLIST_ENTRIES of the firmware */
+#define MAX_STAGES		3
+#define NIBBLE_CHANNELS		4
+
+struct chunk {
+	uint8_t *data;
+	size_t len;
+	uint32_t frame;		/* Planar: samples per channel per frame */
+};
+
+/* Chunks circulating between a producer and a consumer stage */
+struct link {
+	struct blqueue full;	/* Producer to consumer */
+	struct blqueue empty;	/* Consumer back to producer */
+	struct chunk *chunks;
+	uint8_t *mem;
+};
+
+struct stage {
+	const char *name;
+	void *(*run)(void *arg);
+	struct link *in, *out;
+	int cpu;		/* -1: not pinned */
+	pthread_t thread;
+
+	/* Written by the stage, read by the progress display */
+	atomic_uint_fast64_t samples;
+	atomic_uint_fast64_t wait_in_ns;
+	atomic_uint_fast64_t wait_out_ns;
+	uint64_t elapsed_ns;
+};
+
+struct backend {
+	const char *name;
+	int (*setup)(uint32_t unitsize, uint32_t total, double byte_rate);
+	ssize_t (*write)(const void *buf, size_t len);
+	int (*start)(void);
+	int (*finish)(void);
+	uint32_t (*lasterror)(void);
+};
+
+enum generator { GEN_NONE, GEN_COUNTER, GEN_RANDOM, GEN_ZERO };
+
+static struct {
+	struct backend *be;
+	int in_fd;
+	enum generator gen;
+	uint64_t gen_samples;	/* Length of a generated waveform */
+	uint32_t frame;		/* Planar input: samples per frame, 0 = packed */
+	uint32_t channels;	/* Planar input */
+	uint32_t chunk_frames;	/* Frames per chunk of planar input */
+	size_t chunk_bytes;	/* Packed bytes per chunk */
+
+	atomic_int stop;	/* Source ends the stream early */
+	atomic_int finished;	/* Writer is done */
+	int error;		/* First error of the writer */
+	int started;
+	uint64_t written;
+	uint32_t written_crc;
+	double t_start;
+} bs;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Begin device backend section */
+
+static int dev_fd = -1;
+
+static int dev_setup(uint32_t unitsize, uint32_t total, double byte_rate)
+{
+	int ret;
+
+	(void)byte_rate;	/* The sample clock is external */
+	ret = bl_sysfs_write("stream", 1);
+	if (!ret)
+		ret = bl_sysfs_write("bufunitsize", unitsize);
+	if (!ret)
+		ret = bl_sysfs_write("memalloc", total);
+	if (ret)
+		return ret;
+	dev_fd = bl_open();
+	return dev_fd < 0 ? dev_fd : 0;
+}
+
+static ssize_t dev_write(const void *buf, size_t len)
+{
+	ssize_t n;
+
+	do {
+		n = write(dev_fd, buf, len);
+	} while (n < 0 && errno == EINTR);
+	return n < 0 ? -errno : n;
+}
+
+static int dev_start(void)
+{
+	return bl_start(dev_fd);
+}
+
+/* close() returns once the stream has played */
+static int dev_finish(void)
+{
+	int ret = bl_end_stream(dev_fd);
+
+	close(dev_fd);
+	dev_fd = -1;
+	return ret;
+}
+
+static uint32_t dev_lasterror(void)
+{
+	uint32_t val = 0;
+
+	bl_sysfs_read("lasterror", &val);
+	return val;
+}
+
+/* End device backend section */
+
+/* Begin mock backend section */
+
+static struct blmock mock;
+
+static int mock_setup(uint32_t unitsize, uint32_t total, double byte_rate)
+{
+	int ret;
+
+	blmock_init(&mock, MOCK_MAXBUFCOUNT);
+	ret = blmock_set_stream(&mock, 1, byte_rate);
+	if (!ret)
+		ret = blmock_set_bufunitsize(&mock, unitsize);
+	if (!ret)
+		ret = blmock_memalloc(&mock, total);
+	if (!ret)
+		blmock_open(&mock);
+	return ret;
+}
+
+static ssize_t mock_write(const void *buf, size_t len)
+{
+	return blmock_write(&mock, buf, len);
+}
+
+static int mock_start(void)
+{
+	return blmock_start(&mock);
+}
+
+static int mock_finish(void)
+{
+	blmock_close(&mock);
+	return 0;
+}
+
+static uint32_t mock_lasterror(void)
+{
+	return mock.lasterror;
+}
+
+/* End mock backend section */
+
+/* Begin pipeline section */
+
+static int link_init(struct link *l, unsigned count, size_t size)
+{
+	unsigned i;
+
+	if (blq_init(&l->full, count) || blq_init(&l->empty, count))
+		return -ENOMEM;
+	l->chunks = calloc(count, sizeof(*l->chunks));
+	l->mem = aligned_alloc(BLQ_CACHE_LINE,
+			(size + BLQ_CACHE_LINE - 1) / BLQ_CACHE_LINE *
+			BLQ_CACHE_LINE * count);
+	if (!l->chunks || !l->mem)
+		return -ENOMEM;
+	for (i = 0; i < count; i++) {
+		l->chunks[i].data = l->mem + i * ((size + BLQ_CACHE_LINE - 1) /
+				BLQ_CACHE_LINE * BLQ_CACHE_LINE);
+		blq_push(&l->empty, &l->chunks[i]);
+	}
+	return 0;
+}
+
+static void link_free(struct link *l)
+{
+	blq_free(&l->full);
+	blq_free(&l->empty);
+	free(l->chunks);
+	free(l->mem);
+}
+
+static struct chunk *timed_pop(struct blqueue *q, atomic_uint_fast64_t *wait)
+{
+	uint64_t t0 = now_ns();
+	struct chunk *c = blq_pop(q);
+
+	atomic_fetch_add_explicit(wait, now_ns() - t0, memory_order_relaxed);
+	return c;
+}
+
+static void timed_push(struct blqueue *q, struct chunk *c,
+		atomic_uint_fast64_t *wait)
+{
+	uint64_t t0 = now_ns();
+
+	blq_push(q, c);
+	atomic_fetch_add_explicit(wait, now_ns() - t0, memory_order_relaxed);
+}
+
+/* An empty chunk to fill, from the consumer downstream */
+static struct chunk *get_empty(struct stage *s)
+{
+	return timed_pop(&s->out->empty, &s->wait_out_ns);
+}
+
+static void put_full(struct stage *s, struct chunk *c)
+{
+	timed_push(&s->out->full, c, &s->wait_out_ns);
+}
+
+/* The next chunk from upstream, NULL at the end of the stream */
+static struct chunk *get_full(struct stage *s)
+{
+	return timed_pop(&s->in->full, &s->wait_in_ns);
+}
+
+static void put_empty(struct stage *s, struct chunk *c)
+{
+	blq_push(&s->in->empty, c);
+}
+
+static void add_samples(struct stage *s, uint64_t n)
+{
+	atomic_fetch_add_explicit(&s->samples, n, memory_order_relaxed);
+}
+
+/* End pipeline section */
+
+/* Begin source section */
+
+static size_t read_full(int fd, uint8_t *buf, size_t len)
+{
+	size_t done = 0;
+	ssize_t n;
+
+	while (done < len) {
+		n = read(fd, buf + done, len - done);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		done += n;
+	}
+	return done;
+}
+
+static uint64_t xorshift64(uint64_t *x)
+{
+	*x ^= *x << 13;
+	*x ^= *x >> 7;
+	*x ^= *x << 17;
+	return *x;
+}
+
+/* One planar frame of 'frame' samples per channel, 'frame' a multiple of 16.
+ * The counter counts up on the 4 outputs: channel c toggles every 2^c
+ * samples */
+static void generate(uint8_t *out, uint32_t frame, uint64_t *seed)
+{
+	static const uint8_t counter[3] = { 0xAA, 0xCC, 0xF0 };
+	size_t plane = frame / 8, j, c;
+	uint64_t r;
+
+	for (c = 0; c < NIBBLE_CHANNELS; c++) {
+		uint8_t *p = out + c * plane;
+
+		switch (bs.gen) {
+		case GEN_COUNTER:
+			if (c < 3)
+				memset(p, counter[c], plane);
+			else
+				for (j = 0; j < plane; j++)
+					p[j] = j & 1 ? 0xFF : 0x00;
+			break;
+		case GEN_RANDOM:
+			for (j = 0; j < plane; j += 8) {
+				r = xorshift64(seed);
+				memcpy(p + j, &r, plane - j < 8 ? plane - j : 8);
+			}
+			break;
+		default:
+			memset(p, 0, plane);
+			break;
+		}
+	}
+}
+
+static void *source_run(void *arg)
+{
+	struct stage *s = arg;
+	uint64_t left = bs.gen_samples, seed = 0x9E3779B97F4A7C15ull;
+	size_t plane_frame = bs.frame ? bs.frame / 8 * bs.channels : 0;
+	struct chunk *c;
+	size_t len;
+
+	while (!atomic_load(&bs.stop)) {
+		c = get_empty(s);
+		c->frame = bs.frame;
+
+		if (bs.gen != GEN_NONE) {
+			if (!left)
+				break;
+			if (left < bs.frame)
+				c->frame = (left + 15) & ~(uint64_t)15;
+			generate(c->data, c->frame, &seed);
+			c->len = c->frame / 8 * NIBBLE_CHANNELS;
+			left -= left < c->frame ? left : c->frame;
+			add_samples(s, c->frame);
+		} else if (bs.frame) {
+			len = read_full(bs.in_fd, c->data,
+					plane_frame * bs.chunk_frames);
+			if (len % plane_frame)
+				fprintf(stderr, "blstream: dropping %zu bytes "
+						"of an incomplete frame\n",
+						len % plane_frame);
+			c->len = len - len % plane_frame;
+			add_samples(s, c->len / plane_frame * bs.frame);
+		} else {
+			c->len = read_full(bs.in_fd, c->data, bs.chunk_bytes);
+			add_samples(s, c->len * 2);
+		}
+
+		if (!c->len) {
+			blq_push(&s->out->empty, c);
+			break;
+		}
+		put_full(s, c);
+	}
+	blq_close(&s->out->full);
+	return NULL;
+}
+
+/* End source section */
+
+/* Begin pack section */
+
+/* Bit k of a byte moved to bit 4k of a word */
+static uint32_t spread[256];
+
+static void pack_init(void)
+{
+	unsigned i, k;
+
+	for (i = 0; i < 256; i++)
+		for (k = 0; k < 8; k++)
+			if (i & (1 << k))
+				spread[i] |= 1u << (4 * k);
+}
+
+/* One planar frame into 4 bit samples, low nibble first */
+static void pack_frame(const uint8_t *in, uint32_t channels, size_t plane,
+		uint8_t *out)
+{
+	size_t j;
+	uint32_t w, c;
+
+	for (j = 0; j < plane; j++) {
+		if (channels == NIBBLE_CHANNELS) {
+			w = spread[in[j]] | spread[in[plane + j]] << 1 |
+				spread[in[2 * plane + j]] << 2 |
+				spread[in[3 * plane + j]] << 3;
+		} else {
+			for (w = 0, c = 0; c < channels; c++)
+				w |= spread[in[c * plane + j]] << c;
+		}
+		out[0] = w;
+		out[1] = w >> 8;
+		out[2] = w >> 16;
+		out[3] = w >> 24;
+		out += 4;
+	}
+}
+
+static void *pack_run(void *arg)
+{
+	struct stage *s = arg;
+	uint32_t channels = bs.gen != GEN_NONE ? NIBBLE_CHANNELS : bs.channels;
+	struct chunk *in, *out;
+	size_t plane, frames, i;
+
+	while ((in = get_full(s))) {
+		out = get_empty(s);
+		plane = in->frame / 8;
+		frames = in->len / (plane * channels);
+		for (i = 0; i < frames; i++)
+			pack_frame(in->data + i * plane * channels, channels,
+					plane, out->data + i * plane * 4);
+		out->len = frames * plane * 4;
+		put_empty(s, in);
+		add_samples(s, out->len * 2);
+		put_full(s, out);
+	}
+	blq_close(&s->out->full);
+	return NULL;
+}
+
+/* End pack section */
+
+/* Begin writer section */
+
+/* Hands one chunk to the driver; the first time the ring is full before
+ * the start, playback is started and write() blocks from then on */
+static int write_chunk(struct stage *s, const uint8_t *p, size_t len)
+{
+	uint64_t t0;
+	ssize_t n;
+	int ret;
+
+	while (len) {
+		t0 = now_ns();
+		n = bs.be->write(p, len);
+		if (bs.started)
+			atomic_fetch_add_explicit(&s->wait_out_ns,
+					now_ns() - t0, memory_order_relaxed);
+		if (n < 0)
+			return n;
+		if (n == 0) {
+			if (bs.started)
+				return -EPIPE;
+			ret = bs.be->start();
+			if (ret)
+				return ret;
+			bs.started = 1;
+			bs.t_start = now();
+			continue;
+		}
+		bs.written += n;
+		bs.written_crc = blwf_crc32(bs.written_crc, p, n);
+		add_samples(s, n * 2);
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static void *writer_run(void *arg)
+{
+	struct stage *s = arg;
+	struct chunk *c;
+	uint64_t t0;
+	int ret;
+
+	while ((c = get_full(s))) {
+		if (!bs.error) {
+			ret = write_chunk(s, c->data, c->len);
+			if (ret) {
+				/* Keep draining so that upstream can finish */
+				bs.error = ret;
+				atomic_store(&bs.stop, 1);
+			}
+		}
+		put_empty(s, c);
+	}
+
+	/* A waveform shorter than the ring has not started yet */
+	if (!bs.error && !bs.started && bs.written) {
+		bs.error = bs.be->start();
+		bs.started = !bs.error;
+		bs.t_start = now();
+	}
+	/* Draining the ring at the sample rate is waiting on the device too */
+	t0 = now_ns();
+	ret = bs.be->finish();
+	atomic_fetch_add_explicit(&s->wait_out_ns, now_ns() - t0,
+			memory_order_relaxed);
+	if (!bs.error)
+		bs.error = ret;
+	atomic_store(&bs.finished, 1);
+	return NULL;
+}
+
+/* End writer section */
+
+static void *stage_main(void *arg)
+{
+	struct stage *s = arg;
+	uint64_t t0 = now_ns();
+	cpu_set_t set;
+
+	if (s->cpu >= 0) {
+		CPU_ZERO(&set);
+		CPU_SET(s->cpu, &set);
+		if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set))
+			fprintf(stderr, "blstream: cannot pin %s to CPU %d\n",
+					s->name, s->cpu);
+	}
+	s->run(s);
+	s->elapsed_ns = now_ns() - t0;
+	return NULL;
+}
+
+static void on_signal(int sig)
+{
+	(void)sig;
+	atomic_store(&bs.stop, 1);
+}
+
+static unsigned long parse_size(const char *s)
+{
+	char *end;
+	unsigned long v = strtoul(s, &end, 0);
+
+	if (*end == 'k' || *end == 'K')
+		v <<= 10;
+	else if (*end == 'M' || *end == 'm')
+		v <<= 20;
+	return v;
+}
+
+static void print_stage(const struct stage *s)
+{
+	double elapsed = s->elapsed_ns * 1e-9;
+	double wait_in = s->wait_in_ns * 1e-9, wait_out = s->wait_out_ns * 1e-9;
+	double busy = elapsed - wait_in - wait_out;
+	uint64_t samples = s->samples;
+
+	printf("stage=%s cpu=%d msps=%.3f capacity_msps=%.3f busy=%.1f%% "
+			"wait_in=%.1f%% wait_out=%.1f%%\n", s->name, s->cpu,
+			samples / elapsed / 1e6,
+			busy > 0 ? samples / busy / 1e6 : 0.0,
+			100 * busy / elapsed, 100 * wait_in / elapsed,
+			100 * wait_out / elapsed);
+}
+
+/* Whether the mock played exactly what was written, plus the zero padding
+ * fsync() added to the last buffer */
+static int verify_mock(void)
+{
+	static const uint8_t zero[64];
+	uint32_t crc = bs.written_crc;
+	uint64_t pad;
+
+	if (mock.done < bs.written || mock.done - bs.written >= 64)
+		return 0;
+	pad = mock.done - bs.written;
+	crc = blwf_crc32(crc, zero, pad);
+	return crc == mock.played_crc;
+}
+
+static void usage(FILE *f)
+{
+	fprintf(f,
+		"Usage: blstream [options] [FILE]\n"
+		"  -m          use the userspace mock instead of /dev/beaglelogic\n"
+		"  -g GEN      generate a test waveform instead of reading FILE:\n"
+		"              counter, random or zero\n"
+		"  -n SAMPLES  length of the generated waveform (default 16M)\n"
+		"  -p FRAME    FILE is planar, in frames of FRAME samples per\n"
+		"              channel (a multiple of 16)\n"
+		"  -c N        channels of planar input, 1 to 4 (default 4)\n"
+		"  -r HZ       sample rate the throughput of every stage is\n"
+		"              compared against; paces the mock (default 50M)\n"
+		"  -u BYTES    buffer unit size (default 256k)\n"
+		"  -t BYTES    size of the buffer ring (default 4M)\n"
+		"  -w BYTES    bytes of device data per chunk (default 64k)\n"
+		"  -q N        chunks per link between two stages (default 8)\n"
+		"  -a CPUS     pin the stages to CPUs, in pipeline order,\n"
+		"              e.g. 0,1,1 (- leaves a stage unpinned)\n"
+		"  -v          print progress once per second\n"
+		"Without FILE, or with -, packed or planar data is read from\n"
+		"stdin. Sizes accept k and M suffixes.\n");
+}
+
+int main(int argc, char **argv)
+{
+	struct backend dev = {
+		"device", dev_setup, dev_write, dev_start, dev_finish,
+		dev_lasterror
+	};
+	struct backend mck = {
+		"mock", mock_setup, mock_write, mock_start, mock_finish,
+		mock_lasterror
+	};
+	struct stage stages[MAX_STAGES];
+	struct link links[MAX_STAGES - 1];
+	uint32_t unitsize = 256 << 10, total = 4 << 20, queue_depth = 8;
+	unsigned nstages = 0, i;
+	char *cpus = NULL, *tok;
+	double rate = 0, elapsed, t0;
+	int opt, use_mock = 0, verbose = 0, ret;
+	uint32_t lasterror;
+
+	memset(&bs, 0, sizeof(bs));
+	memset(stages, 0, sizeof(stages));
+	memset(links, 0, sizeof(links));
+	bs.in_fd = STDIN_FILENO;
+	bs.gen_samples = 16 << 20;
+	bs.channels = NIBBLE_CHANNELS;
+	bs.chunk_bytes = 64 << 10;
+
+	while ((opt = getopt(argc, argv, "mg:n:p:c:r:u:t:w:q:a:vh")) != -1) {
+		switch (opt) {
+		case 'm':
+			use_mock = 1;
+			break;
+		case 'g':
+			if (!strcmp(optarg, "counter"))
+				bs.gen = GEN_COUNTER;
+			else if (!strcmp(optarg, "random"))
+				bs.gen = GEN_RANDOM;
+			else if (!strcmp(optarg, "zero"))
+				bs.gen = GEN_ZERO;
+			else {
+				usage(stderr);
+				return 1;
+			}
+			break;
+		case 'n':
+			bs.gen_samples = parse_size(optarg);
+			break;
+		case 'p':
+			bs.frame = parse_size(optarg);
+			break;
+		case 'c':
+			bs.channels = atoi(optarg);
+			break;
+		case 'r':
+			rate = atof(optarg);
+			break;
+		case 'u':
+			unitsize = parse_size(optarg);
+			break;
+		case 't':
+			total = parse_size(optarg);
+			break;
+		case 'w':
+			bs.chunk_bytes = parse_size(optarg);
+			break;
+		case 'q':
+			queue_depth = atoi(optarg);
+			break;
+		case 'a':
+			cpus = optarg;
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		case 'h':
+			usage(stdout);
+			return 0;
+		default:
+			usage(stderr);
+			return 1;
+		}
+	}
+	if (bs.chunk_bytes < 64 || bs.chunk_bytes % 64 || queue_depth < 1 ||
+			bs.channels < 1 || bs.channels > NIBBLE_CHANNELS ||
+			bs.frame % 16 || argc - optind > 1 ||
+			(bs.gen != GEN_NONE && argc - optind)) {
+		usage(stderr);
+		return 1;
+	}
+	if (argc - optind == 1 && strcmp(argv[optind], "-")) {
+		bs.in_fd = open(argv[optind], O_RDONLY);
+		if (bs.in_fd < 0) {
+			fprintf(stderr, "blstream: %s: %s\n", argv[optind],
+					strerror(errno));
+			return 1;
+		}
+	}
+
+	/* Generated waveforms come as one planar frame per chunk */
+	if (bs.gen != GEN_NONE)
+		bs.frame = bs.chunk_bytes * 2;
+	if (bs.frame) {
+		bs.chunk_frames = bs.chunk_bytes * 2 / bs.frame;
+		if (!bs.chunk_frames)
+			bs.chunk_frames = 1;
+		bs.chunk_bytes = (size_t)bs.chunk_frames * bs.frame / 2;
+	}
+
+	/* Build the pipeline */
+	stages[nstages++] = (struct stage){ .name = "source", .run = source_run };
+	if (bs.frame) {
+		pack_init();
+		stages[nstages++] = (struct stage){ .name = "pack",
+			.run = pack_run };
+	}
+	stages[nstages++] = (struct stage){ .name = "writer", .run = writer_run };
+
+	for (i = 0; i + 1 < nstages; i++) {
+		size_t size = bs.chunk_bytes;
+
+		/* Planar chunks hold up to 8 / 4 times the packed bytes */
+		if (i == 0 && bs.frame)
+			size = (size_t)bs.chunk_frames * bs.frame / 8 *
+				(bs.gen != GEN_NONE ? NIBBLE_CHANNELS :
+				 bs.channels);
+		if (link_init(&links[i], queue_depth, size)) {
+			fprintf(stderr, "blstream: out of memory\n");
+			return 1;
+		}
+		stages[i].out = &links[i];
+		stages[i + 1].in = &links[i];
+	}
+	for (i = 0; i < nstages; i++) {
+		tok = cpus ? strsep(&cpus, ",") : NULL;
+		stages[i].cpu = tok && *tok && *tok != '-' ? atoi(tok) : -1;
+	}
+
+	bs.be = use_mock ? &mck : &dev;
+	if (use_mock && rate <= 0)
+		rate = 50e6;
+	ret = bs.be->setup(unitsize, total, rate / 2);
+	if (ret) {
+		fprintf(stderr, "blstream: %s setup: %s\n", bs.be->name,
+				strerror(-ret));
+		return 1;
+	}
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+
+	t0 = now();
+	for (i = 0; i < nstages; i++)
+		if (pthread_create(&stages[i].thread, NULL, stage_main,
+					&stages[i])) {
+			fprintf(stderr, "blstream: cannot start %s\n",
+					stages[i].name);
+			return 1;
+		}
+
+	if (verbose) {
+		uint64_t last = 0, cur;
+
+		while (!atomic_load(&bs.finished)) {
+			sleep(1);
+			cur = stages[nstages - 1].samples;
+			fprintf(stderr, "blstream: %.1f s, %.3f Msps written\n",
+					now() - t0, (cur - last) / 1e6);
+			last = cur;
+		}
+	}
+
+	for (i = 0; i < nstages; i++)
+		pthread_join(stages[i].thread, NULL);
+	elapsed = now() - t0;
+	lasterror = bs.be->lasterror();
+
+	printf("backend=%s\n", bs.be->name);
+	printf("elapsed_s=%.3f\n", elapsed);
+	if (bs.started)
+		printf("prefill_s=%.3f\n", bs.t_start - t0);
+	printf("samples=%llu\n", (unsigned long long)bs.written * 2);
+	if (rate > 0)
+		printf("required_msps=%.3f\n", rate / 1e6);
+	for (i = 0; i < nstages; i++)
+		print_stage(&stages[i]);
+	printf("lasterror=0x%x\n", lasterror);
+	if (lasterror & 0x10000)
+		printf("underrun=buffer %u\n", lasterror & 0xFFFF);
+	else if (use_mock && !bs.error)
+		printf("verify=%s\n", verify_mock() ? "ok" : "mismatch");
+	if (bs.error)
+		printf("error=%s\n", strerror(-bs.error));
+
+	for (i = 0; i + 1 < nstages; i++)
+		link_free(&links[i]);
+	if (use_mock)
+		blmock_memfree(&mock);
+	if (bs.in_fd != STDIN_FILENO)
+		close(bs.in_fd);
+	return bs.error || lasterror ? 1 : 0;
+}
@@ -0,0 +1,437 @@
+/*
+ * BLWF container format: validation, decoding and writing
+ *
+ * This file is a part of the PRU digital waveform generator project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "blwf.h"
+#include "blz.h"
+
+/* Begin CRC section */
+
+static uint32_t crc_table[256];
+
+static void crc_init(void)
+{
+	uint32_t c;
+	int i, k;
+
+	for (i = 0; i < 256; i++) {
+		c = i;
+		for (k = 0; k < 8; k++)
+			c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+		crc_table[i] = c;
+	}
+}
+
+/* CRC-32 (IEEE 802.3), start with crc = 0 */
+uint32_t blwf_crc32(uint32_t crc, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+
+	if (!crc_table[1])
+		crc_init();
+
+	crc = ~crc;
+	while (len--)
+		crc = crc_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+	return ~crc;
+}
+
+static uint32_t header_crc(const struct blwf_header *h)
+{
+	struct blwf_header tmp = *h;
+	uint32_t crc;
+
+	tmp.header_crc = 0;
+	crc = blwf_crc32(0, &tmp, sizeof(tmp));
+	return blwf_crc32(crc, h + 1, h->header_size - sizeof(tmp));
+}
+
+/* End CRC section */
+
+/* Begin reader section */
+
+static enum blz_format blwf_blz_format(uint8_t encoding)
+{
+	return encoding == BLWF_ENC_ZSTD ? BLZ_ZSTD :
+		encoding == BLWF_ENC_LZ4 ? BLZ_LZ4 : BLZ_NONE;
+}
+
+static int check_header(const struct blwf_header *h, size_t filesize)
+{
+	uint64_t max_samples;
+
+	if (h->channels == 0 || h->channels > BLWF_MAX_CHANNELS ||
+			h->sample_bits != 4 || h->channels > h->sample_bits)
+		return -EINVAL;
+	if (h->encoding > BLWF_ENC_LZ4)
+		return -ENOTSUP;
+	if (h->payload_offset % BLWF_PAGE_SIZE ||
+			h->payload_offset < h->header_size ||
+			h->payload_offset > filesize ||
+			h->payload_size > filesize - h->payload_offset)
+		return -EINVAL;
+
+	/* Raw payloads hold the decoded stream, padded to a whole byte */
+	if (h->encoding == BLWF_ENC_RAW) {
+		max_samples = h->payload_size * 8 / h->sample_bits;
+		if (h->samples > max_samples ||
+				blwf_bytes(h, h->samples + 1) < h->payload_size)
+			return -EINVAL;
+	}
+
+	if ((h->flags & BLWF_FLAG_LOOP) && (h->loop_start >= h->loop_end ||
+			h->loop_end > h->samples))
+		return -EINVAL;
+	return 0;
+}
+
+int blwf_open(struct blwf_file *f, const char *path)
+{
+	struct blwf_header h;
+	struct stat st;
+	uint32_t i;
+	int ret;
+
+	memset(f, 0, sizeof(*f));
+	f->fd = open(path, O_RDONLY);
+	if (f->fd < 0)
+		return -errno;
+
+	if (fstat(f->fd, &st)) {
+		ret = -errno;
+		goto fail;
+	}
+	f->size = st.st_size;
+
+	/* Look at the fixed part first, then map the whole header */
+	ret = -EINVAL;
+	if (pread(f->fd, &h, sizeof(h), 0) != sizeof(h))
+		goto fail;
+	if (h.magic != BLWF_MAGIC)
+		goto fail;
+	ret = -ENOTSUP;
+	if (h.version != BLWF_VERSION)
+		goto fail;
+	ret = -EINVAL;
+	if (h.header_size < sizeof(h) || h.header_size > f->size ||
+			h.header_size != sizeof(h) +
+			(size_t)h.nsegments * sizeof(struct blwf_segment))
+		goto fail;
+
+	f->maplen = h.header_size;
+	f->hdr = mmap(NULL, f->maplen, PROT_READ, MAP_SHARED, f->fd, 0);
+	if (f->hdr == MAP_FAILED) {
+		f->hdr = NULL;
+		ret = -errno;
+		goto fail;
+	}
+	f->segs = (const struct blwf_segment *)(f->hdr + 1);
+
+	ret = -EBADMSG;
+	if (header_crc(f->hdr) != f->hdr->header_crc)
+		goto fail;
+	ret = check_header(f->hdr, f->size);
+	if (ret)
+		goto fail;
+
+	ret = -EINVAL;
+	for (i = 0; i < f->hdr->nsegments; i++)
+		if (f->segs[i].start + f->segs[i].samples > f->hdr->samples ||
+				memchr(f->segs[i].name, 0, BLWF_NAME_LEN) == NULL)
+			goto fail;
+	return 0;
+fail:
+	blwf_close(f);
+	return ret;
+}
+
+void blwf_close(struct blwf_file *f)
+{
+	if (f->hdr)
+		munmap((void *)f->hdr, f->maplen);
+	if (f->fd >= 0)
+		close(f->fd);
+	f->hdr = NULL;
+	f->segs = NULL;
+	f->fd = -1;
+}
+
+const struct blwf_segment *blwf_find_segment(const struct blwf_file *f,
+		const char *name)
+{
+	uint32_t i;
+
+	for (i = 0; i < f->hdr->nsegments; i++)
+		if (!strncmp(f->segs[i].name, name, BLWF_NAME_LEN))
+			return &f->segs[i];
+	return NULL;
+}
+
+static const uint8_t *map_payload(const struct blwf_file *f)
+{
+	void *p;
+
+	if (!f->hdr->payload_size)
+		return NULL;
+	p = mmap(NULL, f->hdr->payload_size + f->hdr->payload_offset,
+			PROT_READ, MAP_SHARED, f->fd, 0);
+	if (p == MAP_FAILED)
+		return NULL;
+	return (const uint8_t *)p + f->hdr->payload_offset;
+}
+
+static void unmap_payload(const struct blwf_file *f, const uint8_t *p)
+{
+	munmap((void *)(p - f->hdr->payload_offset),
+			f->hdr->payload_size + f->hdr->payload_offset);
+}
+
+int blwf_verify_payload(const struct blwf_file *f)
+{
+	const uint8_t *p = map_payload(f);
+	uint32_t crc;
+
+	if (!p)
+		return f->hdr->payload_size ? -errno : 0;
+	crc = blwf_crc32(0, p, f->hdr->payload_size);
+	unmap_payload(f, p);
+	return crc == f->hdr->payload_crc ? 0 : -EBADMSG;
+}
+
+/* Feeds decoded bytes in [start, end) to the sink through 'out' */
+struct rle_state {
+	uint8_t *out;
+	size_t fill, chunk;
+	ssize_t (*sink)(void *arg, const void *buf, size_t len);
+	void *arg;
+};
+
+static int rle_flush(struct rle_state *s)
+{
+	size_t done = 0;
+	ssize_t n;
+
+	while (done < s->fill) {
+		n = s->sink(s->arg, s->out + done, s->fill - done);
+		if (n <= 0)
+			return n ? (int)n : -ENOSPC;
+		done += n;
+	}
+	s->fill = 0;
+	return 0;
+}
+
+static int decode_rle(const struct blwf_file *f, const uint8_t *p,
+		uint64_t start, uint64_t len, struct rle_state *s)
+{
+	uint64_t pos = 0, end = start + len, from, to;
+	size_t i, n;
+	int ret;
+
+	for (i = 0; i + 1 < f->hdr->payload_size && pos < end; i += 2) {
+		uint64_t run = (uint64_t)p[i] + 1;
+
+		from = pos > start ? pos : start;
+		to = pos + run < end ? pos + run : end;
+		pos += run;
+		while (from < to) {
+			n = s->chunk - s->fill;
+			if (n > to - from)
+				n = to - from;
+			memset(s->out + s->fill, p[i + 1], n);
+			s->fill += n;
+			from += n;
+			if (s->fill == s->chunk) {
+				ret = rle_flush(s);
+				if (ret)
+					return ret;
+			}
+		}
+	}
+	if (pos < end)
+		return -EBADMSG;
+	return rle_flush(s);
+}
+
+int blwf_decode(const struct blwf_file *f, uint64_t start, uint64_t len,
+		size_t chunk, ssize_t (*sink)(void *arg, const void *buf,
+			size_t len), void *arg)
+{
+	const uint8_t *p = map_payload(f);
+	struct rle_state s;
+	uint64_t done = 0;
+	ssize_t n;
+	int ret = 0;
+
+	if (!p)
+		return len ? -EINVAL : 0;
+
+	if (f->hdr->encoding == BLWF_ENC_RAW) {
+		if (start + len > f->hdr->payload_size) {
+			ret = -EINVAL;
+			goto out;
+		}
+		while (done < len) {
+			size_t piece = len - done < chunk ? len - done : chunk;
+
+			n = sink(arg, p + start + done, piece);
+			if (n <= 0) {
+				ret = n ? (int)n : -ENOSPC;
+				goto out;
+			}
+			done += n;
+		}
+		goto out;
+	}
+
+	if (f->hdr->encoding != BLWF_ENC_RLE) {
+		ret = blz_decode(blwf_blz_format(f->hdr->encoding), p,
+				f->hdr->payload_size, start, len, chunk, sink,
+				arg);
+		goto out;
+	}
+
+	s.out = malloc(chunk);
+	if (!s.out) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	s.fill = 0;
+	s.chunk = chunk;
+	s.sink = sink;
+	s.arg = arg;
+	ret = decode_rle(f, p, start, len, &s);
+	free(s.out);
+out:
+	unmap_payload(f, p);
+	return ret;
+}
+
+/* End reader section */
+
+/* Begin writer section */
+
+static size_t encode_rle(const uint8_t *data, size_t len, uint8_t *out)
+{
+	size_t i = 0, o = 0, run;
+
+	while (i < len) {
+		run = 1;
+		while (i + run < len && run < 256 && data[i + run] == data[i])
+			run++;
+		out[o++] = run - 1;
+		out[o++] = data[i];
+		i += run;
+	}
+	return o;
+}
+
+static int write_all(int fd, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	ssize_t n;
+
+	while (len) {
+		n = write(fd, p, len);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+int blwf_write(const char *path, struct blwf_header *hdr,
+		const struct blwf_segment *segs, uint32_t nsegments,
+		const uint8_t *data, size_t len)
+{
+	const uint8_t *payload = data;
+	uint8_t *encoded = NULL, *pad = NULL;
+	size_t header_size, padlen;
+	int fd, ret;
+
+	header_size = sizeof(*hdr) + nsegments * sizeof(*segs);
+	if (header_size > 0xFFFF)
+		return -E2BIG;
+
+	hdr->magic = BLWF_MAGIC;
+	hdr->version = BLWF_VERSION;
+	hdr->header_size = header_size;
+	hdr->nsegments = nsegments;
+	if (!hdr->samples)
+		hdr->samples = (uint64_t)len * 8 / hdr->sample_bits;
+	hdr->payload_offset = (header_size + BLWF_PAGE_SIZE - 1) &
+		~(uint64_t)(BLWF_PAGE_SIZE - 1);
+	hdr->payload_size = len;
+
+	if (hdr->encoding == BLWF_ENC_RLE) {
+		encoded = malloc(len * 2 + 2);
+		if (!encoded)
+			return -ENOMEM;
+		hdr->payload_size = encode_rle(data, len, encoded);
+		payload = encoded;
+	} else if (hdr->encoding != BLWF_ENC_RAW) {
+		size_t size;
+
+		ret = blz_encode(blwf_blz_format(hdr->encoding), data, len,
+				(void **)&encoded, &size);
+		if (ret)
+			return ret;
+		hdr->payload_size = size;
+		payload = encoded;
+	}
+	hdr->payload_crc = blwf_crc32(0, payload, hdr->payload_size);
+
+	ret = check_header(hdr, hdr->payload_offset + hdr->payload_size);
+	if (ret)
+		goto out;
+
+	/* The CRC covers the segment table, which directly follows */
+	padlen = hdr->payload_offset - sizeof(*hdr);
+	pad = calloc(1, padlen);
+	if (!pad) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	memcpy(pad, segs, nsegments * sizeof(*segs));
+	hdr->header_crc = 0;
+	hdr->header_crc = blwf_crc32(blwf_crc32(0, hdr, sizeof(*hdr)),
+			pad, header_size - sizeof(*hdr));
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		ret = -errno;
+		goto out;
+	}
+	ret = write_all(fd, hdr, sizeof(*hdr));
+	if (!ret)
+		ret = write_all(fd, pad, padlen);
+	if (!ret)
+		ret = write_all(fd, payload, hdr->payload_size);
+	if (close(fd) && !ret)
+		ret = -errno;
+out:
+	free(pad);
+	free(encoded);
+	return ret;
+}
+
+/* End writer section */
@@ -0,0 +1,127 @@
+/*
+ * BLWF - container format for waveform files
+ *
+ * A file starts with a fixed little-endian header, followed by a segment
+ * table; the payload starts at the next page boundary. A raw payload is
+ * exactly the byte stream the device plays (two 4 bit samples per byte,
+ * low nibble first), so it can be mmap'd or spliced into /dev/beaglelogic
+ * without being parsed or copied in user space.
+ *
+ *   offset 0               struct blwf_header
+ *   sizeof(header)         struct blwf_segment[nsegments]
+ *   payload_offset         payload (page aligned, payload_size bytes)
+ *
+ * All positions (segments, loop points) count samples of the decoded
+ * waveform. The header CRC covers the first header_size bytes of the file
+ * with the header_crc field taken as zero; the payload CRC covers the
+ * payload as stored.
+ *
+ * This file is a part of the PRU digital waveform generator project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef BLWF_H_
+#define BLWF_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define BLWF_MAGIC		0x46574C42	/* "BLWF" */
+#define BLWF_VERSION		1
+#define BLWF_PAGE_SIZE		4096
+#define BLWF_MAX_CHANNELS	8
+#define BLWF_PIN_NAME_LEN	8
+#define BLWF_NAME_LEN		32
+
+/* Payload encodings */
+enum blwf_encoding {
+	BLWF_ENC_RAW,		/* Device byte stream as is */
+	BLWF_ENC_RLE,		/* Pairs of (run length - 1, byte) */
+	BLWF_ENC_ZSTD,		/* One zstd frame, see blz.h */
+	BLWF_ENC_LZ4,		/* One LZ4 frame */
+};
+
+/* Header flags */
+#define BLWF_FLAG_LOOP		(1 << 0)	/* loop_start/loop_end valid */
+
+struct blwf_segment {
+	uint64_t start;				/* First sample */
+	uint64_t samples;			/* Length in samples */
+	char name[BLWF_NAME_LEN];		/* NUL terminated */
+} __attribute__((packed));
+
+struct blwf_header {
+	uint32_t magic;				/* BLWF_MAGIC */
+	uint16_t version;			/* BLWF_VERSION */
+	uint16_t header_size;			/* Header plus segment table */
+	uint32_t flags;
+	uint32_t header_crc;
+
+	uint8_t channels;			/* Outputs in use */
+	uint8_t sample_bits;			/* Bits per sample: 4 */
+	uint8_t encoding;			/* enum blwf_encoding */
+	uint8_t reserved0;
+	uint32_t sample_rate;			/* Hz, 0 when not fixed */
+	char pins[BLWF_MAX_CHANNELS][BLWF_PIN_NAME_LEN];	/* Bit 0 first */
+
+	uint64_t samples;			/* Decoded length */
+	uint64_t payload_offset;		/* Page aligned */
+	uint64_t payload_size;			/* Stored (encoded) bytes */
+	uint32_t payload_crc;
+	uint32_t nsegments;
+
+	uint64_t loop_start;			/* First sample of the loop */
+	uint64_t loop_end;			/* First sample after it */
+	uint32_t loop_count;			/* 0 = until stopped */
+	uint32_t reserved1;
+
+	char description[64];			/* NUL terminated */
+} __attribute__((packed));
+
+/* A validated, mapped container */
+struct blwf_file {
+	int fd;
+	size_t size;
+	const struct blwf_header *hdr;		/* Mapped header page(s) */
+	const struct blwf_segment *segs;
+	size_t maplen;
+};
+
+uint32_t blwf_crc32(uint32_t crc, const void *buf, size_t len);
+
+/* Bytes of decoded payload for a number of samples */
+static inline uint64_t blwf_bytes(const struct blwf_header *h, uint64_t samples)
+{
+	return samples * h->sample_bits / 8;
+}
+
+int blwf_open(struct blwf_file *f, const char *path);
+void blwf_close(struct blwf_file *f);
+int blwf_verify_payload(const struct blwf_file *f);
+const struct blwf_segment *blwf_find_segment(const struct blwf_file *f,
+		const char *name);
+
+/*
+ * Writes a container: 'hdr' supplies the metadata (channels, sample_bits,
+ * encoding, sample rate, pins, loop points, description); sizes, offsets
+ * and CRCs are filled in. 'data' is the decoded device byte stream.
+ */
+int blwf_write(const char *path, struct blwf_header *hdr,
+		const struct blwf_segment *segs, uint32_t nsegments,
+		const uint8_t *data, size_t len);
+
+/*
+ * Decodes [start, start + len) bytes of the decoded stream, in pieces of
+ * at most 'chunk' bytes, handing each piece to 'sink'. Raw payloads are
+ * handed over straight from the mapping; compressed ones are decoded from
+ * it one piece at a time.
+ */
+int blwf_decode(const struct blwf_file *f, uint64_t start, uint64_t len,
+		size_t chunk, ssize_t (*sink)(void *arg, const void *buf,
+			size_t len), void *arg);
+
+#endif /* BLWF_H_ */
@@ -0,0 +1,334 @@
+/*
+ * Compressed waveform streams: zstd and LZ4 frames
+ *
+ * This file is a part of the PRU digital waveform generator project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef HAVE_LZ4
+#include <lz4frame.h>
+#endif
+
+#include "blz.h"
+
+#define ZSTD_FRAME_MAGIC	0xFD2FB528
+#define LZ4_FRAME_MAGIC		0x184D2204
+
+#if defined(HAVE_ZSTD) || defined(HAVE_LZ4)
+/* Delivers the part of each decoded piece that lies in [start, end) */
+struct blz_out {
+	uint8_t *buf;
+	size_t chunk;
+	uint64_t pos;		/* Decoded bytes before 'buf' */
+	uint64_t start, end;
+	ssize_t (*sink)(void *arg, const void *buf, size_t len);
+	void *arg;
+};
+
+/* Returns 1 once the range is complete */
+static int blz_emit(struct blz_out *o, size_t n)
+{
+	uint64_t from = o->pos > o->start ? o->pos : o->start;
+	uint64_t to = o->pos + n < o->end ? o->pos + n : o->end;
+	size_t done = 0, piece;
+	ssize_t ret;
+
+	while (from + done < to) {
+		piece = to - from - done;
+		ret = o->sink(o->arg, o->buf + (from - o->pos) + done, piece);
+		if (ret <= 0)
+			return ret ? (int)ret : -ENOSPC;
+		done += ret;
+	}
+	o->pos += n;
+	return o->pos >= o->end;
+}
+#endif
+
+static uint32_t get_le32(const void *buf)
+{
+	const uint8_t *p = buf;
+
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+enum blz_format blz_detect(const void *buf, size_t len)
+{
+	if (len < 4)
+		return BLZ_NONE;
+	switch (get_le32(buf)) {
+	case ZSTD_FRAME_MAGIC:
+		return BLZ_ZSTD;
+	case LZ4_FRAME_MAGIC:
+		return BLZ_LZ4;
+	}
+	return BLZ_NONE;
+}
+
+const char *blz_name(enum blz_format fmt)
+{
+	return fmt == BLZ_ZSTD ? "zstd" : fmt == BLZ_LZ4 ? "lz4" : "none";
+}
+
+/* Begin zstd section */
+
+#ifdef HAVE_ZSTD
+static uint64_t zstd_content_size(const void *buf, size_t len)
+{
+	unsigned long long size = ZSTD_getFrameContentSize(buf, len);
+
+	if (size == ZSTD_CONTENTSIZE_UNKNOWN || size == ZSTD_CONTENTSIZE_ERROR)
+		return BLZ_SIZE_UNKNOWN;
+	return size;
+}
+
+static int zstd_decode(const void *buf, size_t len, struct blz_out *o)
+{
+	ZSTD_DStream *ds = ZSTD_createDStream();
+	ZSTD_inBuffer in = { buf, len, 0 };
+	ZSTD_outBuffer out;
+	size_t r = 0;
+	int ret = 0;
+
+	if (!ds)
+		return -ENOMEM;
+	ZSTD_initDStream(ds);
+
+	/* Until all input is consumed and the decoder holds nothing back */
+	do {
+		out.dst = o->buf;
+		out.size = o->chunk;
+		out.pos = 0;
+		r = ZSTD_decompressStream(ds, &out, &in);
+		if (ZSTD_isError(r)) {
+			ret = -EBADMSG;
+			break;
+		}
+		ret = blz_emit(o, out.pos);
+	} while (!ret && (in.pos < in.size || out.pos == out.size));
+
+	ZSTD_freeDStream(ds);
+	if (ret == 0 && r != 0)
+		ret = -EBADMSG;		/* Truncated frame */
+	return ret < 0 ? ret : 0;
+}
+
+static int zstd_encode(const void *data, size_t len, void **out,
+		size_t *outlen)
+{
+	size_t bound = ZSTD_compressBound(len), r;
+
+	*out = malloc(bound);
+	if (!*out)
+		return -ENOMEM;
+	r = ZSTD_compress(*out, bound, data, len, ZSTD_CLEVEL_DEFAULT);
+	if (ZSTD_isError(r)) {
+		free(*out);
+		*out = NULL;
+		return -EIO;
+	}
+	*outlen = r;
+	return 0;
+}
+#endif
+
+/* End zstd section */
+
+/* Begin LZ4 section */
+
+#ifdef HAVE_LZ4
+static uint64_t lz4_content_size(const void *buf, size_t len)
+{
+	LZ4F_dctx *dctx;
+	LZ4F_frameInfo_t info;
+	size_t size = len, r;
+
+	if (LZ4F_isError(LZ4F_createDecompressionContext(&dctx,
+					LZ4F_VERSION)))
+		return BLZ_SIZE_UNKNOWN;
+	r = LZ4F_getFrameInfo(dctx, &info, buf, &size);
+	LZ4F_freeDecompressionContext(dctx);
+	if (LZ4F_isError(r) || !info.contentSize)
+		return BLZ_SIZE_UNKNOWN;
+	return info.contentSize;
+}
+
+static int lz4_decode(const void *buf, size_t len, struct blz_out *o)
+{
+	const uint8_t *p = buf;
+	LZ4F_dctx *dctx;
+	size_t in = 0, src, dst, r = 0;
+	int ret = 0;
+
+	if (LZ4F_isError(LZ4F_createDecompressionContext(&dctx,
+					LZ4F_VERSION)))
+		return -ENOMEM;
+
+	/* Until all input is consumed and nothing more comes out */
+	do {
+		src = len - in;
+		dst = o->chunk;
+		r = LZ4F_decompress(dctx, o->buf, &dst, p + in, &src, NULL);
+		if (LZ4F_isError(r)) {
+			ret = -EBADMSG;
+			break;
+		}
+		in += src;
+		ret = blz_emit(o, dst);
+	} while (!ret && (in < len || dst));
+
+	LZ4F_freeDecompressionContext(dctx);
+	if (ret == 0 && r != 0)
+		ret = -EBADMSG;		/* Truncated frame */
+	return ret < 0 ? ret : 0;
+}
+
+static int lz4_encode(const void *data, size_t len, void **out,
+		size_t *outlen)
+{
+	LZ4F_preferences_t prefs;
+	size_t bound, r;
+
+	memset(&prefs, 0, sizeof(prefs));
+	prefs.frameInfo.contentSize = len;
+	prefs.frameInfo.blockSizeID = LZ4F_max4MB;
+	bound = LZ4F_compressFrameBound(len, &prefs);
+
+	*out = malloc(bound);
+	if (!*out)
+		return -ENOMEM;
+	r = LZ4F_compressFrame(*out, bound, data, len, &prefs);
+	if (LZ4F_isError(r)) {
+		free(*out);
+		*out = NULL;
+		return -EIO;
+	}
+	*outlen = r;
+	return 0;
+}
+#endif
+
+/* End LZ4 section */
+
+int blz_supported(enum blz_format fmt)
+{
+	switch (fmt) {
+#ifdef HAVE_ZSTD
+	case BLZ_ZSTD:
+		return 1;
+#endif
+#ifdef HAVE_LZ4
+	case BLZ_LZ4:
+		return 1;
+#endif
+	default:
+		return 0;
+	}
+}
+
+uint64_t blz_content_size(enum blz_format fmt, const void *buf, size_t len)
+{
+	switch (fmt) {
+#ifdef HAVE_ZSTD
+	case BLZ_ZSTD:
+		return zstd_content_size(buf, len);
+#endif
+#ifdef HAVE_LZ4
+	case BLZ_LZ4:
+		return lz4_content_size(buf, len);
+#endif
+	default:
+		(void)buf;
+		(void)len;
+		return BLZ_SIZE_UNKNOWN;
+	}
+}
+
+int blz_decode(enum blz_format fmt, const void *buf, size_t buflen,
+		uint64_t start, uint64_t len, size_t chunk,
+		ssize_t (*sink)(void *arg, const void *buf, size_t len),
+		void *arg)
+{
+#if defined(HAVE_ZSTD) || defined(HAVE_LZ4)
+	struct blz_out o;
+	int ret;
+
+	if (!blz_supported(fmt))
+		return -ENOTSUP;
+	if (!len)
+		return 0;
+
+	o.buf = malloc(chunk);
+	if (!o.buf)
+		return -ENOMEM;
+	o.chunk = chunk;
+	o.pos = 0;
+	o.start = start;
+	o.end = len == BLZ_SIZE_UNKNOWN ? UINT64_MAX : start + len;
+	o.sink = sink;
+	o.arg = arg;
+
+	switch (fmt) {
+#ifdef HAVE_ZSTD
+	case BLZ_ZSTD:
+		ret = zstd_decode(buf, buflen, &o);
+		break;
+#endif
+#ifdef HAVE_LZ4
+	case BLZ_LZ4:
+		ret = lz4_decode(buf, buflen, &o);
+		break;
+#endif
+	default:
+		ret = -ENOTSUP;
+		break;
+	}
+
+	/* The stream ended before the range did */
+	if (!ret && len != BLZ_SIZE_UNKNOWN && o.pos < o.end)
+		ret = -EBADMSG;
+	free(o.buf);
+	return ret;
+#else
+	(void)fmt;
+	(void)buf;
+	(void)buflen;
+	(void)start;
+	(void)len;
+	(void)chunk;
+	(void)sink;
+	(void)arg;
+	return -ENOTSUP;
+#endif
+}
+
+int blz_encode(enum blz_format fmt, const void *data, size_t len,
+		void **out, size_t *outlen)
+{
+	switch (fmt) {
+#ifdef HAVE_ZSTD
+	case BLZ_ZSTD:
+		return zstd_encode(data, len, out, outlen);
+#endif
+#ifdef HAVE_LZ4
+	case BLZ_LZ4:
+		return lz4_encode(data, len, out, outlen);
+#endif
+	default:
+		(void)data;
+		(void)len;
+		(void)out;
+		(void)outlen;
+		return -ENOTSUP;
+	}
+}
@@ -0,0 +1,57 @@
+/*
+ * Compressed waveform streams: zstd and LZ4 frames
+ *
+ * Waveforms are long runs of repeating nibble patterns and compress very
+ * well. The decoder works from a mapping of the compressed data and hands
+ * the decoded stream to a sink in pieces of a fixed size (normally one
+ * buffer unit), so the uncompressed waveform never exists in memory as a
+ * whole. Each format is only available when its library was found at
+ * build time; otherwise the functions return -ENOTSUP.
+ *
+ * This file is a part of the PRU digital waveform generator project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef BLZ_H_
+#define BLZ_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+enum blz_format {
+	BLZ_NONE,
+	BLZ_ZSTD,		/* Zstandard frames (RFC 8878) */
+	BLZ_LZ4,		/* LZ4 frame format */
+};
+
+#define BLZ_SIZE_UNKNOWN	UINT64_MAX
+
+/* Format of a stream, from its first 4 bytes */
+enum blz_format blz_detect(const void *buf, size_t len);
+int blz_supported(enum blz_format fmt);
+const char *blz_name(enum blz_format fmt);
+
+/* Decoded size recorded in the (first) frame header, or BLZ_SIZE_UNKNOWN */
+uint64_t blz_content_size(enum blz_format fmt, const void *buf, size_t len);
+
+/*
+ * Decodes [start, start + len) bytes of the decoded stream of 'buf', in
+ * pieces of at most 'chunk' bytes, handing each piece to 'sink'. Stops
+ * decoding once the range has been delivered; a length of BLZ_SIZE_UNKNOWN
+ * decodes to the end of the stream.
+ */
+int blz_decode(enum blz_format fmt, const void *buf, size_t buflen,
+		uint64_t start, uint64_t len, size_t chunk,
+		ssize_t (*sink)(void *arg, const void *buf, size_t len),
+		void *arg);
+
+/* Compresses 'data' into a single frame that records its size; the result
+ * is malloc'd */
+int blz_encode(enum blz_format fmt, const void *data, size_t len,
+		void **out, size_t *outlen);
+
+#endif /* BLZ_H_ */
@@ -0,0 +1,461 @@
+/*
+ * Userspace library for the PRU digital waveform generator
+ *
+ * This file is a part of the PRU digital waveform generator project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <endian.h>
+#include <sys/sendfile.h>
+
+#include "libbeaglelogic.h"
+
+static const char *sysfs_dir = BL_SYSFS_DIR;
+
+/* Begin device access section */
+
+/* Point the sysfs helpers somewhere else, e.g. at a mock directory */
+void bl_set_sysfs_dir(const char *dir)
+{
+	sysfs_dir = dir ? dir : BL_SYSFS_DIR;
+}
+
+int bl_sysfs_read(const char *attr, uint32_t *val)
+{
+	char path[256], buf[32];
+	ssize_t n;
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/%s", sysfs_dir, attr);
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -errno;
+	n = read(fd, buf, sizeof(buf) - 1);
+	if (n < 0) {
+		n = -errno;
+		close(fd);
+		return n;
+	}
+	close(fd);
+	buf[n] = 0;
+	*val = strtoul(buf, NULL, 10);
+	return 0;
+}
+
+int bl_sysfs_write(const char *attr, uint32_t val)
+{
+	char path[256], buf[32];
+	int fd, len, ret = 0;
+
+	snprintf(path, sizeof(path), "%s/%s", sysfs_dir, attr);
+	fd = open(path, O_WRONLY);
+	if (fd < 0)
+		return -errno;
+	len = snprintf(buf, sizeof(buf), "%u\n", val);
+	if (write(fd, buf, len) != len)
+		ret = -errno;
+	close(fd);
+	return ret;
+}
+
+int bl_open(void)
+{
+	int fd = open(BL_DEVICE, O_RDWR);
+
+	return fd < 0 ? -errno : fd;
+}
+
+int bl_start(int fd)
+{
+	return ioctl(fd, IOCTL_BL_START) ? -errno : 0;
+}
+
+/* Start with the first sample at 'deadline', CLOCK_MONOTONIC ns */
+int bl_start_at(int fd, uint64_t deadline)
+{
+	struct beaglelogic_start start = { deadline, 0 };
+
+	return ioctl(fd, IOCTL_BL_START_AT, &start) ? -errno : 0;
+}
+
+/* The deadline of the last start and when it started, 0 until then */
+int bl_get_start(int fd, struct beaglelogic_start *start)
+{
+	return ioctl(fd, IOCTL_BL_GET_START, start) ? -errno : 0;
+}
+
+int bl_get_buffer_size(int fd, uint32_t *size)
+{
+	return ioctl(fd, IOCTL_BL_GET_BUFFER_SIZE, size) ? -errno : 0;
+}
+
+int bl_get_bufunit_size(int fd, uint32_t *size)
+{
+	return ioctl(fd, IOCTL_BL_GET_BUFUNIT_SIZE, size) ? -errno : 0;
+}
+
+/* Upload part of a file straight from the page cache into the device */
+ssize_t bl_sendfile(int fd, int src, off_t off, size_t len)
+{
+	size_t done = 0;
+	ssize_t n;
+
+	while (done < len) {
+		n = sendfile(fd, src, &off, len - done);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return done ? (ssize_t)done : -errno;
+		}
+		if (n == 0)
+			break;
+		done += n;
+	}
+	return done;
+}
+
+int bl_get_progress(int fd, struct beaglelogic_progress *progress)
+{
+	return ioctl(fd, IOCTL_BL_GET_PROGRESS, progress) ? -errno : 0;
+}
+
+int bl_set_stream(int fd, uint32_t on)
+{
+	return ioctl(fd, IOCTL_BL_SET_STREAM, (unsigned long)on) ? -errno : 0;
+}
+
+/* Stream mode: queue the rest of the data and mark the end of the stream */
+int bl_end_stream(int fd)
+{
+	return fsync(fd) ? -errno : 0;
+}
+
+/* Stream mode: ends the job written so far, returns its id */
+int bl_job_end(int fd)
+{
+	int ret = ioctl(fd, IOCTL_BL_JOB_END);
+
+	return ret < 0 ? -errno : ret;
+}
+
+/* Waits until PRU0 has read the last block of job 'id' */
+int bl_wait_job(int fd, uint32_t id)
+{
+	return ioctl(fd, IOCTL_BL_WAIT_JOB, (unsigned long)id) ? -errno : 0;
+}
+
+int bl_get_jobs(int fd, struct beaglelogic_jobs *jobs)
+{
+	return ioctl(fd, IOCTL_BL_GET_JOBS, jobs) ? -errno : 0;
+}
+
+/* Loop mode: 'count' iterations, BL_LOOP_FOREVER until stopped, 0 off */
+int bl_set_loop(int fd, uint32_t count)
+{
+	return ioctl(fd, IOCTL_BL_SET_LOOP, (unsigned long)count) ? -errno : 0;
+}
+
+/* Loop mode: new contents for buffer 'index', from the next boundary on */
+int bl_swap_segment(int fd, uint32_t index, const void *data, uint32_t len)
+{
+	struct beaglelogic_swap swap;
+
+	swap.index = index;
+	swap.length = len;
+	swap.data = (uintptr_t)data;
+	return ioctl(fd, IOCTL_BL_SWAP_SEGMENT, &swap) ? -errno : 0;
+}
+
+/* Waits until the last swap is in, 'iteration' is the first to play it */
+int bl_wait_swap(int fd, uint32_t *iteration)
+{
+	return ioctl(fd, IOCTL_BL_WAIT_SWAP, iteration) ? -errno : 0;
+}
+
+/* Generator mode while idle, gen->enable 0 plays the buffers again */
+int bl_set_generator(int fd, const struct beaglelogic_generator *gen)
+{
+	return ioctl(fd, IOCTL_BL_SET_GENERATOR, gen) ? -errno : 0;
+}
+
+/* Edge list mode: 1 plays the data as struct beaglelogic_edge records */
+int bl_set_edge(int fd, uint32_t on)
+{
+	return ioctl(fd, IOCTL_BL_SET_EDGE, (unsigned long)on) ? -errno : 0;
+}
+
+/* Internal clock at 'period' PRU cycles per sample, 0 for the external
+ * clock; the first 'segments' buffers at 'periods' (0 keeps 'period') */
+int bl_set_clock(int fd, uint32_t period, const uint32_t *periods,
+		uint32_t segments)
+{
+	struct beaglelogic_clock clk;
+
+	clk.period = period;
+	clk.segments = segments;
+	clk.periods = (uintptr_t)periods;
+	return ioctl(fd, IOCTL_BL_SET_CLOCK, &clk) ? -errno : 0;
+}
+
+/* Capture the inputs in 'mask' to a ring of 'size' bytes, mask 0 off */
+int bl_set_capture(int fd, uint32_t mask, uint32_t size)
+{
+	struct beaglelogic_capture cap = { 0 };
+
+	cap.mask = mask;
+	cap.size = size;
+	return ioctl(fd, IOCTL_BL_SET_CAPTURE, &cap) ? -errno : 0;
+}
+
+int bl_set_sums(int fd, uint32_t on)
+{
+	return ioctl(fd, IOCTL_BL_SET_SUMS, (unsigned long)on) ? -errno : 0;
+}
+
+/* Sums of the run, and of the first 'entries' buffers into 'bufs' (may be
+ * NULL); 'entries' comes back as the number of buffers */
+int bl_get_sums(int fd, struct beaglelogic_sum *run,
+		struct beaglelogic_sum *bufs, uint32_t *entries)
+{
+	struct beaglelogic_sums sums = { 0 };
+
+	sums.entries = bufs ? *entries : 0;
+	sums.sums = (uintptr_t)bufs;
+	if (ioctl(fd, IOCTL_BL_GET_SUMS, &sums))
+		return -errno;
+	if (run)
+		*run = sums.run;
+	if (entries)
+		*entries = sums.entries;
+	return 0;
+}
+
+/* Indexed mode: 'ix' NULL plays the buffers as samples again */
+int bl_set_index(int fd, const struct bl_index *ix)
+{
+	struct beaglelogic_index arg = { 0 };
+
+	if (ix) {
+		arg.enable = 1;
+		arg.blocks = ix->blocks;
+		arg.dict = (uintptr_t)ix->dict;
+	}
+	return ioctl(fd, IOCTL_BL_SET_INDEX, &arg) ? -errno : 0;
+}
+
+/* Restarts the PRUs with other images, NULL or "" keeps the current one */
+int bl_set_firmware(int fd, const char *pru0, const char *pru1)
+{
+	struct beaglelogic_firmware fw;
+
+	memset(&fw, 0, sizeof(fw));
+	if (pru0)
+		strncpy(fw.pru0, pru0, sizeof(fw.pru0) - 1);
+	if (pru1)
+		strncpy(fw.pru1, pru1, sizeof(fw.pru1) - 1);
+	return ioctl(fd, IOCTL_BL_SET_FIRMWARE, &fw) ? -errno : 0;
+}
+
+/* End device access section */
+
+/* Begin indexed mode section */
+
+#define INDEX_SLOTS	(2 * BL_INDEX_MAX_BLOCKS)
+
+static uint32_t bl_block_hash(const uint8_t *p)
+{
+	uint64_t h = 0xcbf29ce484222325ULL, w;
+	int i;
+
+	for (i = 0; i < 64; i += 8) {
+		memcpy(&w, p + i, 8);
+		h = (h ^ w) * 0x100000001b3ULL;
+		h ^= h >> 29;
+	}
+	return (uint32_t)(h ^ (h >> 32));
+}
+
+/* Dictionary index of 'blk', added if new; -E2BIG once it is full */
+static int bl_index_lookup(struct bl_index *ix, const uint8_t *blk)
+{
+	uint32_t h;
+
+	for (h = bl_block_hash(blk) % INDEX_SLOTS; ix->slot[h];
+			h = (h + 1) % INDEX_SLOTS)
+		if (!memcmp(ix->dict + 64 * (ix->slot[h] - 1), blk, 64))
+			return ix->slot[h] - 1;
+
+	if (ix->blocks == BL_INDEX_MAX_BLOCKS)
+		return -E2BIG;
+	if (!(ix->blocks & (ix->blocks - 1))) {
+		uint8_t *dict = realloc(ix->dict,
+				64 * (ix->blocks ? 2 * ix->blocks : 1));
+
+		if (!dict)
+			return -ENOMEM;
+		ix->dict = dict;
+	}
+	memcpy(ix->dict + 64 * ix->blocks, blk, 64);
+	ix->slot[h] = ++ix->blocks;
+	return ix->blocks - 1;
+}
+
+static int bl_index_block(struct bl_index *ix, const uint8_t *blk)
+{
+	int d = bl_index_lookup(ix, blk);
+
+	if (d < 0)
+		return d;
+	if (ix->len + 2 > ix->cap) {
+		size_t cap = ix->cap ? 2 * ix->cap : 4096;
+		uint8_t *stream = realloc(ix->stream, cap);
+
+		if (!stream)
+			return -ENOMEM;
+		ix->stream = stream;
+		ix->cap = cap;
+	}
+	ix->stream[ix->len++] = d;
+	ix->stream[ix->len++] = d >> 8;
+	return 0;
+}
+
+int bl_index_init(struct bl_index *ix)
+{
+	static const uint8_t zero[64];
+
+	memset(ix, 0, sizeof(*ix));
+	ix->slot = calloc(INDEX_SLOTS, sizeof(*ix->slot));
+	if (!ix->slot)
+		return -ENOMEM;
+	return bl_index_lookup(ix, zero);
+}
+
+int bl_index_add(struct bl_index *ix, const void *data, size_t len)
+{
+	const uint8_t *p = data;
+	size_t n;
+	int ret;
+
+	if (ix->tail_len) {
+		n = 64 - ix->tail_len < len ? 64 - ix->tail_len : len;
+		memcpy(ix->tail + ix->tail_len, p, n);
+		ix->tail_len += n;
+		p += n;
+		len -= n;
+		if (ix->tail_len < 64)
+			return 0;
+		ix->tail_len = 0;
+		ret = bl_index_block(ix, ix->tail);
+		if (ret)
+			return ret;
+	}
+	for (; len >= 64; p += 64, len -= 64) {
+		ret = bl_index_block(ix, p);
+		if (ret)
+			return ret;
+	}
+	memcpy(ix->tail, p, len);
+	ix->tail_len = len;
+	return 0;
+}
+
+int bl_index_finish(struct bl_index *ix)
+{
+	static const uint8_t zero[64];
+	int ret = 0;
+
+	if (ix->tail_len) {
+		memset(ix->tail + ix->tail_len, 0, 64 - ix->tail_len);
+		ix->tail_len = 0;
+		ret = bl_index_block(ix, ix->tail);
+	}
+	while (!ret && ix->len % (2 * BL_INDEX_BATCH))
+		ret = bl_index_block(ix, zero);
+	return ret;
+}
+
+void bl_index_free(struct bl_index *ix)
+{
+	free(ix->dict);
+	free(ix->stream);
+	free(ix->slot);
+	memset(ix, 0, sizeof(*ix));
+}
+
+/* End indexed mode section */
+
+/* Begin block sums section */
+
+void bl_sum_update(struct beaglelogic_sum *sum, const void *data, size_t len)
+{
+	const uint8_t *p = data;
+	uint32_t a = sum->a, b = sum->b, w;
+	size_t i;
+
+	for (i = 0; i < len; i += 4) {
+		w = 0;
+		memcpy(&w, p + i, len - i < 4 ? len - i : 4);
+		a += le32toh(w);
+		b += a;
+	}
+
+	/* The zero words that pad the last block leave a as it is */
+	for (; i % 64; i += 4)
+		b += a;
+	sum->a = a;
+	sum->b = b;
+	sum->blocks += (len + 63) / 64;
+}
+
+/* End block sums section */
+
+/* Begin rate model section */
+
+static const struct bl_rate_model rate_models[] = {
+	{ 4, 128, 126 },	/* 2 samples per byte */
+	{ 8, 64, 62 },		/* 1 sample per byte */
+	{ 13, 32, 30 },		/* 1 sample per halfword */
+};
+
+const struct bl_rate_model *bl_rate_model(uint32_t channels)
+{
+	size_t i;
+
+	for (i = 0; i < sizeof(rate_models) / sizeof(rate_models[0]); i++)
+		if (rate_models[i].channels == channels)
+			return &rate_models[i];
+	return NULL;
+}
+
+uint32_t bl_max_samplerate(uint32_t channels, uint32_t ddr_ns)
+{
+	const struct bl_rate_model *m = bl_rate_model(channels);
+	uint64_t rate;
+	uint32_t block_cycles;
+
+	if (!m)
+		return 0;
+
+	block_cycles = (ddr_ns + BL_PRU_CYCLE_NS - 1) / BL_PRU_CYCLE_NS +
+		BL_PRU0_BLOCK_OVERHEAD;
+	rate = (uint64_t)m->margin * BL_PRU_CLK_HZ / block_cycles;
+	if (rate > (uint64_t)m->samples_per_block * BL_PRU_CLK_HZ /
+			(block_cycles + BL_PRU0_CLOCK_CYCLES))
+		rate = (uint64_t)m->samples_per_block * BL_PRU_CLK_HZ /
+			(block_cycles + BL_PRU0_CLOCK_CYCLES);
+	if (rate > BL_PRU_CLK_HZ / BL_PRU1_CYCLES_PER_SAMPLE)
+		rate = BL_PRU_CLK_HZ / BL_PRU1_CYCLES_PER_SAMPLE;
+	return rate;
+}
+
+/* End rate model section */
@@ -0,0 +1,126 @@
+/*
+ * Userspace library for the PRU digital waveform generator
+ *
+ * Wraps the sysfs attributes and the ioctl interface of /dev/beaglelogic
+ * and mirrors the firmware models of the kernel driver, so tools can plan
+ * a run before the device is touched.
+ *
+ * This file is a part of the PRU digital waveform generator project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef LIBBEAGLELOGIC_H_
+#define LIBBEAGLELOGIC_H_
+
+#include <stdint.h>
+#include <sys/ioctl.h>
+#include <sys/types.h>
+
+/* The ioctl definitions are shared with the kernel driver */
+typedef uint32_t u32;
+typedef uint64_t u64;
+#include "beaglelogic.h"
+
+#define BL_DEVICE		"/dev/beaglelogic"
+#define BL_SYSFS_DIR		"/sys/devices/virtual/misc/beaglelogic"
+
+/* Device access, all functions return a negative errno on failure */
+void bl_set_sysfs_dir(const char *dir);
+int bl_sysfs_read(const char *attr, uint32_t *val);
+int bl_sysfs_write(const char *attr, uint32_t val);
+
+int bl_open(void);
+int bl_start(int fd);
+int bl_start_at(int fd, uint64_t deadline);
+int bl_get_start(int fd, struct beaglelogic_start *start);
+int bl_get_buffer_size(int fd, uint32_t *size);
+int bl_get_bufunit_size(int fd, uint32_t *size);
+int bl_get_progress(int fd, struct beaglelogic_progress *progress);
+ssize_t bl_sendfile(int fd, int src, off_t off, size_t len);
+int bl_set_stream(int fd, uint32_t on);
+int bl_end_stream(int fd);
+int bl_job_end(int fd);
+int bl_wait_job(int fd, uint32_t id);
+int bl_get_jobs(int fd, struct beaglelogic_jobs *jobs);
+int bl_set_loop(int fd, uint32_t count);
+int bl_swap_segment(int fd, uint32_t index, const void *data, uint32_t len);
+int bl_wait_swap(int fd, uint32_t *iteration);
+int bl_set_generator(int fd, const struct beaglelogic_generator *gen);
+int bl_set_edge(int fd, uint32_t on);
+int bl_set_clock(int fd, uint32_t period, const uint32_t *periods,
+		uint32_t segments);
+int bl_set_capture(int fd, uint32_t mask, uint32_t size);
+int bl_set_sums(int fd, uint32_t on);
+int bl_get_sums(int fd, struct beaglelogic_sum *run,
+		struct beaglelogic_sum *bufs, uint32_t *entries);
+int bl_set_firmware(int fd, const char *pru0, const char *pru1);
+
+/*
+ * Indexed mode: collects the unique 64 byte blocks of a waveform, fed in
+ * pieces of any size, into a dictionary (block 0 is all zeros) and builds
+ * the index stream the device plays, 16 bits little endian per block. Equal
+ * blocks are found by a hash of their contents. bl_index_finish() pads the
+ * last block with zeros and the stream to a batch of BL_INDEX_BATCH with
+ * index 0.
+ */
+struct bl_index {
+	uint8_t *dict;		/* blocks * 64 bytes */
+	uint32_t blocks;
+	uint8_t *stream;	/* len bytes, 2 per block */
+	size_t len;
+
+	/* Private */
+	uint32_t *slot;		/* Dictionary block + 1 by hash, 0 if free */
+	size_t cap;
+	uint8_t tail[64];
+	size_t tail_len;
+};
+
+int bl_index_init(struct bl_index *ix);
+int bl_index_add(struct bl_index *ix, const void *data, size_t len);
+int bl_index_finish(struct bl_index *ix);
+void bl_index_free(struct bl_index *ix);
+int bl_set_index(int fd, const struct bl_index *ix);
+
+/*
+ * Block sums as PRU0 folds them: a += w, then b += a for every little endian
+ * 32 bit word w. Start from zero and pass each buffer as played, once per
+ * iteration in loop mode; a last partial block is folded with the zeros
+ * that pad it, as PRU0 plays them. 'blocks' counts the blocks.
+ */
+void bl_sum_update(struct beaglelogic_sum *sum, const void *data, size_t len);
+
+/*
+ * Cycle budget model of the firmware loops, see the rate model section of
+ * kernel/beaglelogic.c. 'ddr_ns' is the worst time PRU0 takes to read one
+ * 64 byte block from DDR, as reported by the ddrlatencymax attribute.
+ * In loop mode, a boundary that swaps a segment costs BL_PRU0_LOOP_OVERHEAD
+ * cycles more; add them to 'ddr_ns'. In indexed mode, pass twice the read
+ * time plus BL_PRU0_INDEX_OVERHEAD cycles. Capture adds BL_PRU0_CAPTURE_CYCLES
+ * and caps the rate at BL_PRU_CLK_HZ / BL_PRU1_CAPTURE_CYCLES.
+ * Block sums add BL_PRU0_SUM_CYCLES.
+ */
+#define BL_PRU_CLK_HZ		200000000
+#define BL_PRU_CYCLE_NS		5
+#define BL_PRU1_CYCLES_PER_SAMPLE	4
+#define BL_PRU0_BLOCK_OVERHEAD	25
+#define BL_PRU0_LOOP_OVERHEAD	12
+#define BL_PRU0_CLOCK_CYCLES	30
+#define BL_PRU0_INDEX_OVERHEAD	28
+#define BL_PRU1_CAPTURE_CYCLES	6
+#define BL_PRU0_CAPTURE_CYCLES	55
+#define BL_PRU0_SUM_CYCLES	61
+
+struct bl_rate_model {
+	uint32_t channels;
+	uint32_t samples_per_block;
+	uint32_t margin;	/* samples PRU0 has to refill the scratchpad */
+};
+
+const struct bl_rate_model *bl_rate_model(uint32_t channels);
+uint32_t bl_max_samplerate(uint32_t channels, uint32_t ddr_ns);
+
+#endif /* LIBBEAGLELOGIC_H_ */
@@ -0,0 +1,2939 @@
+/*
+ * prusim - host-side cycle model of the PRU waveform data path
+ *
+ * Runs the PRU0 'run' routine and the PRU1 'asm_main' routine straight from
+ * the firmware assembler sources on an ordinary Linux machine. Both cores
+ * are stepped in lockstep, one PRU clock (5 ns) at a time, with a model of
+ * the scratchpad banks, the INTC system events, the R30 outputs, the R31
+ * inputs (external sample clock on bit 16, in capture mode the outputs
+ * looped back inverted on bits 7:4) and a configurable DDR latency.
+ *
+ * The PRU0 C code (main loop, configure_capture) is not executed; the
+ * harness below performs the same steps on the simulated cores.
+ *
+ * The simulator reports the emitted samples against the uploaded buffers,
+ * the cycles spent per sample and the slack PRU0 left before PRU1 consumed
+ * each scratchpad block, so a firmware change can be checked for timing
+ * margin without a BeagleBone. Exit status is non-zero on any mismatch.
+ *
+ * This file is a part of the PRU digital waveform generator project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <getopt.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "libbeaglelogic.h"
+
+#define PRU_CLK_HZ		200000000.0
+#define PRU_CYCLE_NS		5.0
+
+/* Capture context layout, see struct capture_context in beaglelogic-pru0.c */
+#define FW_MAGIC		0xBEA61E10
+#define CXT_MAGIC		0
+#define CXT_CMD			4
+#define CXT_RESP		8
+#define MAX_BUFLIST_ENTRIES	128
+
+/* Default buffer unit size, as set in beaglelogic_probe */
+#define DEFAULT_BUFUNITSIZE	640000
+
+/* PRU local address map */
+#define ADDR_DRAM_OWN		0x00000
+#define ADDR_DRAM_OTHER		0x02000
+#define ADDR_SHARED		0x10000
+#define ADDR_INTC		0x20000
+#define ADDR_PRU0_CTRL		0x22000
+#define ADDR_PRU1_CTRL		0x24000
+#define ADDR_CFG		0x26000
+#define ADDR_IEP		0x2E000
+#define ADDR_DDR		0x80000000u
+
+#define DRAM_SIZE		0x2000
+#define SHARED_SIZE		0x3000
+
+/* IEP register offsets */
+#define IEP_GLB_CFG		0x00
+#define IEP_CNT			0x0C
+
+/* INTC register offsets */
+#define INTC_SISR		0x20
+#define INTC_SICR		0x24
+#define INTC_SRSR0		0x200
+#define INTC_SRSR1		0x204
+#define INTC_SECR0		0x280
+#define INTC_SECR1		0x284
+
+/* Events raised towards the ARM, and the command doorbell */
+#define SYSEV_PRU0_TO_ARM_A	22
+#define SYSEV_ARM_TO_PRU0_A	23
+#define SYSEV_PRU0_TO_ARM_B	24
+#define SYSEV_PRU0_TO_ARM_C	25
+
+/* Internal clock: PRU1 cycles of a sample beyond the count in R29 */
+#define INT_CLOCK_CYCLES	7
+
+/* Return address handed to 'run' in R3.w2 */
+#define RET_SENTINEL		0xFFFF
+
+#define MAX_LINE		512
+#define MAX_OPERANDS		4
+#define MAX_MACRO_DEPTH		8
+
+enum opcode {
+	OP_ADD, OP_ADC, OP_SUB, OP_SUC, OP_RSB, OP_RSC,
+	OP_LSL, OP_LSR, OP_AND, OP_OR, OP_XOR, OP_NOT, OP_MIN, OP_MAX,
+	OP_CLR, OP_SET, OP_MOV, OP_LDI, OP_LDI32, OP_ZERO,
+	OP_LBBO, OP_SBBO, OP_LBCO, OP_SBCO, OP_XIN, OP_XOUT,
+	OP_JMP, OP_JAL, OP_QBA,
+	OP_QBGT, OP_QBGE, OP_QBLT, OP_QBLE, OP_QBEQ, OP_QBNE,
+	OP_QBBS, OP_QBBC, OP_WBS, OP_WBC, OP_LOOP, OP_HALT,
+};
+
+static const struct {
+	const char *name;
+	enum opcode op;
+} mnemonics[] = {
+	{ "ADD", OP_ADD }, { "ADC", OP_ADC }, { "SUB", OP_SUB },
+	{ "SUC", OP_SUC }, { "RSB", OP_RSB }, { "RSC", OP_RSC },
+	{ "LSL", OP_LSL }, { "LSR", OP_LSR }, { "AND", OP_AND },
+	{ "OR", OP_OR }, { "XOR", OP_XOR }, { "NOT", OP_NOT },
+	{ "MIN", OP_MIN }, { "MAX", OP_MAX }, { "CLR", OP_CLR },
+	{ "SET", OP_SET }, { "MOV", OP_MOV }, { "LDI", OP_LDI },
+	{ "LDI32", OP_LDI32 }, { "ZERO", OP_ZERO },
+	{ "LBBO", OP_LBBO }, { "SBBO", OP_SBBO }, { "LBCO", OP_LBCO },
+	{ "SBCO", OP_SBCO }, { "XIN", OP_XIN }, { "XOUT", OP_XOUT },
+	{ "JMP", OP_JMP }, { "JAL", OP_JAL }, { "QBA", OP_QBA },
+	{ "QBGT", OP_QBGT }, { "QBGE", OP_QBGE }, { "QBLT", OP_QBLT },
+	{ "QBLE", OP_QBLE }, { "QBEQ", OP_QBEQ }, { "QBNE", OP_QBNE },
+	{ "QBBS", OP_QBBS }, { "QBBC", OP_QBBC }, { "WBS", OP_WBS },
+	{ "WBC", OP_WBC }, { "LOOP", OP_LOOP }, { "HALT", OP_HALT },
+};
+
+enum operand_type {
+	OPD_REG,	/* Rn, Rn.wK, Rn.bK, optionally prefixed with & */
+	OPD_CREG,	/* Cn */
+	OPD_IMM,	/* expression, resolved after the first pass */
+};
+
+struct operand {
+	enum operand_type type;
+	int reg;	/* register or constant table entry number */
+	int byteoff;	/* byte offset of the field inside the register */
+	int width;	/* field width in bytes */
+	char *expr;	/* unresolved expression text */
+	int64_t imm;
+};
+
+struct insn {
+	enum opcode op;
+	int nopd;
+	struct operand opd[MAX_OPERANDS];
+	uint32_t addr;	/* word address in instruction RAM */
+	const char *file;
+	int line;
+};
+
+struct symbol {
+	char *name;
+	char *text;	/* .asg / #define substitution text */
+	int64_t value;	/* label word address */
+	int is_label;
+	struct symbol *next;
+};
+
+struct macro {
+	char *name;
+	int nparams;
+	char *params[8];
+	int nlines;
+	char **lines;
+	struct macro *next;
+};
+
+struct program {
+	const char *name;
+	struct insn *insns;
+	int ninsns, cap;
+	uint32_t nextaddr;
+	struct symbol *syms;
+	struct macro *macros;
+	struct macro *defining;	/* macro being recorded */
+};
+
+struct core {
+	int id;
+	struct program *prog;
+	uint8_t regs[32 * 4];
+	int pc;			/* instruction index */
+	int halted;
+	uint64_t busy_until;
+	uint32_t r30_last;
+	/* Hardware loop state */
+	int loop_active;
+	int loop_start, loop_end;
+	uint32_t loop_count;
+};
+
+/* DDR latency model, in PRU cycles for the first 4 bytes of a burst */
+enum lat_kind { LAT_FIXED, LAT_UNIFORM, LAT_TABLE };
+
+struct latency_model {
+	enum lat_kind kind;
+	unsigned lo, hi;
+	unsigned *table;
+	size_t ntable;
+};
+
+static struct sim {
+	struct core pru[2];
+	uint8_t dram[2][DRAM_SIZE];
+	uint8_t shared[SHARED_SIZE];
+	uint8_t scratch[3][30 * 4];	/* banks 10, 11, 12 */
+	uint64_t events;		/* INTC raw event status */
+	uint64_t cycle;
+
+	/* IEP timer: counts (cycle - iep_epoch) * increment when enabled */
+	uint32_t iep_cfg;
+	uint32_t iep_base;
+	uint64_t iep_epoch;
+
+	uint8_t *ddr;
+	size_t ddr_size;
+	size_t data_size;	/* before the padding of the last buffer */
+
+	struct latency_model lat;
+	double clk_period;	/* external clock period, in PRU cycles */
+
+	/* Bank 10 hand-over bookkeeping */
+	unsigned bank10_version;
+	uint64_t bank10_xout_cycle;
+	unsigned last_xin_version;
+	int xin_seen;
+	long long slack_min;
+	unsigned underruns;
+	unsigned blocks;
+
+	/* Output bookkeeping */
+	uint8_t *expected;	/* expected nibble per sample of one pass */
+	uint8_t *expected_swap;	/* the same, with the first buffer swapped */
+	size_t swap_from;	/* first sample of the swapped passes, 0 if none */
+	size_t pass_samples;
+	size_t nexpected;	/* over all passes */
+	size_t nsamples;
+	size_t mismatches;
+	long long first_mismatch;
+	uint64_t first_sample_cycle, last_sample_cycle;
+	uint64_t cps_min, cps_max;
+	unsigned channel_mask;
+
+	/* Edge list mode: due time of each expected output change, counted
+	 * from the first one, and how the played ones compared */
+	int edge;
+	uint64_t *edge_time;
+	uint64_t edge_origin;
+	size_t edges_early, edges_late;
+	uint64_t edge_late_max;
+
+	/* Indexed mode: DDR address and size of the dictionary */
+	uint32_t index_dict;
+	uint32_t index_blocks;
+
+	/* Internal clock: PRU cycles each sample of one pass is due to take,
+	 * and the samples that took a different time */
+	uint32_t *period;
+	size_t period_errors;
+
+	/* Capture (-k): PRU1's inputs are its outputs inverted; the nibble
+	 * expected in the capture for every sample played and the DDR ring */
+	unsigned cap_mask;
+	uint8_t *cap_expected;
+	size_t cap_n, cap_alloc;
+	uint32_t cap_start, cap_size;
+
+	/* Block sums (-K): the sums of the blocks PRU0 handed over */
+	int sum;
+	uint32_t sum_a, sum_b;
+
+	/* Events towards the ARM */
+	unsigned arm_irqs[64];
+
+	/* Status query sent through the command mailbox during the run */
+	long long query_at;	/* cycle after run start, -1 for none */
+	uint64_t query_cycle, reply_cycle;
+	int query_pending;
+
+	FILE *vcd;
+	int verbose;
+} sim;
+
+/* Begin utility section */
+
+static void die(const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	fprintf(stderr, "prusim: ");
+	vfprintf(stderr, fmt, ap);
+	fprintf(stderr, "\n");
+	va_end(ap);
+	exit(2);
+}
+
+static char *xstrdup(const char *s)
+{
+	char *d = strdup(s);
+
+	if (!d)
+		die("out of memory");
+	return d;
+}
+
+static void *xcalloc(size_t n, size_t sz)
+{
+	void *p = calloc(n, sz);
+
+	if (!p && n && sz)
+		die("out of memory");
+	return p;
+}
+
+static char *trim(char *s)
+{
+	char *e;
+
+	while (isspace((unsigned char)*s))
+		s++;
+	e = s + strlen(s);
+	while (e > s && isspace((unsigned char)e[-1]))
+		*--e = 0;
+	return s;
+}
+
+static int is_ident_char(int c)
+{
+	return isalnum(c) || c == '_' || c == '$';
+}
+
+/* Split on commas outside quotes and parentheses */
+static int split_args(char *s, char **out, int max)
+{
+	int n = 0, depth = 0, quoted = 0;
+	char *start = s;
+
+	if (!*trim(s))
+		return 0;
+
+	for (; ; s++) {
+		if (*s == '"')
+			quoted = !quoted;
+		else if (!quoted && *s == '(')
+			depth++;
+		else if (!quoted && *s == ')')
+			depth--;
+
+		if (*s == 0 || (*s == ',' && !quoted && depth == 0)) {
+			int end = (*s == 0);
+
+			if (n == max)
+				return -1;
+			*s = 0;
+			out[n++] = trim(start);
+			if (end)
+				break;
+			start = s + 1;
+		}
+	}
+	return n;
+}
+
+static char *unquote(char *s)
+{
+	size_t len = strlen(s);
+
+	if (len >= 2 && s[0] == '"' && s[len - 1] == '"') {
+		s[len - 1] = 0;
+		return s + 1;
+	}
+	return s;
+}
+
+/* End utility section */
+
+/* Begin symbol and expression section */
+
+static struct symbol *sym_find(struct program *p, const char *name)
+{
+	struct symbol *s;
+
+	for (s = p->syms; s; s = s->next)
+		if (!strcmp(s->name, name))
+			return s;
+	return NULL;
+}
+
+static void sym_define_text(struct program *p, const char *name,
+		const char *text)
+{
+	struct symbol *s = sym_find(p, name);
+
+	if (!s) {
+		s = xcalloc(1, sizeof(*s));
+		s->name = xstrdup(name);
+		s->next = p->syms;
+		p->syms = s;
+	} else {
+		free(s->text);
+	}
+	s->text = xstrdup(text);
+	s->is_label = 0;
+}
+
+static void sym_define_label(struct program *p, const char *name,
+		uint32_t addr, const char *file, int line)
+{
+	struct symbol *s = sym_find(p, name);
+
+	if (s && s->is_label)
+		die("%s:%d: label '%s' redefined", file, line, name);
+	if (!s) {
+		s = xcalloc(1, sizeof(*s));
+		s->name = xstrdup(name);
+		s->next = p->syms;
+		p->syms = s;
+	}
+	s->is_label = 1;
+	s->value = addr;
+}
+
+struct expr_state {
+	struct program *prog;
+	const char *s;
+	int depth;
+	int error;
+};
+
+static int64_t expr_or(struct expr_state *st);
+
+static void expr_skip(struct expr_state *st)
+{
+	while (isspace((unsigned char)*st->s))
+		st->s++;
+}
+
+static int64_t expr_eval_text(struct program *p, const char *text,
+		int depth, int *error);
+
+static int64_t expr_primary(struct expr_state *st)
+{
+	int64_t v;
+
+	expr_skip(st);
+	if (*st->s == '(') {
+		const char *save;
+
+		st->s++;
+		save = st->s;
+		/* Skip C casts such as (uint32_t) */
+		while (is_ident_char((unsigned char)*st->s))
+			st->s++;
+		if (*st->s == ')' && save != st->s &&
+				!isdigit((unsigned char)*save)) {
+			char name[64];
+			size_t len = st->s - save;
+
+			if (len < sizeof(name)) {
+				memcpy(name, save, len);
+				name[len] = 0;
+				if (!sym_find(st->prog, name)) {
+					st->s++;
+					return expr_primary(st);
+				}
+			}
+		}
+		st->s = save;
+		v = expr_or(st);
+		expr_skip(st);
+		if (*st->s != ')')
+			st->error = 1;
+		else
+			st->s++;
+		return v;
+	}
+	if (*st->s == '-') {
+		st->s++;
+		return -expr_primary(st);
+	}
+	if (*st->s == '~') {
+		st->s++;
+		return ~expr_primary(st);
+	}
+	if (*st->s == '+') {
+		st->s++;
+		return expr_primary(st);
+	}
+	if (isdigit((unsigned char)*st->s)) {
+		char *end;
+
+		v = strtoll(st->s, &end, 0);
+		while (*end == 'u' || *end == 'U' || *end == 'l' || *end == 'L')
+			end++;
+		st->s = end;
+		return v;
+	}
+	if (is_ident_char((unsigned char)*st->s)) {
+		char name[128];
+		size_t len = 0;
+		struct symbol *sym;
+
+		while (is_ident_char((unsigned char)*st->s) &&
+				len < sizeof(name) - 1)
+			name[len++] = *st->s++;
+		name[len] = 0;
+
+		sym = sym_find(st->prog, name);
+		if (!sym) {
+			st->error = 1;
+			return 0;
+		}
+		if (sym->is_label)
+			return sym->value;
+		return expr_eval_text(st->prog, sym->text, st->depth + 1,
+				&st->error);
+	}
+	st->error = 1;
+	return 0;
+}
+
+static int64_t expr_mul(struct expr_state *st)
+{
+	int64_t v = expr_primary(st);
+
+	for (;;) {
+		expr_skip(st);
+		if (*st->s == '*') {
+			st->s++;
+			v *= expr_primary(st);
+		} else if (*st->s == '/' || *st->s == '%') {
+			char op = *st->s++;
+			int64_t d = expr_primary(st);
+
+			if (!d) {
+				st->error = 1;
+				return 0;
+			}
+			v = (op == '/') ? v / d : v % d;
+		} else {
+			return v;
+		}
+	}
+}
+
+static int64_t expr_add(struct expr_state *st)
+{
+	int64_t v = expr_mul(st);
+
+	for (;;) {
+		expr_skip(st);
+		if (*st->s == '+') {
+			st->s++;
+			v += expr_mul(st);
+		} else if (*st->s == '-') {
+			st->s++;
+			v -= expr_mul(st);
+		} else {
+			return v;
+		}
+	}
+}
+
+static int64_t expr_shift(struct expr_state *st)
+{
+	int64_t v = expr_add(st);
+
+	for (;;) {
+		expr_skip(st);
+		if (st->s[0] == '<' && st->s[1] == '<') {
+			st->s += 2;
+			v <<= expr_add(st);
+		} else if (st->s[0] == '>' && st->s[1] == '>') {
+			st->s += 2;
+			v >>= expr_add(st);
+		} else {
+			return v;
+		}
+	}
+}
+
+static int64_t expr_and(struct expr_state *st)
+{
+	int64_t v = expr_shift(st);
+
+	for (;;) {
+		expr_skip(st);
+		if (*st->s == '&' && st->s[1] != '&') {
+			st->s++;
+			v &= expr_shift(st);
+		} else {
+			return v;
+		}
+	}
+}
+
+static int64_t expr_xor(struct expr_state *st)
+{
+	int64_t v = expr_and(st);
+
+	for (;;) {
+		expr_skip(st);
+		if (*st->s == '^') {
+			st->s++;
+			v ^= expr_and(st);
+		} else {
+			return v;
+		}
+	}
+}
+
+static int64_t expr_or(struct expr_state *st)
+{
+	int64_t v = expr_xor(st);
+
+	for (;;) {
+		expr_skip(st);
+		if (*st->s == '|' && st->s[1] != '|') {
+			st->s++;
+			v |= expr_xor(st);
+		} else {
+			return v;
+		}
+	}
+}
+
+static int64_t expr_eval_text(struct program *p, const char *text,
+		int depth, int *error)
+{
+	struct expr_state st = { p, text, depth, 0 };
+	int64_t v;
+
+	if (depth > 16) {
+		*error = 1;
+		return 0;
+	}
+	v = expr_or(&st);
+	expr_skip(&st);
+	if (st.error || *st.s)
+		*error = 1;
+	return v;
+}
+
+/* End symbol and expression section */
+
+/* Begin assembler front-end section */
+
+static void load_file(struct program *p, const char *dir, const char *fname);
+
+/* Apply .asg substitutions until the text no longer changes */
+static void substitute(struct program *p, const char *in, char *out,
+		size_t outsz)
+{
+	char buf[2][MAX_LINE];
+	int pass, cur = 0;
+
+	snprintf(buf[0], MAX_LINE, "%s", in);
+	for (pass = 0; pass < 8; pass++) {
+		const char *s = buf[cur];
+		char *d = buf[!cur];
+		size_t n = 0;
+		int changed = 0;
+
+		while (*s && n < MAX_LINE - 1) {
+			if (is_ident_char((unsigned char)*s) &&
+					(s == buf[cur] ||
+					 !is_ident_char((unsigned char)s[-1]))) {
+				char name[128];
+				size_t len = 0;
+				struct symbol *sym;
+
+				while (is_ident_char((unsigned char)s[len]) &&
+						len < sizeof(name) - 1) {
+					name[len] = s[len];
+					len++;
+				}
+				name[len] = 0;
+				sym = sym_find(p, name);
+				if (sym && !sym->is_label && sym->text &&
+						strcmp(sym->text, name)) {
+					n += snprintf(d + n, MAX_LINE - n,
+							"%s", sym->text);
+					changed = 1;
+				} else {
+					n += snprintf(d + n, MAX_LINE - n,
+							"%s", name);
+				}
+				s += len;
+				if (n >= MAX_LINE)
+					n = MAX_LINE - 1;
+			} else {
+				d[n++] = *s++;
+			}
+		}
+		d[n] = 0;
+		cur = !cur;
+		if (!changed)
+			break;
+	}
+	snprintf(out, outsz, "%s", buf[cur]);
+}
+
+static int parse_reg(const char *s, struct operand *o)
+{
+	char *end;
+	long n;
+
+	if (*s == '&')
+		s++;
+	if (*s != 'R' && *s != 'r')
+		return 0;
+	if (!isdigit((unsigned char)s[1]))
+		return 0;
+	n = strtol(s + 1, &end, 10);
+	if (n < 0 || n > 31)
+		return 0;
+
+	o->type = OPD_REG;
+	o->reg = n;
+	o->byteoff = 0;
+	o->width = 4;
+	if (*end == 0)
+		return 1;
+	if (*end != '.')
+		return 0;
+	end++;
+	if ((end[0] == 'b' || end[0] == 'B') && end[1] >= '0' &&
+			end[1] <= '3' && !end[2]) {
+		o->byteoff = end[1] - '0';
+		o->width = 1;
+		return 1;
+	}
+	if ((end[0] == 'w' || end[0] == 'W') && end[1] >= '0' &&
+			end[1] <= '2' && !end[2]) {
+		o->byteoff = end[1] - '0';
+		o->width = 2;
+		return 1;
+	}
+	return 0;
+}
+
+static void parse_operand(struct program *p, char *text, struct operand *o)
+{
+	char sub[MAX_LINE];
+
+	substitute(p, text, sub, sizeof(sub));
+	memset(o, 0, sizeof(*o));
+	if (parse_reg(sub, o))
+		return;
+	if ((sub[0] == 'C' || sub[0] == 'c') && isdigit((unsigned char)sub[1])) {
+		char *end;
+		long n = strtol(sub + 1, &end, 10);
+
+		if (!*end && n >= 0 && n < 32) {
+			o->type = OPD_CREG;
+			o->reg = n;
+			return;
+		}
+	}
+	o->type = OPD_IMM;
+	o->expr = xstrdup(sub);
+}
+
+static struct insn *new_insn(struct program *p)
+{
+	if (p->ninsns == p->cap) {
+		p->cap = p->cap ? p->cap * 2 : 256;
+		p->insns = realloc(p->insns, p->cap * sizeof(*p->insns));
+		if (!p->insns)
+			die("out of memory");
+	}
+	memset(&p->insns[p->ninsns], 0, sizeof(struct insn));
+	return &p->insns[p->ninsns++];
+}
+
+static void process_line(struct program *p, const char *dir,
+		const char *file, int lineno, const char *raw, int depth);
+
+static void expand_macro(struct program *p, struct macro *m, char *args,
+		const char *dir, const char *file, int lineno, int depth)
+{
+	char *argv[8];
+	int argc, i, j;
+
+	argc = split_args(args, argv, 8);
+	if (argc < 0 || argc > m->nparams)
+		die("%s:%d: bad arguments for macro %s", file, lineno, m->name);
+
+	for (i = 0; i < m->nlines; i++) {
+		const char *s = m->lines[i];
+		char out[MAX_LINE];
+		size_t n = 0;
+
+		/* Replace whole-word parameter names with their arguments */
+		while (*s && n < sizeof(out) - 1) {
+			if (is_ident_char((unsigned char)*s) &&
+					(s == m->lines[i] ||
+					 !is_ident_char((unsigned char)s[-1]))) {
+				size_t len = 0;
+				int found = -1;
+
+				while (is_ident_char((unsigned char)s[len]))
+					len++;
+				for (j = 0; j < m->nparams; j++)
+					if (strlen(m->params[j]) == len &&
+					    !strncmp(m->params[j], s, len))
+						found = j;
+				if (found >= 0) {
+					const char *a = found < argc ?
+						unquote(argv[found]) : "";
+
+					n += snprintf(out + n, sizeof(out) - n,
+							"%s", a);
+				} else {
+					n += snprintf(out + n, sizeof(out) - n,
+							"%.*s", (int)len, s);
+				}
+				s += len;
+				if (n >= sizeof(out))
+					n = sizeof(out) - 1;
+			} else {
+				out[n++] = *s++;
+			}
+		}
+		out[n] = 0;
+		process_line(p, dir, file, lineno, out, depth + 1);
+	}
+}
+
+static void parse_instruction(struct program *p, const char *file,
+		int lineno, const char *mnem, char *args)
+{
+	struct insn *in;
+	char *argv[MAX_OPERANDS + 1];
+	int argc, i;
+	size_t k;
+
+	for (k = 0; k < sizeof(mnemonics) / sizeof(mnemonics[0]); k++)
+		if (!strcasecmp(mnemonics[k].name, mnem))
+			break;
+	if (k == sizeof(mnemonics) / sizeof(mnemonics[0]))
+		die("%s:%d: unsupported instruction '%s'", file, lineno, mnem);
+
+	argc = split_args(args, argv, MAX_OPERANDS + 1);
+	if (argc < 0 || argc > MAX_OPERANDS)
+		die("%s:%d: too many operands", file, lineno);
+
+	in = new_insn(p);
+	in->op = mnemonics[k].op;
+	in->nopd = argc;
+	in->file = file;
+	in->line = lineno;
+	in->addr = p->nextaddr;
+	p->nextaddr += (in->op == OP_LDI32) ? 2 : 1;
+
+	for (i = 0; i < argc; i++)
+		parse_operand(p, argv[i], &in->opd[i]);
+}
+
+static void process_line(struct program *p, const char *dir,
+		const char *file, int lineno, const char *raw, int depth)
+{
+	char line[MAX_LINE], *s, *tok, *rest;
+	int quoted = 0;
+
+	if (depth > MAX_MACRO_DEPTH)
+		die("%s:%d: macro nesting too deep", file, lineno);
+
+	snprintf(line, sizeof(line), "%s", raw);
+
+	/* Strip comments */
+	if (line[0] == '*')
+		return;
+	for (s = line; *s; s++) {
+		if (*s == '"')
+			quoted = !quoted;
+		else if (*s == ';' && !quoted) {
+			*s = 0;
+			break;
+		}
+	}
+
+	/* Recording a macro body */
+	if (p->defining) {
+		struct macro *m = p->defining;
+
+		if (!strcasecmp(trim(line), ".endm")) {
+			p->defining = NULL;
+			return;
+		}
+		m->lines = realloc(m->lines, (m->nlines + 1) * sizeof(char *));
+		if (!m->lines)
+			die("out of memory");
+		m->lines[m->nlines++] = xstrdup(line);
+		return;
+	}
+
+	s = line;
+	/* Label or macro definition in the first column */
+	if (*s && !isspace((unsigned char)*s)) {
+		char *colon, *name = s;
+
+		while (*s && !isspace((unsigned char)*s) && *s != ':')
+			s++;
+		colon = s;
+		if (*colon == ':') {
+			*colon = 0;
+			sym_define_label(p, name, p->nextaddr, file, lineno);
+			s = colon + 1;
+		} else {
+			char *directive;
+
+			if (*s)
+				*s++ = 0;
+			directive = trim(s);
+			if (!strncasecmp(directive, ".macro", 6)) {
+				struct macro *m = xcalloc(1, sizeof(*m));
+				char *argv[8];
+				int i;
+
+				m->name = xstrdup(name);
+				m->nparams = split_args(directive + 6,
+						argv, 8);
+				if (m->nparams < 0)
+					die("%s:%d: too many macro parameters",
+							file, lineno);
+				for (i = 0; i < m->nparams; i++)
+					m->params[i] = xstrdup(argv[i]);
+				m->next = p->macros;
+				p->macros = m;
+				p->defining = m;
+				return;
+			}
+			if (!strncasecmp(directive, ".set", 4) ||
+					!strncasecmp(directive, ".equ", 4)) {
+				sym_define_text(p, name, trim(directive + 4));
+				return;
+			}
+			/* Plain label without a colon */
+			sym_define_label(p, name, p->nextaddr, file, lineno);
+			s = directive;
+		}
+	}
+
+	s = trim(s);
+	if (!*s)
+		return;
+
+	tok = s;
+	while (*s && !isspace((unsigned char)*s))
+		s++;
+	if (*s)
+		*s++ = 0;
+	rest = trim(s);
+
+	if (tok[0] == '.') {
+		if (!strcasecmp(tok, ".asg")) {
+			char *argv[2];
+
+			if (split_args(rest, argv, 2) != 2)
+				die("%s:%d: bad .asg", file, lineno);
+			sym_define_text(p, argv[1], unquote(argv[0]));
+		} else if (!strcasecmp(tok, ".include") ||
+				!strcasecmp(tok, ".cdecls")) {
+			char *argv[4];
+			int argc = split_args(rest, argv, 4);
+
+			if (argc < 1)
+				die("%s:%d: bad %s", file, lineno, tok);
+			load_file(p, dir, unquote(argv[argc - 1]));
+		}
+		/* .sect, .global, .clink, .text, .end are layout only */
+		return;
+	}
+
+	{
+		struct macro *m;
+
+		for (m = p->macros; m; m = m->next)
+			if (!strcasecmp(m->name, tok)) {
+				expand_macro(p, m, rest, dir, file, lineno,
+						depth);
+				return;
+			}
+	}
+
+	parse_instruction(p, file, lineno, tok, rest);
+}
+
+/* Import simple object-like #defines from C sources pulled in by .cdecls */
+static void load_c_defines(struct program *p, const char *dir,
+		const char *fname, int depth)
+{
+	char path[1024], line[MAX_LINE];
+	FILE *f;
+
+	if (depth > 4)
+		return;
+	snprintf(path, sizeof(path), "%s/%s", dir, fname);
+	f = fopen(path, "r");
+	if (!f)
+		return;	/* System headers are not needed */
+
+	while (fgets(line, sizeof(line), f)) {
+		char *s = trim(line), *name, *val;
+
+		if (!strncmp(s, "#include", 8)) {
+			char *q1 = strchr(s, '"'), *q2;
+
+			if (q1 && (q2 = strchr(q1 + 1, '"'))) {
+				*q2 = 0;
+				load_c_defines(p, dir, q1 + 1, depth + 1);
+			}
+			continue;
+		}
+		if (strncmp(s, "#define", 7) || !isspace((unsigned char)s[7]))
+			continue;
+		name = trim(s + 7);
+		val = name;
+		while (*val && is_ident_char((unsigned char)*val))
+			val++;
+		if (*val == '(')
+			continue;	/* function-like macro */
+		if (*val)
+			*val++ = 0;
+		val = strstr(val, "/*") ? (*strstr(val, "/*") = 0, val) : val;
+		val = strstr(val, "//") ? (*strstr(val, "//") = 0, val) : val;
+		val = trim(val);
+		if (*val && !sym_find(p, name))
+			sym_define_text(p, name, val);
+	}
+	fclose(f);
+}
+
+static void load_file(struct program *p, const char *dir, const char *fname)
+{
+	char path[1024], line[MAX_LINE];
+	const char *dot = strrchr(fname, '.');
+	FILE *f;
+	int lineno = 0;
+	char *file;
+
+	if (dot && (!strcmp(dot, ".c") || !strcmp(dot, ".h"))) {
+		load_c_defines(p, dir, fname, 0);
+		return;
+	}
+
+	snprintf(path, sizeof(path), "%s/%s", dir, fname);
+	f = fopen(path, "r");
+	if (!f)
+		die("cannot open %s: %s", path, strerror(errno));
+	file = xstrdup(fname);
+
+	while (fgets(line, sizeof(line), f)) {
+		line[strcspn(line, "\r\n")] = 0;
+		process_line(p, dir, file, ++lineno, line, 0);
+	}
+	fclose(f);
+}
+
+static void resolve_program(struct program *p)
+{
+	int i, j;
+
+	for (i = 0; i < p->ninsns; i++) {
+		struct insn *in = &p->insns[i];
+
+		for (j = 0; j < in->nopd; j++) {
+			struct operand *o = &in->opd[j];
+			int err = 0;
+
+			if (o->type != OPD_IMM)
+				continue;
+			o->imm = expr_eval_text(p, o->expr, 0, &err);
+			if (err)
+				die("%s:%d: cannot evaluate '%s'", in->file,
+						in->line, o->expr);
+		}
+	}
+}
+
+static struct program *load_program(const char *dir, const char *fname)
+{
+	struct program *p = xcalloc(1, sizeof(*p));
+
+	p->name = fname;
+	load_file(p, dir, fname);
+	if (p->defining)
+		die("%s: unterminated macro %s", fname, p->defining->name);
+	resolve_program(p);
+	return p;
+}
+
+static int program_index(struct program *p, uint32_t addr)
+{
+	int lo = 0, hi = p->ninsns - 1;
+
+	while (lo <= hi) {
+		int mid = (lo + hi) / 2;
+
+		if (p->insns[mid].addr == addr)
+			return mid;
+		if (p->insns[mid].addr < addr)
+			lo = mid + 1;
+		else
+			hi = mid - 1;
+	}
+	return -1;
+}
+
+/* Value of a constant the firmware shares with the assembler code */
+static uint32_t program_const(struct program *p, const char *name)
+{
+	struct symbol *s = sym_find(p, name);
+	int err = 0;
+	int64_t v;
+
+	if (!s || s->is_label)
+		die("%s: constant '%s' not found", p->name, name);
+	v = expr_eval_text(p, s->text, 0, &err);
+	if (err)
+		die("%s: cannot evaluate '%s'", p->name, name);
+	return (uint32_t)v;
+}
+
+static int program_entry(struct program *p, const char *label)
+{
+	struct symbol *s = sym_find(p, label);
+	int idx;
+
+	if (!s || !s->is_label)
+		die("%s: entry point '%s' not found", p->name, label);
+	idx = program_index(p, s->value);
+	if (idx < 0)
+		die("%s: entry point '%s' has no code", p->name, label);
+	return idx;
+}
+
+/* End assembler front-end section */
+
+/* Begin machine model section */
+
+static unsigned latency_sample(void)
+{
+	struct latency_model *l = &sim.lat;
+
+	switch (l->kind) {
+	case LAT_UNIFORM:
+		return l->lo + (unsigned)(rand() % (l->hi - l->lo + 1));
+	case LAT_TABLE:
+		return l->table[rand() % l->ntable];
+	default:
+		return l->lo;
+	}
+}
+
+static int clock_level(uint64_t cycle)
+{
+	double phase = fmod((double)cycle, sim.clk_period);
+
+	return phase >= sim.clk_period / 2.0;
+}
+
+static void raise_event(int ev)
+{
+	sim.events |= 1ULL << ev;
+	if (ev == SYSEV_PRU0_TO_ARM_A || ev == SYSEV_PRU0_TO_ARM_B ||
+			ev == SYSEV_PRU0_TO_ARM_C || ev == 16 || ev == 18)
+		sim.arm_irqs[ev]++;
+}
+
+/*
+ * Host interrupt status, following the channel map of resource_table_0.h:
+ * events 17 and 20 reach host 0 (R31.30), events 21 and 23 reach host 1
+ * (R31.31).
+ */
+static uint32_t host_irq_bits(void)
+{
+	uint32_t v = 0;
+
+	if (sim.events & ((1ULL << 17) | (1ULL << 20)))
+		v |= 1u << 30;
+	if (sim.events & ((1ULL << 21) | (1ULL << 23)))
+		v |= 1u << 31;
+	return v;
+}
+
+static uint32_t reg_read(struct core *c, const struct operand *o)
+{
+	uint32_t v = 0;
+	int i;
+
+	if (o->reg == 31) {
+		uint32_t r31 = host_irq_bits();
+
+		if (c->id == 1 && clock_level(sim.cycle))
+			r31 |= 1u << 16;
+		if (c->id == 1 && sim.cap_mask)
+			r31 |= (~c->regs[30 * 4] & 0xF) << 4;
+		for (i = 0; i < o->width; i++)
+			v |= ((r31 >> (8 * (o->byteoff + i))) & 0xFF) << (8 * i);
+		return v;
+	}
+	for (i = 0; i < o->width; i++)
+		v |= (uint32_t)c->regs[o->reg * 4 + o->byteoff + i] << (8 * i);
+	return v;
+}
+
+static void sample_emitted(struct core *c);
+
+static void reg_write(struct core *c, const struct operand *o, uint32_t v)
+{
+	int i;
+
+	if (o->reg == 31) {
+		/* Writing R31 with bit 5 set raises system event 16..31 */
+		if (o->byteoff == 0 && (v & (1 << 5)))
+			raise_event(16 + (v & 0xF));
+		return;
+	}
+	for (i = 0; i < o->width; i++)
+		c->regs[o->reg * 4 + o->byteoff + i] = v >> (8 * i);
+	if (o->reg == 30 && c->id == 1)
+		sample_emitted(c);
+}
+
+static uint32_t opd_value(struct core *c, const struct operand *o)
+{
+	if (o->type == OPD_REG)
+		return reg_read(c, o);
+	return (uint32_t)o->imm;
+}
+
+static uint32_t intc_read(uint32_t off)
+{
+	switch (off) {
+	case INTC_SRSR0:
+		return (uint32_t)sim.events;
+	case INTC_SRSR1:
+		return (uint32_t)(sim.events >> 32);
+	}
+	return 0;
+}
+
+static void intc_write(uint32_t off, uint32_t v)
+{
+	switch (off) {
+	case INTC_SISR:
+		raise_event(v & 63);
+		break;
+	case INTC_SICR:
+		sim.events &= ~(1ULL << (v & 63));
+		break;
+	case INTC_SECR0:
+		sim.events &= ~(uint64_t)v;
+		break;
+	case INTC_SECR1:
+		sim.events &= ~((uint64_t)v << 32);
+		break;
+	}
+}
+
+static uint32_t iep_count(void)
+{
+	if (!(sim.iep_cfg & 1))
+		return sim.iep_base;
+	return sim.iep_base + (uint32_t)((sim.cycle - sim.iep_epoch) *
+			((sim.iep_cfg >> 4) & 0xF));
+}
+
+static uint32_t iep_read(uint32_t off)
+{
+	switch (off) {
+	case IEP_GLB_CFG:
+		return sim.iep_cfg;
+	case IEP_CNT:
+		return iep_count();
+	}
+	return 0;
+}
+
+static void iep_write(uint32_t off, uint32_t v)
+{
+	switch (off) {
+	case IEP_GLB_CFG:
+		sim.iep_base = iep_count();
+		sim.iep_epoch = sim.cycle;
+		sim.iep_cfg = v;
+		break;
+	case IEP_CNT:
+		sim.iep_base = v;
+		sim.iep_epoch = sim.cycle;
+		break;
+	}
+}
+
+/* Resolve a PRU local address to host memory, NULL for MMIO */
+static uint8_t *mem_ptr(struct core *c, uint32_t addr, uint32_t len,
+		int *is_ddr)
+{
+	*is_ddr = 0;
+	if (addr >= ADDR_DDR) {
+		if (addr - ADDR_DDR + len > sim.ddr_size)
+			die("PRU%d: DDR access out of range at 0x%08x",
+					c->id, addr);
+		*is_ddr = 1;
+		return sim.ddr + (addr - ADDR_DDR);
+	}
+	if (addr + len <= ADDR_DRAM_OWN + DRAM_SIZE)
+		return sim.dram[c->id] + addr;
+	if (addr >= ADDR_DRAM_OTHER && addr + len <= ADDR_DRAM_OTHER + DRAM_SIZE)
+		return sim.dram[!c->id] + (addr - ADDR_DRAM_OTHER);
+	if (addr >= ADDR_SHARED && addr + len <= ADDR_SHARED + SHARED_SIZE)
+		return sim.shared + (addr - ADDR_SHARED);
+	return NULL;
+}
+
+/* Burst transfer between the register file and memory; returns cycles */
+static unsigned mem_xfer(struct core *c, const struct insn *in, int store,
+		uint32_t addr, int regbyte, uint32_t len)
+{
+	uint8_t *p;
+	int is_ddr;
+	uint32_t i;
+
+	if (regbyte + len > sizeof(c->regs))
+		die("%s:%d: burst runs past R31", in->file, in->line);
+
+	p = mem_ptr(c, addr, len, &is_ddr);
+	if (p) {
+		if (store)
+			memcpy(p, c->regs + regbyte, len);
+		else
+			memcpy(c->regs + regbyte, p, len);
+	} else if (addr >= ADDR_INTC && addr < ADDR_INTC + 0x2000) {
+		for (i = 0; i < len; i += 4) {
+			uint32_t v;
+
+			if (store) {
+				memcpy(&v, c->regs + regbyte + i, 4);
+				intc_write(addr - ADDR_INTC + i, v);
+			} else {
+				v = intc_read(addr - ADDR_INTC + i);
+				memcpy(c->regs + regbyte + i, &v, 4);
+			}
+		}
+	} else if (addr >= ADDR_IEP && addr < ADDR_IEP + 0x400) {
+		for (i = 0; i < len; i += 4) {
+			uint32_t v;
+
+			if (store) {
+				memcpy(&v, c->regs + regbyte + i, 4);
+				iep_write(addr - ADDR_IEP + i, v);
+			} else {
+				v = iep_read(addr - ADDR_IEP + i);
+				memcpy(c->regs + regbyte + i, &v, 4);
+			}
+		}
+	} else if ((addr >= ADDR_PRU0_CTRL && addr < ADDR_PRU0_CTRL + 0x4000) ||
+			(addr >= ADDR_CFG && addr < ADDR_CFG + 0x100)) {
+		/* Control and CFG registers read as zero */
+		if (!store)
+			memset(c->regs + regbyte, 0, len);
+	} else {
+		die("%s:%d: PRU%d access to unmapped address 0x%08x",
+				in->file, in->line, c->id, addr);
+	}
+
+	if (is_ddr)
+		return store ? 1 + (len + 3) / 4 :
+			latency_sample() + (len + 3) / 4;
+	/* Local memories: read takes ~3 cycles + 1 per extra 32-bit word */
+	return store ? 1 + (len - 1) / 4 : 3 + (len - 1) / 4;
+}
+
+static uint32_t creg_base(struct core *c, int n)
+{
+	switch (n) {
+	case 0:
+		return ADDR_INTC;
+	case 4:
+		return ADDR_CFG;
+	case 24:
+		return ADDR_DRAM_OWN;
+	case 25:
+		return ADDR_DRAM_OTHER;
+	case 26:
+		return ADDR_IEP;
+	case 28:
+		return ADDR_SHARED;
+	case 31:
+		return ADDR_DDR;
+	}
+	die("PRU%d: constant table entry C%d not modelled", c->id, n);
+	return 0;
+}
+
+static uint8_t *scratch_bank(const struct insn *in, int bank)
+{
+	if (bank < 10 || bank > 12)
+		die("%s:%d: scratchpad device %d not modelled", in->file,
+				in->line, bank);
+	return sim.scratch[bank - 10];
+}
+
+/* Fold little endian words into a block sum, see beaglelogic-pru0.c */
+static void sum_fold(uint32_t *a, uint32_t *b, const uint8_t *p,
+		size_t words)
+{
+	for (; words; words--, p += 4) {
+		*a += p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+		*b += *a;
+	}
+}
+
+static void xout_bank10(struct core *c)
+{
+	(void)c;
+	if (sim.sum)
+		sum_fold(&sim.sum_a, &sim.sum_b, sim.scratch[0] + 13 * 4, 16);
+	sim.bank10_version++;
+	sim.bank10_xout_cycle = sim.cycle;
+}
+
+static void xin_bank10(struct core *c)
+{
+	long long slack;
+
+	(void)c;
+	sim.blocks++;
+	if (sim.xin_seen && sim.bank10_version == sim.last_xin_version) {
+		/* PRU1 read the same block twice: PRU0 was too late */
+		sim.underruns++;
+		if (sim.verbose)
+			fprintf(stderr, "prusim: underrun at cycle %llu\n",
+					(unsigned long long)sim.cycle);
+		return;
+	}
+	/* The first block is handed over before PRU1 is started */
+	slack = (long long)(sim.cycle - sim.bank10_xout_cycle);
+	if (sim.xin_seen && (sim.slack_min < 0 || slack < sim.slack_min))
+		sim.slack_min = slack;
+	sim.xin_seen = 1;
+	sim.last_xin_version = sim.bank10_version;
+}
+
+/* Edge list mode: an R30 write is due at the time of its record */
+static void edge_emitted(uint32_t v)
+{
+	size_t n = sim.nsamples++;
+	uint64_t due;
+
+	if (!n) {
+		sim.first_sample_cycle = sim.cycle;
+		sim.edge_origin = sim.cycle - sim.edge_time[0];
+	}
+	sim.last_sample_cycle = sim.cycle;
+	if (n >= sim.nexpected || v != sim.expected[n]) {
+		if (!sim.mismatches)
+			sim.first_mismatch = n;
+		sim.mismatches++;
+	}
+	if (n >= sim.nexpected)
+		return;
+
+	due = sim.edge_origin + sim.edge_time[n];
+	if (sim.cycle < due) {
+		sim.edges_early++;
+	} else if (sim.cycle > due) {
+		sim.edges_late++;
+		if (sim.cycle - due > sim.edge_late_max)
+			sim.edge_late_max = sim.cycle - due;
+		if (sim.verbose)
+			fprintf(stderr, "prusim: edge %zu late by %llu cycles\n",
+					n, (unsigned long long)(sim.cycle - due));
+	}
+}
+
+static void sample_emitted(struct core *c)
+{
+	uint32_t v = c->regs[30 * 4] & sim.channel_mask;
+	size_t n = sim.nsamples;
+
+	if (sim.cap_mask) {
+		if (sim.cap_n == sim.cap_alloc) {
+			sim.cap_alloc = sim.cap_alloc ? 2 * sim.cap_alloc : 4096;
+			sim.cap_expected = realloc(sim.cap_expected,
+					sim.cap_alloc);
+			if (!sim.cap_expected)
+				die("out of memory");
+		}
+		sim.cap_expected[sim.cap_n++] = ~c->regs[30 * 4] &
+			sim.cap_mask;
+	}
+
+	if (sim.edge) {
+		edge_emitted(v);
+		goto trace;
+	}
+
+	if (n) {
+		uint64_t d = sim.cycle - sim.last_sample_cycle;
+
+		if (n == 1 || d < sim.cps_min)
+			sim.cps_min = d;
+		if (d > sim.cps_max)
+			sim.cps_max = d;
+		if (sim.period && n <= sim.nexpected &&
+				d != sim.period[(n - 1) % sim.pass_samples]) {
+			sim.period_errors++;
+			if (sim.verbose)
+				fprintf(stderr, "prusim: sample %zu took %llu cycles\n",
+						n - 1, (unsigned long long)d);
+		}
+	} else {
+		sim.first_sample_cycle = sim.cycle;
+	}
+	sim.last_sample_cycle = sim.cycle;
+
+	if (n < sim.nexpected && v != (sim.swap_from && n >= sim.swap_from ?
+				sim.expected_swap : sim.expected)
+			[n % sim.pass_samples]) {
+		if (!sim.mismatches)
+			sim.first_mismatch = n;
+		sim.mismatches++;
+	}
+	sim.nsamples++;
+
+trace:
+	if (sim.vcd && v != c->r30_last)
+		fprintf(sim.vcd, "#%llu\nb%s%s%s%s p\n",
+				(unsigned long long)(sim.cycle * 5),
+				(v & 8) ? "1" : "0", (v & 4) ? "1" : "0",
+				(v & 2) ? "1" : "0", (v & 1) ? "1" : "0");
+	c->r30_last = v;
+}
+
+static void check_opd(const struct insn *in, int n)
+{
+	if (in->nopd != n)
+		die("%s:%d: expected %d operands", in->file, in->line, n);
+}
+
+static int branch_target(struct core *c, const struct insn *in,
+		const struct operand *o)
+{
+	uint32_t addr = opd_value(c, o) & 0xFFFF;
+	int idx;
+
+	if (addr == RET_SENTINEL)
+		return -1;
+	idx = program_index(c->prog, addr);
+	if (idx < 0)
+		die("%s:%d: jump to 0x%04x outside the program", in->file,
+				in->line, addr);
+	return idx;
+}
+
+/* Execute one instruction; returns the number of cycles it occupies */
+static unsigned step(struct core *c)
+{
+	struct insn *in = &c->prog->insns[c->pc];
+	struct operand *o = in->opd;
+	int next = c->pc + 1;
+	unsigned cycles = 1;
+	uint32_t a, b;
+	int taken;
+
+	switch (in->op) {
+	case OP_ADD: case OP_ADC: case OP_SUB: case OP_SUC:
+	case OP_RSB: case OP_RSC: case OP_LSL: case OP_LSR:
+	case OP_AND: case OP_OR: case OP_XOR: case OP_MIN: case OP_MAX:
+		check_opd(in, 3);
+		a = opd_value(c, &o[1]);
+		b = opd_value(c, &o[2]);
+		switch (in->op) {
+		case OP_ADD: case OP_ADC: a += b; break;
+		case OP_SUB: case OP_SUC: a -= b; break;
+		case OP_RSB: case OP_RSC: a = b - a; break;
+		case OP_LSL: a <<= (b & 31); break;
+		case OP_LSR: a >>= (b & 31); break;
+		case OP_AND: a &= b; break;
+		case OP_OR: a |= b; break;
+		case OP_XOR: a ^= b; break;
+		case OP_MIN: a = a < b ? a : b; break;
+		case OP_MAX: a = a > b ? a : b; break;
+		default: break;
+		}
+		reg_write(c, &o[0], a);
+		break;
+	case OP_NOT:
+		check_opd(in, 2);
+		reg_write(c, &o[0], ~opd_value(c, &o[1]));
+		break;
+	case OP_CLR:
+	case OP_SET:
+		if (in->nopd == 2) {
+			a = opd_value(c, &o[0]);
+			b = opd_value(c, &o[1]);
+		} else {
+			check_opd(in, 3);
+			a = opd_value(c, &o[1]);
+			b = opd_value(c, &o[2]);
+		}
+		if (in->op == OP_SET)
+			a |= 1u << (b & 31);
+		else
+			a &= ~(1u << (b & 31));
+		reg_write(c, &o[0], a);
+		break;
+	case OP_MOV:
+	case OP_LDI:
+		check_opd(in, 2);
+		reg_write(c, &o[0], opd_value(c, &o[1]));
+		break;
+	case OP_LDI32:
+		check_opd(in, 2);
+		reg_write(c, &o[0], opd_value(c, &o[1]));
+		cycles = 2;
+		break;
+	case OP_ZERO:
+		check_opd(in, 2);
+		memset(c->regs + o[0].reg * 4 + o[0].byteoff, 0,
+				opd_value(c, &o[1]));
+		break;
+	case OP_LBBO:
+	case OP_SBBO:
+		check_opd(in, 4);
+		cycles = mem_xfer(c, in, in->op == OP_SBBO,
+				opd_value(c, &o[1]) + opd_value(c, &o[2]),
+				o[0].reg * 4 + o[0].byteoff,
+				opd_value(c, &o[3]));
+		break;
+	case OP_LBCO:
+	case OP_SBCO:
+		check_opd(in, 4);
+		cycles = mem_xfer(c, in, in->op == OP_SBCO,
+				creg_base(c, o[1].reg) + opd_value(c, &o[2]),
+				o[0].reg * 4 + o[0].byteoff,
+				opd_value(c, &o[3]));
+		break;
+	case OP_XIN:
+	case OP_XOUT: {
+		int bank, start;
+		uint32_t len;
+		uint8_t *sp;
+
+		check_opd(in, 3);
+		bank = opd_value(c, &o[0]);
+		start = o[1].reg * 4 + o[1].byteoff;
+		len = opd_value(c, &o[2]);
+		sp = scratch_bank(in, bank);
+		if (start + len > 30 * 4)
+			die("%s:%d: scratchpad transfer past R29", in->file,
+					in->line);
+		if (in->op == OP_XOUT) {
+			memcpy(sp + start, c->regs + start, len);
+			if (bank == 10)
+				xout_bank10(c);
+		} else {
+			memcpy(c->regs + start, sp + start, len);
+			/* R29 alone is the period of the next block */
+			if (bank == 10 && start == 13 * 4)
+				xin_bank10(c);
+		}
+		break;
+	}
+	case OP_JAL:
+		check_opd(in, 2);
+		reg_write(c, &o[0], in->addr + 1);
+		next = branch_target(c, in, &o[1]);
+		break;
+	case OP_JMP:
+	case OP_QBA:
+		check_opd(in, 1);
+		next = branch_target(c, in, &o[0]);
+		break;
+	case OP_QBGT: case OP_QBGE: case OP_QBLT:
+	case OP_QBLE: case OP_QBEQ: case OP_QBNE:
+		/* QBxx label, Rn, op: branch if 'op <cond> Rn' */
+		check_opd(in, 3);
+		a = opd_value(c, &o[1]);
+		b = opd_value(c, &o[2]);
+		switch (in->op) {
+		case OP_QBGT: taken = b > a; break;
+		case OP_QBGE: taken = b >= a; break;
+		case OP_QBLT: taken = b < a; break;
+		case OP_QBLE: taken = b <= a; break;
+		case OP_QBEQ: taken = b == a; break;
+		default: taken = b != a; break;
+		}
+		if (taken)
+			next = branch_target(c, in, &o[0]);
+		break;
+	case OP_QBBS:
+	case OP_QBBC:
+		check_opd(in, 3);
+		a = opd_value(c, &o[1]);
+		b = opd_value(c, &o[2]);
+		taken = !!(a & (1u << (b & 31)));
+		if (in->op == OP_QBBC)
+			taken = !taken;
+		if (taken)
+			next = branch_target(c, in, &o[0]);
+		break;
+	case OP_WBS:
+	case OP_WBC:
+		check_opd(in, 2);
+		a = opd_value(c, &o[0]);
+		b = opd_value(c, &o[1]);
+		taken = !!(a & (1u << (b & 31)));
+		if (in->op == OP_WBC)
+			taken = !taken;
+		if (!taken)
+			next = c->pc;
+		break;
+	case OP_LOOP: {
+		int end;
+
+		check_opd(in, 2);
+		end = program_index(c->prog, o[0].imm);
+		a = opd_value(c, &o[1]);
+		if (end < 0)
+			die("%s:%d: bad LOOP end", in->file, in->line);
+		if (!a) {
+			next = end;
+		} else {
+			c->loop_active = 1;
+			c->loop_start = c->pc + 1;
+			c->loop_end = end;
+			c->loop_count = a;
+		}
+		break;
+	}
+	case OP_HALT:
+		c->halted = 1;
+		next = c->pc + 1;
+		break;
+	}
+
+	if (c->loop_active && next == c->loop_end) {
+		if (--c->loop_count)
+			next = c->loop_start;
+		else
+			c->loop_active = 0;
+	}
+
+	if (next < 0) {
+		/* Returned to the (simulated) C caller */
+		c->halted = 1;
+		c->pc = -1;
+	} else {
+		c->pc = next;
+	}
+	return cycles;
+}
+
+/* Advance both cores by one PRU clock */
+static void tick(void)
+{
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		struct core *c = &sim.pru[i];
+
+		if (c->halted || sim.cycle < c->busy_until)
+			continue;
+		c->busy_until = sim.cycle + step(c);
+	}
+	sim.cycle++;
+}
+
+static void run_until_halt(struct core *c, uint64_t max)
+{
+	uint64_t end = sim.cycle + max;
+
+	while (!c->halted && sim.cycle < end)
+		tick();
+	if (!c->halted)
+		die("PRU%d did not halt", c->id);
+}
+
+/* End machine model section */
+
+/* Begin harness section */
+
+static void put32(uint8_t *p, uint32_t v)
+{
+	memcpy(p, &v, 4);
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, 4);
+	return v;
+}
+
+static void parse_latency(const char *spec)
+{
+	struct latency_model *l = &sim.lat;
+
+	if (!strncmp(spec, "fixed:", 6)) {
+		l->kind = LAT_FIXED;
+		l->lo = l->hi = strtoul(spec + 6, NULL, 0);
+	} else if (!strncmp(spec, "uniform:", 8)) {
+		char *end;
+
+		l->kind = LAT_UNIFORM;
+		l->lo = strtoul(spec + 8, &end, 0);
+		if (*end != ':')
+			die("bad latency spec '%s'", spec);
+		l->hi = strtoul(end + 1, NULL, 0);
+		if (l->hi < l->lo)
+			die("bad latency range '%s'", spec);
+	} else if (!strncmp(spec, "file:", 5)) {
+		FILE *f = fopen(spec + 5, "r");
+		unsigned v;
+		size_t cap = 0;
+
+		if (!f)
+			die("cannot open %s: %s", spec + 5, strerror(errno));
+		l->kind = LAT_TABLE;
+		while (fscanf(f, "%u", &v) == 1) {
+			if (l->ntable == cap) {
+				cap = cap ? cap * 2 : 256;
+				l->table = realloc(l->table,
+						cap * sizeof(*l->table));
+				if (!l->table)
+					die("out of memory");
+			}
+			l->table[l->ntable++] = v;
+		}
+		fclose(f);
+		if (!l->ntable)
+			die("no latencies in %s", spec + 5);
+	} else {
+		die("bad latency spec '%s'", spec);
+	}
+}
+
+/* Lay the input out in simulated DDR the way beaglelogic_memalloc does */
+static unsigned load_buffers(char **files, int nfiles, uint32_t unitsize,
+		uint32_t *starts, uint32_t *ends)
+{
+	size_t total = 0, cap = 0, off, size;
+	uint8_t *data = NULL;
+	unsigned cnt, i;
+	int k;
+
+	for (k = 0; k < nfiles; k++) {
+		FILE *f = fopen(files[k], "rb");
+		size_t n;
+
+		if (!f)
+			die("cannot open %s: %s", files[k], strerror(errno));
+		for (;;) {
+			if (total + 65536 > cap) {
+				cap = cap ? cap * 2 : 1 << 20;
+				data = realloc(data, cap);
+				if (!data)
+					die("out of memory");
+			}
+			n = fread(data + total, 1, 65536, f);
+			if (!n)
+				break;
+			total += n;
+		}
+		fclose(f);
+	}
+	if (!total)
+		die("no waveform data");
+
+	cnt = (total + unitsize - 1) / unitsize;
+	if (cnt > MAX_BUFLIST_ENTRIES)
+		die("%u buffers exceed the firmware limit of %d", cnt,
+				MAX_BUFLIST_ENTRIES);
+
+	/* Last buffer is padded with zeros to a multiple of 64 bytes */
+	sim.ddr_size = (cnt - 1) * (size_t)unitsize +
+		((total - (cnt - 1) * (size_t)unitsize + 63) & ~(size_t)63);
+	sim.ddr = xcalloc(1, sim.ddr_size);
+	sim.data_size = total;
+	memcpy(sim.ddr, data, total);
+	free(data);
+
+	for (i = 0, off = 0; i < cnt; i++, off += size) {
+		size = (i == cnt - 1) ? sim.ddr_size - off : unitsize;
+		starts[i] = ADDR_DDR + off;
+		ends[i] = ADDR_DDR + off + size;
+	}
+
+	/* Each byte is played as low nibble, then high nibble */
+	sim.pass_samples = sim.ddr_size * 2;
+	sim.nexpected = sim.pass_samples;
+	sim.expected = xcalloc(1, sim.pass_samples);
+	for (off = 0; off < sim.ddr_size; off++) {
+		sim.expected[2 * off] = sim.ddr[off] & sim.channel_mask;
+		sim.expected[2 * off + 1] = (sim.ddr[off] >> 4) &
+			sim.channel_mask;
+	}
+	return cnt;
+}
+
+static void core_init(struct core *c, int id, struct program *p,
+		const char *entry)
+{
+	memset(c, 0, sizeof(*c));
+	c->id = id;
+	c->prog = p;
+	c->pc = program_entry(p, entry);
+}
+
+/* Resume a halted core over its HALT, like resume_other_pru() */
+static void core_resume(struct core *c)
+{
+	c->halted = 0;
+	c->busy_until = sim.cycle;
+}
+
+/* Loop mode: place an inverted copy of the first buffer after the others,
+ * to be swapped in while the waveform plays. Returns its DDR address */
+static uint32_t load_swap_buffer(uint32_t start, uint32_t end)
+{
+	size_t len = end - start, off = start - ADDR_DDR, i;
+	uint32_t addr = ADDR_DDR + sim.ddr_size;
+
+	sim.ddr = realloc(sim.ddr, sim.ddr_size + len);
+	if (!sim.ddr)
+		die("out of memory");
+	for (i = 0; i < len; i++)
+		sim.ddr[sim.ddr_size + i] = ~sim.ddr[off + i];
+	sim.ddr_size += len;
+
+	sim.expected_swap = xcalloc(1, sim.pass_samples);
+	memcpy(sim.expected_swap, sim.expected, sim.pass_samples);
+	for (i = 0; i < 2 * len; i++)
+		sim.expected_swap[2 * off + i] = ~sim.expected[2 * off + i] &
+			sim.channel_mask;
+	return addr;
+}
+
+/* Edge list mode (-e): 8 byte records of a time in PRU cycles and a value.
+ * The rest of the last block is padded with skipped records, as the host
+ * tools do; the times of the others become due times from the first one */
+#define EDGE_SKIP	0x80000000u
+
+static void edge_setup(void)
+{
+	uint32_t time, v, prev = 0;
+	uint64_t t = 0;
+	size_t off, n = 0;
+
+	if (sim.data_size % 8)
+		die("edge list of %zu bytes is not made of 8 byte records",
+				sim.data_size);
+	for (off = sim.data_size; off < sim.ddr_size; off += 8) {
+		put32(sim.ddr + off, 0);
+		put32(sim.ddr + off + 4, EDGE_SKIP);
+	}
+
+	free(sim.expected);
+	sim.expected = xcalloc(1, sim.ddr_size / 8);
+	sim.edge_time = xcalloc(sim.ddr_size / 8, sizeof(*sim.edge_time));
+	for (off = 0; off < sim.data_size; off += 8) {
+		time = get32(sim.ddr + off);
+		v = get32(sim.ddr + off + 4);
+		if (v & EDGE_SKIP)
+			continue;
+		t = n ? t + (uint32_t)(time - prev) : time;
+		prev = time;
+		sim.edge_time[n] = t;
+		sim.expected[n++] = v & sim.channel_mask;
+	}
+	if (!n)
+		die("edge list has no records to play");
+	sim.nexpected = n;
+}
+
+/* Indexed mode (-x): the data becomes a dictionary of unique 64 byte
+ * blocks, block 0 all zeros, and one 16 bit index per block, padded with
+ * index 0 to a batch of 32 as the host tools do. The indices take the place
+ * of the data in the buffers, the dictionary follows them */
+#define INDEX_BATCH	32
+#define INDEX_MAX	65536
+
+static uint32_t block_hash(const uint8_t *p)
+{
+	uint32_t h = 2166136261u;
+	int i;
+
+	for (i = 0; i < 64; i++)
+		h = (h ^ p[i]) * 16777619u;
+	return h;
+}
+
+static unsigned index_setup(uint32_t unitsize, uint32_t *starts,
+		uint32_t *ends)
+{
+	size_t nblocks = sim.ddr_size / 64, nindex, len, off, size, b;
+	uint32_t *slot, nslots = 1, h, d, ndict = 1;
+	uint8_t *ddr, *dict, *blk;
+	unsigned cnt, i;
+
+	nindex = (nblocks + INDEX_BATCH - 1) / INDEX_BATCH * INDEX_BATCH;
+	len = nindex * 2;
+	while (nslots < 2 * (nblocks + 1))
+		nslots <<= 1;
+	slot = xcalloc(nslots, sizeof(*slot));
+	ddr = xcalloc(1, len + (nblocks + 1) * 64);
+	dict = ddr + len;
+
+	/* Slots hold dictionary block + 1; block 0 is the zero block */
+	slot[block_hash(dict) & (nslots - 1)] = 1;
+	for (b = 0; b < nblocks; b++) {
+		blk = sim.ddr + 64 * b;
+		for (h = block_hash(blk) & (nslots - 1); slot[h];
+				h = (h + 1) & (nslots - 1))
+			if (!memcmp(dict + 64 * (slot[h] - 1), blk, 64))
+				break;
+		if (!slot[h]) {
+			if (ndict == INDEX_MAX)
+				die("more than %d different blocks", INDEX_MAX);
+			memcpy(dict + 64 * ndict, blk, 64);
+			slot[h] = ++ndict;
+		}
+		d = slot[h] - 1;
+		ddr[2 * b] = d;
+		ddr[2 * b + 1] = d >> 8;
+	}
+	free(slot);
+
+	/* The padding plays the zero block */
+	sim.expected = realloc(sim.expected, nindex * 128);
+	if (!sim.expected)
+		die("out of memory");
+	memset(sim.expected + sim.pass_samples, 0,
+			nindex * 128 - sim.pass_samples);
+	sim.pass_samples = nindex * 128;
+	sim.nexpected = sim.pass_samples;
+
+	free(sim.ddr);
+	sim.ddr = ddr;
+	sim.ddr_size = len + ndict * 64;
+	sim.index_dict = ADDR_DDR + len;
+	sim.index_blocks = ndict;
+
+	cnt = (len + unitsize - 1) / unitsize;
+	if (cnt > MAX_BUFLIST_ENTRIES)
+		die("%u buffers exceed the firmware limit of %d", cnt,
+				MAX_BUFLIST_ENTRIES);
+	for (i = 0, off = 0; i < cnt; i++, off += size) {
+		size = (i == cnt - 1) ? len - off : unitsize;
+		starts[i] = ADDR_DDR + off;
+		ends[i] = ADDR_DDR + off + size;
+	}
+	return cnt;
+}
+
+/* Generator mode settings (-g), the fields of struct beaglelogic_generator */
+struct gen_spec {
+	uint32_t channels;	/* source of channel N in bits 4N+3:4N */
+	uint32_t poly;		/* PRBS x^b + x^a + 1 */
+	uint32_t seed;		/* its first b bits */
+	uint32_t start;		/* counter start value */
+	uint32_t div;		/* samples per count, a power of 2 */
+	uint32_t blocks;
+	const char *pattern[4];	/* GEN_PATTERN channels, as 0/1 strings */
+};
+
+#define GEN_LOW		0
+#define GEN_HIGH	1
+#define GEN_PRBS	2
+#define GEN_COUNT	3
+#define GEN_PATTERN	4
+#define GEN_INVERT	8
+
+/* Words of all tables together, the size of the shared RAM */
+#define GEN_TABLE_WORDS	(SHARED_SIZE / 4)
+
+static void parse_gen(const char *spec, struct gen_spec *g)
+{
+	uint32_t *field[] = { &g->channels, &g->poly, &g->seed, &g->start,
+		&g->div, &g->blocks };
+	const char *s = spec;
+	char *end;
+	unsigned i, c;
+
+	for (i = 0; i < 6; i++) {
+		*field[i] = strtoul(s, &end, 0);
+		if (end == s || (*end != ':' && (i < 5 || *end)))
+			die("bad generator spec %s", spec);
+		s = end + 1;
+	}
+
+	/* One pattern for each GEN_PATTERN channel, in channel order */
+	for (c = 0; c < 4; c++) {
+		if (((g->channels >> (4 * c)) & 7) != GEN_PATTERN)
+			continue;
+		if (!*end)
+			die("generator spec %s lacks a pattern for channel %u",
+					spec, c);
+		g->pattern[c] = s;
+		end = strchr(s, ':');
+		if (!end)
+			end = (char *)s + strlen(s);
+		if (end == s || strspn(s, "01") != (size_t)(end - s))
+			die("bad pattern for channel %u", c);
+		s = end + 1;
+	}
+	if (*end)
+		die("bad generator spec %s", spec);
+}
+
+/* Lags of s[t] = s[t - a] ^ s[t - b] for the trinomial x^b + x^a + 1 */
+static void gen_lags(uint32_t poly, unsigned *a, unsigned *b)
+{
+	uint32_t rest;
+
+	if (!(poly & 1) || !(poly >> 1))
+		die("PRBS polynomial must be x^b + x^a + 1");
+	*b = 31 - __builtin_clz(poly);
+	rest = poly & ~(1u << *b) & ~1u;
+	if (!rest || (rest & (rest - 1)))
+		die("PRBS polynomial must be x^b + x^a + 1");
+	*a = __builtin_ctz(rest);
+}
+
+static size_t pattern_len(const char *p)
+{
+	return strcspn(p, ":");
+}
+
+/* Level of channel c at sample t; seq holds the PRBS from 32 bits before
+ * its start */
+static unsigned gen_bit(const struct gen_spec *g, const uint8_t *seq,
+		unsigned c, size_t t)
+{
+	unsigned src = (g->channels >> (4 * c)) & 15, bit;
+
+	switch (src & 7) {
+	case GEN_HIGH:
+		bit = 1;
+		break;
+	case GEN_PRBS:
+		bit = seq[32 + 4 * t + c];
+		break;
+	case GEN_COUNT:
+		bit = (((g->start + t / g->div) & 15) >> c) & 1;
+		break;
+	case GEN_PATTERN:
+		bit = g->pattern[c][t % pattern_len(g->pattern[c])] == '1';
+		break;
+	default:
+		bit = 0;
+		break;
+	}
+	return bit ^ !!(src & GEN_INVERT);
+}
+
+/* Loop length of channel c in samples */
+static size_t gen_period(const struct gen_spec *g, unsigned b, unsigned c)
+{
+	switch ((g->channels >> (4 * c)) & 7) {
+	case GEN_PRBS:
+		return ((size_t)1 << b) - 1;
+	case GEN_COUNT:
+		return (size_t)g->div << (c + 1);
+	case GEN_PATTERN:
+		return pattern_len(g->pattern[c]);
+	}
+	return 1;
+}
+
+/* A table of L / gcd(L, 8) words loops over L samples */
+static size_t gen_table_words(size_t period)
+{
+	size_t low = period & -period;
+
+	return period / (low < 8 ? low : 8);
+}
+
+/* Fill in the generator words of the context like the driver does and
+ * compute the expected output with a plain bit-serial model */
+static void gen_setup(struct program *p0, const struct gen_spec *g)
+{
+	uint32_t prbs_mask = 0, count_mask = 0, invert = 0, hist = 0, taps;
+	uint32_t inc, pattern = 0, lane, words = 0, state[8];
+	size_t n, t, period[4] = { 0 }, len, w;
+	unsigned a, b, k = 1, i, c, tables = 0;
+	uint8_t *seq;
+
+	gen_lags(g->poly, &a, &b);
+	if (!(g->seed & ((1ull << b) - 1)))
+		die("PRBS seed must not be 0");
+	if (!g->div || (g->div & (g->div - 1)) || g->div > 0x80000000u)
+		die("counter divider must be a power of 2");
+	if (!g->blocks)
+		die("generator mode needs at least one block");
+
+	for (c = 0; c < 4; c++) {
+		switch ((g->channels >> (4 * c)) & 7) {
+		case GEN_LOW:
+			break;
+		case GEN_HIGH:
+			invert ^= 0x11111111u << c;
+			break;
+		case GEN_PRBS:
+			prbs_mask |= 0x11111111u << c;
+			break;
+		case GEN_COUNT:
+			count_mask |= 0x11111111u << c;
+			break;
+		case GEN_PATTERN:
+			tables = 1;
+			break;
+		default:
+			die("unknown source for channel %u", c);
+		}
+		if ((g->channels >> (4 * c)) & GEN_INVERT)
+			invert ^= 0x11111111u << c;
+	}
+
+	for (c = 0; tables && c < 4; c++) {
+		period[c] = gen_period(g, b, c);
+		len = gen_table_words(period[c]);
+		if (len > GEN_TABLE_WORDS - words)
+			die("channel tables exceed %d words", GEN_TABLE_WORDS);
+		words += len;
+	}
+
+	/* The sequence from 32 bits before the seed, run backwards */
+	n = (size_t)g->blocks * 512 + 32;
+	for (c = 0; c < 4; c++)
+		if (4 * period[c] + 36 > n)
+			n = 4 * period[c] + 36;
+	seq = xcalloc(1, n);
+	for (i = 0; i < b; i++)
+		seq[32 + i] = (g->seed >> i) & 1;
+	for (i = 32; i-- > 0;)
+		seq[i] = seq[i + b] ^ seq[i + b - a];
+	for (t = 32 + b; t < n; t++)
+		seq[t] = seq[t - a] ^ seq[t - b];
+	for (i = 0; i < 32; i++)
+		hist |= (uint32_t)seq[i] << i;
+
+	if (tables) {
+		/* Each channel's samples in place, the channels ORed */
+		for (c = 0, words = 0; c < 4; c++) {
+			len = gen_table_words(period[c]);
+			for (w = 0; w < len; w++) {
+				lane = 0;
+				for (i = 0; i < 8; i++)
+					lane |= gen_bit(g, seq, c, (8 * w + i) %
+							period[c]) << (4 * i + c);
+				put32(sim.shared + 4 * (words + w), lane);
+			}
+			state[2 * c] = (uint32_t)len * 4 << 16;
+			state[2 * c + 1] = ADDR_SHARED + 4 * words;
+			words += len;
+		}
+	} else {
+		/* Two shift/XOR rounds per word: double the lags while they
+		 * fit */
+		while (2 * k * b <= 31)
+			k *= 2;
+		if (k * a < 16)
+			die("PRBS lags too short for the firmware");
+		taps = k * a | (k * b) << 8 | (32 - k * a) << 16 |
+			(32 - k * b) << 24;
+
+		inc = 0x80000000u / g->div;
+		for (i = 0; g->div < 8 && i < 8; i++)
+			pattern |= (i / g->div) << (4 * i);
+
+		state[0] = hist;
+		state[1] = taps;
+		state[2] = ((g->start & 15) << 28) - inc;
+		state[3] = inc;
+		state[4] = pattern;
+		state[5] = prbs_mask;
+		state[6] = count_mask;
+		state[7] = invert;
+	}
+
+	put32(sim.dram[0] + program_const(p0, "CXT_GEN_OFFSET"), g->blocks);
+	put32(sim.dram[0] + program_const(p0, "CXT_GEN_BLOCK_OFFSET"), 0);
+	put32(sim.dram[0] + program_const(p0, "CXT_GEN_TABLES_OFFSET"), tables);
+	for (i = 0; i < 8; i++)
+		put32(sim.dram[0] + program_const(p0, "CXT_GEN_STATE_OFFSET") +
+				4 * i, state[i]);
+
+	sim.pass_samples = (size_t)g->blocks * 128;
+	sim.nexpected = sim.pass_samples;
+	sim.expected = xcalloc(1, sim.pass_samples);
+	for (t = 0; t < sim.pass_samples; t++) {
+		unsigned v = 0;
+
+		for (c = 0; c < 4; c++)
+			v |= gen_bit(g, seq, c, t) << c;
+		sim.expected[t] = v & sim.channel_mask;
+	}
+	free(seq);
+}
+
+/* Rising clock edges between the first and the last sample not played */
+/* Internal clock (-i): period of buffer i, the last one given repeating */
+static uint32_t buffer_period(const uint32_t *periods, unsigned nperiods,
+		unsigned i)
+{
+	return periods[i < nperiods ? i : nperiods - 1];
+}
+
+/* The clk word of a list entry, see beaglelogic-pru0.c */
+static uint32_t clock_word(uint32_t period)
+{
+	return (period - INT_CLOCK_CYCLES) << 8;
+}
+
+/* Due period of every sample of one pass: a buffer holds 2 samples per
+ * byte, or in indexed mode 128 per 16 bit index */
+static void period_setup(const uint32_t *periods, unsigned nperiods,
+		unsigned cnt, const uint32_t *starts, const uint32_t *ends,
+		int index)
+{
+	size_t from, to, n;
+	unsigned i;
+
+	sim.period = xcalloc(sim.pass_samples, sizeof(*sim.period));
+	if (!cnt) {
+		for (n = 0; n < sim.pass_samples; n++)
+			sim.period[n] = periods[0];
+		return;
+	}
+	for (i = 0; i < cnt; i++) {
+		from = (size_t)(starts[i] - ADDR_DDR) * (index ? 64 : 2);
+		to = (size_t)(ends[i] - ADDR_DDR) * (index ? 64 : 2);
+		for (n = from; n < to && n < sim.pass_samples; n++)
+			sim.period[n] = buffer_period(periods, nperiods, i);
+	}
+	/* Indexed mode pads the last batch, at the last buffer's period */
+	for (; to < sim.pass_samples; to++)
+		sim.period[to] = buffer_period(periods, nperiods, cnt - 1);
+}
+
+/* Capture (-k): a DDR ring of 'bytes' after the buffers, or one that holds
+ * the whole run if 0, and the context words the driver sets */
+static void capture_setup(struct program *p0, uint32_t bytes)
+{
+	uint32_t cap = program_const(p0, "CXT_CAP_OFFSET");
+
+	sim.cap_size = bytes ? (bytes + 63) & ~63u :
+		((sim.nexpected / 2 + 63) & ~(size_t)63);
+	sim.cap_start = ADDR_DDR + sim.ddr_size;
+	sim.ddr = realloc(sim.ddr, sim.ddr_size + sim.cap_size);
+	if (!sim.ddr)
+		die("out of memory");
+	memset(sim.ddr + sim.ddr_size, 0, sim.cap_size);
+	sim.ddr_size += sim.cap_size;
+
+	put32(sim.dram[0] + cap, sim.cap_start);
+	put32(sim.dram[0] + cap + 4, sim.cap_start + sim.cap_size);
+	put32(sim.dram[0] + program_const(p0, "CXT_CAP_ADDR_OFFSET"),
+			sim.cap_start);
+	put32(sim.dram[0] + cap + 16, sim.cap_mask);
+}
+
+/* Bytes of the DDR ring that differ from the inputs of the samples played;
+ * once it has wrapped it holds the last cap_size of them */
+static size_t capture_errors(uint32_t blocks)
+{
+	size_t total = (size_t)blocks * 64, i, errors = 0;
+	uint8_t want;
+
+	for (i = total > sim.cap_size ? total - sim.cap_size : 0; i < total;
+			i++) {
+		if (2 * i + 1 >= sim.cap_n) {
+			errors++;
+			continue;
+		}
+		want = sim.cap_expected[2 * i] |
+			sim.cap_expected[2 * i + 1] << 4;
+		if (sim.ddr[sim.cap_start - ADDR_DDR + i % sim.cap_size] !=
+				want)
+			errors++;
+	}
+	return errors;
+}
+
+/* Block sums (-K): list entries whose sums differ from those
+ * bl_sum_update computes over the file data of their buffer, played 'reps'
+ * times and without the padding of the last one; the data of indexed and
+ * swapped entries is not checked, only the number of blocks over all of
+ * them */
+static unsigned sum_errors(struct program *p0, unsigned cnt,
+		const uint32_t *starts, const uint32_t *ends, unsigned reps,
+		int check_data)
+{
+	uint32_t list = program_const(p0, "CXT_SUM_LIST_OFFSET");
+	struct beaglelogic_sum sum;
+	uint32_t blocks = 0;
+	unsigned i, r, errors = 0;
+	size_t off, len;
+	const uint8_t *s;
+
+	for (i = 0; i < cnt; i++) {
+		s = sim.dram[0] + list + 12 * i;
+		blocks += get32(s + 8);
+		if (!check_data)
+			continue;
+		off = starts[i] - ADDR_DDR;
+		len = ends[i] - starts[i];
+		if (off + len > sim.data_size)
+			len = sim.data_size > off ? sim.data_size - off : 0;
+		memset(&sum, 0, sizeof(sum));
+		for (r = 0; r < reps; r++)
+			bl_sum_update(&sum, sim.ddr + off, len);
+		if (get32(s) != sum.a || get32(s + 4) != sum.b ||
+				get32(s + 8) != sum.blocks)
+			errors++;
+	}
+	return errors + (blocks != sim.bank10_version);
+}
+
+static long long missed_edges(void)
+{
+	double half = sim.clk_period / 2.0;
+	long long edges;
+
+	if (sim.edge || sim.period || sim.nsamples < 2)
+		return 0;
+	edges = (long long)floor(((double)sim.last_sample_cycle - half) /
+			sim.clk_period) -
+		(long long)floor(((double)sim.first_sample_cycle - half) /
+			sim.clk_period);
+	return edges > (long long)sim.nsamples - 1 ?
+		edges - ((long long)sim.nsamples - 1) : 0;
+}
+
+static void vcd_header(void)
+{
+	fprintf(sim.vcd,
+		"$timescale 1ns $end\n"
+		"$scope module pru1 $end\n"
+		"$var wire 4 p r30 [3:0] $end\n"
+		"$upscope $end\n"
+		"$enddefinitions $end\n"
+		"#0\nb0000 p\n");
+}
+
+static void usage(FILE *f)
+{
+	fprintf(f,
+		"Usage: prusim [options] FILE...\n"
+		"       prusim [options] -g SPEC\n"
+		"Plays the concatenated FILEs through the PRU firmware model.\n\n"
+		"  -f DIR     firmware source directory (default ../firmware)\n"
+		"  -r HZ      external sample clock frequency (default 25e6)\n"
+		"  -u BYTES   buffer unit size (default %d)\n"
+		"  -l SPEC    DDR read latency in PRU cycles: fixed:N,\n"
+		"             uniform:LO:HI or file:PATH (default fixed:60)\n"
+		"  -c N       number of output channels (default 4)\n"
+		"  -s SEED    random seed for the latency model\n"
+		"  -t FILE    write the pin trace as a VCD file\n"
+		"  -q CYCLE   send CMD_GET_STATUS CYCLE cycles into the run\n"
+		"  -T CYCLES  scheduled start: PRU1 holds the first sample until\n"
+		"             CYCLES after CMD_START\n"
+		"  -S N       stream mode: close the list into a ring and queue\n"
+		"             each buffer again as PRU0 hands it back, N passes\n"
+		"  -L N       loop mode: play the list N times\n"
+		"  -W ITER    loop mode: post a swap of the first buffer for its\n"
+		"             inverse once ITER iterations have been read\n"
+		"  -g SPEC    generator mode, no FILE: SOURCES:POLY:SEED:START:DIV:\n"
+		"             BLOCKS, e.g. 0x3322:0xC1:1:0:1:100 (PRBS7 on\n"
+		"             channels 0-1, counter bits 2-3), then a 0/1 string\n"
+		"             for each pattern channel (source 4)\n"
+		"  -e         edge list mode: the FILEs hold (time, value) records\n"
+		"  -x         indexed mode: play the FILEs from a dictionary of\n"
+		"             their unique 64 byte blocks\n"
+		"  -i P,...   internal clock instead of -r: PRU cycles per sample\n"
+		"             (at least 9) of each buffer, the last one repeating\n"
+		"  -k MASK[:BYTES]  capture the inputs MASK selects, the outputs\n"
+		"             looped back inverted, into a DDR ring of BYTES\n"
+		"             (default the whole run) and check it\n"
+		"  -K         fold the blocks into sums and check them\n"
+		"  -v         report every underrun\n"
+		"  -h         this help\n", DEFAULT_BUFUNITSIZE);
+}
+
+int main(int argc, char **argv)
+{
+	const char *fwdir = "../firmware", *vcdfile = NULL;
+	uint32_t starts[MAX_BUFLIST_ENTRIES], ends[MAX_BUFLIST_ENTRIES];
+	uint32_t unitsize = DEFAULT_BUFUNITSIZE;
+	struct program *p0, *p1;
+	struct core *pru0 = &sim.pru[0], *pru1 = &sim.pru[1];
+	double rate = 25e6;
+	unsigned cnt, i, channels = 4, seed = 1, passes = 0, seen = 0;
+	unsigned queued[MAX_BUFLIST_ENTRIES], loops = 0;
+	uint64_t run_start, limit;
+	uint32_t list, swap_addr = 0;
+	long swap_at = -1;
+	struct gen_spec gen = { 0 };
+	int opt, failed, swap_posted = 0, index = 0;
+	uint32_t start_delay = 0, start_ref = 0, start_iep = 0, start_done = 0;
+	uint64_t start_cycle = 0;
+	uint32_t periods[MAX_BUFLIST_ENTRIES], entry, clk;
+	unsigned nperiods = 0;
+	uint32_t cap_bytes = 0, cap_blocks = 0;
+	size_t cap_errs = 0;
+	unsigned sum_errs = 0;
+	char *tok;
+
+	sim.slack_min = -1;
+	sim.query_at = -1;
+	sim.lat.kind = LAT_FIXED;
+	sim.lat.lo = sim.lat.hi = 60;
+
+	while ((opt = getopt(argc, argv, "f:r:u:l:c:s:t:q:T:S:L:W:g:exi:k:Kvh")) != -1) {
+		switch (opt) {
+		case 'f':
+			fwdir = optarg;
+			break;
+		case 'r':
+			rate = strtod(optarg, NULL);
+			break;
+		case 'u':
+			unitsize = strtoul(optarg, NULL, 0);
+			if (unitsize < 64)
+				die("buffer unit size must be at least 64");
+			unitsize = (unitsize + 63) & ~63u;
+			break;
+		case 'l':
+			parse_latency(optarg);
+			break;
+		case 'c':
+			channels = strtoul(optarg, NULL, 0);
+			if (!channels || channels > 8)
+				die("1 to 8 channels supported");
+			break;
+		case 's':
+			seed = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			vcdfile = optarg;
+			break;
+		case 'q':
+			sim.query_at = strtoll(optarg, NULL, 0);
+			break;
+		case 'T':
+			start_delay = strtoul(optarg, NULL, 0);
+			if (start_delay >= 1u << 31)
+				die("the start must be less than 2^31 cycles away");
+			break;
+		case 'S':
+			passes = strtoul(optarg, NULL, 0);
+			if (!passes)
+				die("stream mode needs at least one pass");
+			break;
+		case 'L':
+			loops = strtoul(optarg, NULL, 0);
+			if (!loops)
+				die("loop mode needs at least one iteration");
+			break;
+		case 'W':
+			swap_at = strtol(optarg, NULL, 0);
+			break;
+		case 'g':
+			parse_gen(optarg, &gen);
+			break;
+		case 'e':
+			sim.edge = 1;
+			break;
+		case 'x':
+			index = 1;
+			break;
+		case 'i':
+			for (tok = strtok(optarg, ","); tok;
+					tok = strtok(NULL, ",")) {
+				if (nperiods == MAX_BUFLIST_ENTRIES)
+					die("at most %d periods",
+							MAX_BUFLIST_ENTRIES);
+				periods[nperiods] = strtoul(tok, NULL, 0);
+				if (periods[nperiods] < INT_CLOCK_CYCLES + 2 ||
+						periods[nperiods] - INT_CLOCK_CYCLES
+						>= 1u << 24)
+					die("a period takes 9 to 2^24 + 6 cycles");
+				nperiods++;
+			}
+			break;
+		case 'k':
+			sim.cap_mask = strtoul(optarg, &tok, 0);
+			if (*tok == ':')
+				cap_bytes = strtoul(tok + 1, NULL, 0);
+			if (!sim.cap_mask || sim.cap_mask > 0xF)
+				die("the capture mask selects 1 to 4 inputs");
+			break;
+		case 'K':
+			sim.sum = 1;
+			break;
+		case 'v':
+			sim.verbose = 1;
+			break;
+		case 'h':
+			usage(stdout);
+			return 0;
+		default:
+			usage(stderr);
+			return 2;
+		}
+	}
+	if (gen.blocks ? optind < argc || passes || loops || sim.edge || index :
+			optind >= argc) {
+		usage(stderr);
+		return 2;
+	}
+	if (rate <= 0 || rate > PRU_CLK_HZ / 2)
+		die("clock rate must be between 0 and %g Hz", PRU_CLK_HZ / 2);
+
+	srand(seed);
+	sim.clk_period = PRU_CLK_HZ / rate;
+	for (i = 0; i < nperiods; i++)
+		if (i == 0 || periods[i] > sim.clk_period)
+			sim.clk_period = periods[i];
+	sim.channel_mask = (1u << channels) - 1;
+
+	p0 = load_program(fwdir, "beaglelogic-pru0-core.asm");
+	p1 = load_program(fwdir, "beaglelogic-pru1-core.asm");
+
+	cnt = gen.blocks ? 0 : load_buffers(argv + optind, argc - optind,
+			unitsize, starts, ends);
+	if (sim.edge) {
+		if (passes || loops)
+			die("edge list mode plays the list once");
+		edge_setup();
+	}
+	if (index) {
+		if (sim.edge || swap_at >= 0)
+			die("indexed mode plays samples, without swaps");
+		cnt = index_setup(unitsize, starts, ends);
+	}
+	if (passes) {
+		if (cnt < 2)
+			die("stream mode needs at least two buffers");
+		sim.nexpected *= passes;
+	}
+	if (nperiods && sim.edge)
+		die("edge list mode has no sample clock");
+	if (sim.cap_mask && (sim.edge || gen.blocks || nperiods))
+		die("capture runs on the external clock, in list modes");
+	if (sim.sum && gen.blocks)
+		die("block sums are taken in list modes");
+	if (loops) {
+		if (passes)
+			die("stream and loop mode exclude each other");
+		sim.nexpected *= loops;
+		if (swap_at >= 0)
+			swap_addr = load_swap_buffer(starts[0], ends[0]);
+	} else if (swap_at >= 0) {
+		die("a swap needs loop mode");
+	}
+
+	if (vcdfile) {
+		sim.vcd = fopen(vcdfile, "w");
+		if (!sim.vcd)
+			die("cannot create %s: %s", vcdfile, strerror(errno));
+		vcd_header();
+	}
+
+	/* Capture context and null terminated buffer list in PRU0 RAM; in
+	 * stream and loop mode the terminator links back to the first entry.
+	 * With the internal clock each entry carries its buffer's period */
+	list = program_const(p0, "CXT_LIST_OFFSET");
+	entry = program_const(p0, "LIST_ENTRY_SIZE");
+	clk = program_const(p0, "LIST_CLK_OFFSET");
+	put32(sim.dram[0] + CXT_MAGIC, FW_MAGIC);
+	put32(sim.dram[0] + program_const(p0, "CXT_LOOP_OFFSET"), loops);
+	put32(sim.dram[0] + program_const(p0, "CXT_EDGE_OFFSET"), sim.edge);
+	put32(sim.dram[0] + program_const(p0, "CXT_INDEX_OFFSET"),
+			sim.index_dict);
+	put32(sim.dram[0] + program_const(p0, "CXT_SUM_OFFSET"), sim.sum);
+	if (nperiods)
+		put32(sim.dram[0] + program_const(p0, "CXT_CLK_INT_OFFSET"),
+				clock_word(periods[0]));
+	if (gen.blocks)
+		gen_setup(p0, &gen);
+	if (nperiods)
+		period_setup(periods, nperiods, cnt, starts, ends, index);
+	if (sim.cap_mask)
+		capture_setup(p0, cap_bytes);
+	for (i = 0; i < cnt; i++) {
+		put32(sim.dram[0] + list + entry * i, starts[i]);
+		put32(sim.dram[0] + list + entry * i + 4, ends[i]);
+		put32(sim.dram[0] + list + entry * i + clk, nperiods ?
+				clock_word(buffer_period(periods, nperiods, i)) :
+				0);
+		queued[i] = 1;
+	}
+	put32(sim.dram[0] + list + entry * cnt, 0);
+	put32(sim.dram[0] + list + entry * cnt + 4,
+			passes || loops ? program_const(p0, "LIST_LINK") : 0);
+
+	/* main() starts the IEP counter, 1 count per cycle */
+	iep_write(IEP_GLB_CFG, 0x11);
+
+	/* PRU1 boots and halts with its magic in R0 */
+	core_init(pru1, 1, p1, "asm_main");
+	pru0->halted = 1;
+	run_until_halt(pru1, 1000);
+	if (get32(pru1->regs) != FW_MAGIC)
+		die("PRU1 firmware magic mismatch");
+
+	/* CMD_SET_CONFIG: configure_capture() hands PRU1 the address of
+	 * edge_late in R12 (1 for the internal clock, 2 for capture, 0 for
+	 * the external clock), the address of cap_ring in R4 and the capture
+	 * mask in R11, and resumes it once */
+	put32(pru1->regs + 12 * 4, sim.edge ? ADDR_DRAM_OTHER +
+			program_const(p0, "CXT_EDGE_LATE_OFFSET") : nperiods ?
+			1 : sim.cap_mask ? 2 : 0);
+	put32(pru1->regs + 4 * 4, ADDR_DRAM_OTHER +
+			program_const(p0, "CXT_CAP_RING_OFFSET"));
+	put32(pru1->regs + 11 * 4, sim.cap_mask * 0x11111111);
+	core_resume(pru1);
+	run_until_halt(pru1, 1000);
+
+	/* CMD_START: main() notes the IEP count, hands PRU1 the start time
+	 * in R9 and the address of start_iep in R10, clears the INTC, resumes
+	 * PRU1 and calls run() */
+	start_ref = iep_count();
+	start_cycle = sim.cycle + start_delay;
+	put32(sim.dram[0] + program_const(p0, "CXT_START_OFFSET"),
+			start_delay);
+	put32(sim.dram[0] + program_const(p0, "CXT_START_OFFSET") + 4,
+			start_ref);
+	put32(pru1->regs + 9 * 4, start_ref + start_delay);
+	put32(pru1->regs + 10 * 4, start_delay ? ADDR_DRAM_OTHER +
+			program_const(p0, "CXT_START_IEP_OFFSET") : 0);
+	sim.events = 0;
+	memset(sim.arm_irqs, 0, sizeof(sim.arm_irqs));
+	core_resume(pru1);
+	core_init(pru0, 0, p0, "run");
+	put32(pru0->regs + 14 * 4, 0);			/* R14 = &cxt */
+	pru0->regs[3 * 4 + 2] = RET_SENTINEL & 0xFF;	/* R3.w2 = return */
+	pru0->regs[3 * 4 + 3] = RET_SENTINEL >> 8;
+
+	run_start = sim.cycle;
+	limit = (sim.edge ? sim.edge_time[sim.nexpected - 1] :
+		(uint64_t)((double)sim.nexpected * (sim.clk_period + 8) * 2))
+		+ start_delay + 1000000;
+	while (!pru0->halted && sim.cycle - run_start < limit) {
+		/* beaglelogic_send_cmd: write cmd, then ring ARM_TO_PRU0_A */
+		if (sim.query_at >= 0 &&
+				sim.cycle - run_start == (uint64_t)sim.query_at) {
+			put32(sim.dram[0] + CXT_CMD,
+					program_const(p0, "CMD_GET_STATUS"));
+			raise_event(SYSEV_ARM_TO_PRU0_A);
+			sim.query_cycle = sim.cycle;
+			sim.query_pending = 1;
+		}
+		tick();
+
+		/* Stream mode: queue every buffer PRU0 hands back again, as
+		 * the driver's writer does once it has refilled it */
+		if (passes && sim.arm_irqs[SYSEV_PRU0_TO_ARM_C] != seen) {
+			seen = sim.arm_irqs[SYSEV_PRU0_TO_ARM_C];
+			for (i = 0; i < cnt; i++) {
+				if (get32(sim.dram[0] + list + entry * i) ||
+						queued[i] >= passes)
+					continue;
+				put32(sim.dram[0] + list + entry * i,
+						starts[i]);
+				queued[i]++;
+			}
+		}
+		/* Loop mode: post the swap like IOCTL_BL_SWAP_SEGMENT, the new
+		 * addresses first, and see which iteration took it */
+		if (swap_addr && !swap_posted && get32(sim.dram[0] +
+				program_const(p0, "CXT_LOOP_ITER_OFFSET")) >=
+				(unsigned long)swap_at) {
+			put32(sim.dram[0] +
+				program_const(p0, "CXT_SWAP_ADDR_OFFSET"),
+				swap_addr);
+			put32(sim.dram[0] +
+				program_const(p0, "CXT_SWAP_ADDR_OFFSET") + 4,
+				swap_addr + ends[0] - starts[0]);
+			put32(sim.dram[0] + program_const(p0,
+					"CXT_SWAP_OFFSET"), list);
+			swap_posted = 1;
+		}
+		if (swap_posted && !sim.swap_from && !get32(sim.dram[0] +
+				program_const(p0, "CXT_SWAP_OFFSET")))
+			sim.swap_from = get32(sim.dram[0] + program_const(p0,
+					"CXT_SWAP_ITER_OFFSET")) *
+				sim.pass_samples;
+		if (sim.query_pending && sim.arm_irqs[SYSEV_PRU0_TO_ARM_B] &&
+				get32(sim.dram[0] + CXT_CMD) == 0) {
+			sim.reply_cycle = sim.cycle;
+			sim.query_pending = 0;
+		}
+	}
+
+	/* main() resets PRU1 right after run() returns */
+	for (i = 0; i < 4; i++)
+		tick();
+	pru1->halted = 1;
+
+	if (sim.vcd) {
+		fprintf(sim.vcd, "#%llu\n", (unsigned long long)sim.cycle * 5);
+		fclose(sim.vcd);
+	}
+
+	printf("buffers=%u\n", cnt);
+	if (index)
+		printf("index_blocks=%u\n", sim.index_blocks);
+	printf("bytes=%zu\n", sim.pass_samples / 2);
+	if (nperiods)
+		printf("clock_hz=internal\n");
+	else
+		printf("clock_hz=%.0f\n", rate);
+	printf("pru0_returned=%d\n", pru0->pc == -1);
+	printf("arm_irq_done=%u\n", sim.arm_irqs[SYSEV_PRU0_TO_ARM_A]);
+	printf("buffers_released=%u\n", sim.arm_irqs[SYSEV_PRU0_TO_ARM_C]);
+	if (passes)
+		printf("stream_passes=%u\n", passes);
+	if (loops)
+		printf("loop_iterations=%u\n", get32(sim.dram[0] +
+				program_const(p0, "CXT_LOOP_ITER_OFFSET")));
+	if (gen.blocks)
+		printf("gen_blocks=%u\n", get32(sim.dram[0] +
+				program_const(p0, "CXT_GEN_BLOCK_OFFSET")));
+	if (swap_addr)
+		printf("swap_iteration=%lld\n", sim.swap_from ?
+				(long long)(sim.swap_from / sim.pass_samples) :
+				-1LL);
+	printf("run_cycles=%llu\n", (unsigned long long)(sim.cycle - run_start));
+	printf("samples_expected=%zu\n", sim.nexpected);
+	printf("samples_emitted=%zu\n", sim.nsamples);
+	printf("samples_missing=%zu\n", sim.nsamples < sim.nexpected ?
+			sim.nexpected - sim.nsamples : 0);
+	printf("mismatches=%zu\n", sim.mismatches);
+	printf("first_mismatch=%lld\n", sim.mismatches ?
+			sim.first_mismatch : -1LL);
+	printf("ddr_lat_max_cycles=%u\n",
+			get32(sim.dram[0] + program_const(p0, "CXT_DDR_LAT_OFFSET")));
+	if (!gen.blocks)
+		printf("progress_index=%u\n", (get32(sim.dram[0] +
+				program_const(p0, "CXT_PROGRESS_OFFSET")) -
+				list) / entry);
+	printf("blocks=%u\n", sim.blocks);
+	printf("underruns=%u\n", sim.underruns);
+	printf("slack_min_cycles=%lld\n", sim.slack_min);
+	printf("missed_clock_edges=%lld\n", missed_edges());
+	if (sim.period)
+		printf("period_errors=%zu\n", sim.period_errors);
+	if (sim.cap_mask) {
+		cap_blocks = get32(sim.dram[0] +
+				program_const(p0, "CXT_CAP_ADDR_OFFSET") + 4);
+		cap_errs = capture_errors(cap_blocks);
+		printf("capture_blocks=%u\n", cap_blocks);
+		printf("capture_bytes_checked=%zu\n", (size_t)cap_blocks * 64 >
+				sim.cap_size ? sim.cap_size :
+				(size_t)cap_blocks * 64);
+		printf("capture_errors=%zu\n", cap_errs);
+	}
+	if (sim.sum) {
+		uint32_t sum = program_const(p0, "CXT_SUM_A_OFFSET");
+
+		sum_errs = sum_errors(p0, cnt, starts, ends, loops ? loops :
+				passes ? passes : 1, !index && !swap_addr) +
+			(get32(sim.dram[0] + sum) != sim.sum_a ||
+			 get32(sim.dram[0] + sum + 4) != sim.sum_b);
+		printf("sum_a=0x%08x\n", get32(sim.dram[0] + sum));
+		printf("sum_b=0x%08x\n", get32(sim.dram[0] + sum + 4));
+		printf("sum_errors=%u\n", sum_errs);
+	}
+	if (sim.edge) {
+		printf("edge_start_cycles=%llu\n", sim.nsamples ?
+				(unsigned long long)(sim.edge_origin -
+					run_start) : 0ULL);
+		printf("edges_early=%zu\n", sim.edges_early);
+		printf("edges_late=%zu\n", sim.edges_late);
+		printf("edges_late_reported=%u\n", get32(sim.dram[0] +
+				program_const(p0, "CXT_EDGE_LATE_OFFSET")));
+		printf("edge_late_max_cycles=%llu\n",
+				(unsigned long long)sim.edge_late_max);
+	}
+	printf("cycles_per_sample_min=%llu\n", (unsigned long long)sim.cps_min);
+	printf("cycles_per_sample_max=%llu\n", (unsigned long long)sim.cps_max);
+	printf("cycles_per_sample_mean=%.3f\n", sim.nsamples > 1 ?
+			(double)(sim.last_sample_cycle -
+				 sim.first_sample_cycle) /
+			(double)(sim.nsamples - 1) : 0.0);
+	if (!sim.edge) {
+		uint32_t clk = program_const(p0, "CXT_CLK_OFFSET");
+
+		printf("clock_blocks=%u\n", get32(sim.dram[0] + clk + 12));
+		printf("clock_block_cycles_min=%u\n", get32(sim.dram[0] + clk));
+		printf("clock_block_cycles_max=%u\n",
+				get32(sim.dram[0] + clk + 4));
+		printf("clock_late=%u\n", get32(sim.dram[0] + clk + 16));
+	}
+
+	if (start_delay) {
+		start_iep = get32(sim.dram[0] +
+				program_const(p0, "CXT_START_IEP_OFFSET"));
+		start_done = get32(sim.dram[0] +
+				program_const(p0, "CXT_START_IEP_OFFSET") + 4);
+		printf("start_delay_cycles=%u\n", start_delay);
+		printf("start_reported=%d\n", start_done != 0);
+		printf("start_reported_cycles=%u\n", start_iep - start_ref);
+		printf("start_first_sample_cycles=%lld\n", sim.nsamples ?
+				(long long)(sim.first_sample_cycle -
+					start_cycle) : -1LL);
+	}
+
+	if (sim.query_at >= 0) {
+		printf("cmd_replied=%d\n", !sim.query_pending &&
+				sim.reply_cycle != 0);
+		printf("cmd_resp=%d\n", (int)get32(sim.dram[0] + CXT_RESP));
+		printf("cmd_latency_cycles=%llu\n", sim.reply_cycle ?
+				(unsigned long long)(sim.reply_cycle -
+					sim.query_cycle) : 0ULL);
+	}
+
+	failed = pru0->pc != -1 || sim.mismatches || sim.underruns ||
+		sim.edges_early || sim.edges_late || get32(sim.dram[0] +
+			program_const(p0, "CXT_EDGE_LATE_OFFSET")) ||
+		missed_edges() || sim.period_errors || cap_errs || sum_errs ||
+		(sim.cap_mask && (size_t)cap_blocks * 128 != sim.cap_n) ||
+		sim.nsamples < sim.nexpected ||
+		(sim.query_at >= 0 && sim.query_pending) ||
+		(swap_addr && !sim.swap_from) ||
+		(start_delay && (!start_done || !sim.nsamples ||
+			sim.first_sample_cycle < start_cycle ||
+			start_iep - start_ref < start_delay));
+	printf("result=%s\n", failed ? "FAIL" : "PASS");
+	return failed;
+}
+
+/* End harness section */